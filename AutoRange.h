@@ -0,0 +1,178 @@
+#pragma once
+
+#include "DepthEngine.h"
+#include "P2Quantile.h"
+
+#include <cstdint>
+
+#define AUTO_RANGE_DIVIDER          8       // one CV sample every 8 frames, ~3kHz
+#define AUTO_RANGE_WINDOW           8192    // samples per estimator window, ~2.6s
+#define AUTO_RANGE_LOW              0.02f   // quantiles taken as the ends of the CV range
+#define AUTO_RANGE_HIGH             0.98f
+#define AUTO_RANGE_DRIFT            512     // low or high move that updates the coefficients, 16 bit LSB
+#define AUTO_RANGE_CENTER_DRIFT     8       // median move that updates them, 1/8 of the range: the median
+                                            // of a periodic CV moves with the periods cut by the windows
+#define AUTO_RANGE_MIN_SPAN         4096    // narrowest CV range scaled to full scale
+
+const float auto_range_probabilities[3] = {AUTO_RANGE_LOW, 0.5f, AUTO_RANGE_HIGH};
+
+// Scaling and centering derived from the estimates, cached: they only change
+// when an estimate drifts past AUTO_RANGE_DRIFT / AUTO_RANGE_CENTER_DRIFT
+struct AutoRangeCoefficients {
+    uint16_t low;
+    uint16_t high;
+    uint16_t median;
+    uint16_t offset;        // CV scaled to 0: low, or below for a narrow range
+    uint32_t gain;          // full scale / (high - offset), 16.16
+    uint16_t center_slider; // slider value centering the plateau on the median
+};
+
+// Automatic range of the CV input: the low, median and high quantiles of the
+// filtered CV, tracked by P² estimators, scale [low, high] to full scale and
+// centre the plateau on the median, the slider then offsetting it from there.
+//
+// P² estimates everything since its start: two estimators run on windows of
+// AUTO_RANGE_WINDOW samples, half a window apart, each restarting at the end
+// of its window. The older one is used, so the estimates follow a re-patched
+// source within one window. O(1) per frame, bounded by two estimator updates
+// on one frame out of AUTO_RANGE_DIVIDER.
+class AutoRange {
+public:
+    AutoRange() :
+        _windows{P2Quantiles<3>(auto_range_probabilities), P2Quantiles<3>(auto_range_probabilities)},
+        _frames(0),
+        _samples(0),
+        _updates(0),
+        _ready(false),
+        _coefficients()
+    {
+    }
+
+    void reset()
+    {
+        _windows[0].reset();
+        _windows[1].reset();
+        _frames = 0;
+        _samples = 0;
+        _ready = false;
+    }
+
+    // Once per frame, returns true when the coefficients changed
+    bool add(uint32_t cv)
+    {
+        if (++_frames < AUTO_RANGE_DIVIDER) {
+            return false;
+        }
+        _frames = 0;
+
+        for (uint32_t w = 0; w < 2; w++) {
+            if (w == 1 && _samples < AUTO_RANGE_WINDOW / 2) {
+                break;
+            }
+            if (_windows[w].count() == AUTO_RANGE_WINDOW) {
+                _windows[w].reset();
+            }
+            _windows[w].add((float)cv);
+        }
+        _samples++;
+
+        const P2Quantiles<3> &window = _windows[_windows[1].count() > _windows[0].count() ? 1 : 0];
+        if (!window.ready()) {
+            return false;
+        }
+        uint16_t low = round_u16(window.quantile(0));
+        uint16_t median = round_u16(window.quantile(1));
+        uint16_t high = round_u16(window.quantile(2));
+        if (_ready && drift(low, _coefficients.low) <= AUTO_RANGE_DRIFT && drift(high, _coefficients.high) <= AUTO_RANGE_DRIFT
+            && drift(median, _coefficients.median) <= ((uint32_t)UI16_MAX << 16) / _coefficients.gain / AUTO_RANGE_CENTER_DRIFT) {
+            return false;
+        }
+        update(low, median, high);
+        return true;
+    }
+
+    // Coefficients derived at least once
+    bool ready() const
+    {
+        return _ready;
+    }
+
+    // CV from [low, high] to full scale
+    uint32_t scale(uint32_t cv) const
+    {
+        if (cv <= _coefficients.offset) {
+            return 0;
+        }
+        uint64_t scaled = ((uint64_t)(cv - _coefficients.offset) * _coefficients.gain) >> 16;
+        return scaled > UI16_MAX ? UI16_MAX : (uint32_t)scaled;
+    }
+
+    // Slider mid travel centres the plateau on the median
+    uint32_t slider(uint32_t slider) const
+    {
+        int32_t value = (int32_t)_coefficients.center_slider + (int32_t)slider - UI16_MAX / 2;
+        return value < 0 ? 0 : (value > UI16_MAX ? UI16_MAX : (uint32_t)value);
+    }
+
+    const AutoRangeCoefficients &coefficients() const
+    {
+        return _coefficients;
+    }
+
+    // Coefficient changes since the start
+    uint32_t updates() const
+    {
+        return _updates;
+    }
+
+private:
+    static uint16_t round_u16(float value)
+    {
+        return value <= 0.0f ? 0 : (value >= UI16_MAX ? UI16_MAX : (uint16_t)(value + 0.5f));
+    }
+
+    static uint32_t drift(uint16_t a, uint16_t b)
+    {
+        return a > b ? a - b : b - a;
+    }
+
+    void update(uint16_t low, uint16_t median, uint16_t high)
+    {
+        _coefficients.low = low;
+        _coefficients.median = median;
+        _coefficients.high = high;
+
+        // A narrow range (a constant CV) is widened around its middle
+        int32_t span_low = low, span_high = high;
+        if (span_high - span_low < AUTO_RANGE_MIN_SPAN) {
+            int32_t middle = (span_low + span_high) / 2;
+            span_low = middle - AUTO_RANGE_MIN_SPAN / 2;
+            span_high = middle + AUTO_RANGE_MIN_SPAN / 2;
+            if (span_low < 0) {
+                span_high -= span_low;
+                span_low = 0;
+            }
+            if (span_high > UI16_MAX) {
+                span_low -= span_high - UI16_MAX;
+                span_high = UI16_MAX;
+            }
+        }
+        _coefficients.offset = (uint16_t)span_low;
+        _coefficients.gain = (uint32_t)(((uint64_t)UI16_MAX << 16) / (uint32_t)(span_high - span_low));
+
+        // Inverse of depth_center_from_slider() at the scaled median
+        uint32_t center = scale(median);
+        uint32_t slider = center > CENTER_WIDTH_UI16 ? (center - CENTER_WIDTH_UI16) * UI16_MAX / SLIDER_LENGTH_MINUS_CENTER : 0;
+        _coefficients.center_slider = (uint16_t)(slider > UI16_MAX ? UI16_MAX : slider);
+
+        _ready = true;
+        _updates++;
+    }
+
+    P2Quantiles<3>        _windows[2];
+    uint32_t              _frames;
+    uint32_t              _samples;
+    uint32_t              _updates;
+    bool                  _ready;
+    AutoRangeCoefficients _coefficients;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+#define DEBOUNCE_SAMPLE_US          1000 // debouncer tick
+#define DEBOUNCE_SAMPLES            8    // stable samples to change state, 8 ms
+
+enum ButtonEventType : uint8_t {
+    BUTTON_PRESSED,
+    BUTTON_RELEASED
+};
+
+struct ButtonEvent {
+    uint8_t         button;
+    ButtonEventType type;
+};
+
+// Shift register debouncer, sampled at a fixed rate from a timer: the state
+// only changes once the last DEBOUNCE_SAMPLES samples agree, so a bouncing
+// contact gives exactly one event per real press or release. Active low, for
+// a button to ground with a pull-up.
+class Debouncer {
+    static_assert(DEBOUNCE_SAMPLES >= 2 && DEBOUNCE_SAMPLES <= 32, "DEBOUNCE_SAMPLES must fit the history");
+
+public:
+    Debouncer() :
+        _history(MASK),
+        _pressed(false)
+    {
+    }
+
+    // Feeds one sample of the pin, returns true when the debounced state
+    // changed, pressed() telling which way
+    bool sample(int level)
+    {
+        _history = ((_history << 1) | (level ? 1 : 0)) & MASK;
+        if (_pressed && _history == MASK) {
+            _pressed = false;
+            return true;
+        }
+        if (!_pressed && _history == 0) {
+            _pressed = true;
+            return true;
+        }
+        return false;
+    }
+
+    bool pressed() const
+    {
+        return _pressed;
+    }
+
+private:
+    static const uint32_t MASK = (uint32_t)((1ull << DEBOUNCE_SAMPLES) - 1);
+
+    uint32_t _history;
+    bool     _pressed;
+};
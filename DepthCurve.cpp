@@ -0,0 +1,430 @@
+#include "DepthCurve.h"
+#include "DepthEngine.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+enum CurveOpCode : uint8_t {
+    OP_PUSH,
+    OP_LOAD,
+    OP_STORE,
+    OP_NEG,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_POW,
+    OP_CALL
+};
+
+enum CurveFunction : uint8_t {
+    FUNCTION_ABS,
+    FUNCTION_SQRT,
+    FUNCTION_EXP,
+    FUNCTION_LOG,
+    FUNCTION_SIN,
+    FUNCTION_COS,
+    FUNCTION_MIN,
+    FUNCTION_MAX,
+    FUNCTION_POW,
+    FUNCTION_CLAMP,
+    FUNCTION_COUNT
+};
+
+struct CurveFunctionInfo {
+    const char *name;
+    uint8_t     arguments;
+};
+
+const CurveFunctionInfo functions[FUNCTION_COUNT] = {
+    {"abs", 1},
+    {"sqrt", 1},
+    {"exp", 1},
+    {"log", 1},
+    {"sin", 1},
+    {"cos", 1},
+    {"min", 2},
+    {"max", 2},
+    {"pow", 2},
+    {"clamp", 3}
+};
+
+const float pi = 3.14159265f;
+
+// Recursive descent, one method per precedence level, emitting the code of
+// each operand before its operator. The stack depth is tracked as the code is
+// emitted: evaluate() needs no bound checks.
+class CurveParser {
+public:
+    CurveParser(const char *source, DepthCurveProgram &program) :
+        _source(source),
+        _at(source),
+        _program(program),
+        _error(nullptr),
+        _error_at(source),
+        _depth(0),
+        _names()
+    {
+        _program.count = 0;
+        _program.names = 1;
+        strcpy(_names[0], "cv");
+    }
+
+    bool parse(DepthCurveError &error)
+    {
+        bool ok = program();
+        error.position = (uint16_t)(_error_at - _source);
+        error.message = _error;
+        return ok;
+    }
+
+private:
+    bool fail(const char *message, const char *at)
+    {
+        if (!_error) {
+            _error = message;
+            _error_at = at;
+        }
+        return false;
+    }
+
+    bool emit(uint8_t code, uint8_t index = 0, float value = 0.0f)
+    {
+        if (_program.count == DEPTH_CURVE_MAX_OPS) {
+            return fail("expression too long", _at);
+        }
+        switch (code) {
+            case OP_PUSH:
+            case OP_LOAD:
+                _depth++;
+                break;
+            case OP_STORE:
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_POW:
+                _depth--;
+                break;
+            case OP_CALL:
+                _depth -= functions[index].arguments - 1;
+                break;
+            default:
+                break;
+        }
+        if (_depth > DEPTH_CURVE_STACK) {
+            return fail("expression nested too deep", _at);
+        }
+        _program.ops[_program.count++] = DepthCurveOp{code, index, value};
+        return true;
+    }
+
+    void skip_spaces()
+    {
+        while (*_at == ' ' || *_at == '\t' || *_at == '\r' || *_at == '\n') {
+            _at++;
+        }
+    }
+
+    bool accept(char c)
+    {
+        skip_spaces();
+        if (*_at != c) {
+            return false;
+        }
+        _at++;
+        return true;
+    }
+
+    static bool name_start(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    static bool name_char(char c)
+    {
+        return name_start(c) || (c >= '0' && c <= '9');
+    }
+
+    // Copies the name at _at, without moving
+    bool peek_name(char *name, const char *&end)
+    {
+        skip_spaces();
+        if (!name_start(*_at)) {
+            return false;
+        }
+        end = _at;
+        while (name_char(*end)) {
+            end++;
+        }
+        if (end - _at > DEPTH_CURVE_MAX_NAME) {
+            return fail("name too long", _at);
+        }
+        memcpy(name, _at, end - _at);
+        name[end - _at] = '\0';
+        return true;
+    }
+
+    int find_name(const char *name) const
+    {
+        for (int slot = 0; slot < _program.names; slot++) {
+            if (strcmp(_names[slot], name) == 0) {
+                return slot;
+            }
+        }
+        return -1;
+    }
+
+    // { name '=' expression ';' } expression [';']
+    bool program()
+    {
+        while (true) {
+            char name[DEPTH_CURVE_MAX_NAME + 1];
+            const char *end = nullptr;
+            if (!peek_name(name, end)) {
+                if (_error) {
+                    return false;
+                }
+                break;
+            }
+            const char *after = end;
+            while (*after == ' ' || *after == '\t') {
+                after++;
+            }
+            if (*after != '=') {
+                break;
+            }
+            if (find_name(name) >= 0 || strcmp(name, "pi") == 0) {
+                return fail("name already defined", _at);
+            }
+            if (_program.names == DEPTH_CURVE_MAX_NAMES) {
+                return fail("too many definitions", _at);
+            }
+            _at = after + 1;
+            if (!expression()) {
+                return false;
+            }
+            if (!accept(';')) {
+                return fail("';' expected after the definition", _at);
+            }
+            // Defined after its expression: it cannot use itself
+            uint8_t slot = _program.names++;
+            strcpy(_names[slot], name);
+            if (!emit(OP_STORE, slot)) {
+                return false;
+            }
+        }
+        if (!expression()) {
+            return false;
+        }
+        accept(';');
+        skip_spaces();
+        if (*_at) {
+            return fail("unexpected character", _at);
+        }
+        return true;
+    }
+
+    bool expression()
+    {
+        if (!term()) {
+            return false;
+        }
+        while (true) {
+            if (accept('+')) {
+                if (!term() || !emit(OP_ADD)) {
+                    return false;
+                }
+            } else if (accept('-')) {
+                if (!term() || !emit(OP_SUB)) {
+                    return false;
+                }
+            } else {
+                return true;
+            }
+        }
+    }
+
+    bool term()
+    {
+        if (!unary()) {
+            return false;
+        }
+        while (true) {
+            if (accept('*')) {
+                if (!unary() || !emit(OP_MUL)) {
+                    return false;
+                }
+            } else if (accept('/')) {
+                if (!unary() || !emit(OP_DIV)) {
+                    return false;
+                }
+            } else {
+                return true;
+            }
+        }
+    }
+
+    // -x^2 is -(x^2), 2^-x is 2^(-x)
+    bool unary()
+    {
+        if (accept('-')) {
+            return unary() && emit(OP_NEG);
+        }
+        return power();
+    }
+
+    bool power()
+    {
+        if (!primary()) {
+            return false;
+        }
+        if (accept('^')) {
+            return unary() && emit(OP_POW);
+        }
+        return true;
+    }
+
+    bool primary()
+    {
+        skip_spaces();
+        if ((*_at >= '0' && *_at <= '9') || *_at == '.') {
+            char *end = nullptr;
+            float value = strtof(_at, &end);
+            if (end == _at) {
+                return fail("bad number", _at);
+            }
+            _at = end;
+            return emit(OP_PUSH, 0, value);
+        }
+        if (accept('(')) {
+            if (!expression()) {
+                return false;
+            }
+            return accept(')') ? true : fail("')' expected", _at);
+        }
+
+        char name[DEPTH_CURVE_MAX_NAME + 1];
+        const char *end = nullptr;
+        const char *start = _at;
+        if (!peek_name(name, end)) {
+            return fail(*_at ? "unexpected character" : "unexpected end", _at);
+        }
+        _at = end;
+        if (accept('(')) {
+            for (uint8_t function = 0; function < FUNCTION_COUNT; function++) {
+                if (strcmp(functions[function].name, name) == 0) {
+                    return call(function);
+                }
+            }
+            return fail("unknown function", start);
+        }
+        if (strcmp(name, "pi") == 0) {
+            return emit(OP_PUSH, 0, pi);
+        }
+        int slot = find_name(name);
+        if (slot < 0) {
+            return fail("unknown name", start);
+        }
+        return emit(OP_LOAD, (uint8_t)slot);
+    }
+
+    // After the '('
+    bool call(uint8_t function)
+    {
+        for (uint8_t argument = 0; argument < functions[function].arguments; argument++) {
+            if (argument && !accept(',')) {
+                return fail("',' expected, wrong argument count", _at);
+            }
+            if (!expression()) {
+                return false;
+            }
+        }
+        if (!accept(')')) {
+            return fail("')' expected, wrong argument count", _at);
+        }
+        return emit(OP_CALL, function);
+    }
+
+    const char        *_source;
+    const char        *_at;
+    DepthCurveProgram &_program;
+    const char        *_error;
+    const char        *_error_at;
+    int                _depth;
+    char               _names[DEPTH_CURVE_MAX_NAMES][DEPTH_CURVE_MAX_NAME + 1];
+};
+
+float call_function(uint8_t function, const float *arguments)
+{
+    switch (function) {
+        case FUNCTION_ABS:   return fabsf(arguments[0]);
+        case FUNCTION_SQRT:  return sqrtf(arguments[0]);
+        case FUNCTION_EXP:   return expf(arguments[0]);
+        case FUNCTION_LOG:   return logf(arguments[0]);
+        case FUNCTION_SIN:   return sinf(arguments[0]);
+        case FUNCTION_COS:   return cosf(arguments[0]);
+        case FUNCTION_MIN:   return arguments[0] < arguments[1] ? arguments[0] : arguments[1];
+        case FUNCTION_MAX:   return arguments[0] > arguments[1] ? arguments[0] : arguments[1];
+        case FUNCTION_POW:   return powf(arguments[0], arguments[1]);
+        case FUNCTION_CLAMP: return arguments[0] < arguments[1] ? arguments[1] : (arguments[0] > arguments[2] ? arguments[2] : arguments[0]);
+        default:             return 0.0f;
+    }
+}
+
+} // namespace
+
+float DepthCurveProgram::evaluate(float cv) const
+{
+    float stack[DEPTH_CURVE_STACK];
+    float values[DEPTH_CURVE_MAX_NAMES];
+    uint32_t top = 0;
+    values[0] = cv;
+    for (uint16_t i = 0; i < count; i++) {
+        const DepthCurveOp &op = ops[i];
+        switch (op.code) {
+            case OP_PUSH:  stack[top++] = op.value; break;
+            case OP_LOAD:  stack[top++] = values[op.index]; break;
+            case OP_STORE: values[op.index] = stack[--top]; break;
+            case OP_NEG:   stack[top - 1] = -stack[top - 1]; break;
+            case OP_ADD:   top--; stack[top - 1] += stack[top]; break;
+            case OP_SUB:   top--; stack[top - 1] -= stack[top]; break;
+            case OP_MUL:   top--; stack[top - 1] *= stack[top]; break;
+            case OP_DIV:   top--; stack[top - 1] /= stack[top]; break;
+            case OP_POW:   top--; stack[top - 1] = powf(stack[top - 1], stack[top]); break;
+            case OP_CALL:
+                top -= functions[op.index].arguments;
+                stack[top] = call_function(op.index, stack + top);
+                top++;
+                break;
+            default:
+                break;
+        }
+    }
+    return stack[0];
+}
+
+bool depth_curve_compile(const char *source, DepthCurveProgram &program, DepthCurveError &error)
+{
+    CurveParser parser(source, program);
+    return parser.parse(error);
+}
+
+bool depth_curve_table(const DepthCurveProgram &program, uint16_t *table, DepthCurveError &error)
+{
+    for (uint32_t point = 0; point < DEPTH_CURVE_POINTS; point++) {
+        uint32_t cv = point << (16 - DEPTH_CURVE_BITS);
+        float volume = program.evaluate((float)(cv < UI16_MAX ? cv : UI16_MAX) / UI16_MAX);
+        if (volume != volume) {
+            error.position = 0;
+            error.message = "not a number within the CV range";
+            return false;
+        }
+        volume = volume < 0.0f ? 0.0f : (volume > 1.0f ? 1.0f : volume);
+        table[point] = (uint16_t)(volume * UI16_MAX + 0.5f);
+    }
+    return true;
+}
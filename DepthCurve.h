@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+// User depth laws: an expression of the CV, compiled once into a table of the
+// volume that the control loop interpolates, nothing is interpreted per frame.
+//
+//   c = 0.5; w = 0.2; g = 2; clamp(1 - abs(cv - c)/w, 0, 1)^g
+//
+// cv is the CV from 0 to 1, the result the volume from 0 to 1 (clamped).
+// Definitions 'name = expression;' come before the final expression, they may
+// use cv and the names defined before them. Numbers, + - * / ^ (right
+// associative, above unary minus), parentheses, pi, and abs sqrt exp log sin
+// cos (one argument), min max pow (two), clamp (value, low, high).
+//
+// Fixed sizes, no allocation: the firmware compiles uploads on its own thread.
+
+#define DEPTH_CURVE_BITS            10 // 1024 segments, CV bits 15..6 pick the segment
+#define DEPTH_CURVE_POINTS          ((1 << DEPTH_CURVE_BITS) + 1)
+#define DEPTH_CURVE_MAX_OPS         128
+#define DEPTH_CURVE_MAX_NAMES       8 // cv and the definitions
+#define DEPTH_CURVE_MAX_NAME        8
+#define DEPTH_CURVE_STACK           16
+
+struct DepthCurveError {
+    uint16_t    position; // offset in the source
+    const char *message;
+};
+
+struct DepthCurveOp {
+    uint8_t code;
+    uint8_t index; // name slot or function
+    float   value;
+};
+
+// Stack machine code of an expression
+struct DepthCurveProgram {
+    DepthCurveOp ops[DEPTH_CURVE_MAX_OPS];
+    uint16_t     count;
+    uint8_t      names;
+
+    float evaluate(float cv) const;
+};
+
+// Returns false and fills error on a syntax error or when the code does not
+// fit the fixed sizes
+bool depth_curve_compile(const char *source, DepthCurveProgram &program, DepthCurveError &error);
+
+// Evaluates the program at the DEPTH_CURVE_POINTS points of the CV range.
+// Returns false and fills error (position 0) when a point is not a number.
+bool depth_curve_table(const DepthCurveProgram &program, uint16_t *table, DepthCurveError &error);
+
+// Volume of a 16 bit CV, linear between the table points
+constexpr uint16_t depth_curve_lookup(const uint16_t *table, uint32_t cv)
+{
+    uint32_t index = cv >> (16 - DEPTH_CURVE_BITS);
+    int32_t fraction = (int32_t)(cv & ((1u << (16 - DEPTH_CURVE_BITS)) - 1));
+    int32_t delta = (int32_t)table[index + 1] - (int32_t)table[index];
+    return (uint16_t)(table[index] + delta * fraction / (1 << (16 - DEPTH_CURVE_BITS)));
+}
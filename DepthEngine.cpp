@@ -0,0 +1,274 @@
+#include "DepthEngine.h"
+#include "InputFilter.h"
+#include <cmath>
+
+// Property checks of depth_compute(), evaluated by the compiler: a broken
+// invariant fails the build, and the static_assert message shows the failing
+// seed/frame (the comparison is printed with its reduced operands). A smoke
+// test of the engine alone: host/tests/property_test runs long random
+// sequences through the buttons, the filters and auto-range, and shrinks
+// its failures.
+
+namespace {
+
+constexpr uint32_t xorshift32(uint32_t x)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+constexpr uint32_t max_u32(uint32_t a, uint32_t b)
+{
+    return a > b ? a : b;
+}
+
+// One randomly automated input: linear sweeps towards random targets, with
+// optional noise bursts on top
+struct InputModel {
+    uint32_t level;
+    uint32_t target;
+    uint32_t steps_left;
+    uint32_t noise;
+
+    constexpr uint32_t next(uint32_t &rng, bool bursts)
+    {
+        if (steps_left == 0) {
+            rng = xorshift32(rng);
+            target = rng & UI16_MAX;
+            rng = xorshift32(rng);
+            steps_left = 1 + (rng & 0xFF);
+            rng = xorshift32(rng);
+            noise = (bursts && (rng & 3) == 0) ? (rng >> 20) : 0;
+        }
+        int32_t step = ((int32_t)target - (int32_t)level) / (int32_t)steps_left;
+        level = (uint32_t)((int32_t)level + step);
+        steps_left--;
+
+        int32_t value = (int32_t)level;
+        if (noise) {
+            rng = xorshift32(rng);
+            value += (int32_t)(rng % (2 * noise + 1)) - (int32_t)noise;
+        }
+        if (value < 0) {
+            value = 0;
+        }
+        if (value > UI16_MAX) {
+            value = UI16_MAX;
+        }
+        return (uint32_t)value;
+    }
+};
+
+constexpr bool output_in_bounds(const DepthInputs &in, const DepthOutputs &out)
+{
+    if (out.right_slide_point - out.left_slide_point != CENTER_WIDTH_UI16 * 2) {
+        return false;
+    }
+    switch (out.region) {
+        case DEPTH_LEFT:
+            return in.cv < out.left_slide_point && out.volume >= in.left;
+        case DEPTH_RIGHT:
+            return in.cv > out.right_slide_point && out.volume >= in.right;
+        default:
+            return out.volume == UI16_MAX;
+    }
+}
+
+// Coarse grid over every input, returns the index of the first failing point or -1
+constexpr int32_t grid_first_failure()
+{
+    int32_t index = 0;
+    for (uint8_t lin_log = 0; lin_log <= (DEPTH_LOG_LEFT | DEPTH_LOG_RIGHT); lin_log += DEPTH_LOG_LEFT | DEPTH_LOG_RIGHT) {
+        for (uint32_t slider = 0; slider <= UI16_MAX; slider += 8191) {
+            for (uint32_t left = 0; left <= UI16_MAX; left += 8191) {
+                for (uint32_t right = 0; right <= UI16_MAX; right += 8191) {
+                    for (uint32_t cv = 0; cv <= UI16_MAX; cv += 1023, index++) {
+                        DepthInputs in{cv, slider, left, right, lin_log};
+                        if (!output_in_bounds(in, depth_compute(in))) {
+                            return index;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+// At the ends of the slider travel the plateau reaches the end of the CV range
+constexpr bool plateau_covers_range_at_limits()
+{
+    DepthOutputs low = depth_compute(DepthInputs{0, 0, 0, 0});
+    DepthOutputs high = depth_compute(DepthInputs{UI16_MAX, UI16_MAX, 0, 0});
+    return low.left_slide_point == 0 && low.region == DEPTH_PLATEAU
+           && high.right_slide_point == UI16_MAX && high.region == DEPTH_PLATEAU;
+}
+
+// Random frame sequence (pot sweeps, CV sweeps with noise bursts, Lin/Log
+// switches) through the input filters
+struct FrameSource {
+    uint32_t    rng;
+    InputModel  cv;
+    InputModel  slider;
+    InputModel  left;
+    InputModel  right;
+    InputFilter ewma_cv;
+    InputFilter ewma_slider;
+    InputFilter ewma_left;
+    InputFilter ewma_right;
+    uint8_t     lin_log;
+
+    constexpr FrameSource(uint32_t seed) :
+        rng(seed),
+        cv{UI16_MAX / 2, 0, 0, 0},
+        slider{UI16_MAX / 2, 0, 0, 0},
+        left{0, 0, 0, 0},
+        right{0, 0, 0, 0},
+        ewma_cv(FILTER_CV_WEIGHT, FILTER_WEIGHT_SCALE),
+        ewma_slider(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE),
+        ewma_left(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE),
+        ewma_right(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE),
+        lin_log(0)
+    {
+    }
+
+    constexpr DepthInputs next()
+    {
+        DepthInputs in{};
+        in.cv = (uint32_t)ewma_cv.filter((int)cv.next(rng, true));
+        in.slider = (uint32_t)ewma_slider.filter((int)slider.next(rng, false));
+        in.left = (uint32_t)ewma_left.filter((int)left.next(rng, false));
+        in.right = (uint32_t)ewma_right.filter((int)right.next(rng, false));
+        rng = xorshift32(rng);
+        if ((rng & 0x1FF) == 0) {
+            lin_log ^= rng & 0x200 ? DEPTH_LOG_LEFT : DEPTH_LOG_RIGHT;
+        }
+        in.lin_log = lin_log;
+        return in;
+    }
+};
+
+// Returns the first failing frame of a random sequence or -1
+constexpr int32_t sequence_first_failure(uint32_t seed, uint32_t frames)
+{
+    FrameSource source(seed);
+    DepthInputs previous_in{};
+    DepthOutputs previous_out{};
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        DepthInputs in = source.next();
+        DepthOutputs out = depth_compute(in);
+        if (!output_in_bounds(in, out)) {
+            return (int32_t)frame;
+        }
+        if (frame && !depth_slew_bounded(previous_in, previous_out, in, out)) {
+            return (int32_t)frame;
+        }
+        previous_in = in;
+        previous_out = out;
+    }
+    return -1;
+}
+
+// Deviation of a variant from the float reference, on the input grid and on
+// random sequences
+struct DeviationSum {
+    uint32_t max;
+    uint64_t sum;
+    uint64_t sum_sq;
+    uint32_t count;
+
+    constexpr void add(DepthOutputs (*variant)(const DepthInputs &), const DepthInputs &in)
+    {
+        uint32_t deviation = depth_distance(depth_compute(in).volume, variant(in).volume);
+        max = max_u32(max, deviation);
+        sum += deviation;
+        sum_sq += (uint64_t)deviation * deviation;
+        count++;
+    }
+};
+
+constexpr DeviationSum variant_deviation(DepthOutputs (*variant)(const DepthInputs &))
+{
+    DeviationSum total{0, 0, 0, 0};
+    for (uint8_t lin_log = 0; lin_log <= (DEPTH_LOG_LEFT | DEPTH_LOG_RIGHT); lin_log += DEPTH_LOG_LEFT | DEPTH_LOG_RIGHT) {
+        for (uint32_t slider = 0; slider <= UI16_MAX; slider += 8191) {
+            for (uint32_t left = 0; left <= UI16_MAX; left += 16383) {
+                for (uint32_t right = 0; right <= UI16_MAX; right += 16383) {
+                    for (uint32_t cv = 0; cv <= UI16_MAX; cv += 1023) {
+                        total.add(variant, DepthInputs{cv, slider, left, right, lin_log});
+                    }
+                }
+            }
+        }
+    }
+    FrameSource source(0x6C8E9CF5);
+    for (uint32_t frame = 0; frame < 2500; frame++) {
+        total.add(variant, source.next());
+    }
+    return total;
+}
+
+constexpr DeviationSum fixed_deviation_sum = variant_deviation(depth_compute_fixed);
+constexpr DeviationSum lut_deviation_sum = variant_deviation(depth_compute_lut);
+
+// depth_divide_lut() against the division, for every small divisor and a
+// spread of the others, at the ends of the numerator range, around the
+// multiples of the divisor and a random one. Returns the first wrong divisor,
+// -1 when there is none. Every divisor is checked by engine_test.
+constexpr int32_t divide_lut_first_failure()
+{
+    uint32_t rng = 0x3C6EF372;
+    for (uint32_t divisor = 1; divisor <= UI16_MAX; divisor += divisor < 1024 ? 1 : 61) {
+        rng = xorshift32(rng);
+        const uint32_t numerators[] = {
+            0, divisor - 1, divisor, (uint32_t)UI16_MAX * UI16_MAX, UI16_MAX * divisor - 1, UI16_MAX * divisor,
+            rng % (UI16_MAX * divisor)
+        };
+        for (uint32_t numerator : numerators) {
+            if (depth_divide_lut(numerator, divisor) != numerator / divisor) {
+                return (int32_t)divisor;
+            }
+        }
+    }
+    return -1;
+}
+
+static_assert(grid_first_failure() == -1, "depth_compute() output out of bounds");
+static_assert(plateau_covers_range_at_limits(), "plateau does not cover the CV range at the slider limits");
+static_assert(sequence_first_failure(0x2545F491, 2500) == -1, "depth_compute() slew not bounded");
+static_assert(sequence_first_failure(0x9E3779B9, 2500) == -1, "depth_compute() slew not bounded");
+static_assert(sequence_first_failure(0x0BADCAFE, 2500) == -1, "depth_compute() slew not bounded");
+static_assert(sequence_first_failure(0x12345678, 2500) == -1, "depth_compute() slew not bounded");
+
+static_assert(fixed_deviation_sum.max <= FIXED_MAX_DEVIATION, "depth_compute_fixed() max deviation");
+static_assert(fixed_deviation_sum.sum <= (uint64_t)FIXED_MEAN_DEVIATION * fixed_deviation_sum.count / 1000, "depth_compute_fixed() mean deviation");
+static_assert(fixed_deviation_sum.sum_sq <= (uint64_t)FIXED_RMS_DEVIATION * FIXED_RMS_DEVIATION * fixed_deviation_sum.count / 1000000, "depth_compute_fixed() RMS deviation");
+
+static_assert(divide_lut_first_failure() == -1, "depth_divide_lut() not exact");
+static_assert(lut_deviation_sum.max <= LUT_MAX_DEVIATION, "depth_compute_lut() max deviation");
+static_assert(lut_deviation_sum.sum <= (uint64_t)LUT_MEAN_DEVIATION * lut_deviation_sum.count / 1000, "depth_compute_lut() mean deviation");
+static_assert(lut_deviation_sum.sum_sq <= (uint64_t)LUT_RMS_DEVIATION * LUT_RMS_DEVIATION * lut_deviation_sum.count / 1000000, "depth_compute_lut() RMS deviation");
+
+DepthDeviation deviation_of(const DeviationSum &sum)
+{
+    DepthDeviation deviation;
+    deviation.max = sum.max;
+    deviation.mean = (float)sum.sum / sum.count;
+    deviation.rms = sqrtf((float)sum.sum_sq / sum.count);
+    deviation.points = sum.count;
+    return deviation;
+}
+
+} // namespace
+
+DepthDeviation depth_fixed_deviation()
+{
+    return deviation_of(fixed_deviation_sum);
+}
+
+DepthDeviation depth_lut_deviation()
+{
+    return deviation_of(lut_deviation_sum);
+}
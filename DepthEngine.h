@@ -0,0 +1,273 @@
+#pragma once
+
+#include <cstdint>
+
+#define UI16_MAX                    65535
+
+// Pente de profondeur selon l'entrée CV
+// Largeur du plateau, en %
+#define CENTER_WIDTH                0.2
+#define CENTER_WIDTH_UI16           (uint16_t)(CENTER_WIDTH * UI16_MAX) / 2
+#define SLIDER_LENGTH_MINUS_CENTER  (uint16_t)(UI16_MAX - (CENTER_WIDTH_UI16 * 2))
+#define LEFT_SILDER_ADJ             50 // Pour ajuster le point où le plateau recouvre tout à gauche (dépend des valeurs absolues)
+#define RIGHT_SILDER_ADJ            50
+
+// Tolerances of the faster variants against the float reference, in output LSB
+// (mean and RMS in thousandths of LSB), checked at compile time in DepthEngine.cpp
+#define FIXED_MAX_DEVIATION         1
+#define FIXED_MEAN_DEVIATION        500
+#define FIXED_RMS_DEVIATION         1000
+#define LUT_MAX_DEVIATION           1
+#define LUT_MEAN_DEVIATION          500
+#define LUT_RMS_DEVIATION           1000
+
+// Zone de la courbe où se trouve le CV (valeur de superdebug)
+enum DepthRegion : uint8_t {
+    DEPTH_PLATEAU = 0,
+    DEPTH_LEFT    = 1,
+    DEPTH_RIGHT   = 2
+};
+
+// Ramp laws selected by the Lin/Log buttons, bits of DepthInputs::lin_log.
+// Log squares the position along the ramp: the volume stays near the pot
+// level longer and rises steeply towards the plateau.
+enum DepthLinLog : uint8_t {
+    DEPTH_LOG_LEFT  = 1,
+    DEPTH_LOG_RIGHT = 2
+};
+
+// Filtered readings, full 16 bit scale
+struct DepthInputs {
+    uint32_t cv;
+    uint32_t slider;
+    uint32_t left;
+    uint32_t right;
+    uint8_t  lin_log = 0; // DepthLinLog bits, 0: both ramps Lin
+};
+
+struct DepthOutputs {
+    uint16_t volume;
+    uint16_t volume_left;
+    uint16_t volume_right;
+    uint16_t center_from_slider;
+    uint16_t left_slide_point;
+    uint16_t right_slide_point;
+    float    left_cv_calc;
+    float    right_cv_calc;
+    uint8_t  region;
+};
+
+// Breakpoints of the curve use the float scaling in every variant: the right
+// ramp can be a few LSB long, a one LSB shift of its start moves the output a lot
+constexpr uint16_t depth_center_from_slider(uint32_t slider)
+{
+    return CENTER_WIDTH_UI16 + (uint16_t)((float)slider * ((float)SLIDER_LENGTH_MINUS_CENTER / (float)UI16_MAX));
+}
+
+// Transfer function of the depth module: the plateau (full volume) is centred
+// by the slider, the CV left of it slopes down to the left pot, right of it to
+// the right pot. constexpr so that the invariants in DepthEngine.cpp are
+// checked by the compiler on every build.
+constexpr DepthOutputs depth_compute(const DepthInputs &in)
+{
+    DepthOutputs out{};
+
+    out.center_from_slider = depth_center_from_slider(in.slider);
+    out.left_slide_point = out.center_from_slider - CENTER_WIDTH_UI16;
+    out.right_slide_point = out.center_from_slider + CENTER_WIDTH_UI16;
+
+    if (in.cv < out.left_slide_point) {
+        out.region = DEPTH_LEFT;
+        out.left_cv_calc = ((float)(UI16_MAX - in.left)) / ((float)(out.left_slide_point));
+        uint16_t lift = (uint16_t)(out.left_cv_calc * (float)in.cv);
+        if (in.lin_log & DEPTH_LOG_LEFT) {
+            float position = (float)in.cv / (float)out.left_slide_point;
+            lift = (uint16_t)(out.left_cv_calc * (float)in.cv * position);
+        }
+        out.volume_left = lift + in.left;
+        out.volume = out.volume_left;
+    } else if (in.cv > out.right_slide_point) {
+        out.region = DEPTH_RIGHT;
+        out.right_cv_calc = -((float)(0 - (in.right - UI16_MAX)) / (float)(UI16_MAX - (out.right_slide_point)));
+        // The product is negative: go through int32_t like the FPU conversion
+        // does, the wrap-around then adds it to UI16_MAX
+        out.volume_right = ((uint16_t)(int32_t)(out.right_cv_calc * (float)(in.cv - out.right_slide_point))) + UI16_MAX;
+        if (in.lin_log & DEPTH_LOG_RIGHT) {
+            float position = (float)(UI16_MAX - in.cv) / (float)(UI16_MAX - out.right_slide_point);
+            out.volume_right = (uint16_t)((float)(UI16_MAX - in.right) * position * position) + in.right;
+        }
+        out.volume = out.volume_right;
+    } else {
+        out.region = DEPTH_PLATEAU;
+        out.volume = UI16_MAX;
+    }
+    return out;
+}
+
+// Steepest slopes of the two ramps, in output LSB per input LSB (rounded up):
+// a Log ramp is twice as steep as the Lin one at the plateau
+constexpr uint32_t depth_left_slope(const DepthInputs &in, const DepthOutputs &out)
+{
+    uint32_t slope = out.left_slide_point ? (UI16_MAX - in.left + out.left_slide_point - 1) / out.left_slide_point : 0;
+    return in.lin_log & DEPTH_LOG_LEFT ? 2 * slope : slope;
+}
+
+constexpr uint32_t depth_right_slope(const DepthInputs &in, const DepthOutputs &out)
+{
+    uint32_t run = UI16_MAX - out.right_slide_point;
+    uint32_t slope = run ? (UI16_MAX - in.right + run - 1) / run : 0;
+    return in.lin_log & DEPTH_LOG_RIGHT ? 2 * slope : slope;
+}
+
+constexpr uint32_t depth_distance(uint32_t a, uint32_t b)
+{
+    return a > b ? a - b : b - a;
+}
+
+// Output change between two frames is bounded by the ramp slopes times the
+// moves of the CV and of the ramp end points, plus the pot moves. A Lin/Log
+// switch is a step, not bounded. Checked at compile time in DepthEngine.cpp
+// and on long sequences by host/tests/property_test.
+constexpr bool depth_slew_bounded(const DepthInputs &a, const DepthOutputs &oa, const DepthInputs &b, const DepthOutputs &ob)
+{
+    if (a.lin_log != b.lin_log) {
+        return true;
+    }
+    uint32_t kl = depth_left_slope(a, oa) > depth_left_slope(b, ob) ? depth_left_slope(a, oa) : depth_left_slope(b, ob);
+    uint32_t kr = depth_right_slope(a, oa) > depth_right_slope(b, ob) ? depth_right_slope(a, oa) : depth_right_slope(b, ob);
+    uint32_t dcv = depth_distance(a.cv, b.cv);
+    uint64_t bound = (uint64_t)kl * (dcv + depth_distance(oa.left_slide_point, ob.left_slide_point))
+                     + (uint64_t)kr * (dcv + depth_distance(oa.right_slide_point, ob.right_slide_point))
+                     + depth_distance(a.left, b.left) + depth_distance(a.right, b.right) + 2;
+    return depth_distance(oa.volume, ob.volume) <= bound;
+}
+
+// Integer version of depth_compute(): the ramps use one integer division,
+// three for a Log ramp, instead of a float division and conversions. Checked against depth_compute() in DepthEngine.cpp.
+// left_cv_calc / right_cv_calc are not computed.
+constexpr DepthOutputs depth_compute_fixed(const DepthInputs &in)
+{
+    DepthOutputs out{};
+
+    out.center_from_slider = depth_center_from_slider(in.slider);
+    out.left_slide_point = out.center_from_slider - CENTER_WIDTH_UI16;
+    out.right_slide_point = out.center_from_slider + CENTER_WIDTH_UI16;
+
+    if (in.cv < out.left_slide_point) {
+        out.region = DEPTH_LEFT;
+        uint32_t product = (UI16_MAX - in.left) * in.cv;
+        uint32_t lift = product / out.left_slide_point;
+        if (in.lin_log & DEPTH_LOG_LEFT) {
+            // Scaled by the position again, with the remainder of the first
+            // division carried: the floor of the exact square law
+            uint32_t remainder = product - lift * out.left_slide_point;
+            lift = (lift * in.cv + remainder * in.cv / out.left_slide_point) / out.left_slide_point;
+        }
+        out.volume_left = lift + in.left;
+        out.volume = out.volume_left;
+    } else if (in.cv > out.right_slide_point) {
+        out.region = DEPTH_RIGHT;
+        uint32_t run = UI16_MAX - out.right_slide_point;
+        if (in.lin_log & DEPTH_LOG_RIGHT) {
+            uint32_t rest = UI16_MAX - in.cv;
+            uint32_t product = (UI16_MAX - in.right) * rest;
+            uint32_t lift = product / run;
+            uint32_t remainder = product - lift * run;
+            out.volume_right = (lift * rest + remainder * rest / run) / run + in.right;
+        } else {
+            out.volume_right = UI16_MAX - (UI16_MAX - in.right) * (in.cv - out.right_slide_point) / run;
+        }
+        out.volume = out.volume_right;
+    } else {
+        out.region = DEPTH_PLATEAU;
+        out.volume = UI16_MAX;
+    }
+    return out;
+}
+
+// Reciprocal seeds of depth_divide_lut(): 2^32 over the middle of each of the
+// 128 intervals of the top 8 bits of a divisor normalized to [2^15, 2^16)
+#define DEPTH_RECIPROCAL_BITS       7
+
+struct DepthReciprocalTable {
+    uint32_t seed[1 << DEPTH_RECIPROCAL_BITS];
+};
+
+constexpr DepthReciprocalTable depth_reciprocal_table()
+{
+    DepthReciprocalTable table{};
+    for (uint32_t i = 0; i < (1u << DEPTH_RECIPROCAL_BITS); i++) {
+        table.seed[i] = (1u << 25) / (257 + 2 * i);
+    }
+    return table;
+}
+
+constexpr DepthReciprocalTable depth_reciprocals = depth_reciprocal_table();
+
+// numerator / divisor without a divide instruction, for cores without one:
+// the seed of the table refined by one Newton step is within 2^-18 of the
+// reciprocal, the quotient then at most 2 short, and corrected. Exact, checked
+// for every divisor in DepthEngine.cpp. divisor in [1, UI16_MAX].
+constexpr uint32_t depth_divide_lut(uint32_t numerator, uint32_t divisor)
+{
+    uint32_t shift = __builtin_clz(divisor) - 16;
+    uint64_t normalized = divisor << shift;
+    uint64_t seed = depth_reciprocals.seed[(normalized >> 8) - (1 << DEPTH_RECIPROCAL_BITS)];
+    uint64_t reciprocal = seed * ((1ull << 33) - normalized * seed) >> 32;
+    uint32_t quotient = (uint32_t)(numerator * reciprocal >> (32 - shift));
+    while ((uint64_t)(quotient + 1) * divisor <= numerator) {
+        quotient++;
+    }
+    return quotient;
+}
+
+// depth_compute_fixed() with the divisions of depth_divide_lut()
+constexpr DepthOutputs depth_compute_lut(const DepthInputs &in)
+{
+    DepthOutputs out{};
+
+    out.center_from_slider = depth_center_from_slider(in.slider);
+    out.left_slide_point = out.center_from_slider - CENTER_WIDTH_UI16;
+    out.right_slide_point = out.center_from_slider + CENTER_WIDTH_UI16;
+
+    if (in.cv < out.left_slide_point) {
+        out.region = DEPTH_LEFT;
+        uint32_t product = (UI16_MAX - in.left) * in.cv;
+        uint32_t lift = depth_divide_lut(product, out.left_slide_point);
+        if (in.lin_log & DEPTH_LOG_LEFT) {
+            uint32_t remainder = product - lift * out.left_slide_point;
+            lift = depth_divide_lut(lift * in.cv + depth_divide_lut(remainder * in.cv, out.left_slide_point), out.left_slide_point);
+        }
+        out.volume_left = lift + in.left;
+        out.volume = out.volume_left;
+    } else if (in.cv > out.right_slide_point) {
+        out.region = DEPTH_RIGHT;
+        uint32_t run = UI16_MAX - out.right_slide_point;
+        if (in.lin_log & DEPTH_LOG_RIGHT) {
+            uint32_t rest = UI16_MAX - in.cv;
+            uint32_t product = (UI16_MAX - in.right) * rest;
+            uint32_t lift = depth_divide_lut(product, run);
+            uint32_t remainder = product - lift * run;
+            out.volume_right = depth_divide_lut(lift * rest + depth_divide_lut(remainder * rest, run), run) + in.right;
+        } else {
+            out.volume_right = UI16_MAX - depth_divide_lut((UI16_MAX - in.right) * (in.cv - out.right_slide_point), run);
+        }
+        out.volume = out.volume_right;
+    } else {
+        out.region = DEPTH_PLATEAU;
+        out.volume = UI16_MAX;
+    }
+    return out;
+}
+
+// Deviation of a variant from depth_compute(), in output LSB, measured at
+// compile time on the grid and random sequences of DepthEngine.cpp
+struct DepthDeviation {
+    uint32_t max;
+    float    mean;
+    float    rms;
+    uint32_t points;
+};
+
+DepthDeviation depth_fixed_deviation();
+DepthDeviation depth_lut_deviation();
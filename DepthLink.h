@@ -0,0 +1,274 @@
+#pragma once
+
+#include "DepthEngine.h"
+
+#include <cstdint>
+
+// Stereo link of two depth modules over a UART: the leader sends the inputs
+// of its engine, the follower runs its engine on them instead of its own, so
+// both follow the leader's pots, slider and CV region.
+//
+// Fixed size frames, DEPTH_LINK_FRAME bytes: sync (0x5A), sequence number,
+// leader time in us (32 bit), CV, slider, left and right pots (16 bit each,
+// little endian), CRC-16/CCITT of everything after the sync. A leader frame
+// every DEPTH_LINK_DIVIDER control loop frames, ~6kHz, half the link
+// bandwidth at DEPTH_LINK_BAUD.
+//
+// The follower applies the last frame at its own frame boundaries, the CV
+// extrapolated over the age of the frame: the offset of the two clocks is the
+// smallest (arrival - leader time) of the last frames, less the wire time, so
+// the age is measured rather than assumed. No hardware access here: the
+// firmware (LinkSerial.h) and host/depth_link share it.
+
+#define DEPTH_LINK_SYNC             0x5A
+#define DEPTH_LINK_FRAME            16
+#define DEPTH_LINK_BAUD             2000000
+#define DEPTH_LINK_WIRE_US          (DEPTH_LINK_FRAME * 10 * 1000000 / DEPTH_LINK_BAUD) // 8N1
+#define DEPTH_LINK_DIVIDER          4 // one frame every 4 control loop frames
+#define DEPTH_LINK_OFFSET_WINDOW    1024 // frames of a clock offset minimum, ~170ms: follows a 100ppm drift within 17us
+#define DEPTH_LINK_MAX_AGE_US       1000 // longest CV extrapolation
+#define DEPTH_LINK_TIMEOUT_US       20000 // without frames, the follower runs on its own inputs
+
+// CRC-16/CCITT, polynomial 0x1021, a nibble at a time
+const uint16_t depth_link_crc_nibbles[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+inline uint16_t depth_link_crc(const uint8_t *bytes, uint32_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (uint32_t i = 0; i < length; i++) {
+        crc = (uint16_t)(crc << 4) ^ depth_link_crc_nibbles[(crc >> 12) ^ (bytes[i] >> 4)];
+        crc = (uint16_t)(crc << 4) ^ depth_link_crc_nibbles[(crc >> 12) ^ (bytes[i] & 0x0F)];
+    }
+    return crc;
+}
+
+struct DepthLinkFrame {
+    uint8_t     sequence;
+    uint32_t    time_us;
+    DepthInputs inputs;
+};
+
+inline void depth_link_encode(const DepthLinkFrame &frame, uint8_t *out)
+{
+    const uint32_t fields[4] = {frame.inputs.cv, frame.inputs.slider, frame.inputs.left, frame.inputs.right};
+    out[0] = DEPTH_LINK_SYNC;
+    out[1] = frame.sequence;
+    for (uint32_t i = 0; i < 4; i++) {
+        out[2 + i] = (uint8_t)(frame.time_us >> (8 * i));
+        out[6 + 2 * i] = (uint8_t)fields[i];
+        out[7 + 2 * i] = (uint8_t)(fields[i] >> 8);
+    }
+    uint16_t crc = depth_link_crc(out + 1, DEPTH_LINK_FRAME - 3);
+    out[DEPTH_LINK_FRAME - 2] = (uint8_t)crc;
+    out[DEPTH_LINK_FRAME - 1] = (uint8_t)(crc >> 8);
+}
+
+// Byte at a time decoder. A frame with a bad CRC is dropped and the decoder
+// resyncs on the next sync byte within it.
+class DepthLinkDecoder {
+public:
+    DepthLinkDecoder() :
+        _count(0),
+        _frames(0),
+        _errors(0),
+        _lost(0),
+        _sequence(0),
+        _bytes()
+    {
+    }
+
+    // Returns true when the byte completes a frame, frame then holds it
+    bool feed(uint8_t byte, DepthLinkFrame &frame)
+    {
+        if (_count == 0 && byte != DEPTH_LINK_SYNC) {
+            return false;
+        }
+        _bytes[_count++] = byte;
+        if (_count < DEPTH_LINK_FRAME) {
+            return false;
+        }
+
+        uint16_t crc = (uint16_t)(_bytes[DEPTH_LINK_FRAME - 2] | _bytes[DEPTH_LINK_FRAME - 1] << 8);
+        if (depth_link_crc(_bytes + 1, DEPTH_LINK_FRAME - 3) != crc) {
+            _errors++;
+            resync();
+            return false;
+        }
+        _count = 0;
+
+        frame.sequence = _bytes[1];
+        frame.time_us = 0;
+        uint32_t fields[4];
+        for (uint32_t i = 0; i < 4; i++) {
+            frame.time_us |= (uint32_t)_bytes[2 + i] << (8 * i);
+            fields[i] = (uint32_t)(_bytes[6 + 2 * i] | _bytes[7 + 2 * i] << 8);
+        }
+        frame.inputs = DepthInputs{fields[0], fields[1], fields[2], fields[3]};
+
+        if (_frames) {
+            _lost += (uint8_t)(frame.sequence - _sequence - 1);
+        }
+        _sequence = frame.sequence;
+        _frames++;
+        return true;
+    }
+
+    void reset()
+    {
+        _count = 0;
+        _frames = 0;
+        _errors = 0;
+        _lost = 0;
+    }
+
+    uint32_t frames() const
+    {
+        return _frames;
+    }
+
+    // Frames dropped on a bad CRC
+    uint32_t errors() const
+    {
+        return _errors;
+    }
+
+    // Gaps in the sequence numbers: frames dropped, not sent or overwritten
+    uint32_t lost() const
+    {
+        return _lost;
+    }
+
+private:
+    // Restarts at the next sync byte after the one of the bad frame
+    void resync()
+    {
+        uint32_t start = 1;
+        while (start < _count && _bytes[start] != DEPTH_LINK_SYNC) {
+            start++;
+        }
+        for (uint32_t i = start; i < _count; i++) {
+            _bytes[i - start] = _bytes[i];
+        }
+        _count -= start;
+    }
+
+    uint32_t _count;
+    uint32_t _frames;
+    uint32_t _errors;
+    uint32_t _lost;
+    uint8_t  _sequence;
+    uint8_t  _bytes[DEPTH_LINK_FRAME];
+};
+
+class DepthLinkLeader {
+public:
+    DepthLinkLeader() :
+        _frames(0),
+        _sequence(0)
+    {
+    }
+
+    // Once per control loop frame. Returns true with a frame to send in out,
+    // DEPTH_LINK_FRAME bytes, every DEPTH_LINK_DIVIDER frames.
+    bool frame(const DepthInputs &in, uint32_t now_us, uint8_t *out)
+    {
+        if (++_frames < DEPTH_LINK_DIVIDER) {
+            return false;
+        }
+        _frames = 0;
+        depth_link_encode(DepthLinkFrame{_sequence++, now_us, in}, out);
+        return true;
+    }
+
+private:
+    uint32_t _frames;
+    uint8_t  _sequence;
+};
+
+class DepthLinkFollower {
+public:
+    DepthLinkFollower() :
+        _last(),
+        _received_us(0),
+        _slope(0),
+        _offset_min{0, 0},
+        _offset_frames(0),
+        _have(false)
+    {
+    }
+
+    void reset()
+    {
+        _have = false;
+        _offset_frames = 0;
+    }
+
+    // A frame decoded at now_us, on the follower's clock. Returns false when
+    // it is ignored: repeated, out of order, or not within
+    // DEPTH_LINK_TIMEOUT_US of the last one, the CRC of misaligned bytes
+    // matching after a resync (one resync in 65536). A leader restart is
+    // followed after the timeout.
+    bool receive(const DepthLinkFrame &frame, uint32_t now_us)
+    {
+        if (_have && now_us - _received_us <= DEPTH_LINK_TIMEOUT_US
+            && ((int8_t)(frame.sequence - _last.sequence) <= 0 || frame.time_us - _last.time_us > DEPTH_LINK_TIMEOUT_US)) {
+            return false;
+        }
+
+        // Clock offset plus delay, smallest of the current and the previous window
+        int32_t offset = (int32_t)(now_us - frame.time_us);
+        if (_offset_frames == 0) {
+            _offset_min[0] = _offset_min[1] = offset;
+        } else if (_offset_frames % DEPTH_LINK_OFFSET_WINDOW == 0) {
+            _offset_min[1] = _offset_min[0];
+            _offset_min[0] = offset;
+        } else if (offset < _offset_min[0]) {
+            _offset_min[0] = offset;
+        }
+        _offset_frames++;
+
+        // CV slope in LSB per us, 16.16
+        int32_t elapsed = (int32_t)(frame.time_us - _last.time_us);
+        _slope = _have && elapsed > 0 ? ((int64_t)frame.inputs.cv - (int64_t)_last.inputs.cv) * 65536 / elapsed : 0;
+
+        _last = frame;
+        _received_us = now_us;
+        _have = true;
+        return true;
+    }
+
+    // Leader inputs at now_us. Returns false without a frame for
+    // DEPTH_LINK_TIMEOUT_US, the follower then runs on its own inputs. The
+    // Lin/Log modes stay the follower's, set by its own buttons.
+    bool inputs(uint32_t now_us, DepthInputs &in) const
+    {
+        if (!_have || now_us - _received_us > DEPTH_LINK_TIMEOUT_US) {
+            return false;
+        }
+        uint8_t lin_log = in.lin_log;
+        in = _last.inputs;
+        in.lin_log = lin_log;
+        int64_t cv = (int64_t)in.cv + ((int64_t)_slope * age_us(now_us) >> 16);
+        in.cv = cv < 0 ? 0 : (cv > UI16_MAX ? UI16_MAX : (uint32_t)cv);
+        return true;
+    }
+
+    // Time since the leader sent the last frame, on the leader's clock
+    int32_t age_us(uint32_t now_us) const
+    {
+        int32_t offset = (_offset_min[0] < _offset_min[1] ? _offset_min[0] : _offset_min[1]) - DEPTH_LINK_WIRE_US;
+        int32_t age = (int32_t)(now_us - _last.time_us) - offset;
+        return age < 0 ? 0 : (age > DEPTH_LINK_MAX_AGE_US ? DEPTH_LINK_MAX_AGE_US : age);
+    }
+
+private:
+    DepthLinkFrame _last;
+    uint32_t       _received_us;
+    int32_t        _slope;
+    int32_t        _offset_min[2];
+    uint32_t       _offset_frames;
+    bool           _have;
+};
@@ -0,0 +1,125 @@
+#include "DmaPWM.h"
+#include "platform/mbed_critical.h"
+
+#if !defined(TARGET_STM32L4)
+#error "DmaPWM.cpp only knows the STM32L4 timers and DMA"
+#endif
+
+#include "stm32l4xx_ll_bus.h"
+#include "stm32l4xx_ll_dma.h"
+#include "stm32l4xx_ll_tim.h"
+
+// TIM6_UP is request 6 of DMA1 channel 3 (RM0394, DMA1 requests)
+#define DMA_PWM_CHANNEL             LL_DMA_CHANNEL_3
+#define DMA_PWM_REQUEST             LL_DMA_REQUEST_6
+#define DMA_PWM_IRQ                 DMA1_Channel3_IRQn
+
+namespace {
+
+// Function local: DmaPWM globals are constructed during static init
+PwmPattern<DMA_PWM_STEPS> &dma_pattern()
+{
+    static PwmPattern<DMA_PWM_STEPS> pattern;
+    return pattern;
+}
+
+GPIO_TypeDef *pattern_port = nullptr;
+uint32_t pattern_period_us = DMA_PWM_DEFAULT_PERIOD_US;
+
+// Only enabled while halves of the pattern are to be rewritten
+void dma_irq()
+{
+    PwmPattern<DMA_PWM_STEPS> &pattern = dma_pattern();
+    bool pending = pattern.pending();
+    if (LL_DMA_IsActiveFlag_HT3(DMA1)) {
+        LL_DMA_ClearFlag_HT3(DMA1);
+        pending = pattern.half_done(0);
+    }
+    if (LL_DMA_IsActiveFlag_TC3(DMA1)) {
+        LL_DMA_ClearFlag_TC3(DMA1);
+        pending = pattern.half_done(1);
+    }
+    if (!pending) {
+        LL_DMA_DisableIT_HT(DMA1, DMA_PWM_CHANNEL);
+        LL_DMA_DisableIT_TC(DMA1, DMA_PWM_CHANNEL);
+    }
+}
+
+// One update event per step. TIM6 runs at the core clock, APB1 not divided.
+void set_timer_period()
+{
+    uint32_t ticks = (uint32_t)((uint64_t)SystemCoreClock * pattern_period_us / 1000000 / DMA_PWM_STEPS);
+    uint32_t prescaler = ticks / 65536;
+    LL_TIM_SetPrescaler(TIM6, prescaler);
+    LL_TIM_SetAutoReload(TIM6, ticks / (prescaler + 1) - 1);
+    LL_TIM_GenerateEvent_UPDATE(TIM6);
+}
+
+void start(GPIO_TypeDef *port)
+{
+    PwmPattern<DMA_PWM_STEPS> &pattern = dma_pattern();
+    pattern_port = port;
+    pattern.fill();
+
+    LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA1);
+    LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM6);
+
+    LL_DMA_ConfigTransfer(DMA1, DMA_PWM_CHANNEL, LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_MODE_CIRCULAR |
+                          LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_WORD |
+                          LL_DMA_MDATAALIGN_WORD | LL_DMA_PRIORITY_LOW);
+    LL_DMA_SetPeriphRequest(DMA1, DMA_PWM_CHANNEL, DMA_PWM_REQUEST);
+    LL_DMA_ConfigAddresses(DMA1, DMA_PWM_CHANNEL, (uint32_t)pattern.words(), (uint32_t)&port->BSRR,
+                           LL_DMA_DIRECTION_MEMORY_TO_PERIPH);
+    LL_DMA_SetDataLength(DMA1, DMA_PWM_CHANNEL, DMA_PWM_STEPS);
+    NVIC_SetVector(DMA_PWM_IRQ, (uint32_t)dma_irq);
+    NVIC_EnableIRQ(DMA_PWM_IRQ);
+    LL_DMA_EnableChannel(DMA1, DMA_PWM_CHANNEL);
+
+    set_timer_period();
+    LL_TIM_EnableDMAReq_UPDATE(TIM6);
+    LL_TIM_EnableCounter(TIM6);
+}
+
+} // namespace
+
+DmaPWM::DmaPWM(PinName pin, bool positive) :
+    _pin(pin, positive ? 0 : 1),
+    _bit(STM_PIN(pin))
+{
+    GPIO_TypeDef *port = (GPIO_TypeDef *)Set_GPIO_Clock(STM_PORT(pin));
+    MBED_ASSERT(!pattern_port || pattern_port == port);
+
+    core_util_critical_section_enter();
+    dma_pattern().add_pin(_bit, !positive);
+    core_util_critical_section_exit();
+    if (!pattern_port) {
+        start(port);
+    }
+}
+
+void DmaPWM::write(float duty)
+{
+    duty = duty < 0.0f ? 0.0f : (duty > 1.0f ? 1.0f : duty);
+    core_util_critical_section_enter();
+    if (dma_pattern().set_duty(_bit, (uint32_t)(duty * DMA_PWM_STEPS + 0.5f))) {
+        LL_DMA_EnableIT_HT(DMA1, DMA_PWM_CHANNEL);
+        LL_DMA_EnableIT_TC(DMA1, DMA_PWM_CHANNEL);
+    }
+    core_util_critical_section_exit();
+}
+
+float DmaPWM::read()
+{
+    return (float)dma_pattern().duty(_bit) / DMA_PWM_STEPS;
+}
+
+void DmaPWM::period_ms(int period)
+{
+    period_us(period * 1000);
+}
+
+void DmaPWM::period_us(int period)
+{
+    pattern_period_us = period;
+    set_timer_period();
+}
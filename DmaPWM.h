@@ -0,0 +1,39 @@
+#pragma once
+
+#include "mbed.h"
+#include "PwmPattern.h"
+
+// SoftPWM without interrupts: a timer triggers a DMA transfer per step that
+// writes the next BSRR word of a PwmPattern to the GPIO port, in circular
+// mode. A duty change enables the DMA half transfer / transfer complete
+// interrupts until the changed halves are rewritten, nothing interrupts the
+// CPU otherwise.
+//
+// All the DmaPWM pins share one pattern, period and port. DmaPWM.cpp is the
+// STM32L4 implementation (TIM6 -> DMA1 channel 3), host/HostDmaPWM.cpp the
+// host shim one, that emulates the DMA on the virtual clock.
+
+#define DMA_PWM_STEPS               256 // duty resolution
+#define DMA_PWM_DEFAULT_PERIOD_US   20000
+
+class DmaPWM {
+public:
+    DmaPWM(PinName pin, bool positive = true);
+
+    void write(float duty);
+    float read();
+
+    // Period of every DmaPWM pin
+    void period_ms(int period);
+    void period_us(int period);
+
+    DmaPWM &operator=(float duty)
+    {
+        write(duty);
+        return *this;
+    }
+
+private:
+    DigitalOut _pin;
+    uint8_t    _bit;
+};
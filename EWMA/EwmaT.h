@@ -0,0 +1,62 @@
+#pragma once
+
+// Integer Exponentially Weighted Moving Average filter.
+//
+// Reimplementation of the EwmaT template of https://github.com/jonnieZG/EWMA
+// (MIT), kept in the tree so that the firmware and the host tools build
+// without a checkout: same constructors, same filter()/output()/reset() and
+// the same recurrence, rounding included, so the filtered values match the
+// library bit for bit. Not a copy of its sources.
+//
+// The output is alpha/alphaScale of the input plus (alphaScale - alpha)/
+// alphaScale of the previous output, with the state kept alphaScale times
+// larger for the fraction. The first input seeds the state, unless an initial
+// output was given. constexpr, so the host models of DepthEngine.cpp can run
+// the same filter in their compile-time checks.
+
+template <typename T>
+class EwmaT {
+public:
+    constexpr EwmaT(T alpha, unsigned int alphaScale)
+        : alpha(alpha), alphaScale(alphaScale), initialOutput(0), hasInitialOutput(false),
+          outputScaled(0), hasInitial(false)
+    {
+    }
+
+    constexpr EwmaT(T alpha, unsigned int alphaScale, T initialOutput)
+        : alpha(alpha), alphaScale(alphaScale), initialOutput(initialOutput), hasInitialOutput(true),
+          outputScaled(initialOutput * (T)alphaScale), hasInitial(true)
+    {
+    }
+
+    // Back to the state of the constructor
+    constexpr void reset()
+    {
+        outputScaled = initialOutput * (T)alphaScale;
+        hasInitial = hasInitialOutput;
+    }
+
+    constexpr T output() const
+    {
+        return (outputScaled + (T)alphaScale / 2) / (T)alphaScale;
+    }
+
+    constexpr T filter(T input)
+    {
+        if (hasInitial) {
+            outputScaled = alpha * input + ((T)alphaScale - alpha) * outputScaled / (T)alphaScale;
+        } else {
+            outputScaled = input * (T)alphaScale;
+            hasInitial = true;
+        }
+        return output();
+    }
+
+private:
+    T            alpha;
+    unsigned int alphaScale;
+    T            initialOutput;
+    bool         hasInitialOutput;
+    T            outputScaled;
+    bool         hasInitial;
+};
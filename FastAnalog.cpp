@@ -0,0 +1,61 @@
+#include "FastAnalog.h"
+#include "pinmap.h"
+#include "PeripheralPins.h"
+
+#if !defined(TARGET_STM32L4)
+#error "FastAnalog.cpp only knows the STM32L4 ADC and DAC"
+#endif
+
+#include "stm32l4xx_ll_adc.h"
+#include "stm32l4xx_ll_dac.h"
+
+FastAnalogIn::FastAnalogIn(PinName pin) :
+    _analog(pin),
+    _adc((void *)pinmap_peripheral(pin, PinMap_ADC)),
+    _channel(__LL_ADC_DECIMAL_NB_TO_CHANNEL(STM_PIN_CHANNEL(pinmap_function(pin, PinMap_ADC))))
+{
+    // One conversion through the driver sets the sampling time and the
+    // single-ended mode of the channel
+    _analog.read_u16();
+}
+
+uint16_t FastAnalogIn::read_u16()
+{
+    ADC_TypeDef *adc = (ADC_TypeDef *)_adc;
+
+    // The driver disables the ADC after each of its conversions
+    if (!LL_ADC_IsEnabled(adc)) {
+        LL_ADC_ClearFlag_ADRDY(adc);
+        LL_ADC_Enable(adc);
+        while (!LL_ADC_IsActiveFlag_ADRDY(adc)) {
+        }
+    }
+
+    LL_ADC_REG_SetSequencerRanks(adc, LL_ADC_REG_RANK_1, _channel);
+    LL_ADC_ClearFlag_EOC(adc);
+    LL_ADC_REG_StartConversion(adc);
+    while (!LL_ADC_IsActiveFlag_EOC(adc)) {
+    }
+    uint16_t value = LL_ADC_REG_ReadConversionData12(adc);
+    return (value << 4) | ((value >> 8) & 0x000F);
+}
+
+FastAnalogOut::FastAnalogOut(PinName pin) :
+    _analog(pin),
+    _dac((void *)pinmap_peripheral(pin, PinMap_DAC)),
+    _channel(STM_PIN_CHANNEL(pinmap_function(pin, PinMap_DAC)) == 2 ? LL_DAC_CHANNEL_2 : LL_DAC_CHANNEL_1)
+{
+    // Enables the channel, without trigger: a write to the data register
+    // reaches the output on the next APB clock
+    _analog.write_u16(0);
+}
+
+void FastAnalogOut::write_u16(uint16_t value)
+{
+    LL_DAC_ConvertData12RightAligned((DAC_TypeDef *)_dac, _channel, value >> 4);
+}
+
+float FastAnalogOut::read()
+{
+    return (float)LL_DAC_RetrieveOutputData((DAC_TypeDef *)_dac, _channel) / 4095.0f;
+}
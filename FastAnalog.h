@@ -0,0 +1,38 @@
+#pragma once
+
+#include "mbed.h"
+
+// Lock-free ADC/DAC access for the control loop. AnalogIn::read_u16() and
+// AnalogOut::write_u16() take a mutex and reconfigure the converter through
+// the HAL on every call; these go to the registers directly once the mbed
+// driver has set the pin and the converter up.
+//
+// The control loop must be the only user of the converter: nothing else may
+// read an AnalogIn while it runs. FastAnalog.cpp is the STM32L4
+// implementation, host/HostFastAnalog.cpp the host shim one.
+
+class FastAnalogIn {
+public:
+    FastAnalogIn(PinName pin);
+
+    // Same scaling as AnalogIn::read_u16()
+    uint16_t read_u16();
+
+private:
+    AnalogIn _analog;
+    void    *_adc;
+    uint32_t _channel;
+};
+
+class FastAnalogOut {
+public:
+    FastAnalogOut(PinName pin);
+
+    void write_u16(uint16_t value);
+    float read();
+
+private:
+    AnalogOut _analog;
+    void     *_dac;
+    uint32_t  _channel;
+};
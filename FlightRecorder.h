@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+#define FLIGHT_RECORDER_FRAMES      64 // last control loop frames kept, a power of two
+
+// State of one control loop frame, three words
+struct FlightRecord {
+    uint32_t time_us;
+    uint32_t cv_volume;     // filtered CV, volume << 16
+    uint32_t slider_region; // filtered slider, region << 16
+};
+
+// Ring of the last Count frames, written by the control loop with three
+// stores and an increment, read after the loop stopped (PostMortem.h). No
+// constructor: zero as a global, kept across a reset in retained RAM.
+template <uint32_t Count>
+class FlightRecorder {
+    static_assert(Count && (Count & (Count - 1)) == 0, "Count must be a power of two");
+
+public:
+    void record(uint32_t time_us, uint16_t cv, uint16_t volume, uint16_t slider, uint8_t region)
+    {
+        FlightRecord &record = _records[_head++ & (Count - 1)];
+        record.time_us = time_us;
+        record.cv_volume = cv | (uint32_t)volume << 16;
+        record.slider_region = slider | (uint32_t)region << 16;
+    }
+
+    void reset()
+    {
+        _head = 0;
+    }
+
+    // Copies the records, oldest first, returns their count
+    uint32_t copy(FlightRecord *out) const
+    {
+        uint32_t head = _head;
+        uint32_t count = head < Count ? head : Count;
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = _records[(head - count + i) & (Count - 1)];
+        }
+        return count;
+    }
+
+    // Frames recorded since the start
+    uint32_t recorded() const
+    {
+        return _head;
+    }
+
+private:
+    uint32_t     _head;
+    FlightRecord _records[Count];
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+
+#define WATCHDOG_TIMEOUT_MS         100 // hardware watchdog
+#define WATCHDOG_SERVICE_MS         5   // checks of the frames and the heartbeats
+#define WATCHDOG_PRETIMEOUT_MS      80  // without a kick for this long, the pre-timeout handler runs
+#define WATCHDOG_RTOS_SLICE_MS      5   // RTX round-robin time slice (OS_ROBIN_TIMEOUT of mbed's RTX config)
+// Longest time between two frames. The control loop never sleeps and shares
+// osPriorityNormal with the LED and the console (or telemetry) threads: when
+// they wake, each can hold the CPU for up to a time slice before the loop
+// runs again. Two slices, and one of margin for the interrupts.
+#define WATCHDOG_FRAME_DEADLINE_US  (3 * WATCHDOG_RTOS_SLICE_MS * 1000)
+#define WATCHDOG_MAX_TASKS          4
+
+enum WatchdogCause : uint8_t {
+    WATCHDOG_OK,
+    WATCHDOG_FRAMES_STOPPED, // no frame for WATCHDOG_FRAME_DEADLINE_US
+    WATCHDOG_FRAME_DEADLINE, // a frame past WATCHDOG_FRAME_DEADLINE_US after the one before
+    WATCHDOG_TASK_LATE       // a task without heartbeat for its period
+};
+
+// Decides when the hardware watchdog is fed: the control loop marks its
+// frames, the low priority tasks their heartbeats, and a timer interrupt
+// calls service() every WATCHDOG_SERVICE_MS, which returns true to kick the
+// watchdog only when every frame since the last check met its deadline and
+// every task did beat within its period. A missed check only skips a kick:
+// the watchdog resets the module once the checks fail for WATCHDOG_TIMEOUT_MS,
+// after pretimeout() told the owner to dump its state.
+//
+// No hardware access here: main.cpp kicks mbed's Watchdog, which the host
+// shim simulates on the virtual clock.
+class FrameWatchdog {
+public:
+    FrameWatchdog() :
+        _misses(0),
+        _last_frame_us(0),
+        _checked_misses(0),
+        _last_kick_us(0),
+        _skipped(0),
+        _pretimeout_done(false),
+        _cause(WATCHDOG_OK),
+        _late_task(0),
+        _tasks(0),
+        _beats(),
+        _checked_beats(),
+        _beat_us(),
+        _period_us()
+    {
+    }
+
+    void start(uint32_t now_us)
+    {
+        _last_frame_us = now_us;
+        _last_kick_us = now_us;
+        for (uint8_t task = 0; task < _tasks; task++) {
+            _beat_us[task] = now_us;
+        }
+    }
+
+    // A task that must call heartbeat() at least every period_ms, returns its id
+    uint8_t add_task(uint32_t period_ms)
+    {
+        _period_us[_tasks] = period_ms * 1000;
+        return _tasks++;
+    }
+
+    void heartbeat(uint8_t task)
+    {
+        _beats[task]++;
+    }
+
+    // Once per control loop frame: a compare and a store
+    void frame(uint32_t now_us)
+    {
+        if (now_us - _last_frame_us > WATCHDOG_FRAME_DEADLINE_US) {
+            _misses++;
+        }
+        _last_frame_us = now_us;
+    }
+
+    // Every WATCHDOG_SERVICE_MS, from a timer interrupt. Returns true when
+    // the watchdog is to be kicked.
+    bool service(uint32_t now_us)
+    {
+        WatchdogCause cause = WATCHDOG_OK;
+        // A check can fall in a time slice of another thread: no frame since
+        // the last one is fine, as long as the last is within the deadline
+        if (now_us - _last_frame_us > WATCHDOG_FRAME_DEADLINE_US) {
+            cause = WATCHDOG_FRAMES_STOPPED;
+        } else if (_misses != _checked_misses) {
+            cause = WATCHDOG_FRAME_DEADLINE;
+        }
+        _checked_misses = _misses;
+
+        for (uint8_t task = 0; task < _tasks; task++) {
+            if (_beats[task] != _checked_beats[task]) {
+                _checked_beats[task] = _beats[task];
+                _beat_us[task] = now_us;
+            } else if (now_us - _beat_us[task] > _period_us[task] && cause == WATCHDOG_OK) {
+                cause = WATCHDOG_TASK_LATE;
+                _late_task = task;
+            }
+        }
+
+        _cause = cause;
+        if (cause != WATCHDOG_OK) {
+            _skipped++;
+            return false;
+        }
+        _last_kick_us = now_us;
+        _pretimeout_done = false;
+        return true;
+    }
+
+    // True once after WATCHDOG_PRETIMEOUT_MS without a kick
+    bool pretimeout(uint32_t now_us)
+    {
+        if (_pretimeout_done || now_us - _last_kick_us < WATCHDOG_PRETIMEOUT_MS * 1000) {
+            return false;
+        }
+        _pretimeout_done = true;
+        return true;
+    }
+
+    // Result of the last check
+    WatchdogCause cause() const
+    {
+        return _cause;
+    }
+
+    uint8_t late_task() const
+    {
+        return _late_task;
+    }
+
+    // Frames past their deadline since the start
+    uint32_t misses() const
+    {
+        return _misses;
+    }
+
+    // Checks that did not kick since the start: none in a healthy run
+    uint32_t skipped() const
+    {
+        return _skipped;
+    }
+
+    uint32_t last_frame_us() const
+    {
+        return _last_frame_us;
+    }
+
+    uint32_t last_kick_us() const
+    {
+        return _last_kick_us;
+    }
+
+private:
+    // Written by the control loop and the tasks, read by service()
+    volatile uint32_t _misses;
+    volatile uint32_t _last_frame_us;
+    uint32_t          _checked_misses;
+    uint32_t          _last_kick_us;
+    volatile uint32_t _skipped;
+    bool              _pretimeout_done;
+    WatchdogCause     _cause;
+    uint8_t           _late_task;
+    uint8_t           _tasks;
+    volatile uint32_t _beats[WATCHDOG_MAX_TASKS];
+    uint32_t          _checked_beats[WATCHDOG_MAX_TASKS];
+    uint32_t          _beat_us[WATCHDOG_MAX_TASKS];
+    uint32_t          _period_us[WATCHDOG_MAX_TASKS];
+};
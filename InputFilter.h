@@ -0,0 +1,13 @@
+#pragma once
+
+#include "EwmaT.h"
+
+// Smoothing of the analog readings. main.cpp filters every input with it,
+// and the host models of the control chain (DepthEngine.cpp, depth_fleet,
+// property_test) run the same filters, so their inputs match the firmware's.
+
+#define FILTER_CV_WEIGHT            1 // [0, 100] Higher the value - less smoothing (higher the latest reading impact)
+#define FILTER_POTS_WEIGHT          3
+#define FILTER_WEIGHT_SCALE         100
+
+typedef EwmaT<int>                  InputFilter;
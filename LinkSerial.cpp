@@ -0,0 +1,88 @@
+#include "LinkSerial.h"
+#include "hal/serial_api.h"
+#include "pinmap.h"
+#include "PeripheralPins.h"
+
+#if !defined(TARGET_STM32L4)
+#error "LinkSerial.cpp only knows the STM32L4 USART and DMA"
+#endif
+
+#include "stm32l4xx_ll_bus.h"
+#include "stm32l4xx_ll_dma.h"
+#include "stm32l4xx_ll_usart.h"
+
+#include <cstring>
+
+// USART1_TX and USART1_RX are request 2 of DMA1 channels 4 and 5 (RM0394,
+// DMA1 requests). DMA1 channel 3 is DmaPWM's.
+#define LINK_TX_CHANNEL             LL_DMA_CHANNEL_4
+#define LINK_RX_CHANNEL             LL_DMA_CHANNEL_5
+#define LINK_REQUEST                LL_DMA_REQUEST_2
+
+namespace {
+
+// The mbed driver sets the pins, the clock and the format up
+serial_t link_uart;
+
+} // namespace
+
+LinkSerial::LinkSerial(PinName tx, PinName rx, int baud) :
+    _tail(0),
+    _rx(),
+    _tx()
+{
+    USART_TypeDef *usart = (USART_TypeDef *)pinmap_peripheral(rx, PinMap_UART_RX);
+    MBED_ASSERT(usart == USART1);
+    serial_init(&link_uart, tx, rx);
+    serial_baud(&link_uart, baud);
+    serial_format(&link_uart, 8, ParityNone, 1);
+
+    LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA1);
+
+    LL_DMA_ConfigTransfer(DMA1, LINK_RX_CHANNEL, LL_DMA_DIRECTION_PERIPH_TO_MEMORY | LL_DMA_MODE_CIRCULAR |
+                          LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE |
+                          LL_DMA_MDATAALIGN_BYTE | LL_DMA_PRIORITY_HIGH);
+    LL_DMA_SetPeriphRequest(DMA1, LINK_RX_CHANNEL, LINK_REQUEST);
+    LL_DMA_ConfigAddresses(DMA1, LINK_RX_CHANNEL, (uint32_t)&usart->RDR, (uint32_t)_rx,
+                           LL_DMA_DIRECTION_PERIPH_TO_MEMORY);
+    LL_DMA_SetDataLength(DMA1, LINK_RX_CHANNEL, LINK_SERIAL_RING);
+    LL_DMA_EnableChannel(DMA1, LINK_RX_CHANNEL);
+    LL_USART_EnableDMAReq_RX(usart);
+
+    LL_DMA_ConfigTransfer(DMA1, LINK_TX_CHANNEL, LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_MODE_NORMAL |
+                          LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE |
+                          LL_DMA_MDATAALIGN_BYTE | LL_DMA_PRIORITY_MEDIUM);
+    LL_DMA_SetPeriphRequest(DMA1, LINK_TX_CHANNEL, LINK_REQUEST);
+    LL_DMA_ConfigAddresses(DMA1, LINK_TX_CHANNEL, (uint32_t)_tx, (uint32_t)&usart->TDR,
+                           LL_DMA_DIRECTION_MEMORY_TO_PERIPH);
+    LL_USART_EnableDMAReq_TX(usart);
+}
+
+bool LinkSerial::send(const uint8_t *bytes, uint32_t length)
+{
+    // Left enabled by the last transfer, done when its count is down to 0
+    if (LL_DMA_IsEnabledChannel(DMA1, LINK_TX_CHANNEL)) {
+        if (LL_DMA_GetDataLength(DMA1, LINK_TX_CHANNEL)) {
+            return false;
+        }
+        LL_DMA_DisableChannel(DMA1, LINK_TX_CHANNEL);
+    }
+    memcpy(_tx, bytes, length);
+    LL_DMA_SetDataLength(DMA1, LINK_TX_CHANNEL, length);
+    LL_DMA_EnableChannel(DMA1, LINK_TX_CHANNEL);
+    return true;
+}
+
+uint32_t LinkSerial::receive(uint8_t *bytes, uint32_t max)
+{
+    uint32_t head = LINK_SERIAL_RING - LL_DMA_GetDataLength(DMA1, LINK_RX_CHANNEL);
+    if (head == LINK_SERIAL_RING) {
+        head = 0;
+    }
+    uint32_t count = 0;
+    while (_tail != head && count < max) {
+        bytes[count++] = _rx[_tail];
+        _tail = (_tail + 1) % LINK_SERIAL_RING;
+    }
+    return count;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "mbed.h"
+#include "DepthLink.h"
+
+// UART of the stereo link (DepthLink.h), without interrupts: a DMA channel
+// receives in circular mode into a ring that receive() reads up to the DMA
+// position, another one sends a frame from its own buffer.
+//
+// One instance. LinkSerial.cpp is the STM32L4 implementation (USART1 on
+// D1/D0, DMA1 channels 4 and 5), host/HostLinkSerial.cpp the host shim one,
+// on a file descriptor.
+
+#define LINK_SERIAL_RING            256 // received bytes, 1.28ms at 2Mbaud between two receive()
+
+class LinkSerial {
+public:
+    LinkSerial(PinName tx, PinName rx, int baud);
+
+    // Starts sending a frame of up to DEPTH_LINK_FRAME bytes. Returns false
+    // while the previous one is still going out, the frame is dropped.
+    bool send(const uint8_t *bytes, uint32_t length);
+
+    // Bytes received since the last call, up to max
+    uint32_t receive(uint8_t *bytes, uint32_t max);
+
+private:
+    uint32_t _tail;
+    uint8_t  _rx[LINK_SERIAL_RING];
+    uint8_t  _tx[DEPTH_LINK_FRAME];
+};
@@ -0,0 +1,3 @@
+#include "Log.h"
+
+volatile uint32_t log_mask = LOG_MASK_ALL;
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "TokenLog.h"
+#include <cstdint>
+
+// Categorized logging on top of TOKENLOG(). Each category has a compile-time
+// level: sites above it compile to nothing, their arguments are not even
+// evaluated. The sites left in cost one test of log_mask, the categories
+// enabled at run time.
+//
+//   LOG_DEBUG(ENGINE, loop_log, "REGION: %u", region);
+
+#define LOG_LEVEL_NONE              0
+#define LOG_LEVEL_ERROR             1
+#define LOG_LEVEL_WARN              2
+#define LOG_LEVEL_INFO              3
+#define LOG_LEVEL_DEBUG             4
+
+// Build time thresholds, override with -DLOG_LEVEL_ENGINE=LOG_LEVEL_NONE...
+#ifndef LOG_LEVEL_ACQUISITION
+#define LOG_LEVEL_ACQUISITION       LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_ENGINE
+#define LOG_LEVEL_ENGINE            LOG_LEVEL_DEBUG
+#endif
+#ifndef LOG_LEVEL_PWM
+#define LOG_LEVEL_PWM               LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_TELEMETRY
+#define LOG_LEVEL_TELEMETRY         LOG_LEVEL_DEBUG
+#endif
+
+enum LogCategory : uint8_t {
+    LOG_ACQUISITION,
+    LOG_ENGINE,
+    LOG_PWM,
+    LOG_TELEMETRY,
+    LOG_CATEGORY_COUNT
+};
+
+#define LOG_MASK_ALL                ((1u << LOG_CATEGORY_COUNT) - 1)
+
+// Categories enabled at run time, one bit per LogCategory
+extern volatile uint32_t log_mask;
+
+inline void log_enable(LogCategory category, bool enable)
+{
+    if (enable) {
+        log_mask |= 1u << category;
+    } else {
+        log_mask &= ~(1u << category);
+    }
+}
+
+// The level test is a constant, the compiler drops the whole site when it fails
+#define LOG_AT(level, category, log, format, ...) \
+    do { \
+        if (LOG_LEVEL_##category >= (level) && (log_mask & (1u << LOG_##category))) { \
+            TOKENLOG(log, format, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_ERROR(category, log, format, ...) LOG_AT(LOG_LEVEL_ERROR, category, log, format, ##__VA_ARGS__)
+#define LOG_WARN(category, log, format, ...)  LOG_AT(LOG_LEVEL_WARN, category, log, format, ##__VA_ARGS__)
+#define LOG_INFO(category, log, format, ...)  LOG_AT(LOG_LEVEL_INFO, category, log, format, ##__VA_ARGS__)
+#define LOG_DEBUG(category, log, format, ...) LOG_AT(LOG_LEVEL_DEBUG, category, log, format, ##__VA_ARGS__)
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+#define LOOP_RATE_WINDOW_US         100000 // frame count window
+#define LOOP_RATE_PERIOD_SHIFT      4      // period EWMA weight, 1/16
+
+// Control loop rate from a free running microsecond timer, updated in the
+// loop itself: frames counted over a LOOP_RATE_WINDOW_US window, and an EWMA
+// of the frame period in 1/256 us.
+class LoopRate {
+public:
+    LoopRate() :
+        _last_us(0),
+        _window_start_us(0),
+        _window_frames(0),
+        _period_x256(0),
+        _rate_hz(0),
+        _started(false)
+    {
+    }
+
+    void tick(uint32_t now_us)
+    {
+        if (!_started) {
+            _started = true;
+            _last_us = _window_start_us = now_us;
+            return;
+        }
+
+        int32_t period_x256 = (int32_t)((now_us - _last_us) << 8);
+        _last_us = now_us;
+        if (_period_x256) {
+            _period_x256 += (period_x256 - _period_x256) >> LOOP_RATE_PERIOD_SHIFT;
+        } else {
+            _period_x256 = period_x256;
+        }
+
+        _window_frames++;
+        uint32_t window_us = now_us - _window_start_us;
+        if (window_us >= LOOP_RATE_WINDOW_US) {
+            _rate_hz = (uint32_t)(((uint64_t)_window_frames * 1000000 + window_us / 2) / window_us);
+            _window_frames = 0;
+            _window_start_us = now_us;
+        }
+    }
+
+    // Frames per second over the last complete window
+    uint32_t rate_hz() const
+    {
+        return _rate_hz;
+    }
+
+    // Smoothed frame period
+    uint32_t period_ns() const
+    {
+        return (uint32_t)(((int64_t)_period_x256 * 1000) >> 8);
+    }
+
+private:
+    uint32_t _last_us;
+    uint32_t _window_start_us;
+    uint32_t _window_frames;
+    int32_t  _period_x256;
+    uint32_t _rate_hz;
+    bool     _started;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+
+// Streaming estimate of several quantiles of a sequence in constant memory
+// and O(1) per sample: the P² algorithm (Jain & Chlamtac, 1985), extended to
+// Count quantiles (Raatikainen, 1987). 2 * Count + 3 markers sit at the
+// minimum, the quantiles, the midpoints between them and the maximum. Each
+// sample moves the marker positions, a marker off its desired position by one
+// or more moves by one, its height adjusted on a parabola through its
+// neighbours (linearly when the parabola leaves them).
+//
+// Estimates over everything added since reset(): windows of samples are up to
+// the owner (AutoRange.h).
+template <uint32_t Count>
+class P2Quantiles {
+public:
+    // Count probabilities in increasing order, in (0, 1)
+    explicit P2Quantiles(const float *probabilities) :
+        _fractions(),
+        _heights(),
+        _positions(),
+        _desired(),
+        _count(0)
+    {
+        _fractions[0] = 0.0f;
+        for (uint32_t i = 0; i < Count; i++) {
+            float previous = i ? probabilities[i - 1] : 0.0f;
+            _fractions[2 * i + 1] = (previous + probabilities[i]) / 2;
+            _fractions[2 * i + 2] = probabilities[i];
+        }
+        _fractions[MARKERS - 2] = (probabilities[Count - 1] + 1.0f) / 2;
+        _fractions[MARKERS - 1] = 1.0f;
+    }
+
+    void reset()
+    {
+        _count = 0;
+    }
+
+    void add(float x)
+    {
+        if (_count < MARKERS) {
+            // Insertion sort of the first samples, then the markers start on them
+            uint32_t i = _count++;
+            for (; i > 0 && _heights[i - 1] > x; i--) {
+                _heights[i] = _heights[i - 1];
+            }
+            _heights[i] = x;
+            if (_count == MARKERS) {
+                for (uint32_t m = 0; m < MARKERS; m++) {
+                    _positions[m] = (int32_t)m + 1;
+                    _desired[m] = 1.0f + (MARKERS - 1) * _fractions[m];
+                }
+            }
+            return;
+        }
+        _count++;
+
+        uint32_t cell;
+        if (x < _heights[0]) {
+            _heights[0] = x;
+            cell = 0;
+        } else if (x >= _heights[MARKERS - 1]) {
+            _heights[MARKERS - 1] = x;
+            cell = MARKERS - 2;
+        } else {
+            cell = 0;
+            while (x >= _heights[cell + 1]) {
+                cell++;
+            }
+        }
+        for (uint32_t m = cell + 1; m < MARKERS; m++) {
+            _positions[m]++;
+        }
+        for (uint32_t m = 0; m < MARKERS; m++) {
+            _desired[m] += _fractions[m];
+        }
+
+        for (uint32_t m = 1; m < MARKERS - 1; m++) {
+            float offset = _desired[m] - _positions[m];
+            int32_t step = 0;
+            if (offset >= 1.0f && _positions[m + 1] - _positions[m] > 1) {
+                step = 1;
+            } else if (offset <= -1.0f && _positions[m - 1] - _positions[m] < -1) {
+                step = -1;
+            }
+            if (step) {
+                float height = parabolic(m, step);
+                if (height <= _heights[m - 1] || height >= _heights[m + 1]) {
+                    height = linear(m, step);
+                }
+                _heights[m] = height;
+                _positions[m] += step;
+            }
+        }
+    }
+
+    // Samples since reset()
+    uint32_t count() const
+    {
+        return _count;
+    }
+
+    // Estimates are available once the markers are placed
+    bool ready() const
+    {
+        return _count >= MARKERS;
+    }
+
+    // Estimate of the quantile of probabilities[index]
+    float quantile(uint32_t index) const
+    {
+        return _heights[2 * index + 2];
+    }
+
+    float minimum() const
+    {
+        return _heights[0];
+    }
+
+    float maximum() const
+    {
+        return _heights[MARKERS - 1];
+    }
+
+private:
+    static const uint32_t MARKERS = 2 * Count + 3;
+
+    float parabolic(uint32_t m, int32_t step) const
+    {
+        float left = (float)(_positions[m] - _positions[m - 1]);
+        float right = (float)(_positions[m + 1] - _positions[m]);
+        float span = (float)(_positions[m + 1] - _positions[m - 1]);
+        return _heights[m] + step / span
+               * ((left + step) * (_heights[m + 1] - _heights[m]) / right
+                  + (right - step) * (_heights[m] - _heights[m - 1]) / left);
+    }
+
+    float linear(uint32_t m, int32_t step) const
+    {
+        return _heights[m] + step * (_heights[m + step] - _heights[m]) / (float)(_positions[m + step] - _positions[m]);
+    }
+
+    float    _fractions[MARKERS];
+    float    _heights[MARKERS];
+    int32_t  _positions[MARKERS];
+    float    _desired[MARKERS];
+    uint32_t _count;
+};
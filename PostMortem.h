@@ -0,0 +1,111 @@
+#pragma once
+
+#include "FlightRecorder.h"
+#include "StageProfiler.h"
+
+#include <cstdint>
+
+#if !defined(DEPTH_HOST)
+#include "cmsis.h"
+#endif
+
+// State of the module before a watchdog reset or a fault, in RAM that the
+// startup code does not clear, and reported once at the next boot.
+//
+// The flight recorder is written by every frame, in place: the last frames
+// before any reset are there, even when nothing else ran. The rest is
+// written by the watchdog pre-timeout handler or the mbed error hook, which
+// seal it: valid when the magic and the checksum match. The recorder is
+// valid when recorder_magic is set and the reset was not a power on:
+// anything else is what the RAM held at power up.
+//
+// Host tools read the same layout from the report frames of the telemetry
+// stream (TelemetryCodec.h): little endian, natural alignment, on the
+// Cortex-M4 and x86-64 alike.
+//
+// ".noinit" is a NOLOAD output section before .bss, outside what the startup
+// code copies or zeroes. mbed's STM32L432 linker script has none: the firmware
+// links with a copy of it that adds one (CMakeLists.txt). The host build keeps
+// a plain global.
+
+#if defined(DEPTH_HOST)
+#define RETAINED
+#else
+#define RETAINED                    __attribute__((section(".noinit")))
+#endif
+
+#define POST_MORTEM_MAGIC           0x504D5254 // "PMRT"
+#define POST_MORTEM_RECORDER_MAGIC  0x464C4954 // "FLIT"
+
+enum PostMortemKind : uint8_t {
+    POST_MORTEM_NONE,
+    POST_MORTEM_PRETIMEOUT, // watchdog pre-timeout handler
+    POST_MORTEM_FAULT,      // mbed error hook: fault, failed assert or mbed_error()
+    POST_MORTEM_RECORDER    // watchdog reset with interrupts blocked: the flight recorder only
+};
+
+enum PostMortemFault {
+    FAULT_CFSR,             // configurable fault status, SCB
+    FAULT_HFSR,             // hard fault status
+    FAULT_MMFAR,            // memory management fault address
+    FAULT_BFAR,             // bus fault address
+    FAULT_ERROR_STATUS,     // mbed_error_status_t
+    FAULT_ERROR_ADDRESS,    // caller of mbed_error()
+    FAULT_REGISTER_COUNT
+};
+
+struct PostMortem {
+    uint32_t     magic;
+    uint32_t     checksum;              // of the words after it, up to recorder_magic
+    uint32_t     time_us;               // of the dump
+    uint32_t     frame;
+    uint32_t     last_frame_us;
+    uint32_t     misses;                // frames past their deadline since the start
+    uint8_t      kind;                  // PostMortemKind
+    uint8_t      cause;                 // WatchdogCause of the last check
+    uint8_t      task;                  // late task, for WATCHDOG_TASK_LATE
+    uint8_t      reset_reason;          // reset_reason_t, at the next boot
+    uint32_t     fault[FAULT_REGISTER_COUNT];
+    uint32_t     stage_max[STAGE_COUNT]; // cycles, since the last console report
+    uint32_t     stage_average[STAGE_COUNT];
+    uint32_t     recorder_magic;
+    FlightRecorder<FLIGHT_RECORDER_FRAMES> flight;
+};
+
+static_assert(sizeof(PostMortem) % 4 == 0, "checksum of whole words");
+static_assert(sizeof(PostMortem) == 92 + 12 * FLIGHT_RECORDER_FRAMES, "layout read by the host tools");
+
+inline uint32_t post_mortem_checksum(const PostMortem &dump)
+{
+    // FNV-1a over the words after the checksum
+    const uint32_t *words = &dump.checksum + 1;
+    const uint32_t *end = &dump.recorder_magic;
+    uint32_t hash = 2166136261u;
+    for (; words < end; words++) {
+        hash = (hash ^ *words) * 16777619u;
+    }
+    return hash;
+}
+
+inline void post_mortem_seal(PostMortem &dump)
+{
+    dump.checksum = post_mortem_checksum(dump);
+    dump.magic = POST_MORTEM_MAGIC;
+}
+
+inline bool post_mortem_valid(const PostMortem &dump)
+{
+    return dump.magic == POST_MORTEM_MAGIC && dump.checksum == post_mortem_checksum(dump);
+}
+
+inline void post_mortem_fault_registers(uint32_t *fault)
+{
+#if defined(DEPTH_HOST)
+    fault[FAULT_CFSR] = fault[FAULT_HFSR] = fault[FAULT_MMFAR] = fault[FAULT_BFAR] = 0;
+#else
+    fault[FAULT_CFSR] = SCB->CFSR;
+    fault[FAULT_HFSR] = SCB->HFSR;
+    fault[FAULT_MMFAR] = SCB->MMFAR;
+    fault[FAULT_BFAR] = SCB->BFAR;
+#endif
+}
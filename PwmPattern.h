@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdint>
+
+// Software PWM of up to 16 pins of a GPIO port as a pattern of BSRR words,
+// one per step of the period, that a timer triggered DMA writes to the port
+// in circular mode (DmaPWM.h). Every word sets or resets every pin, so the
+// pattern of a pin is its duty in steps of highs, then lows.
+//
+// The DMA keeps reading while the duty changes: a half of the buffer is only
+// rewritten after the DMA signals it has left it (half_done()). A half is
+// written with a duty that keeps the period a single pulse whatever the other
+// half holds, and so a change settles over one or two periods, each of them
+// with a duty between the old and the new one.
+//
+// No hardware access here: the firmware and host/depth_bench share it.
+
+#define PWM_PATTERN_PINS            16
+
+template <uint32_t Steps>
+class PwmPattern {
+    static_assert(Steps % 2 == 0 && Steps >= 2, "two halves of whole steps");
+
+public:
+    PwmPattern() :
+        _pins(0),
+        _inverted(0),
+        _pending(0),
+        _halves_written(0),
+        _target(),
+        _written(),
+        _words()
+    {
+    }
+
+    // The pin is off (low, high when inverted) until set_duty()
+    void add_pin(uint8_t pin, bool inverted)
+    {
+        _pins |= 1u << pin;
+        if (inverted) {
+            _inverted |= 1u << pin;
+        }
+        _target[pin] = 0;
+        _written[0][pin] = 0;
+        _written[1][pin] = HALF;
+        fill_half(0, 0, HALF);
+        fill_half(1, HALF, Steps);
+    }
+
+    // Duty in steps, 0 to Steps. Returns true when halves are to be rewritten:
+    // half_done() must then be called on each DMA half transfer / transfer
+    // complete event, or fill() when the DMA is stopped.
+    bool set_duty(uint8_t pin, uint32_t steps)
+    {
+        _target[pin] = steps > Steps ? Steps : steps;
+        update_pending();
+        return _pending != 0;
+    }
+
+    uint32_t duty(uint8_t pin) const
+    {
+        return _target[pin];
+    }
+
+    // The DMA has finished reading half 0 (half transfer) or 1 (transfer
+    // complete) and moved to the other one. Returns true while halves remain
+    // to be rewritten.
+    bool half_done(uint8_t half)
+    {
+        if (_pending & (1u << half)) {
+            write_half(half);
+            update_pending();
+        }
+        return _pending != 0;
+    }
+
+    // Writes the whole pattern, the DMA being stopped
+    void fill()
+    {
+        while (_pending) {
+            write_half(_pending & 1 ? 0 : 1);
+            update_pending();
+        }
+    }
+
+    bool pending() const
+    {
+        return _pending != 0;
+    }
+
+    // Halves rewritten since the start, for the benches
+    uint32_t halves_written() const
+    {
+        return _halves_written;
+    }
+
+    uint32_t *words()
+    {
+        return _words;
+    }
+
+private:
+    static constexpr uint32_t HALF = Steps / 2;
+
+    // Duty of the pin that half 'half' can take now, as the highs within the
+    // half: 0 to HALF for the first half, HALF to Steps for the second
+    uint32_t effective(uint8_t half, uint8_t pin) const
+    {
+        uint32_t steps = _target[pin];
+        if (half == 0) {
+            // Highs left in the second half: the first one stays all high
+            if (_written[1][pin] > HALF && steps < HALF) {
+                steps = HALF;
+            }
+            return steps > HALF ? HALF : steps;
+        }
+        // Lows in the first half: the second one stays all low
+        if (_written[0][pin] < HALF && steps > HALF) {
+            steps = HALF;
+        }
+        return steps < HALF ? HALF : steps;
+    }
+
+    void update_pending()
+    {
+        _pending = 0;
+        for (uint8_t half = 0; half < 2; half++) {
+            for (uint8_t pin = 0; pin < PWM_PATTERN_PINS; pin++) {
+                if ((_pins & (1u << pin)) && effective(half, pin) != _written[half][pin]) {
+                    _pending |= 1u << half;
+                }
+            }
+        }
+    }
+
+    void write_half(uint8_t half)
+    {
+        for (uint8_t pin = 0; pin < PWM_PATTERN_PINS; pin++) {
+            if (_pins & (1u << pin)) {
+                _written[half][pin] = effective(half, pin);
+            }
+        }
+        fill_half(half, half ? HALF : 0, half ? Steps : HALF);
+        _halves_written++;
+    }
+
+    // BSRR: bit n sets pin n, bit n + 16 resets it
+    void fill_half(uint8_t half, uint32_t first, uint32_t last)
+    {
+        for (uint32_t step = first; step < last; step++) {
+            uint32_t word = 0;
+            for (uint8_t pin = 0; pin < PWM_PATTERN_PINS; pin++) {
+                if (_pins & (1u << pin)) {
+                    bool high = (step < _written[half][pin]) != ((_inverted >> pin) & 1);
+                    word |= high ? 1u << pin : 1u << (pin + 16);
+                }
+            }
+            _words[step] = word;
+        }
+    }
+
+    uint32_t          _pins;
+    uint32_t          _inverted;
+    volatile uint32_t _pending;     // bit per half to rewrite
+    uint32_t          _halves_written;
+    uint32_t          _target[PWM_PATTERN_PINS];
+    uint32_t          _written[2][PWM_PATTERN_PINS];
+    uint32_t          _words[Steps];
+};
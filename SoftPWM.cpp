@@ -1,20 +1,54 @@
 #include "SoftPWM.h"
+#include "pinmap.h"
+#include "PeripheralPins.h"
 
 SoftPWM::SoftPWM(PinName _outpin, bool _positive) :
-        pulse(_outpin)  
+        pulse(nullptr),
+        channel(nullptr)
 {
-    if (_positive) {
-        pulse = 0;
+    positive = _positive;
+    if (has_timer(_outpin)) {
+        channel = new PwmOut(_outpin);
     } else {
-        pulse = 1;
+        pulse = new DigitalOut(_outpin);
+        idle();
     }
 
-    positive = _positive;
     interval = 0.02;
     width = 0;
+    if (channel) {
+        channel->period(interval);
+    }
     start(); 
 }
 
+SoftPWM::~SoftPWM() {
+    delete channel;
+    delete pulse;
+}
+
+// Pin level between the pulses
+void SoftPWM::idle() {
+    if (positive) {
+        *pulse = 0;
+    } else {
+        *pulse = 1;
+    }
+}
+
+// Never TIM2: it runs us_ticker, and a period set on one of its channels would
+// break every Ticker, Timeout and wait
+bool SoftPWM::has_timer(PinName _pin) {
+    uint32_t timer = pinmap_find_peripheral(_pin, PinMap_PWM);
+    return timer != (uint32_t)NC && timer != (uint32_t)PWM_2;
+}
+
+// The timer channel has no polarity: the duty of an inverted pin is its lows
+void SoftPWM::update() {
+    float duty = read();
+    channel->write(positive ? duty : 1.0f - duty);
+}
+
 float SoftPWM::read() {
     if (width <= 0.0) return 0.0;
     if (width > 1.0)  return 1.0;
@@ -25,24 +59,30 @@ void SoftPWM::write(float duty) {
     width = interval * duty;
     if (duty <= 0.0) width =  0.0;
     if (duty > 1.0)  width =  interval;
+    if (channel) update();
 }
 
 void SoftPWM::start() {
+    if (channel) {
+        update();
+        return;
+    }
     _ticker.attach(callback(this, &SoftPWM::TickerInterrapt), interval);
 }
 
 void SoftPWM::stop() {
-    _ticker.detach();
-    if (positive) {
-        pulse = 0;
-    } else {
-        pulse = 1;
+    if (channel) {
+        channel->write(positive ? 0.0f : 1.0f);
+        return;
     }
+    _ticker.detach();
+    idle();
     wait_us(width * 1000000);
 }
 
 void SoftPWM::period(float _period) {
     interval = _period;
+    if (channel) channel->period(interval);
     start();
 }
 
@@ -59,6 +99,7 @@ void SoftPWM::period_us(int _period) {
 void SoftPWM::pulsewidth(float _width) {
     width = _width;
     if (width < 0.0) width = 0.0;
+    if (channel) update();
 }
 
 void SoftPWM::pulsewidth_ms(int _width) {
@@ -75,16 +116,12 @@ void SoftPWM::TickerInterrapt() {
     _timeout.attach(callback(this, &SoftPWM::end), width);
     
     if (positive) {
-        pulse = 1;
+        *pulse = 1;
     } else {
-        pulse = 0;
+        *pulse = 0;
     }    
 }
 
 void SoftPWM::end() {
-    if (positive) {
-        pulse = 0;
-    } else {
-        pulse = 1;
-    }    
+    idle();
 }
\ No newline at end of file
@@ -2,19 +2,32 @@
 
 #include "mbed.h"
 
+// With a timer channel when the target's PinMap_PWM has one for the pin, no
+// interrupt then. A Ticker and a Timeout interrupt per period otherwise, on
+// the pins of TIM2, the us_ticker timer, too. LED1 (PB_3) has no other timer
+// channel on the NUCLEO_L432KC, so LED1 stays software-driven here. The
+// firmware drives LED1 with DmaPWM (DMA_PWM in main.cpp).
+// Only one of the pin's drivers is created: the PwmOut of the channel, or
+// the DigitalOut of the interrupts.
 class SoftPWM  
 {
 private:
     Timeout _timeout;
     Ticker _ticker;
     void end();
-    DigitalOut pulse;
+    DigitalOut *pulse;
     bool positive;
     void TickerInterrapt();
     float width;
     float interval;
+    PwmOut *channel;
+    void update();
+    void idle();
 public:
     SoftPWM(PinName,bool mode=true); 
+    ~SoftPWM();
+    static bool has_timer(PinName);
+    bool uses_timer() { return channel != nullptr; }
 //    void attach_us(int);
     void start();
     void write(float);
@@ -32,9 +45,7 @@ public:
         return width / interval;
     }
     SoftPWM& operator=(float duty)  {
-        width = interval * duty;
-        if ( duty <= 0.0 ) width =  0.0;
-        if ( duty > 1.0 )  width =  interval;
+        write(duty);
         return *this;
     }
                 
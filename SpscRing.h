@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Cortex-M4 has no data cache, 32 keeps the indices apart on cached cores
+#ifndef SPSC_CACHE_LINE
+#if defined(__arm__)
+#define SPSC_CACHE_LINE             32
+#else
+#define SPSC_CACHE_LINE             64
+#endif
+#endif
+
+// Wait-free single producer / single consumer ring, for handing data between
+// the control loop or an ISR and a low priority thread. Exactly one context
+// may push and one may pop. The indices run freely and are masked on access,
+// so the whole Capacity is usable.
+template <typename T, uint32_t Capacity>
+class SpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    SpscRing() :
+        _head(0),
+        _tail_cache(0),
+        _tail(0),
+        _head_cache(0)
+    {
+    }
+
+    // Producer side
+    bool push(const T &item)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail_cache == Capacity) {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+            if (head - _tail_cache == Capacity) {
+                return false;
+            }
+        }
+        _items[head & (Capacity - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pushes as many of the items as fit, returns how many
+    uint32_t push(const T *items, uint32_t count)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t space = Capacity - (head - _tail_cache);
+        if (space < count) {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+            space = Capacity - (head - _tail_cache);
+        }
+        if (count > space) {
+            count = space;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            _items[(head + i) & (Capacity - 1)] = items[i];
+        }
+        _head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    uint32_t free_space() const
+    {
+        return Capacity - (_head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire));
+    }
+
+    // Consumer side
+    bool pop(T &item)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head_cache) {
+            _head_cache = _head.load(std::memory_order_acquire);
+            if (tail == _head_cache) {
+                return false;
+            }
+        }
+        item = _items[tail & (Capacity - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pops up to count items, returns how many
+    uint32_t pop(T *items, uint32_t count)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t available = _head_cache - tail;
+        if (available < count) {
+            _head_cache = _head.load(std::memory_order_acquire);
+            available = _head_cache - tail;
+        }
+        if (count > available) {
+            count = available;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            items[i] = _items[(tail + i) & (Capacity - 1)];
+        }
+        _tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    uint32_t size() const
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    static constexpr uint32_t capacity()
+    {
+        return Capacity;
+    }
+
+private:
+    // Written by the producer
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> _head;
+    uint32_t _tail_cache;
+
+    // Written by the consumer
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> _tail;
+    uint32_t _head_cache;
+
+    alignas(SPSC_CACHE_LINE) T _items[Capacity];
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(DEPTH_HOST)
+#include "HostHal.h"
+#else
+#include "mbed.h"
+#endif
+
+// Stages of one control loop iteration
+enum ProfileStage : uint8_t {
+    STAGE_ACQUISITION,  // ADC reads
+    STAGE_FILTER,       // EWMA filters
+    STAGE_OUTPUT,       // DAC write
+    STAGE_ENGINE,       // depth_compute_fixed(), or depth_compute() without FIXED_ENGINE
+    STAGE_COUNT
+};
+
+struct StageStats {
+    uint32_t min;
+    uint32_t max;
+    uint32_t total;
+    uint32_t count;
+};
+
+// Cycle counts per stage: begin() at the top of the loop, then mark() at the
+// end of each stage. Reads the DWT cycle counter on target (a single load),
+// a nanosecond clock on the host. Stats are read and reset by a lower
+// priority thread without locking: a torn value only spoils one report.
+class StageProfiler {
+public:
+    StageProfiler() :
+        _last(0),
+        _elapsed(),
+        _stats()
+    {
+        reset();
+    }
+
+    static void init()
+    {
+#if !defined(DEPTH_HOST)
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    }
+
+    static uint32_t cycles()
+    {
+#if defined(DEPTH_HOST)
+        return host_cycle_count();
+#else
+        return DWT->CYCCNT;
+#endif
+    }
+
+    void begin()
+    {
+        _last = cycles();
+    }
+
+    void mark(ProfileStage stage)
+    {
+        uint32_t now = cycles();
+        uint32_t elapsed = now - _last;
+        _last = now;
+        _elapsed[stage] = elapsed;
+
+        StageStats &stats = _stats[stage];
+        if (elapsed < stats.min) {
+            stats.min = elapsed;
+        }
+        if (elapsed > stats.max) {
+            stats.max = elapsed;
+        }
+        stats.total += elapsed;
+        stats.count++;
+    }
+
+    // Cycles of the stage in the last iteration
+    uint32_t last(ProfileStage stage) const
+    {
+        return _elapsed[stage];
+    }
+
+    const StageStats &stats(ProfileStage stage) const
+    {
+        return _stats[stage];
+    }
+
+    void reset()
+    {
+        for (StageStats &stats : _stats) {
+            stats.min = UINT32_MAX;
+            stats.max = 0;
+            stats.total = 0;
+            stats.count = 0;
+        }
+    }
+
+private:
+    uint32_t   _last;
+    uint32_t   _elapsed[STAGE_COUNT];
+    StageStats _stats[STAGE_COUNT];
+};
+
+inline const char *profile_stage_name(ProfileStage stage)
+{
+    switch (stage) {
+        case STAGE_ACQUISITION: return "acquisition";
+        case STAGE_FILTER:      return "filter";
+        case STAGE_OUTPUT:      return "output";
+        case STAGE_ENGINE:      return "engine";
+        default:                return "?";
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#define TELEMETRY_STAGE_COUNT       4 // STAGE_COUNT of StageProfiler.h
+
+enum TelemetryInput : uint8_t {
+    INPUT_CV,
+    INPUT_SLIDER,
+    INPUT_CENTER,
+    INPUT_LEFT,
+    INPUT_RIGHT,
+    INPUT_COUNT
+};
+
+// State of the control loop, published once per frame
+struct TelemetrySnapshot {
+    uint32_t time_us;
+    uint32_t frame;
+    uint16_t raw[INPUT_COUNT];
+    uint16_t filtered[INPUT_COUNT];
+    uint16_t volume;
+    uint8_t  region;
+    uint32_t loop_rate_hz;
+    uint32_t loop_period_ns;
+    uint32_t warm_start_us;  // reset to first valid output
+    uint8_t  lin_log;        // bit 0: left Log, bit 1: right Log
+    uint32_t curve_switches;
+    uint32_t stage_cycles[TELEMETRY_STAGE_COUNT];
+};
+
+// Single writer, any number of readers, none of them blocks: the writer bumps
+// the sequence to odd while it copies, readers retry until they saw an even,
+// unchanged sequence around their copy. Readers must not have a higher
+// priority than the writer, or they spin on an interrupted write.
+template <typename T>
+class SeqLock {
+public:
+    SeqLock() :
+        _sequence(0),
+        _value()
+    {
+    }
+
+    void write(const T &value)
+    {
+        uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+        _sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _value = value;
+        std::atomic_thread_fence(std::memory_order_release);
+        _sequence.store(sequence + 2, std::memory_order_relaxed);
+    }
+
+    T read() const
+    {
+        T value;
+        uint32_t before, after;
+        do {
+            before = _sequence.load(std::memory_order_acquire);
+            value = _value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = _sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        return value;
+    }
+
+private:
+    std::atomic<uint32_t> _sequence;
+    T                     _value;
+};
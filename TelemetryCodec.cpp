@@ -0,0 +1,336 @@
+#include "TelemetryCodec.h"
+#include <cstring>
+
+namespace {
+
+// CRC-8, polynomial 0x07, a nibble at a time
+const uint8_t crc8_nibbles[16] = {
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D
+};
+
+uint8_t crc8(uint8_t crc, uint8_t byte)
+{
+    crc ^= byte;
+    crc = (uint8_t)(crc << 4) ^ crc8_nibbles[crc >> 4];
+    crc = (uint8_t)(crc << 4) ^ crc8_nibbles[crc >> 4];
+    return crc;
+}
+
+uint8_t *put_varint(uint8_t *out, uint64_t value)
+{
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+// Returns false past the end of the payload or on an over long varint
+bool get_varint(const uint8_t *&in, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (in == end) {
+            return false;
+        }
+        uint8_t byte = *in++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Header and CRC of a frame whose payload ends at end, returns its length
+uint32_t finish_frame(uint8_t *out, uint8_t kind, uint8_t sequence, uint8_t *end)
+{
+    out[0] = TELEMETRY_FRAME_SYNC;
+    out[1] = kind;
+    out[2] = sequence;
+    out[3] = (uint8_t)(end - out - TELEMETRY_FRAME_HEADER);
+    uint8_t crc = 0;
+    for (const uint8_t *byte = out + 1; byte < end; byte++) {
+        crc = crc8(crc, *byte);
+    }
+    *end++ = crc;
+    return (uint32_t)(end - out);
+}
+
+} // namespace
+
+void telemetry_to_fields(const TelemetrySnapshot &snapshot, uint32_t *fields)
+{
+    *fields++ = snapshot.time_us;
+    *fields++ = snapshot.frame;
+    for (uint8_t input = 0; input < INPUT_COUNT; input++) {
+        *fields++ = snapshot.raw[input];
+    }
+    for (uint8_t input = 0; input < INPUT_COUNT; input++) {
+        *fields++ = snapshot.filtered[input];
+    }
+    *fields++ = snapshot.volume;
+    *fields++ = snapshot.region;
+    *fields++ = snapshot.loop_rate_hz;
+    *fields++ = snapshot.loop_period_ns;
+    *fields++ = snapshot.warm_start_us;
+    *fields++ = snapshot.lin_log;
+    *fields++ = snapshot.curve_switches;
+    for (uint8_t stage = 0; stage < TELEMETRY_STAGE_COUNT; stage++) {
+        *fields++ = snapshot.stage_cycles[stage];
+    }
+}
+
+void telemetry_from_fields(const uint32_t *fields, TelemetrySnapshot &snapshot)
+{
+    snapshot.time_us = *fields++;
+    snapshot.frame = *fields++;
+    for (uint8_t input = 0; input < INPUT_COUNT; input++) {
+        snapshot.raw[input] = (uint16_t)*fields++;
+    }
+    for (uint8_t input = 0; input < INPUT_COUNT; input++) {
+        snapshot.filtered[input] = (uint16_t)*fields++;
+    }
+    snapshot.volume = (uint16_t)*fields++;
+    snapshot.region = (uint8_t)*fields++;
+    snapshot.loop_rate_hz = *fields++;
+    snapshot.loop_period_ns = *fields++;
+    snapshot.warm_start_us = *fields++;
+    snapshot.lin_log = (uint8_t)*fields++;
+    snapshot.curve_switches = *fields++;
+    for (uint8_t stage = 0; stage < TELEMETRY_STAGE_COUNT; stage++) {
+        snapshot.stage_cycles[stage] = *fields++;
+    }
+}
+
+uint32_t telemetry_encode_report(const uint8_t *report, uint32_t length, uint8_t chunk, uint8_t *out)
+{
+    uint32_t offset = (uint32_t)chunk * TELEMETRY_REPORT_CHUNK;
+    if (offset >= length) {
+        return 0;
+    }
+    uint32_t count = length - offset < TELEMETRY_REPORT_CHUNK ? length - offset : TELEMETRY_REPORT_CHUNK;
+    uint8_t *payload = out + TELEMETRY_FRAME_HEADER;
+    payload[0] = (uint8_t)length;
+    payload[1] = (uint8_t)(length >> 8);
+    memcpy(payload + 2, report + offset, count);
+    return finish_frame(out, TELEMETRY_REPORT, chunk, payload + 2 + count);
+}
+
+TelemetryEncoder::TelemetryEncoder() :
+    _previous(),
+    _since_keyframe(TELEMETRY_KEYFRAME_INTERVAL),
+    _sequence(0)
+{
+}
+
+uint32_t TelemetryEncoder::encode(const TelemetrySnapshot &snapshot, uint8_t *out)
+{
+    uint32_t fields[TELEMETRY_FIELD_COUNT];
+    telemetry_to_fields(snapshot, fields);
+
+    uint8_t *payload = out + TELEMETRY_FRAME_HEADER;
+    uint8_t *end = payload;
+    bool keyframe = _since_keyframe >= TELEMETRY_KEYFRAME_INTERVAL;
+    if (keyframe) {
+        for (uint8_t i = 0; i < TELEMETRY_FIELD_COUNT; i++) {
+            end = put_varint(end, fields[i]);
+        }
+        _since_keyframe = 0;
+    } else {
+        uint32_t run = 0;
+        for (uint8_t i = 0; i < TELEMETRY_FIELD_COUNT; i++) {
+            if (fields[i] == _previous[i]) {
+                run++;
+                continue;
+            }
+            if (run) {
+                end = put_varint(end, (uint64_t)run << 1 | 1);
+                run = 0;
+            }
+            end = put_varint(end, (uint64_t)zigzag((int32_t)(fields[i] - _previous[i])) << 1);
+        }
+        // A trailing run is implied by the payload length
+    }
+    _since_keyframe++;
+    memcpy(_previous, fields, sizeof(_previous));
+
+    return finish_frame(out, keyframe ? TELEMETRY_KEYFRAME : TELEMETRY_DELTA, _sequence++, end);
+}
+
+void TelemetryEncoder::force_keyframe()
+{
+    _since_keyframe = TELEMETRY_KEYFRAME_INTERVAL;
+}
+
+TelemetryDecoder::TelemetryDecoder() :
+    _state(WAIT_SYNC),
+    _kind(0),
+    _sequence(0),
+    _last_sequence(0),
+    _length(0),
+    _received(0),
+    _payload(),
+    _fields(),
+    _synced(false),
+    _frames(0),
+    _errors(0),
+    _skipped(0),
+    _reports(0),
+    _report_length(0),
+    _report_chunks(0),
+    _report()
+{
+}
+
+bool TelemetryDecoder::feed(uint8_t byte, TelemetrySnapshot &snapshot)
+{
+    switch (_state) {
+        case WAIT_SYNC:
+            if (byte == TELEMETRY_FRAME_SYNC) {
+                _state = WAIT_KIND;
+            }
+            return false;
+        case WAIT_KIND:
+            if (byte == TELEMETRY_KEYFRAME || byte == TELEMETRY_DELTA || byte == TELEMETRY_REPORT) {
+                _kind = byte;
+                _state = WAIT_SEQUENCE;
+            } else {
+                _state = byte == TELEMETRY_FRAME_SYNC ? WAIT_KIND : WAIT_SYNC;
+            }
+            return false;
+        case WAIT_SEQUENCE:
+            _sequence = byte;
+            _state = WAIT_LENGTH;
+            return false;
+        case WAIT_LENGTH:
+            if (byte > TELEMETRY_FRAME_MAX - TELEMETRY_FRAME_HEADER - 1) {
+                _state = byte == TELEMETRY_FRAME_SYNC ? WAIT_KIND : WAIT_SYNC;
+                return false;
+            }
+            _length = byte;
+            _received = 0;
+            _state = _length ? PAYLOAD : WAIT_CRC;
+            return false;
+        case PAYLOAD:
+            _payload[_received++] = byte;
+            if (_received == _length) {
+                _state = WAIT_CRC;
+            }
+            return false;
+        case WAIT_CRC: {
+            _state = WAIT_SYNC;
+            uint8_t crc = crc8(crc8(crc8(0, _kind), _sequence), _length);
+            for (uint8_t i = 0; i < _length; i++) {
+                crc = crc8(crc, _payload[i]);
+            }
+            if (crc != byte) {
+                // Lost bytes: the deltas that follow apply to an unknown state
+                _errors++;
+                _synced = false;
+                return false;
+            }
+            if (_kind == TELEMETRY_REPORT) {
+                decode_report();
+                return false;
+            }
+            return decode(snapshot);
+        }
+    }
+    return false;
+}
+
+bool TelemetryDecoder::decode(TelemetrySnapshot &snapshot)
+{
+    const uint8_t *in = _payload;
+    const uint8_t *end = _payload + _length;
+    uint32_t fields[TELEMETRY_FIELD_COUNT];
+    uint64_t value;
+
+    if (_kind == TELEMETRY_KEYFRAME) {
+        for (uint8_t i = 0; i < TELEMETRY_FIELD_COUNT; i++) {
+            if (!get_varint(in, end, value)) {
+                _errors++;
+                _synced = false;
+                return false;
+            }
+            fields[i] = (uint32_t)value;
+        }
+    } else {
+        if (_synced && _sequence != (uint8_t)(_last_sequence + 1)) {
+            // A whole frame went missing
+            _errors++;
+            _synced = false;
+        }
+        if (!_synced) {
+            _skipped++;
+            return false;
+        }
+        memcpy(fields, _fields, sizeof(fields));
+        uint32_t i = 0;
+        while (in < end) {
+            if (!get_varint(in, end, value) || i >= TELEMETRY_FIELD_COUNT) {
+                _errors++;
+                _synced = false;
+                return false;
+            }
+            if (value & 1) {
+                i += (value >> 1) > TELEMETRY_FIELD_COUNT ? TELEMETRY_FIELD_COUNT + 1 : (uint32_t)(value >> 1);
+            } else {
+                fields[i++] += (uint32_t)unzigzag((uint32_t)(value >> 1));
+            }
+        }
+        if (i > TELEMETRY_FIELD_COUNT) {
+            _errors++;
+            _synced = false;
+            return false;
+        }
+    }
+    if (in != end) {
+        _errors++;
+        _synced = false;
+        return false;
+    }
+
+    memcpy(_fields, fields, sizeof(_fields));
+    _last_sequence = _sequence;
+    _synced = true;
+    _frames++;
+    telemetry_from_fields(_fields, snapshot);
+    return true;
+}
+
+void TelemetryDecoder::decode_report()
+{
+    uint32_t length = _length >= 2 ? (uint32_t)(_payload[0] | _payload[1] << 8) : 0;
+    uint32_t offset = (uint32_t)_sequence * TELEMETRY_REPORT_CHUNK;
+    uint32_t count = length > offset ? length - offset : 0;
+    count = count < TELEMETRY_REPORT_CHUNK ? count : TELEMETRY_REPORT_CHUNK;
+    if (length > TELEMETRY_REPORT_MAX || count == 0 || _length != 2 + count) {
+        _errors++;
+        return;
+    }
+    // A chunk of another report restarts the assembly
+    if (length != _report_length || _report_chunks & (1u << _sequence)) {
+        _report_length = length;
+        _report_chunks = 0;
+    }
+    memcpy(_report + offset, _payload + 2, count);
+    _report_chunks |= 1u << _sequence;
+    uint32_t chunks = (length + TELEMETRY_REPORT_CHUNK - 1) / TELEMETRY_REPORT_CHUNK;
+    if (_report_chunks == (1u << chunks) - 1) {
+        _reports++;
+        _report_chunks = 0;
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Telemetry.h"
+#include <cstdint>
+
+// Compressed telemetry stream: each snapshot is coded against the previous
+// one, as zigzag varint deltas with runs of unchanged fields collapsed, and
+// every TELEMETRY_KEYFRAME_INTERVAL frames a keyframe carries all the fields
+// so a receiver can start or resync anywhere.
+//
+// Frame: sync (0xA5), kind ('K' or 'D'), sequence number, payload length,
+// payload, CRC-8 of everything after the sync. A gap in the sequence numbers
+// means a frame went missing, the deltas that follow are not applied.
+//   keyframe payload: every field as an unsigned varint
+//   delta payload:    items, varint (zigzag(delta) << 1) for a changed field
+//                     or (count << 1 | 1) for a run of unchanged fields
+//
+// Report frames ('R') carry the retained state of the last run (PostMortem.h),
+// sent once at boot: the sequence number is the chunk number, the payload
+// the report length (u16 LE) and up to TELEMETRY_REPORT_CHUNK bytes of it.
+// They do not take sequence numbers from the snapshot frames.
+
+#define TELEMETRY_FRAME_SYNC        0xA5
+#define TELEMETRY_KEYFRAME_INTERVAL 64
+#define TELEMETRY_FIELD_COUNT       (2 * INPUT_COUNT + 9 + TELEMETRY_STAGE_COUNT)
+#define TELEMETRY_FRAME_HEADER      4
+#define TELEMETRY_FRAME_MAX         (TELEMETRY_FRAME_HEADER + 5 * TELEMETRY_FIELD_COUNT + 1)
+#define TELEMETRY_REPORT_CHUNK      96
+#define TELEMETRY_REPORT_MAX        1024
+
+enum TelemetryFrameKind : uint8_t {
+    TELEMETRY_KEYFRAME = 'K',
+    TELEMETRY_DELTA = 'D',
+    TELEMETRY_REPORT = 'R'
+};
+
+static_assert(2 + TELEMETRY_REPORT_CHUNK <= TELEMETRY_FRAME_MAX - TELEMETRY_FRAME_HEADER - 1, "report chunk in a frame");
+static_assert(TELEMETRY_REPORT_MAX <= 32 * TELEMETRY_REPORT_CHUNK, "report chunks in the decoder mask");
+
+// Snapshot as an array of fields, in stream order
+void telemetry_to_fields(const TelemetrySnapshot &snapshot, uint32_t *fields);
+void telemetry_from_fields(const uint32_t *fields, TelemetrySnapshot &snapshot);
+
+// Codes the given chunk of a report of length bytes into out,
+// TELEMETRY_FRAME_MAX bytes. Returns the frame length, 0 past the last chunk.
+uint32_t telemetry_encode_report(const uint8_t *report, uint32_t length, uint8_t chunk, uint8_t *out);
+
+class TelemetryEncoder {
+public:
+    TelemetryEncoder();
+
+    // Codes the snapshot into out, TELEMETRY_FRAME_MAX bytes, returns the
+    // frame length
+    uint32_t encode(const TelemetrySnapshot &snapshot, uint8_t *out);
+
+    // Next frame is a keyframe, after the receiver may have lost bytes
+    void force_keyframe();
+
+private:
+    uint32_t _previous[TELEMETRY_FIELD_COUNT];
+    uint32_t _since_keyframe;
+    uint8_t  _sequence;
+};
+
+// Byte at a time decoder, resyncs on the sync byte and the CRC. Delta frames
+// are skipped until a keyframe gives the state they apply to.
+class TelemetryDecoder {
+public:
+    TelemetryDecoder();
+
+    // Returns true when the byte completes a frame, snapshot then holds it
+    bool feed(uint8_t byte, TelemetrySnapshot &snapshot);
+
+    uint32_t frames() const
+    {
+        return _frames;
+    }
+
+    // Frames with a bad CRC or payload, and gaps in the sequence
+    uint32_t errors() const
+    {
+        return _errors;
+    }
+
+    // Delta frames received without a valid state to apply them to
+    uint32_t skipped() const
+    {
+        return _skipped;
+    }
+
+    // Reports received whole. The last one is report_length() bytes at
+    // report(), until the next report frame.
+    uint32_t reports() const
+    {
+        return _reports;
+    }
+
+    const uint8_t *report() const
+    {
+        return _report;
+    }
+
+    uint32_t report_length() const
+    {
+        return _report_length;
+    }
+
+private:
+    bool decode(TelemetrySnapshot &snapshot);
+    void decode_report();
+
+    enum State : uint8_t {
+        WAIT_SYNC,
+        WAIT_KIND,
+        WAIT_SEQUENCE,
+        WAIT_LENGTH,
+        PAYLOAD,
+        WAIT_CRC
+    };
+
+    State    _state;
+    uint8_t  _kind;
+    uint8_t  _sequence;
+    uint8_t  _last_sequence;
+    uint8_t  _length;
+    uint8_t  _received;
+    uint8_t  _payload[TELEMETRY_FRAME_MAX];
+    uint32_t _fields[TELEMETRY_FIELD_COUNT];
+    bool     _synced;
+    uint32_t _frames;
+    uint32_t _errors;
+    uint32_t _skipped;
+    uint32_t _reports;
+    uint32_t _report_length;
+    uint32_t _report_chunks; // received, a bit per chunk
+    uint8_t  _report[TELEMETRY_REPORT_MAX];
+};
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "SpscRing.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+// Deferred, tokenized logging: TOKENLOG() hashes its format string at compile
+// time and only queues the 32 bit hash and the raw argument words, so the
+// string never reaches the flash. The owner of the log drains the frames to
+// the console as "#T<hex>" lines, and host/tokenlog_decode rebuilds the text
+// from the format strings of the ELF the frames came from.
+//
+// Each TOKENLOG() site also places its format string, NUL terminated, in the
+// ".tokenlog" section: the format table of the build, in the build. The
+// firmware links it as an INFO section (CMakeLists.txt), kept in the ELF but
+// not loaded, so it costs no flash; the host tools keep a plain section.
+//
+// Arguments are integers (sent as 32 bits) or floats, matching %d %i %u %x %X
+// %o %c or %f %e %g specifiers, flags and width included. %s is not supported.
+//
+//   TOKENLOG(loop_log, "REGION %u at frame %u", region, frame);
+//
+// write_text() queues a short string instead, printed as is by drain(): the
+// replies to the console commands, which are not known at compile time.
+
+#define TOKENLOG_FRAME_HEADER       5 // token, argument count
+#define TOKENLOG_MAX_ARGS           32
+#define TOKENLOG_TEXT               0 // token of the write_text() frames
+
+// FNV-1a
+constexpr uint32_t tokenlog_hash(const char *format)
+{
+    uint32_t hash = 2166136261u;
+    for (; *format; format++) {
+        hash = (hash ^ (uint8_t)*format) * 16777619u;
+    }
+    return hash;
+}
+
+constexpr bool tokenlog_is_conversion(char c)
+{
+    return c == 'd' || c == 'i' || c == 'u' || c == 'x' || c == 'X' || c == 'o' || c == 'c'
+           || c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G' || c == 's' || c == 'p';
+}
+
+// Number of arguments the format string takes
+constexpr uint32_t tokenlog_arg_count(const char *format)
+{
+    uint32_t count = 0;
+    while (*format) {
+        if (*format++ != '%') {
+            continue;
+        }
+        if (*format == '%') {
+            format++;
+            continue;
+        }
+        while (*format && !tokenlog_is_conversion(*format)) {
+            format++;
+        }
+        if (*format) {
+            format++;
+            count++;
+        }
+    }
+    return count;
+}
+
+template <typename T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, int>::type = 0>
+inline uint32_t tokenlog_word(T value)
+{
+    return (uint32_t)value;
+}
+
+inline uint32_t tokenlog_word(double value)
+{
+    float single = (float)value;
+    uint32_t word;
+    memcpy(&word, &single, sizeof(word));
+    return word;
+}
+
+// One producer context per TokenLog: the control loop and the console thread
+// each log to their own
+template <uint32_t Capacity>
+class TokenLog {
+public:
+    TokenLog() :
+        _dropped(0),
+        _reported_dropped(0)
+    {
+    }
+
+    // Queues a frame, or counts it as dropped when it does not fit: never blocks
+    template <uint32_t Count, typename... Args>
+    void write(uint32_t token, Args... args)
+    {
+        static_assert(Count == sizeof...(Args), "TOKENLOG argument count does not match the format string");
+        static_assert(Count <= TOKENLOG_MAX_ARGS, "too many TOKENLOG arguments");
+
+        uint32_t words[sizeof...(Args) + 1] = {tokenlog_word(args)...};
+        uint8_t frame[TOKENLOG_FRAME_HEADER + 4 * sizeof...(Args)];
+        memcpy(frame, &token, 4);
+        frame[4] = (uint8_t)Count;
+        memcpy(frame + TOKENLOG_FRAME_HEADER, words, 4 * sizeof...(Args));
+
+        if (_ring.free_space() < sizeof(frame)) {
+            _dropped++;
+            return;
+        }
+        _ring.push(frame, sizeof(frame));
+    }
+
+    // Queues a text frame, cut to the argument words of a frame, terminator
+    // included. Dropped like write() when it does not fit.
+    void write_text(const char *text)
+    {
+        uint8_t frame[TOKENLOG_FRAME_HEADER + 4 * TOKENLOG_MAX_ARGS] = {};
+        uint32_t length = strnlen(text, 4 * TOKENLOG_MAX_ARGS - 1);
+        uint32_t words = length / 4 + 1;
+        uint32_t token = TOKENLOG_TEXT;
+        memcpy(frame, &token, 4);
+        frame[4] = (uint8_t)words;
+        memcpy(frame + TOKENLOG_FRAME_HEADER, text, length);
+
+        if (_ring.free_space() < TOKENLOG_FRAME_HEADER + 4 * words) {
+            _dropped++;
+            return;
+        }
+        _ring.push(frame, TOKENLOG_FRAME_HEADER + 4 * words);
+    }
+
+    // Consumer side: prints the queued frames, one "#T<hex>" line each, and
+    // the text frames as they are
+    void drain()
+    {
+        uint8_t frame[TOKENLOG_FRAME_HEADER + 4 * TOKENLOG_MAX_ARGS];
+        while (_ring.pop(frame, TOKENLOG_FRAME_HEADER) == TOKENLOG_FRAME_HEADER) {
+            uint32_t length = TOKENLOG_FRAME_HEADER + 4 * frame[4];
+            _ring.pop(frame + TOKENLOG_FRAME_HEADER, length - TOKENLOG_FRAME_HEADER);
+
+            uint32_t token;
+            memcpy(&token, frame, 4);
+            if (token == TOKENLOG_TEXT) {
+                printf("%s\n", (const char *)frame + TOKENLOG_FRAME_HEADER);
+                continue;
+            }
+            printf("#T");
+            for (uint32_t i = 0; i < length; i++) {
+                printf("%02X", frame[i]);
+            }
+            printf("\n");
+        }
+
+        uint32_t dropped = _dropped;
+        if (dropped != _reported_dropped) {
+            printf("TOKENLOG: %u frames dropped\n", (unsigned int)(dropped - _reported_dropped));
+            _reported_dropped = dropped;
+        }
+    }
+
+private:
+    SpscRing<uint8_t, Capacity> _ring;
+    volatile uint32_t           _dropped;
+    uint32_t                    _reported_dropped;
+};
+
+#define TOKENLOG_STRING(x)          TOKENLOG_STRING_(x)
+#define TOKENLOG_STRING_(x)         #x
+
+// The format string of a site in the format table, by the token it returns.
+// One input section per site: GCC does not let the statics of inline
+// functions, in COMDAT groups, share a section with the others.
+#define TOKENLOG_TOKEN(format) \
+    [] { \
+        __attribute__((section(".tokenlog." TOKENLOG_STRING(__LINE__) "." TOKENLOG_STRING(__COUNTER__)), used)) \
+        static const char tokenlog_format[] = format; \
+        return std::integral_constant<uint32_t, tokenlog_hash(format)>::value; \
+    }()
+
+#define TOKENLOG(log, format, ...) \
+    (log).template write<tokenlog_arg_count(format)>(TOKENLOG_TOKEN(format), ##__VA_ARGS__)
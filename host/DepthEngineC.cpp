@@ -0,0 +1,92 @@
+#include "DepthEngineC.h"
+#include "DepthEngine.h"
+
+#include <new>
+
+struct depth_engine {
+    int      variant;
+    uint16_t slider;
+    uint16_t left;
+    uint16_t right;
+};
+
+namespace {
+
+// One loop per variant and region output, so that the inner loop has no
+// branch on the settings
+template <bool Fixed, bool Regions, bool Pots>
+size_t process(const depth_engine *engine, const uint16_t *cv, const uint16_t *slider, const uint16_t *left,
+               const uint16_t *right, uint16_t *volume, uint8_t *region, size_t count)
+{
+    DepthInputs in{0, engine->slider, engine->left, engine->right};
+    for (size_t i = 0; i < count; i++) {
+        in.cv = cv[i];
+        if (Pots) {
+            in.slider = slider[i];
+            in.left = left[i];
+            in.right = right[i];
+        }
+        DepthOutputs out = Fixed ? depth_compute_fixed(in) : depth_compute(in);
+        volume[i] = out.volume;
+        if (Regions) {
+            region[i] = out.region;
+        }
+    }
+    return count;
+}
+
+template <bool Pots>
+size_t dispatch(const depth_engine *engine, const uint16_t *cv, const uint16_t *slider, const uint16_t *left,
+                const uint16_t *right, uint16_t *volume, uint8_t *region, size_t count)
+{
+    if (engine->variant == DEPTH_ENGINE_FIXED) {
+        return region ? process<true, true, Pots>(engine, cv, slider, left, right, volume, region, count)
+                      : process<true, false, Pots>(engine, cv, slider, left, right, volume, region, count);
+    }
+    return region ? process<false, true, Pots>(engine, cv, slider, left, right, volume, region, count)
+                  : process<false, false, Pots>(engine, cv, slider, left, right, volume, region, count);
+}
+
+} // namespace
+
+uint32_t depth_engine_abi_version(void)
+{
+    return DEPTH_ENGINE_ABI_VERSION;
+}
+
+depth_engine *depth_engine_create(void)
+{
+    return new (std::nothrow) depth_engine{DEPTH_ENGINE_FIXED, UI16_MAX / 2, UI16_MAX / 2, UI16_MAX / 2};
+}
+
+void depth_engine_destroy(depth_engine *engine)
+{
+    delete engine;
+}
+
+int depth_engine_set_variant(depth_engine *engine, int variant)
+{
+    if (variant != DEPTH_ENGINE_FIXED && variant != DEPTH_ENGINE_FLOAT) {
+        return -1;
+    }
+    engine->variant = variant;
+    return 0;
+}
+
+void depth_engine_set_pots(depth_engine *engine, uint16_t slider, uint16_t left, uint16_t right)
+{
+    engine->slider = slider;
+    engine->left = left;
+    engine->right = right;
+}
+
+size_t depth_engine_process_block(depth_engine *engine, const uint16_t *cv, uint16_t *volume, uint8_t *region, size_t count)
+{
+    return dispatch<false>(engine, cv, nullptr, nullptr, nullptr, volume, region, count);
+}
+
+size_t depth_engine_process_inputs(depth_engine *engine, const uint16_t *cv, const uint16_t *slider, const uint16_t *left,
+                                   const uint16_t *right, uint16_t *volume, uint8_t *region, size_t count)
+{
+    return dispatch<true>(engine, cv, slider, left, right, volume, region, count);
+}
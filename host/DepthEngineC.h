@@ -0,0 +1,65 @@
+#pragma once
+
+// C ABI of the depth engine, built as the host shared library libdepthengine
+// for analysis scripts (ctypes, cffi). Evaluates the same depth_compute*()
+// as the firmware on caller-owned arrays, without copies or allocations:
+//
+//   lib = ctypes.CDLL("libdepthengine.so")
+//   lib.depth_engine_create.restype = ctypes.c_void_p
+//   engine = lib.depth_engine_create()
+//   lib.depth_engine_set_pots(ctypes.c_void_p(engine), slider, left, right)
+//   cv = numpy.arange(65536, dtype=numpy.uint16)
+//   lib.depth_engine_process_block(ctypes.c_void_p(engine), cv.ctypes.data, cv.ctypes.data, None, cv.size)
+//
+// Values are on the full 16 bit scale of the filtered readings. Calls on one
+// engine are not thread safe, separate engines can run in parallel.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bumped on any incompatible change of the functions below
+#define DEPTH_ENGINE_ABI_VERSION    1
+
+#if defined(DEPTH_ENGINE_BUILD)
+#define DEPTH_ENGINE_API            __attribute__((visibility("default")))
+#else
+#define DEPTH_ENGINE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct depth_engine depth_engine;
+
+enum depth_engine_variant {
+    DEPTH_ENGINE_FIXED = 0, // depth_compute_fixed(), what the firmware runs
+    DEPTH_ENGINE_FLOAT = 1  // depth_compute(), the float reference
+};
+
+DEPTH_ENGINE_API uint32_t depth_engine_abi_version(void);
+
+// Fixed variant, every pot at mid scale. NULL when out of memory.
+DEPTH_ENGINE_API depth_engine *depth_engine_create(void);
+DEPTH_ENGINE_API void depth_engine_destroy(depth_engine *engine);
+
+// Returns 0, or -1 for an unknown variant
+DEPTH_ENGINE_API int depth_engine_set_variant(depth_engine *engine, int variant);
+
+// Slider, left and right pot readings used by depth_engine_process_block()
+DEPTH_ENGINE_API void depth_engine_set_pots(depth_engine *engine, uint16_t slider, uint16_t left, uint16_t right);
+
+// volume[i] and region[i] (a DepthRegion, optional: NULL) for the CV reading
+// cv[i]. volume may be cv itself, processed in place. Returns count.
+DEPTH_ENGINE_API size_t depth_engine_process_block(depth_engine *engine, const uint16_t *cv, uint16_t *volume, uint8_t *region,
+                                                   size_t count);
+
+// Same with every input varying: the pots are read from the arrays instead
+// of the engine settings
+DEPTH_ENGINE_API size_t depth_engine_process_inputs(depth_engine *engine, const uint16_t *cv, const uint16_t *slider,
+                                                    const uint16_t *left, const uint16_t *right, uint16_t *volume,
+                                                    uint8_t *region, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
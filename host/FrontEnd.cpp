@@ -0,0 +1,123 @@
+#include "FrontEnd.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+const char *const front_end_part_names[PART_COUNT] = {
+    "R1", "R2", "R3", "R4", "R5", "R6", "R7", "R8", "C1"
+};
+
+namespace {
+
+uint32_t xorshift32(uint32_t &x)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+// SPICE value: number and optional scale suffix (6.8k, 100n, 2.2Meg)
+bool parse_spice(const std::string &text, float &value)
+{
+    char *end;
+    value = strtof(text.c_str(), &end);
+    if (end == text.c_str()) {
+        return false;
+    }
+    std::string suffix(end);
+    for (char &c : suffix) {
+        c = (char)tolower(c);
+    }
+    if (suffix.compare(0, 3, "meg") == 0) {
+        value *= 1e6f;
+        return true;
+    }
+    switch (suffix.empty() ? 0 : suffix[0]) {
+        case 0:   break;
+        case 'k': value *= 1e3f; break;
+        case 'm': value *= 1e-3f; break;
+        case 'u': value *= 1e-6f; break;
+        case 'n': value *= 1e-9f; break;
+        case 'p': value *= 1e-12f; break;
+        case 'f': value *= 1e-15f; break;
+        default:  return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool front_end_load(const char *path, FrontEndParts &parts, std::string &error)
+{
+    std::ifstream file(path);
+    if (!file) {
+        error = std::string(path) + ": cannot open";
+        return false;
+    }
+
+    // SYMATTR InstName then SYMATTR Value, after each SYMBOL line
+    bool found[PART_COUNT] = {};
+    int part = -1;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream words(line);
+        std::string keyword, attribute, value;
+        words >> keyword >> attribute >> value;
+        if (keyword == "SYMBOL") {
+            part = -1;
+        } else if (keyword == "SYMATTR" && attribute == "InstName") {
+            part = -1;
+            for (int i = 0; i < PART_COUNT; i++) {
+                if (value == front_end_part_names[i]) {
+                    part = i;
+                }
+            }
+        } else if (keyword == "SYMATTR" && attribute == "Value" && part >= 0) {
+            if (!parse_spice(value, parts.value[part]) || parts.value[part] <= 0) {
+                error = std::string(path) + ": bad value " + value + " for " + front_end_part_names[part];
+                return false;
+            }
+            found[part] = true;
+        }
+    }
+    for (int i = 0; i < PART_COUNT; i++) {
+        if (!found[i]) {
+            error = std::string(path) + ": no value for " + front_end_part_names[i];
+            return false;
+        }
+    }
+    return true;
+}
+
+FrontEndParts front_end_draw(const FrontEndParts &nominal, float tolerance, float capacitor_tolerance, uint32_t &rng)
+{
+    FrontEndParts parts;
+    for (int i = 0; i < PART_COUNT; i++) {
+        float spread = i == PART_C1 ? capacitor_tolerance : tolerance;
+        float uniform = (float)xorshift32(rng) / 4294967295.0f * 2.0f - 1.0f;
+        parts.value[i] = nominal.value[i] * (1.0f + spread * uniform);
+    }
+    return parts;
+}
+
+FrontEnd::FrontEnd(const FrontEndParts &parts, uint32_t frame_us) :
+    _adc_volts(0)
+{
+    const float *v = parts.value;
+    _positive_gain = -v[PART_R5] / v[PART_R2] + v[PART_R5] / v[PART_R4] * v[PART_R3] / v[PART_R1];
+    _negative_gain = -v[PART_R5] / v[PART_R2];
+    _divider = v[PART_R8] / (v[PART_R7] + v[PART_R8]);
+    _rc_alpha = 1.0f - expf(-(float)frame_us * 1e-6f / (v[PART_R6] * v[PART_C1]));
+}
+
+float FrontEnd::step(float cv)
+{
+    float rectified = cv * (cv > 0 ? _positive_gain : _negative_gain);
+    float target = rectified * _divider;
+    target = target < 0 ? 0 : (target > FRONT_END_VREF ? FRONT_END_VREF : target);
+    _adc_volts += (target - _adc_volts) * _rc_alpha;
+    return _adc_volts;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// CV input front end of the module (Documentation/cv_input_to_adc.png), with
+// the component values of an LTspice schematic (.asc) so that each simulated
+// module can get its own tolerances:
+//
+//   U1, R1, R3, D1, D2   inverting half-wave rectifier, -R3/R1 for CV > 0
+//   U2, R2, R4, R5       summing amplifier: -(R5/R2 CV + R5/R4 half wave),
+//                        |CV| with matched resistors
+//   R7, R8, U4           divider to the 3.3 V range, buffered
+//   R6, C1, D3, D4       anti-aliasing RC, clamped to the supplies
+//
+// Op amps and diodes are ideal.
+
+#include <cstdint>
+#include <string>
+
+#define FRONT_END_VREF              3.3f
+#define FRONT_END_CV_MIN            -10.0f  // CV of scenario value 0
+#define FRONT_END_CV_MAX            10.0f   // of 65535
+
+enum FrontEndPart {
+    PART_R1,
+    PART_R2,
+    PART_R3,
+    PART_R4,
+    PART_R5,
+    PART_R6,
+    PART_R7,
+    PART_R8,
+    PART_C1,
+    PART_COUNT
+};
+
+extern const char *const front_end_part_names[PART_COUNT];
+
+// Ohms and farads
+struct FrontEndParts {
+    float value[PART_COUNT];
+};
+
+// Reads the parts from the schematic. Returns false and fills error when the
+// file cannot be read or a part is missing.
+bool front_end_load(const char *path, FrontEndParts &parts, std::string &error);
+
+// Each part drawn uniformly within +/- tolerance (0.01 for 1%) of nominal,
+// capacitors within capacitor_tolerance
+FrontEndParts front_end_draw(const FrontEndParts &nominal, float tolerance, float capacitor_tolerance, uint32_t &rng);
+
+class FrontEnd {
+public:
+    FrontEnd(const FrontEndParts &parts, uint32_t frame_us);
+
+    // ADC pin voltage after one frame with this CV, in volts
+    float step(float cv);
+
+private:
+    float _positive_gain;   // rectifier output / CV for CV > 0
+    float _negative_gain;   // for CV < 0
+    float _divider;
+    float _rc_alpha;        // RC filter update per frame
+    float _adc_volts;
+};
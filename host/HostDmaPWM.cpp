@@ -0,0 +1,92 @@
+// Host side of DmaPWM.h: a Ticker plays the DMA, one pattern word written to
+// the pins per step, and the half transfer / transfer complete events at the
+// middle and the end of the buffer
+
+#include "DmaPWM.h"
+
+namespace {
+
+struct HostDma {
+    PwmPattern<DMA_PWM_STEPS> pattern;
+    DigitalOut               *pins[PWM_PATTERN_PINS];
+    int                       port;
+    uint32_t                  period_us;
+    uint32_t                  cursor;
+    Ticker                    ticker;
+};
+
+// Function local: DmaPWM globals are constructed during static init
+HostDma &host_dma()
+{
+    static HostDma dma{{}, {}, -1, DMA_PWM_DEFAULT_PERIOD_US, 0, {}};
+    return dma;
+}
+
+void dma_step()
+{
+    HostDma &dma = host_dma();
+    uint32_t word = dma.pattern.words()[dma.cursor];
+    for (uint8_t pin = 0; pin < PWM_PATTERN_PINS; pin++) {
+        if (word & (1u << pin)) {
+            dma.pins[pin]->write(1);
+        } else if (word & (1u << (pin + 16))) {
+            dma.pins[pin]->write(0);
+        }
+    }
+    if (++dma.cursor == DMA_PWM_STEPS / 2) {
+        dma.pattern.half_done(0);
+    } else if (dma.cursor == DMA_PWM_STEPS) {
+        dma.cursor = 0;
+        dma.pattern.half_done(1);
+    }
+}
+
+// Whole microseconds per step: 10 ms periods run at 9.984 ms
+void start_ticker()
+{
+    HostDma &dma = host_dma();
+    uint32_t step_us = dma.period_us / DMA_PWM_STEPS;
+    dma.ticker.attach_us(dma_step, step_us ? step_us : 1);
+}
+
+} // namespace
+
+DmaPWM::DmaPWM(PinName pin, bool positive) :
+    _pin(pin, positive ? 0 : 1),
+    _bit(pin & 0x0F)
+{
+    HostDma &dma = host_dma();
+    if (dma.port >= 0 && dma.port != (pin >> 4)) {
+        fprintf(stderr, "DmaPWM: pin 0x%02X is not on the port of the others\n", pin);
+        return;
+    }
+    dma.pins[_bit] = &_pin;
+    dma.pattern.add_pin(_bit, !positive);
+    if (dma.port < 0) {
+        dma.port = pin >> 4;
+        dma.pattern.fill();
+        start_ticker();
+    }
+}
+
+void DmaPWM::write(float duty)
+{
+    duty = duty < 0.0f ? 0.0f : (duty > 1.0f ? 1.0f : duty);
+    host_dma().pattern.set_duty(_bit, (uint32_t)(duty * DMA_PWM_STEPS + 0.5f));
+}
+
+float DmaPWM::read()
+{
+    return (float)host_dma().pattern.duty(_bit) / DMA_PWM_STEPS;
+}
+
+void DmaPWM::period_ms(int period)
+{
+    period_us(period * 1000);
+}
+
+void DmaPWM::period_us(int period)
+{
+    host_dma().period_us = period;
+    start_ticker();
+}
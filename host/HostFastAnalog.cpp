@@ -0,0 +1,32 @@
+// Host side of FastAnalog.h: the shim converters have no lock to bypass
+
+#include "FastAnalog.h"
+
+FastAnalogIn::FastAnalogIn(PinName pin) :
+    _analog(pin),
+    _adc(nullptr),
+    _channel(0)
+{
+}
+
+uint16_t FastAnalogIn::read_u16()
+{
+    return _analog.read_u16();
+}
+
+FastAnalogOut::FastAnalogOut(PinName pin) :
+    _analog(pin),
+    _dac(nullptr),
+    _channel(0)
+{
+}
+
+void FastAnalogOut::write_u16(uint16_t value)
+{
+    _analog.write_u16(value);
+}
+
+float FastAnalogOut::read()
+{
+    return _analog.read();
+}
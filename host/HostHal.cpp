@@ -0,0 +1,573 @@
+#include "HostHal.h"
+#include "TimingWheel.h"
+
+#include <setjmp.h>
+#include <ucontext.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+// Firmware stacks are sized for the target, printf on the host needs more
+#define HOST_FIBER_STACK_MIN        (64 * 1024)
+
+// Wakes up like a Timeout: the handler switches to the fiber. The first
+// switch goes through swapcontext() onto the new stack, the others through
+// _setjmp()/_longjmp(), that do not save the signal mask with a system call.
+struct HostFiber : mbed::HostTimer {
+    ucontext_t             context;
+    jmp_buf                jump;
+    std::vector<uint8_t>   stack;
+    mbed::Callback<void()> task;
+    bool                   started;
+    bool                   finished;
+};
+
+namespace {
+
+struct HostPin {
+    uint16_t analog_in;
+    uint16_t analog_out;
+    int      digital_in;
+    int      digital_out;
+    uint32_t digital_writes;
+    bool     driven;
+    PinMode  pull;
+    uint32_t pwm_period_us; // 0 without PwmOut
+    uint32_t pwm_pulse_us;
+    uint64_t pwm_start_us;
+};
+
+HostPin pins[HOST_PIN_COUNT];
+
+HostPin &pin_state(PinName pin)
+{
+    static HostPin unconnected;
+    if (pin < 0 || pin >= HOST_PIN_COUNT) {
+        return unconnected;
+    }
+    return pins[pin];
+}
+
+std::atomic<uint64_t> now_us(0);
+
+// Function local: the firmware globals attach their timers during static init
+TimingWheel &timer_wheel()
+{
+    static TimingWheel wheel;
+    return wheel;
+}
+
+// Context of the simulator, that the fibers switch back to when they sleep
+ucontext_t scheduler_context;
+jmp_buf scheduler_jump;
+
+// Fiber running, nullptr on the simulator's own stack
+HostFiber *current_fiber = nullptr;
+
+void timer_queue(HostTimer *timer)
+{
+    timer_wheel().insert(timer);
+}
+
+void timer_dequeue(HostTimer *timer)
+{
+    timer_wheel().remove(timer);
+}
+
+void fiber_entry()
+{
+    HostFiber *fiber = current_fiber;
+    fiber->task();
+    fiber->finished = true;
+    _longjmp(scheduler_jump, 1);
+}
+
+// Runs the fiber until it sleeps or returns
+void fiber_resume(HostFiber *fiber)
+{
+    current_fiber = fiber;
+    if (!_setjmp(scheduler_jump)) {
+        if (fiber->started) {
+            _longjmp(fiber->jump, 1);
+        }
+        fiber->started = true;
+        swapcontext(&scheduler_context, &fiber->context);
+    }
+    current_fiber = nullptr;
+    if (fiber->finished) {
+        std::vector<uint8_t>().swap(fiber->stack);
+    }
+}
+
+struct HostWatchdog {
+    HostTimer timer;
+    uint32_t  resets;
+    uint64_t  reset_us;
+};
+
+// Function local: the firmware globals may start the watchdog during static init
+HostWatchdog &host_watchdog()
+{
+    static HostWatchdog watchdog{};
+    return watchdog;
+}
+
+mbed_error_hook_t error_hook;
+
+void watchdog_expired()
+{
+    HostWatchdog &watchdog = host_watchdog();
+    watchdog.resets++;
+    watchdog.reset_us = now_us.load();
+    Watchdog::get_instance().stop();
+}
+
+} // namespace
+
+uint64_t host_time_us()
+{
+    return now_us.load();
+}
+
+void host_advance_us(uint64_t us)
+{
+    uint64_t target = now_us.load() + us;
+    while (TimingWheelNode *node = timer_wheel().expire(target)) {
+        HostTimer *timer = static_cast<HostTimer *>(node);
+        now_us.store(timer_wheel().now());
+        if (timer->period_us) {
+            timer->due_us += timer->period_us;
+            timer_queue(timer);
+        }
+        // The handler may attach its own timer again
+        Callback<void()> handler = timer->handler;
+        handler();
+    }
+    now_us.store(target);
+}
+
+uint32_t host_cycle_count()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void host_analog_set(PinName pin, uint16_t value)
+{
+    pin_state(pin).analog_in = value;
+}
+
+void host_digital_set(PinName pin, int value)
+{
+    pin_state(pin).digital_in = value;
+    pin_state(pin).driven = true;
+}
+
+uint16_t host_analog_output(PinName pin)
+{
+    return pin_state(pin).analog_out;
+}
+
+int host_digital_output(PinName pin)
+{
+    HostPin &state = pin_state(pin);
+    if (state.pwm_period_us) {
+        return (now_us.load() - state.pwm_start_us) % state.pwm_period_us < state.pwm_pulse_us;
+    }
+    return state.digital_out;
+}
+
+uint32_t host_digital_writes(PinName pin)
+{
+    return pin_state(pin).digital_writes;
+}
+
+mbed_error_status_t mbed_error(mbed_error_status_t error_status, const char *, unsigned int error_value, const char *, int)
+{
+    if (error_hook) {
+        mbed_error_ctx context{error_status, 0, error_value};
+        error_hook(&context);
+    }
+    return error_status;
+}
+
+mbed_error_status_t mbed_warning(mbed_error_status_t error_status, const char *error_msg, unsigned int error_value, const char *filename, int line_number)
+{
+    return mbed_error(error_status, error_msg, error_value, filename, line_number);
+}
+
+mbed_error_status_t mbed_set_error_hook(mbed_error_hook_t custom_error_hook)
+{
+    error_hook = custom_error_hook;
+    return MBED_SUCCESS;
+}
+
+uint32_t host_watchdog_resets()
+{
+    return host_watchdog().resets;
+}
+
+uint64_t host_watchdog_reset_us()
+{
+    return host_watchdog().reset_us;
+}
+
+// Peripheral: timer, function: channel. As mbed's NUCLEO_L432KC
+// PeripheralPins.c: no TIM2 channel, TIM2 being the us_ticker timer, so PA_1
+// to PA_3 get their TIM15 channels and PA_0, PA_5, PA_15 and PB_3 (LED1) none.
+const PinMap PinMap_PWM[] = {
+    {PA_1,  PWM_15, 1}, // TIM15_CH1N
+    {PA_2,  PWM_15, 1}, // TIM15_CH1
+    {PA_3,  PWM_15, 2}, // TIM15_CH2
+    {PA_6,  PWM_16, 1}, // TIM16_CH1
+    {PA_7,  PWM_1,  1}, // TIM1_CH1N
+    {PA_8,  PWM_1,  1}, // TIM1_CH1
+    {PA_9,  PWM_1,  2}, // TIM1_CH2
+    {PA_10, PWM_1,  3}, // TIM1_CH3
+    {PA_11, PWM_1,  4}, // TIM1_CH4
+    {PB_0,  PWM_1,  2}, // TIM1_CH2N
+    {PB_1,  PWM_1,  3}, // TIM1_CH3N
+    {PB_6,  PWM_16, 1}, // TIM16_CH1N
+    {NC,    0,      0}
+};
+
+uint32_t pinmap_find_peripheral(PinName pin, const PinMap *map)
+{
+    for (; map->pin != NC; map++) {
+        if (map->pin == pin) {
+            return (uint32_t)map->peripheral;
+        }
+    }
+    return (uint32_t)NC;
+}
+
+namespace mbed {
+
+AnalogIn::AnalogIn(PinName pin) :
+    _pin(pin)
+{
+}
+
+uint16_t AnalogIn::read_u16()
+{
+    // 12 bit converter, scaled like the STM32 HAL does
+    uint16_t value = pin_state(_pin).analog_in >> 4;
+    return (value << 4) | (value >> 8);
+}
+
+float AnalogIn::read()
+{
+    return (float)(pin_state(_pin).analog_in >> 4) / 4095.0f;
+}
+
+AnalogOut::AnalogOut(PinName pin) :
+    _pin(pin)
+{
+}
+
+void AnalogOut::write_u16(uint16_t value)
+{
+    pin_state(_pin).analog_out = value & 0xFFF0;
+}
+
+void AnalogOut::write(float value)
+{
+    if (value < 0.0f) {
+        value = 0.0f;
+    }
+    if (value > 1.0f) {
+        value = 1.0f;
+    }
+    write_u16((uint16_t)(value * 65535.0f));
+}
+
+float AnalogOut::read()
+{
+    return (float)(pin_state(_pin).analog_out >> 4) / 4095.0f;
+}
+
+DigitalIn::DigitalIn(PinName pin) :
+    _pin(pin)
+{
+}
+
+void DigitalIn::mode(PinMode pull)
+{
+    pin_state(_pin).pull = pull;
+}
+
+int DigitalIn::read()
+{
+    HostPin &state = pin_state(_pin);
+    if (!state.driven) {
+        return state.pull == PullUp;
+    }
+    return state.digital_in;
+}
+
+DigitalOut::DigitalOut(PinName pin, int value) :
+    _pin(pin)
+{
+    write(value);
+}
+
+void DigitalOut::write(int value)
+{
+    pin_state(_pin).digital_out = value;
+    pin_state(_pin).digital_writes++;
+}
+
+int DigitalOut::read()
+{
+    return pin_state(_pin).digital_out;
+}
+
+// Counter restarted on period changes, duty kept, like the STM32 HAL does
+PwmOut::PwmOut(PinName pin) :
+    _pin(pin)
+{
+    HostPin &state = pin_state(_pin);
+    state.pwm_period_us = 20000;
+    state.pwm_pulse_us = 0;
+    state.pwm_start_us = now_us.load();
+}
+
+void PwmOut::write(float value)
+{
+    if (value < 0.0f) {
+        value = 0.0f;
+    }
+    if (value > 1.0f) {
+        value = 1.0f;
+    }
+    HostPin &state = pin_state(_pin);
+    state.pwm_pulse_us = (uint32_t)(state.pwm_period_us * value + 0.5f);
+}
+
+float PwmOut::read()
+{
+    HostPin &state = pin_state(_pin);
+    return (float)state.pwm_pulse_us / state.pwm_period_us;
+}
+
+void PwmOut::period(float seconds)
+{
+    period_us((int)(seconds * 1000000.0f));
+}
+
+void PwmOut::period_ms(int ms)
+{
+    period_us(ms * 1000);
+}
+
+void PwmOut::period_us(int us)
+{
+    float duty = read();
+    HostPin &state = pin_state(_pin);
+    state.pwm_period_us = us > 0 ? us : 1;
+    state.pwm_start_us = now_us.load();
+    write(duty);
+}
+
+void PwmOut::pulsewidth(float seconds)
+{
+    pulsewidth_us((int)(seconds * 1000000.0f));
+}
+
+void PwmOut::pulsewidth_ms(int ms)
+{
+    pulsewidth_us(ms * 1000);
+}
+
+void PwmOut::pulsewidth_us(int us)
+{
+    HostPin &state = pin_state(_pin);
+    state.pwm_pulse_us = std::min<uint32_t>(us > 0 ? us : 0, state.pwm_period_us);
+}
+
+Ticker::Ticker() :
+    _one_shot(false),
+    _timer()
+{
+}
+
+Ticker::~Ticker()
+{
+    detach();
+}
+
+void Ticker::attach(Callback<void()> func, float t)
+{
+    attach_us(func, (uint64_t)(t * 1000000.0f));
+}
+
+void Ticker::attach(Callback<void()> func, std::chrono::microseconds t)
+{
+    attach_us(func, t.count());
+}
+
+void Ticker::attach_us(Callback<void()> func, uint64_t t)
+{
+    timer_dequeue(&_timer);
+    if (t == 0) {
+        t = 1;
+    }
+    _timer.handler = func;
+    _timer.due_us = now_us.load() + t;
+    _timer.period_us = _one_shot ? 0 : t;
+    timer_queue(&_timer);
+}
+
+void Ticker::detach()
+{
+    timer_dequeue(&_timer);
+}
+
+Timeout::Timeout()
+{
+    _one_shot = true;
+}
+
+Watchdog &Watchdog::get_instance()
+{
+    static Watchdog instance;
+    return instance;
+}
+
+Watchdog::Watchdog() :
+    _timeout(0),
+    _running(false)
+{
+}
+
+bool Watchdog::start(uint32_t timeout)
+{
+    _timeout = timeout;
+    _running = true;
+    kick();
+    return true;
+}
+
+bool Watchdog::stop()
+{
+    _running = false;
+    timer_dequeue(&host_watchdog().timer);
+    return true;
+}
+
+void Watchdog::kick()
+{
+    if (!_running) {
+        return;
+    }
+    HostTimer &timer = host_watchdog().timer;
+    timer_dequeue(&timer);
+    timer.handler = watchdog_expired;
+    timer.due_us = now_us.load() + (uint64_t)_timeout * 1000;
+    timer.period_us = 0;
+    timer_queue(&timer);
+}
+
+uint32_t Watchdog::get_timeout() const
+{
+    return _timeout;
+}
+
+bool Watchdog::is_running() const
+{
+    return _running;
+}
+
+reset_reason_t ResetReason::get()
+{
+    return host_watchdog().resets ? RESET_REASON_WATCHDOG : RESET_REASON_POWER_ON;
+}
+
+uint32_t ResetReason::get_raw()
+{
+    return get();
+}
+
+ssize_t FileHandle::write(const void *buffer, size_t size)
+{
+    fflush(stdout);
+    return (ssize_t)fwrite(buffer, 1, size, stdout);
+}
+
+FileHandle *mbed_file_handle(int fd)
+{
+    static FileHandle console;
+    return fd == STDOUT_FILENO ? &console : nullptr;
+}
+
+} // namespace mbed
+
+namespace rtos {
+
+Thread::Thread(osPriority, uint32_t stack_size, unsigned char *, const char *) :
+    _stack_size(stack_size),
+    _fiber(nullptr)
+{
+}
+
+// The fiber first runs at the next clock advance, after its creator
+osStatus Thread::start(mbed::Callback<void()> task)
+{
+    if (_fiber) {
+        return -1;
+    }
+    _fiber = new HostFiber();
+    _fiber->task = task;
+    _fiber->stack.resize(std::max<uint32_t>(_stack_size, HOST_FIBER_STACK_MIN));
+    getcontext(&_fiber->context);
+    _fiber->context.uc_stack.ss_sp = _fiber->stack.data();
+    _fiber->context.uc_stack.ss_size = _fiber->stack.size();
+    _fiber->context.uc_link = nullptr;
+    makecontext(&_fiber->context, fiber_entry, 0);
+
+    HostFiber *fiber = _fiber;
+    fiber->handler = [fiber]() {
+        fiber_resume(fiber);
+    };
+    fiber->due_us = now_us.load();
+    timer_queue(fiber);
+    return osOK;
+}
+
+void ThisThread::sleep_for(std::chrono::milliseconds rel_time)
+{
+    sleep_until(now_us.load() + rel_time.count() * 1000);
+}
+
+// From a fiber, switches back to the simulator until the wake-up time. From
+// the simulator itself, advances the clock.
+void ThisThread::sleep_until(uint64_t abs_time_us)
+{
+    uint64_t now = now_us.load();
+    if (abs_time_us <= now) {
+        return;
+    }
+    HostFiber *fiber = current_fiber;
+    if (!fiber) {
+        host_advance_us(abs_time_us - now);
+        return;
+    }
+    fiber->due_us = abs_time_us;
+    timer_queue(fiber);
+    if (!_setjmp(fiber->jump)) {
+        _longjmp(scheduler_jump, 1);
+    }
+}
+
+} // namespace rtos
+
+uint32_t us_ticker_read(void)
+{
+    return (uint32_t)now_us.load();
+}
+
+// Busy wait of the firmware: nothing to wait for on the virtual clock
+void wait_us(int)
+{
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+// Simulator side of the host shim: drive the pins and the virtual clock seen
+// by the firmware through mbed.h.
+
+#include "mbed.h"
+
+// Virtual time, in microseconds since the start of the simulation
+uint64_t host_time_us();
+
+// Advance the virtual clock, running the Ticker/Timeout handlers that fall due
+// and the threads whose sleep ends, in time order, on the calling thread
+void host_advance_us(uint64_t us);
+
+// Free running nanosecond counter, the host stand-in for the DWT cycle counter
+uint32_t host_cycle_count();
+
+// Value read by AnalogIn / DigitalIn on a pin
+void host_analog_set(PinName pin, uint16_t value);
+void host_digital_set(PinName pin, int value);
+
+// Last value written by AnalogOut / DigitalOut on a pin, level of a PwmOut
+uint16_t host_analog_output(PinName pin);
+int host_digital_output(PinName pin);
+
+// DigitalOut writes to a pin since the start, the interrupt handler load of a
+// software PWM
+uint32_t host_digital_writes(PinName pin);
+
+// Watchdog resets since the start and the time of the last one. The firmware
+// keeps running on the host: the simulator ends the run.
+uint32_t host_watchdog_resets();
+uint64_t host_watchdog_reset_us();
+
+// File descriptor of the stereo link (LinkSerial.h), a socket or a pty to
+// the other instance. Unset, frames are dropped and nothing is received.
+void host_link_fd(int fd);
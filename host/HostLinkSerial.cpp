@@ -0,0 +1,56 @@
+// Host side of LinkSerial.h: the link is a file descriptor set by
+// host_link_fd(), a socket or a pty to the other instance, read and written
+// without blocking. A frame keeps the line busy for its wire time on the
+// virtual clock.
+
+#include "LinkSerial.h"
+#include "HostHal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+int link_fd = -1;
+uint32_t link_byte_us = 0;
+uint64_t link_busy_until_us = 0;
+
+} // namespace
+
+void host_link_fd(int fd)
+{
+    link_fd = fd;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+LinkSerial::LinkSerial(PinName tx, PinName rx, int baud) :
+    _tail(0),
+    _rx(),
+    _tx()
+{
+    (void)tx;
+    (void)rx;
+    link_byte_us = 10 * 1000000 / baud;
+}
+
+bool LinkSerial::send(const uint8_t *bytes, uint32_t length)
+{
+    uint64_t now = host_time_us();
+    if (now < link_busy_until_us) {
+        return false;
+    }
+    link_busy_until_us = now + length * link_byte_us;
+    if (link_fd >= 0 && write(link_fd, bytes, length) < 0) {
+        return false;
+    }
+    return true;
+}
+
+uint32_t LinkSerial::receive(uint8_t *bytes, uint32_t max)
+{
+    if (link_fd < 0) {
+        return 0;
+    }
+    ssize_t count = read(link_fd, bytes, max);
+    return count > 0 ? (uint32_t)count : 0;
+}
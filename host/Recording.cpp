@@ -0,0 +1,558 @@
+#include "Recording.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char file_magic[4] = {'D', 'R', 'E', 'C'};
+const uint32_t chunk_magic = 0x4B4E4843;    // "CHNK"
+const uint32_t index_magic = 0x58444944;    // "DIDX"
+const uint32_t trailer_magic = 0x444E4544;  // "DEND"
+
+struct FileHeader {
+    char     magic[4];
+    uint16_t version;
+    uint16_t field_count;
+    uint32_t frame_size;
+    uint32_t reserved;
+};
+
+struct ChunkHeader {
+    uint32_t magic;
+    uint8_t  kind;
+    uint8_t  reserved[3];
+    uint32_t frames;
+    uint32_t bytes;         // payload, without the padding
+    uint64_t first_time_us;
+    uint64_t last_time_us;
+    uint64_t first_frame;
+    uint32_t payload_crc;
+    uint32_t header_crc;    // of the header up to here
+};
+
+struct IndexHeader {
+    uint32_t magic;
+    uint32_t chunks;
+    uint64_t frames;
+};
+
+struct Trailer {
+    uint64_t index_offset;
+    uint32_t magic;
+    uint32_t crc;           // of the index header, the entries and index_offset
+};
+
+static_assert(sizeof(FileHeader) % 8 == 0 && sizeof(ChunkHeader) % 8 == 0 && sizeof(IndexHeader) % 8 == 0,
+              "headers keep the payloads 8 byte aligned");
+
+// CRC-32 (IEEE), slicing by 8
+struct Crc32Tables {
+    uint32_t table[8][256];
+
+    Crc32Tables()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int slice = 1; slice < 8; slice++) {
+                table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+const Crc32Tables crc_tables;
+
+uint32_t crc32(const void *data, size_t length, uint32_t crc = 0)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    const uint32_t (*t)[256] = crc_tables.table;
+    crc = ~crc;
+    while (length >= 8) {
+        uint32_t low, high;
+        memcpy(&low, bytes, 4);
+        memcpy(&high, bytes + 4, 4);
+        low ^= crc;
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+              ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        bytes += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *bytes++) & 0xFF];
+    }
+    return ~crc;
+}
+
+uint64_t padded(uint64_t bytes)
+{
+    return (bytes + 7) & ~(uint64_t)7;
+}
+
+bool write_all(int fd, const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    while (length) {
+        ssize_t count = ::write(fd, bytes, length);
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        length -= (size_t)count;
+    }
+    return true;
+}
+
+bool valid_file_header(const uint8_t *data, size_t size)
+{
+    FileHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    return memcmp(header.magic, file_magic, 4) == 0 && header.version == RECORDING_VERSION
+           && header.field_count == TELEMETRY_FIELD_COUNT && header.frame_size == sizeof(RecordingFrame);
+}
+
+// Chunk header at offset if it is complete and consistent, payload CRC aside
+bool read_chunk_header(const uint8_t *data, size_t size, uint64_t offset, ChunkHeader &header)
+{
+    if (offset + sizeof(header) > size) {
+        return false;
+    }
+    memcpy(&header, data + offset, sizeof(header));
+    return header.magic == chunk_magic && header.header_crc == crc32(&header, offsetof(ChunkHeader, header_crc))
+           && (header.kind == RECORDING_RAW || header.kind == RECORDING_DELTA)
+           && header.frames > 0 && header.frames <= RECORDING_CHUNK_FRAMES
+           && (header.kind != RECORDING_RAW || header.bytes == header.frames * sizeof(RecordingFrame))
+           && offset + sizeof(header) + padded(header.bytes) <= size;
+}
+
+// Chunks from the start of the file up to the first incomplete or damaged one
+std::vector<RecordingIndexEntry> scan_chunks(const uint8_t *data, size_t size, bool check_payload, uint64_t &end, uint64_t &frames)
+{
+    std::vector<RecordingIndexEntry> index;
+    end = sizeof(FileHeader);
+    frames = 0;
+    ChunkHeader header;
+    while (read_chunk_header(data, size, end, header) && header.first_frame == frames) {
+        if (check_payload && crc32(data + end + sizeof(header), header.bytes) != header.payload_crc) {
+            break;
+        }
+        index.push_back(RecordingIndexEntry{header.first_time_us, header.first_frame, end});
+        end += sizeof(header) + padded(header.bytes);
+        frames += header.frames;
+    }
+    return index;
+}
+
+// Decodes a delta chunk, times unwrapped from the chunk's first time
+bool decode_delta(const uint8_t *payload, uint32_t bytes, uint32_t frames, uint64_t first_time_us, std::vector<RecordingFrame> &out)
+{
+    out.clear();
+    out.reserve(frames);
+    TelemetryDecoder decoder;
+    TelemetrySnapshot snapshot;
+    uint64_t time_us = first_time_us;
+    for (uint32_t i = 0; i < bytes; i++) {
+        if (!decoder.feed(payload[i], snapshot)) {
+            continue;
+        }
+        RecordingFrame frame{};
+        telemetry_to_fields(snapshot, frame.fields);
+        time_us += (uint32_t)(snapshot.time_us - (uint32_t)time_us);
+        frame.time_us = time_us;
+        out.push_back(frame);
+    }
+    return out.size() == frames && decoder.errors() == 0 && decoder.skipped() == 0;
+}
+
+} // namespace
+
+uint64_t recording_raw_chunk_offset(uint64_t chunk)
+{
+    return sizeof(FileHeader) + chunk * (sizeof(ChunkHeader) + padded(RECORDING_CHUNK_FRAMES * sizeof(RecordingFrame)));
+}
+
+RecordingWriter::RecordingWriter() :
+    _fd(-1),
+    _kind(RECORDING_RAW),
+    _offset(0),
+    _frames(0),
+    _time_us(0),
+    _have_time(false)
+{
+}
+
+RecordingWriter::~RecordingWriter()
+{
+    close();
+}
+
+bool RecordingWriter::open(const std::string &path, RecordingChunkKind kind, bool append, std::string &error)
+{
+    close();
+    _kind = kind;
+    _frames = 0;
+    _have_time = false;
+    _index.clear();
+    _pending.clear();
+    _pending.reserve(RECORDING_CHUNK_FRAMES);
+
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+    if (_fd < 0) {
+        error = path + ": cannot open for writing";
+        return false;
+    }
+
+    struct stat info;
+    fstat(_fd, &info);
+    if (append && info.st_size > 0) {
+        // Keeps the complete chunks, drops a partial one and the old index
+        void *map = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, _fd, 0);
+        if (map == MAP_FAILED || !valid_file_header((const uint8_t *)map, (size_t)info.st_size)) {
+            if (map != MAP_FAILED) {
+                munmap(map, (size_t)info.st_size);
+            }
+            error = path + ": not a recording of this version";
+            ::close(_fd);
+            _fd = -1;
+            return false;
+        }
+        const uint8_t *data = (const uint8_t *)map;
+        _index = scan_chunks(data, (size_t)info.st_size, true, _offset, _frames);
+        bool same_kind = true;
+        ChunkHeader chunk;
+        for (const RecordingIndexEntry &entry : _index) {
+            memcpy(&chunk, data + entry.offset, sizeof(chunk));
+            same_kind &= chunk.kind == kind;
+        }
+        if (!_index.empty()) {
+            _time_us = chunk.last_time_us;
+            _have_time = true;
+        }
+        munmap(map, (size_t)info.st_size);
+        if (!same_kind) {
+            error = path + ": chunks of another kind";
+        } else if (ftruncate(_fd, (off_t)_offset) != 0 || lseek(_fd, (off_t)_offset, SEEK_SET) < 0) {
+            error = path + ": cannot truncate";
+        } else {
+            return true;
+        }
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    FileHeader header{};
+    memcpy(header.magic, file_magic, 4);
+    header.version = RECORDING_VERSION;
+    header.field_count = TELEMETRY_FIELD_COUNT;
+    header.frame_size = sizeof(RecordingFrame);
+    if (!write_all(_fd, &header, sizeof(header))) {
+        error = path + ": cannot write";
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+    _offset = sizeof(header);
+    return true;
+}
+
+bool RecordingWriter::write(const TelemetrySnapshot &snapshot)
+{
+    if (_fd < 0) {
+        return false;
+    }
+    if (_have_time) {
+        _time_us += (uint32_t)(snapshot.time_us - (uint32_t)_time_us);
+    } else {
+        _time_us = snapshot.time_us;
+        _have_time = true;
+    }
+
+    RecordingFrame frame{};
+    frame.time_us = _time_us;
+    telemetry_to_fields(snapshot, frame.fields);
+    _pending.push_back(frame);
+    return _pending.size() < RECORDING_CHUNK_FRAMES || flush_chunk();
+}
+
+bool RecordingWriter::flush_chunk()
+{
+    if (_pending.empty()) {
+        return true;
+    }
+
+    std::vector<uint8_t> payload;
+    if (_kind == RECORDING_RAW) {
+        const uint8_t *frames = (const uint8_t *)_pending.data();
+        payload.assign(frames, frames + _pending.size() * sizeof(RecordingFrame));
+    } else {
+        // A new encoder per chunk: each chunk starts on a keyframe
+        TelemetryEncoder encoder;
+        uint8_t frame[TELEMETRY_FRAME_MAX];
+        for (const RecordingFrame &pending : _pending) {
+            TelemetrySnapshot snapshot;
+            telemetry_from_fields(pending.fields, snapshot);
+            uint32_t length = encoder.encode(snapshot, frame);
+            payload.insert(payload.end(), frame, frame + length);
+        }
+    }
+
+    ChunkHeader header{};
+    header.magic = chunk_magic;
+    header.kind = _kind;
+    header.frames = (uint32_t)_pending.size();
+    header.bytes = (uint32_t)payload.size();
+    header.first_time_us = _pending.front().time_us;
+    header.last_time_us = _pending.back().time_us;
+    header.first_frame = _frames;
+    header.payload_crc = crc32(payload.data(), payload.size());
+    header.header_crc = crc32(&header, offsetof(ChunkHeader, header_crc));
+    payload.resize(padded(payload.size()));
+
+    // Header and payload in one write: a crash leaves a partial chunk at
+    // most, which the readers ignore
+    std::vector<uint8_t> chunk(sizeof(header) + payload.size());
+    memcpy(chunk.data(), &header, sizeof(header));
+    memcpy(chunk.data() + sizeof(header), payload.data(), payload.size());
+    if (!write_all(_fd, chunk.data(), chunk.size())) {
+        return false;
+    }
+
+    _index.push_back(RecordingIndexEntry{header.first_time_us, header.first_frame, _offset});
+    _offset += chunk.size();
+    _frames += _pending.size();
+    _pending.clear();
+    return true;
+}
+
+bool RecordingWriter::close()
+{
+    if (_fd < 0) {
+        return true;
+    }
+    bool ok = flush_chunk();
+
+    IndexHeader index{index_magic, (uint32_t)_index.size(), _frames};
+    Trailer trailer{_offset, trailer_magic, 0};
+    uint32_t crc = crc32(&index, sizeof(index));
+    crc = crc32(_index.data(), _index.size() * sizeof(RecordingIndexEntry), crc);
+    trailer.crc = crc32(&trailer.index_offset, sizeof(trailer.index_offset), crc);
+    ok = ok && write_all(_fd, &index, sizeof(index))
+         && write_all(_fd, _index.data(), _index.size() * sizeof(RecordingIndexEntry))
+         && write_all(_fd, &trailer, sizeof(trailer));
+
+    ok = ::close(_fd) == 0 && ok;
+    _fd = -1;
+    return ok;
+}
+
+RecordingReader::RecordingReader() :
+    _map(nullptr),
+    _size(0),
+    _frames(0),
+    _indexed(false),
+    _decoded_chunk(SIZE_MAX)
+{
+}
+
+RecordingReader::~RecordingReader()
+{
+    close();
+}
+
+void RecordingReader::close()
+{
+    if (_map) {
+        munmap((void *)_map, _size);
+    }
+    _map = nullptr;
+    _size = 0;
+    _frames = 0;
+    _index.clear();
+    _chunks.clear();
+    _decoded_chunk = SIZE_MAX;
+    _decoded.clear();
+}
+
+bool RecordingReader::open(const std::string &path, std::string &error)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = path + ": cannot open";
+        return false;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    _size = (size_t)info.st_size;
+    void *map = _size ? mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (map == MAP_FAILED || !valid_file_header((const uint8_t *)map, _size)) {
+        if (map != MAP_FAILED) {
+            munmap(map, _size);
+        }
+        _size = 0;
+        error = path + ": not a recording of this version";
+        return false;
+    }
+    _map = (const uint8_t *)map;
+
+    // The index of a cleanly closed file, else a walk of the chunk headers
+    _indexed = false;
+    Trailer trailer;
+    if (_size >= sizeof(FileHeader) + sizeof(IndexHeader) + sizeof(trailer)) {
+        memcpy(&trailer, _map + _size - sizeof(trailer), sizeof(trailer));
+        IndexHeader index;
+        if (trailer.magic == trailer_magic && trailer.index_offset >= sizeof(FileHeader)
+            && trailer.index_offset + sizeof(index) + sizeof(trailer) <= _size) {
+            memcpy(&index, _map + trailer.index_offset, sizeof(index));
+            uint64_t entries_size = (uint64_t)index.chunks * sizeof(RecordingIndexEntry);
+            if (index.magic == index_magic && trailer.index_offset + sizeof(index) + entries_size + sizeof(trailer) == _size) {
+                const uint8_t *entries = _map + trailer.index_offset + sizeof(index);
+                uint32_t crc = crc32(&index, sizeof(index));
+                crc = crc32(entries, entries_size, crc);
+                if (crc32(&trailer.index_offset, sizeof(trailer.index_offset), crc) == trailer.crc) {
+                    _index.resize(index.chunks);
+                    memcpy(_index.data(), entries, entries_size);
+                    _frames = index.frames;
+                    _indexed = true;
+                }
+            }
+        }
+    }
+    if (!_indexed) {
+        uint64_t end;
+        _index = scan_chunks(_map, _size, false, end, _frames);
+    }
+
+    // Chunk headers are read here, the payloads on first access
+    _chunks.resize(_index.size());
+    for (size_t i = 0; i < _index.size(); i++) {
+        ChunkHeader header;
+        Chunk &chunk = _chunks[i];
+        if (!read_chunk_header(_map, _size, _index[i].offset, header) || header.first_frame != _index[i].first_frame) {
+            // Damaged past the index: keep what comes before
+            _chunks.resize(i);
+            _index.resize(i);
+            _frames = i ? _index[i - 1].first_frame + _chunks[i - 1].frames : 0;
+            break;
+        }
+        chunk.payload = _map + _index[i].offset + sizeof(header);
+        chunk.frames = header.frames;
+        chunk.bytes = header.bytes;
+        chunk.crc = header.payload_crc;
+        chunk.kind = (RecordingChunkKind)header.kind;
+        chunk.valid = -1;
+    }
+    return true;
+}
+
+size_t RecordingReader::chunk_of(uint64_t frame) const
+{
+    auto after = std::upper_bound(_index.begin(), _index.end(), frame,
+    [](uint64_t value, const RecordingIndexEntry &entry) {
+        return value < entry.first_frame;
+    });
+    return (size_t)(after - _index.begin()) - 1;
+}
+
+bool RecordingReader::check(size_t chunk)
+{
+    Chunk &c = _chunks[chunk];
+    if (c.valid < 0) {
+        c.valid = crc32(c.payload, c.bytes) == c.crc;
+    }
+    return c.valid;
+}
+
+bool RecordingReader::decode(size_t chunk)
+{
+    if (_decoded_chunk == chunk) {
+        return true;
+    }
+    const Chunk &c = _chunks[chunk];
+    if (!check(chunk) || !decode_delta(c.payload, c.bytes, c.frames, _index[chunk].first_time_us, _decoded)) {
+        _decoded_chunk = SIZE_MAX;
+        return false;
+    }
+    _decoded_chunk = chunk;
+    return true;
+}
+
+uint64_t RecordingReader::seek(uint64_t time_us)
+{
+    if (_index.empty() || time_us <= _index.front().first_time_us) {
+        return 0;
+    }
+    auto after = std::upper_bound(_index.begin(), _index.end(), time_us,
+    [](uint64_t value, const RecordingIndexEntry &entry) {
+        return value <= entry.first_time_us;
+    });
+    size_t chunk = (size_t)(after - _index.begin()) - 1;
+    const Chunk &c = _chunks[chunk];
+
+    const RecordingFrame *begin;
+    if (c.kind == RECORDING_RAW) {
+        if (!check(chunk)) {
+            return _index[chunk].first_frame;
+        }
+        begin = (const RecordingFrame *)c.payload;
+    } else {
+        if (!decode(chunk)) {
+            return _index[chunk].first_frame;
+        }
+        begin = _decoded.data();
+    }
+    const RecordingFrame *found = std::lower_bound(begin, begin + c.frames, time_us,
+    [](const RecordingFrame &frame, uint64_t value) {
+        return frame.time_us < value;
+    });
+    return _index[chunk].first_frame + (uint64_t)(found - begin);
+}
+
+const RecordingFrame *RecordingReader::view(uint64_t frame)
+{
+    if (frame >= _frames) {
+        return nullptr;
+    }
+    size_t chunk = chunk_of(frame);
+    if (_chunks[chunk].kind != RECORDING_RAW || !check(chunk)) {
+        return nullptr;
+    }
+    return (const RecordingFrame *)_chunks[chunk].payload + (frame - _index[chunk].first_frame);
+}
+
+bool RecordingReader::frame(uint64_t frame, RecordingFrame &out)
+{
+    if (frame >= _frames) {
+        return false;
+    }
+    size_t chunk = chunk_of(frame);
+    if (_chunks[chunk].kind == RECORDING_RAW) {
+        const RecordingFrame *in_place = view(frame);
+        if (!in_place) {
+            return false;
+        }
+        out = *in_place;
+        return true;
+    }
+    if (!decode(chunk)) {
+        return false;
+    }
+    out = _decoded[frame - _index[chunk].first_frame];
+    return true;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+// Recording files (.drec) for long captures of the control loop, with random
+// access by time. Little endian, host tools only.
+//
+//   file header   "DREC", version, field count, frame size
+//   chunk...      header (kind, frame count, byte size, first/last time,
+//                 first frame number, payload CRC-32, header CRC-32), then
+//                 the payload, padded to 8 bytes
+//   index         optional, written by close(): "DIDX", one entry per chunk
+//                 (first time, first frame, offset), CRC-32, and a trailer
+//                 pointing at it
+//
+// A chunk holds RECORDING_CHUNK_FRAMES frames, either raw RecordingFrame
+// records that the reader hands out in place, or TelemetryCodec frames
+// (delta compressed, about a tenth of the size) decoded on access. A file cut
+// anywhere, by a crash or a full disk, reads back up to its last complete
+// chunk: without a valid index the reader rebuilds it by walking the chunk
+// headers, and the writer reopens it for appending after that chunk.
+
+#include "TelemetryCodec.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define RECORDING_VERSION           1
+#define RECORDING_CHUNK_FRAMES      4096
+
+enum RecordingChunkKind : uint8_t {
+    RECORDING_RAW = 'R',
+    RECORDING_DELTA = 'D'
+};
+
+// One frame, time extended to 64 bits: the module's counter wraps every 71 min
+struct RecordingFrame {
+    uint64_t time_us;
+    uint32_t fields[TELEMETRY_FIELD_COUNT]; // telemetry_to_fields() order
+    uint32_t reserved;
+};
+
+static_assert(sizeof(RecordingFrame) % 8 == 0, "raw chunks are arrays of aligned RecordingFrame");
+
+struct RecordingIndexEntry {
+    uint64_t first_time_us;
+    uint64_t first_frame;
+    uint64_t offset;        // of the chunk header
+};
+
+// Offset of the header of a chunk in a raw recording of full chunks, for the
+// tools that cut or split files
+uint64_t recording_raw_chunk_offset(uint64_t chunk);
+
+class RecordingWriter {
+public:
+    RecordingWriter();
+    ~RecordingWriter();
+
+    // Creates the file, or reopens it for appending after its last complete
+    // chunk, which must hold chunks of the same kind. Returns false and fills
+    // error on failure, the file closed.
+    bool open(const std::string &path, RecordingChunkKind kind, bool append, std::string &error);
+
+    // Frames are buffered and written a chunk at a time
+    bool write(const TelemetrySnapshot &snapshot);
+
+    // Writes the pending frames and the index
+    bool close();
+
+    uint64_t frames() const
+    {
+        return _frames;
+    }
+
+private:
+    bool flush_chunk();
+
+    int                              _fd;
+    RecordingChunkKind               _kind;
+    uint64_t                         _offset;
+    uint64_t                         _frames;
+    uint64_t                         _time_us;
+    bool                             _have_time;
+    std::vector<RecordingFrame>      _pending;
+    std::vector<RecordingIndexEntry> _index;
+};
+
+class RecordingReader {
+public:
+    RecordingReader();
+    ~RecordingReader();
+
+    bool open(const std::string &path, std::string &error);
+    void close();
+
+    uint64_t frame_count() const
+    {
+        return _frames;
+    }
+
+    size_t chunk_count() const
+    {
+        return _index.size();
+    }
+
+    // True when the index came from the file, false when rebuilt by a scan
+    bool indexed() const
+    {
+        return _indexed;
+    }
+
+    // First frame at or after time_us, frame_count() past the end
+    uint64_t seek(uint64_t time_us);
+
+    // The frame in place in the mapping for raw chunks, nullptr for delta
+    // chunks, a frame past the end or a chunk failing its CRC
+    const RecordingFrame *view(uint64_t frame);
+
+    // Copy of the frame, any chunk kind
+    bool frame(uint64_t frame, RecordingFrame &out);
+
+private:
+    struct Chunk {
+        const uint8_t     *payload;
+        uint32_t           frames;
+        uint32_t           bytes;
+        uint32_t           crc;
+        RecordingChunkKind kind;
+        int8_t             valid;   // -1 until the CRC is checked
+    };
+
+    size_t chunk_of(uint64_t frame) const;
+    bool check(size_t chunk);
+    bool decode(size_t chunk);
+
+    const uint8_t                   *_map;
+    size_t                           _size;
+    uint64_t                         _frames;
+    bool                             _indexed;
+    std::vector<RecordingIndexEntry> _index;
+    std::vector<Chunk>               _chunks;
+
+    // Last delta chunk decoded
+    size_t                           _decoded_chunk;
+    std::vector<RecordingFrame>      _decoded;
+};
@@ -0,0 +1,329 @@
+#include "Scenario.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+const char *const scenario_channel_names[CHANNEL_COUNT] = {
+    "cv_raw",
+    "cv",
+    "slider",
+    "left",
+    "right",
+    "volume",
+    "region",
+    "dac",
+    "led",
+    "lin_log"
+};
+
+#define BOUNCE_MIN_US               50
+#define BOUNCE_MAX_US               700
+
+namespace {
+
+const char *const pot_names[POT_COUNT] = {"slider", "center", "left", "right"};
+
+// "2s", "500ms", "40us"
+bool parse_time(const std::string &text, uint64_t &us)
+{
+    char *end = nullptr;
+    double value = strtod(text.c_str(), &end);
+    if (end == text.c_str() || value < 0) {
+        return false;
+    }
+    std::string unit(end);
+    if (unit == "s") {
+        value *= 1000000.0;
+    } else if (unit == "ms") {
+        value *= 1000.0;
+    } else if (unit != "us") {
+        return false;
+    }
+    us = (uint64_t)llround(value);
+    return true;
+}
+
+bool parse_hz(const std::string &text, float &hz)
+{
+    char *end = nullptr;
+    hz = strtof(text.c_str(), &end);
+    return end != text.c_str() && strcmp(end, "Hz") == 0 && hz > 0.0f;
+}
+
+bool parse_u16(const std::string &text, uint16_t &value)
+{
+    char *end = nullptr;
+    long number = strtol(text.c_str(), &end, 0);
+    if (end == text.c_str() || *end || number < 0 || number > UINT16_MAX) {
+        return false;
+    }
+    value = (uint16_t)number;
+    return true;
+}
+
+bool parse_wave(const std::string &name, ScenarioWave &wave)
+{
+    static const char *const names[] = {"const", "ramp", "triangle", "sine", "square"};
+    for (int i = 0; i < 5; i++) {
+        if (name == names[i]) {
+            wave = (ScenarioWave)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// One statement, returns an error message or nullptr
+const char *parse_line(const std::vector<std::string> &words, Scenario &scenario)
+{
+    const std::string &keyword = words[0];
+    size_t count = words.size();
+
+    if (keyword == "duration" && count == 2) {
+        return parse_time(words[1], scenario.duration_us) ? nullptr : "bad duration";
+    }
+    if (keyword == "frame" && count == 2) {
+        uint64_t us = 0;
+        if (!parse_time(words[1], us) || us == 0) {
+            return "bad frame time";
+        }
+        scenario.frame_us = (uint32_t)us;
+        return nullptr;
+    }
+    if (keyword == "sample" && count == 2) {
+        uint64_t us = 0;
+        if (!parse_time(words[1], us) || us == 0) {
+            return "bad sample period";
+        }
+        scenario.sample_us = (uint32_t)us;
+        return nullptr;
+    }
+    if (keyword == "cv" && count == 3 && words[1] == "noise") {
+        return parse_u16(words[2], scenario.noise) ? nullptr : "bad noise amplitude";
+    }
+    if (keyword == "cv" && count == 5 && words[1] == "burst") {
+        ScenarioBurst burst{};
+        if (!parse_time(words[2], burst.start_us) || !parse_time(words[3], burst.length_us) || !parse_u16(words[4], burst.amplitude)) {
+            return "usage: cv burst <start> <length> <amplitude>";
+        }
+        scenario.bursts.push_back(burst);
+        return nullptr;
+    }
+    if (keyword == "cv" && count >= 3) {
+        if (!parse_wave(words[1], scenario.wave)) {
+            return "unknown CV waveform";
+        }
+        if (scenario.wave == WAVE_CONST) {
+            return (count == 3 && parse_u16(words[2], scenario.wave_a)) ? nullptr : "usage: cv const <value>";
+        }
+        if (count != 5 || !parse_u16(words[2], scenario.wave_a) || !parse_u16(words[3], scenario.wave_b) || !parse_hz(words[4], scenario.wave_hz)) {
+            return "usage: cv <waveform> <a> <b> <frequency>Hz";
+        }
+        return nullptr;
+    }
+    if (keyword == "pot" && count == 4) {
+        for (int pot = 0; pot < POT_COUNT; pot++) {
+            if (words[1] == pot_names[pot]) {
+                ScenarioKeyframe keyframe{};
+                if (!parse_time(words[2], keyframe.time_us) || !parse_u16(words[3], keyframe.value)) {
+                    return "usage: pot <name> <time> <value>";
+                }
+                std::vector<ScenarioKeyframe> &keys = scenario.pots[pot];
+                keys.insert(std::upper_bound(keys.begin(), keys.end(), keyframe.time_us,
+                [](uint64_t time_us, const ScenarioKeyframe &key) {
+                    return time_us < key.time_us;
+                }), keyframe);
+                return nullptr;
+            }
+        }
+        return "unknown pot";
+    }
+    if (keyword == "button" && (count == 4 || count == 5)) {
+        ScenarioButton button{};
+        uint64_t bounce_us = 0;
+        if ((words[1] != "l" && words[1] != "r") || !parse_time(words[2], button.time_us) || (words[3] != "down" && words[3] != "up")
+            || (count == 5 && !parse_time(words[4], bounce_us))) {
+            return "usage: button <l|r> <time> <down|up> [bounce]";
+        }
+        button.button = words[1][0];
+        button.down = words[3] == "down";
+
+        // Contact bounce: the pin chatters between both levels for the bounce
+        // time before it settles, in BOUNCE_MIN_US to BOUNCE_MAX_US steps
+        uint32_t rng = (uint32_t)button.time_us ^ 0x9E3779B9;
+        uint64_t settle_us = button.time_us + bounce_us;
+        bool level = button.down;
+        while (button.time_us < settle_us) {
+            scenario.buttons.push_back(ScenarioButton{button.time_us, button.button, level});
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            button.time_us += BOUNCE_MIN_US + rng % (BOUNCE_MAX_US - BOUNCE_MIN_US + 1);
+            level = !level;
+        }
+        button.time_us = std::max(button.time_us, settle_us);
+        scenario.buttons.push_back(button);
+        return nullptr;
+    }
+    if (keyword == "curve" && count >= 3) {
+        ScenarioCommand command{0, "curve"};
+        if (!parse_time(words[1], command.time_us)) {
+            return "usage: curve <time> <expression|off>";
+        }
+        for (size_t i = 2; i < count; i++) {
+            command.line += " " + words[i];
+        }
+        scenario.commands.push_back(command);
+        return nullptr;
+    }
+    if (keyword == "range" && count == 3) {
+        ScenarioCommand command{0, "range " + words[2]};
+        if (!parse_time(words[1], command.time_us) || (words[2] != "auto" && words[2] != "manual")) {
+            return "usage: range <time> <auto|manual>";
+        }
+        scenario.commands.push_back(command);
+        return nullptr;
+    }
+    if (keyword == "stall" && count == 3) {
+        ScenarioStall stall{};
+        if (!parse_time(words[1], stall.start_us) || !parse_time(words[2], stall.length_us)) {
+            return "usage: stall <start> <length>";
+        }
+        scenario.stalls.push_back(stall);
+        return nullptr;
+    }
+    if (keyword == "fault" && count == 2) {
+        return parse_time(words[1], scenario.fault_us) ? nullptr : "usage: fault <time>";
+    }
+    if (keyword == "warning" && count == 2) {
+        return parse_time(words[1], scenario.warning_us) ? nullptr : "usage: warning <time>";
+    }
+    if (keyword == "log" && count >= 2) {
+        for (size_t i = 1; i < count; i++) {
+            const char *const *name = std::find_if(scenario_channel_names, scenario_channel_names + CHANNEL_COUNT,
+            [&](const char *channel) {
+                return words[i] == channel;
+            });
+            if (name == scenario_channel_names + CHANNEL_COUNT) {
+                return "unknown log channel";
+            }
+            scenario.channels.push_back((ScenarioChannel)(name - scenario_channel_names));
+        }
+        return nullptr;
+    }
+    return "unknown statement";
+}
+
+} // namespace
+
+bool scenario_load(const char *path, Scenario &scenario, std::string &error)
+{
+    std::ifstream file(path);
+    if (!file) {
+        error = std::string(path) + ": cannot open";
+        return false;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream stream(line);
+        std::vector<std::string> words;
+        for (std::string word; stream >> word;) {
+            words.push_back(word);
+        }
+        if (words.empty()) {
+            continue;
+        }
+        const char *message = parse_line(words, scenario);
+        if (message) {
+            error = std::string(path) + ":" + std::to_string(number) + ": " + message;
+            return false;
+        }
+    }
+
+    std::stable_sort(scenario.buttons.begin(), scenario.buttons.end(),
+    [](const ScenarioButton &a, const ScenarioButton &b) {
+        return a.time_us < b.time_us;
+    });
+    std::stable_sort(scenario.commands.begin(), scenario.commands.end(),
+    [](const ScenarioCommand &a, const ScenarioCommand &b) {
+        return a.time_us < b.time_us;
+    });
+    if (scenario.channels.empty()) {
+        scenario.channels = {CHANNEL_CV, CHANNEL_VOLUME, CHANNEL_DAC};
+    }
+    return true;
+}
+
+uint16_t scenario_cv(const Scenario &scenario, uint64_t time_us, uint32_t &rng)
+{
+    double phase = fmod((double)time_us * 1e-6 * scenario.wave_hz, 1.0);
+    double a = scenario.wave_a;
+    double b = scenario.wave_b;
+    double value = a;
+    switch (scenario.wave) {
+        case WAVE_CONST:
+            break;
+        case WAVE_RAMP:
+            value = a + (b - a) * phase;
+            break;
+        case WAVE_TRIANGLE:
+            value = a + (b - a) * (phase < 0.5 ? 2.0 * phase : 2.0 - 2.0 * phase);
+            break;
+        case WAVE_SINE:
+            value = a + (b - a) * 0.5 * (1.0 - cos(2.0 * M_PI * phase));
+            break;
+        case WAVE_SQUARE:
+            value = phase < 0.5 ? a : b;
+            break;
+    }
+
+    uint32_t amplitude = scenario.noise;
+    for (const ScenarioBurst &burst : scenario.bursts) {
+        if (time_us >= burst.start_us && time_us < burst.start_us + burst.length_us) {
+            amplitude += burst.amplitude;
+        }
+    }
+    if (amplitude) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        value += (double)(rng % (2 * amplitude + 1)) - amplitude;
+    }
+    return (uint16_t)std::min(std::max(value, 0.0), (double)UINT16_MAX);
+}
+
+uint16_t scenario_pot(const Scenario &scenario, ScenarioPot pot, uint64_t time_us)
+{
+    const std::vector<ScenarioKeyframe> &keys = scenario.pots[pot];
+    if (keys.empty()) {
+        return UINT16_MAX / 2;
+    }
+    if (time_us <= keys.front().time_us) {
+        return keys.front().value;
+    }
+    for (size_t i = 1; i < keys.size(); i++) {
+        if (time_us < keys[i].time_us) {
+            const ScenarioKeyframe &from = keys[i - 1];
+            const ScenarioKeyframe &to = keys[i];
+            double t = (double)(time_us - from.time_us) / (double)(to.time_us - from.time_us);
+            return (uint16_t)lround(from.value + (to.value - (double)from.value) * t);
+        }
+    }
+    return keys.back().value;
+}
+
+bool scenario_stalled(const Scenario &scenario, uint64_t time_us)
+{
+    for (const ScenarioStall &stall : scenario.stalls) {
+        if (time_us >= stall.start_us && time_us < stall.start_us + stall.length_us) {
+            return true;
+        }
+    }
+    return false;
+}
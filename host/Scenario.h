@@ -0,0 +1,116 @@
+#pragma once
+
+// Scenario files of depth_sim: CV waveform, pot automation, button events and
+// the channels to log. One statement per line, '#' starts a comment:
+//
+//   duration 2s                   simulated time
+//   frame 40us                    virtual time per control loop iteration
+//   cv triangle 0 65535 1Hz       const V | ramp A B F | triangle A B F | sine A B F | square A B F
+//   cv noise 800                  uniform noise added to the CV, +/- amplitude
+//   cv burst 1s 200ms 4000        noise burst: start, length, amplitude
+//   pot slider 0s 32768           pot keyframe (slider, center, left, right),
+//   pot slider 1s 65535           linear between keyframes, mid travel without any
+//   button l 500ms down           Lin/Log button l or r, down or up
+//   button l 500ms down 4ms       same, with 4 ms of contact bounce
+//   curve 1s clamp(1 - cv, 0, 1)  depth law upload (DepthCurve.h), the rest of
+//   curve 2s off                  the line, or back to the built-in law
+//   range 1s auto                 CV auto-range (AutoRange.h) on, or manual
+//   stall 1s 150ms                control loop stopped: start, length
+//   fault 1s                      mbed_error() from the control loop, halted after it
+//   warning 1s                    mbed_warning() from the control loop, which carries on
+//   log cv volume dac led         channels, see scenario_channel_names
+//   sample 1ms                    log period
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum ScenarioWave {
+    WAVE_CONST,
+    WAVE_RAMP,
+    WAVE_TRIANGLE,
+    WAVE_SINE,
+    WAVE_SQUARE
+};
+
+enum ScenarioPot {
+    POT_SLIDER,
+    POT_CENTER,
+    POT_LEFT,
+    POT_RIGHT,
+    POT_COUNT
+};
+
+enum ScenarioChannel {
+    CHANNEL_CV_RAW,
+    CHANNEL_CV,
+    CHANNEL_SLIDER,
+    CHANNEL_LEFT,
+    CHANNEL_RIGHT,
+    CHANNEL_VOLUME,
+    CHANNEL_REGION,
+    CHANNEL_DAC,
+    CHANNEL_LED,
+    CHANNEL_LIN_LOG,
+    CHANNEL_COUNT
+};
+
+extern const char *const scenario_channel_names[CHANNEL_COUNT];
+
+struct ScenarioKeyframe {
+    uint64_t time_us;
+    uint16_t value;
+};
+
+struct ScenarioBurst {
+    uint64_t start_us;
+    uint64_t length_us;
+    uint16_t amplitude;
+};
+
+struct ScenarioButton {
+    uint64_t time_us;
+    char     button; // 'l' or 'r'
+    bool     down;
+};
+
+// Control loop stopped, the timers and the threads running
+struct ScenarioStall {
+    uint64_t start_us;
+    uint64_t length_us;
+};
+
+// Console input line of the firmware (depth_command() of main.cpp)
+struct ScenarioCommand {
+    uint64_t    time_us;
+    std::string line;
+};
+
+struct Scenario {
+    uint64_t                      duration_us = 1000000;
+    uint32_t                      frame_us = 40;
+    uint32_t                      sample_us = 1000;
+
+    ScenarioWave                  wave = WAVE_CONST;
+    uint16_t                      wave_a = 0;
+    uint16_t                      wave_b = 0;
+    float                         wave_hz = 1.0f;
+    uint16_t                      noise = 0;
+    std::vector<ScenarioBurst>    bursts;
+
+    std::vector<ScenarioKeyframe> pots[POT_COUNT];
+    std::vector<ScenarioButton>   buttons;          // sorted by time
+    std::vector<ScenarioCommand>  commands;         // sorted by time
+    std::vector<ScenarioStall>    stalls;
+    uint64_t                      fault_us = UINT64_MAX;
+    uint64_t                      warning_us = UINT64_MAX;
+    std::vector<ScenarioChannel>  channels;
+};
+
+// Returns false and fills error ("file:line: message") on a parse error
+bool scenario_load(const char *path, Scenario &scenario, std::string &error);
+
+// Input values at a point of virtual time. rng is the noise generator state.
+uint16_t scenario_cv(const Scenario &scenario, uint64_t time_us, uint32_t &rng);
+uint16_t scenario_pot(const Scenario &scenario, ScenarioPot pot, uint64_t time_us);
+bool scenario_stalled(const Scenario &scenario, uint64_t time_us);
@@ -0,0 +1,58 @@
+# Runs one scenario in depth_sim and compares its log, as CSV, with the
+# expected one, and leaves its recording for engine_test. See the scenario
+# tests in CMakeLists.txt.
+#
+# cmake -DDEPTH_SIM=<depth_sim> -DSCENARIO=<.scn> -DEXPECTED=<.csv> -DOUTPUT=<prefix> -P ScenarioTest.cmake
+
+get_filename_component(output_dir ${OUTPUT} DIRECTORY)
+file(MAKE_DIRECTORY ${output_dir})
+
+execute_process(
+    COMMAND ${DEPTH_SIM} ${SCENARIO} -o ${OUTPUT}.dsim -t ${OUTPUT}.tlm -r ${OUTPUT}.drec
+    RESULT_VARIABLE result
+    ERROR_VARIABLE summary
+)
+message("${summary}")
+if(result)
+    message(FATAL_ERROR "depth_sim ${SCENARIO} failed: ${result}")
+endif()
+
+# The decoded post-mortem lines of the summary, after a watchdog reset,
+# against <expected>.report
+string(REGEX MATCHALL "  post-mortem[^\n]*\n" report "${summary}")
+string(REPLACE ";" "" report "${report}")
+string(REGEX REPLACE "\\.csv$" ".report" expected_report ${EXPECTED})
+
+execute_process(
+    COMMAND ${DEPTH_SIM} --dump ${OUTPUT}.dsim
+    OUTPUT_FILE ${OUTPUT}.csv
+    RESULT_VARIABLE result
+)
+if(result)
+    message(FATAL_ERROR "depth_sim --dump ${OUTPUT}.dsim failed: ${result}")
+endif()
+
+if(DEFINED ENV{DEPTH_SIM_UPDATE})
+    execute_process(COMMAND ${CMAKE_COMMAND} -E copy ${OUTPUT}.csv ${EXPECTED})
+    message(STATUS "${EXPECTED} updated")
+    if(report)
+        file(WRITE ${expected_report} "${report}")
+        message(STATUS "${expected_report} updated")
+    endif()
+    return()
+endif()
+
+if(report OR EXISTS ${expected_report})
+    file(READ ${expected_report} expected_text)
+    if(NOT report STREQUAL expected_text)
+        message(FATAL_ERROR "post-mortem report differs from ${expected_report}:\n${report}")
+    endif()
+endif()
+
+execute_process(
+    COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT}.csv ${EXPECTED}
+    RESULT_VARIABLE result
+)
+if(result)
+    message(FATAL_ERROR "${OUTPUT}.csv differs from ${EXPECTED}")
+endif()
@@ -0,0 +1,156 @@
+#include "TimingWheel.h"
+
+namespace {
+
+uint32_t digit(uint64_t time, uint32_t level)
+{
+    return (uint32_t)(time >> (8 * level)) & (TIMING_WHEEL_SLOTS - 1);
+}
+
+// Start of the block of 'time' at 'level': the bytes above it, the rest zero
+uint64_t block_start(uint64_t time, uint32_t level)
+{
+    return level + 1 < TIMING_WHEEL_LEVELS ? time >> (8 * (level + 1)) << (8 * (level + 1)) : 0;
+}
+
+} // namespace
+
+TimingWheel::TimingWheel() :
+    _now(0),
+    _next_due(UINT64_MAX),
+    _count(0),
+    _slots(),
+    _occupied()
+{
+}
+
+void TimingWheel::insert(TimingWheelNode *node)
+{
+    if (node->queued) {
+        remove(node);
+    }
+    node->queued = true;
+    _count++;
+    place(node);
+}
+
+void TimingWheel::place(TimingWheelNode *node)
+{
+    uint64_t due = node->due_us > _now ? node->due_us : _now;
+    uint64_t differ = due ^ _now;
+    uint32_t level = differ < TIMING_WHEEL_SLOTS ? 0 : (63 - __builtin_clzll(differ)) / 8;
+    uint32_t index = digit(due, level);
+
+    // expire() must stop at the start of the block of the slot to cascade it,
+    // not at the due time
+    uint64_t start = due >> (8 * level) << (8 * level);
+    if (start < _next_due) {
+        _next_due = start;
+    }
+
+    node->slot = (uint16_t)(level * TIMING_WHEEL_SLOTS + index);
+    Slot &slot = _slots[node->slot];
+    node->next = nullptr;
+    node->prev = slot.tail;
+    if (slot.tail) {
+        slot.tail->next = node;
+    } else {
+        slot.head = node;
+        _occupied[level][index / 64] |= 1ULL << (index % 64);
+    }
+    slot.tail = node;
+}
+
+void TimingWheel::remove(TimingWheelNode *node)
+{
+    if (!node->queued) {
+        return;
+    }
+    Slot &slot = _slots[node->slot];
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        slot.head = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    } else {
+        slot.tail = node->prev;
+    }
+    if (!slot.head) {
+        uint32_t level = node->slot / TIMING_WHEEL_SLOTS, index = node->slot % TIMING_WHEEL_SLOTS;
+        _occupied[level][index / 64] &= ~(1ULL << (index % 64));
+    }
+    node->queued = false;
+    _count--;
+}
+
+// First occupied slot of the level at or after 'from'
+bool TimingWheel::occupied_from(uint32_t level, uint32_t from, uint32_t &index) const
+{
+    for (uint32_t word = from / 64; word < TIMING_WHEEL_SLOTS / 64; word++) {
+        uint64_t bits = _occupied[level][word];
+        if (word == from / 64) {
+            bits &= ~0ULL << (from % 64);
+        }
+        if (bits) {
+            index = word * 64 + __builtin_ctzll(bits);
+            return true;
+        }
+    }
+    return false;
+}
+
+// The wheel time entered the block of this slot: spread its nodes over the
+// levels below, in order
+void TimingWheel::cascade(uint32_t level, uint32_t index)
+{
+    Slot &slot = _slots[level * TIMING_WHEEL_SLOTS + index];
+    TimingWheelNode *node = slot.head;
+    slot.head = slot.tail = nullptr;
+    _occupied[level][index / 64] &= ~(1ULL << (index % 64));
+    while (node) {
+        TimingWheelNode *next = node->next;
+        place(node);
+        node = next;
+    }
+}
+
+TimingWheelNode *TimingWheel::expire(uint64_t target)
+{
+    while (_count && _next_due <= target) {
+        uint32_t index;
+        if (occupied_from(0, digit(_now, 0), index)) {
+            uint64_t due = block_start(_now, 0) | index;
+            _next_due = due;
+            if (due > target) {
+                break;
+            }
+            _now = due;
+            TimingWheelNode *node = _slots[index].head;
+            remove(node);
+            return node;
+        }
+
+        // Nothing left in the current level 0 block: move to the start of the
+        // next occupied block above
+        uint32_t level = 1;
+        while (level < TIMING_WHEEL_LEVELS && !occupied_from(level, digit(_now, level) + 1, index)) {
+            level++;
+        }
+        if (level == TIMING_WHEEL_LEVELS) {
+            break;
+        }
+        uint64_t start = block_start(_now, level) | (uint64_t)index << (8 * level);
+        _next_due = start;
+        if (start > target) {
+            break;
+        }
+        _now = start;
+        cascade(level, index);
+    }
+    if (target > _now) {
+        _now = target;
+    }
+    return nullptr;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+// Hierarchical timing wheel, the event queue of the host virtual clock.
+//
+// Eight levels of 256 slots, one per byte of the 64 bit due time: a node sits
+// at the level of the highest byte where its due time differs from the wheel
+// time, in the slot of that byte. Level 0 slots are single microseconds.
+// When the wheel time enters the block of a higher level slot, its nodes are
+// cascaded down. Insert and remove are O(1), finding the next due node scans
+// per level occupancy bitmaps. Nodes are intrusive: the wheel allocates
+// nothing, the owner of a node (Ticker, Timeout) holds its storage.
+//
+// Nodes due at the same time expire in insertion order, like the
+// std::multimap queue this replaces, so simulations stay reproducible.
+
+#include <cstdint>
+
+#define TIMING_WHEEL_LEVELS         8
+#define TIMING_WHEEL_SLOTS          256
+
+struct TimingWheelNode {
+    TimingWheelNode *prev;
+    TimingWheelNode *next;
+    uint64_t         due_us;
+    uint16_t         slot;      // level * TIMING_WHEEL_SLOTS + index
+    bool             queued;
+};
+
+class TimingWheel {
+public:
+    TimingWheel();
+
+    // Due times before now() expire at the next expire() call
+    void insert(TimingWheelNode *node);
+
+    // No effect on a node not queued
+    void remove(TimingWheelNode *node);
+
+    // Dequeues the first node due at or before target and moves the wheel
+    // time to its due time. Without one, moves the wheel time to target and
+    // returns nullptr.
+    TimingWheelNode *expire(uint64_t target);
+
+    uint64_t now() const
+    {
+        return _now;
+    }
+
+    bool empty() const
+    {
+        return _count == 0;
+    }
+
+private:
+    struct Slot {
+        TimingWheelNode *head;
+        TimingWheelNode *tail;
+    };
+
+    void place(TimingWheelNode *node);
+    bool occupied_from(uint32_t level, uint32_t from, uint32_t &index) const;
+    void cascade(uint32_t level, uint32_t index);
+
+    uint64_t _now;
+    uint64_t _next_due; // no node due nor slot to cascade before, expire() returns early
+    uint32_t _count;
+    Slot     _slots[TIMING_WHEEL_LEVELS * TIMING_WHEEL_SLOTS];
+    uint64_t _occupied[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SLOTS / 64];
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool of the host tools. Each worker owns a deque of task
+// indices: it takes from the bottom of its own, and once that is empty it
+// steals from the top of the others. A worker that finishes early thus takes
+// over the tail of a slow one, without a shared counter every worker goes
+// through for every task.
+
+// Chase-Lev deque (Lê, Pop, Cohen, Zappa Nardelli, "Correct and efficient
+// work-stealing for weak memory models", PPoPP 2013) over a fixed buffer.
+// Only the owner may push() and pop(), any thread may steal(). The buffer
+// does not wrap: at most 'capacity' pushes over the life of the deque, so a
+// thief never reads a slot the owner is writing.
+template <typename T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity) :
+        _top(0),
+        _bottom(0),
+        _items(capacity)
+    {
+    }
+
+    enum Steal {
+        STEAL_TAKEN,
+        STEAL_EMPTY,
+        STEAL_LOST     // another thread took the item first, try again
+    };
+
+    // Owner side. Returns false when the buffer is full.
+    bool push(const T &item)
+    {
+        int64_t bottom = _bottom.load(std::memory_order_relaxed);
+        if (bottom >= (int64_t)_items.size()) {
+            return false;
+        }
+        _items[bottom] = item;
+        _bottom.store(bottom + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Owner side, last pushed first
+    bool pop(T &item)
+    {
+        int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+        _bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = _top.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item = _items[bottom];
+        if (top == bottom) {
+            // The last item: the owner and a thief race for it on _top
+            bool won = _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread, first pushed first
+    Steal steal(T &item)
+    {
+        int64_t top = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = _bottom.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return STEAL_EMPTY;
+        }
+        item = _items[top];
+        if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return STEAL_LOST;
+        }
+        return STEAL_TAKEN;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> _top;
+    alignas(64) std::atomic<int64_t> _bottom;
+    std::vector<T> _items;
+};
+
+// Runs task(index) once for every index in [0, tasks) on 'threads' workers,
+// the calling thread being one of them. Worker w starts with the w-th
+// contiguous block of indices, taken from its start. Returns when every task
+// has run.
+template <typename Task>
+void work_stealing_run(uint32_t threads, uint32_t tasks, Task task)
+{
+    if (threads < 1) {
+        threads = 1;
+    }
+    std::vector<std::unique_ptr<WorkStealingDeque<uint32_t>>> deques;
+    for (uint32_t w = 0; w < threads; w++) {
+        uint32_t first = (uint64_t)tasks * w / threads, last = (uint64_t)tasks * (w + 1) / threads;
+        deques.emplace_back(new WorkStealingDeque<uint32_t>(last - first));
+        // Pushed backwards: pop() takes the block from its start
+        for (uint32_t index = last; index-- > first;) {
+            deques[w]->push(index);
+        }
+    }
+
+    auto worker = [&](uint32_t self) {
+        uint32_t index;
+        while (true) {
+            while (deques[self]->pop(index)) {
+                task(index);
+            }
+            // Steals until every deque was seen empty in one pass. No task is
+            // ever pushed again, so an empty deque stays empty.
+            bool stolen = false, lost = false;
+            for (uint32_t i = 1; i < threads && !stolen; i++) {
+                switch (deques[(self + i) % threads]->steal(index)) {
+                    case WorkStealingDeque<uint32_t>::STEAL_TAKEN: stolen = true; break;
+                    case WorkStealingDeque<uint32_t>::STEAL_LOST:  lost = true; break;
+                    default:                                       break;
+                }
+            }
+            if (stolen) {
+                task(index);
+            } else if (!lost) {
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (uint32_t w = 1; w < threads; w++) {
+        workers.emplace_back(worker, w);
+    }
+    worker(0);
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+}
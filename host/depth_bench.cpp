@@ -0,0 +1,693 @@
+// Host benchmarks: timings only, the behaviour they run is checked by the
+// tests of host/tests (ctest).
+//
+// depth_bench [bench...]     runs the named benches, all of them by default
+//
+//   engine    ns/frame of the depth engine variants, deviation from float
+//   abi       ns/sample of libdepthengine blocks (DepthEngineC.h), in place,
+//             with regions and with every input varying
+//   timers    events/s of the host timing wheel (TimingWheel.h) against a
+//             std::priority_queue, with periodic timers like SoftPWM's and
+//             with timeouts re-armed at random delays up to 16 s
+//   fibers    10000 simulated Threads sleeping 1 to 8 ms in loops, over 2 s
+//             of virtual time advanced in 40 us frames: context switches/s
+//   pwm       PwmPattern (DmaPWM.h) on a simulated DMA: 4 pins, random duty
+//             changes at random steps. DMA interrupts against the two per
+//             period per pin of SoftPWM, cost of the rewrites.
+//   curve     compile and table times of a depth law (DepthCurve.h)
+//   autorange ns per frame of AutoRange (AutoRange.h) on a source re-patched
+//             to another range halfway
+//   link      stereo link frames (DepthLink.h): decoder and follower ns per
+//             frame on a stream with corrupted frames and noise
+//   watchdog  ns per frame() of FrameWatchdog (FrameWatchdog.h) and per
+//             record of the flight recorder (FlightRecorder.h)
+//   spsc      SpscRing throughput between two threads
+//   log       ns/call of a function without log site, with a site compiled
+//             out and with a site masked at run time. Their code sizes:
+//             nm -S depth_bench | grep log_site
+//   recording write, sequential scan and seek times of a raw and a delta
+//             compressed recording (Recording.h), 2 GB raw by default, size
+//             in MB from DEPTH_BENCH_RECORDING_MB, files in TMPDIR or /tmp.
+//             Then the open of the raw file without its index.
+
+// PWM compiled out for the log bench
+#define LOG_LEVEL_PWM               LOG_LEVEL_NONE
+
+#include "AutoRange.h"
+#include "DepthCurve.h"
+#include "DepthEngine.h"
+#include "DepthEngineC.h"
+#include "DepthLink.h"
+#include "FlightRecorder.h"
+#include "FrameWatchdog.h"
+#include "HostHal.h"
+#include "PwmPattern.h"
+#include "Log.h"
+#include "Recording.h"
+#include "SpscRing.h"
+#include "TelemetryCodec.h"
+#include "TimingWheel.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock bench_clock;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+uint32_t xorshift32(uint32_t &x)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+template <typename Engine>
+double engine_ns_per_frame(const std::vector<DepthInputs> &inputs, Engine engine, uint32_t &checksum)
+{
+    bench_clock::time_point start = bench_clock::now();
+    for (const DepthInputs &in : inputs) {
+        checksum += engine(in).volume;
+    }
+    return seconds_since(start) * 1e9 / inputs.size();
+}
+
+DepthOutputs engine_float(const DepthInputs &in)
+{
+    return depth_compute(in);
+}
+
+DepthOutputs engine_fixed(const DepthInputs &in)
+{
+    return depth_compute_fixed(in);
+}
+
+DepthOutputs engine_lut(const DepthInputs &in)
+{
+    return depth_compute_lut(in);
+}
+
+bool bench_engine()
+{
+    std::vector<DepthInputs> inputs(10000000);
+    uint32_t rng = 0x2545F491;
+    for (DepthInputs &in : inputs) {
+        in.cv = xorshift32(rng) & UI16_MAX;
+        in.slider = xorshift32(rng) & UI16_MAX;
+        in.left = xorshift32(rng) & UI16_MAX;
+        in.right = xorshift32(rng) & UI16_MAX;
+    }
+
+    uint32_t checksum = 0;
+    printf("engine float: %.2f ns/frame\n", engine_ns_per_frame(inputs, engine_float, checksum));
+    printf("engine fixed: %.2f ns/frame\n", engine_ns_per_frame(inputs, engine_fixed, checksum));
+    printf("engine lut: %.2f ns/frame\n", engine_ns_per_frame(inputs, engine_lut, checksum));
+
+    DepthDeviation deviation = depth_fixed_deviation();
+    printf("engine fixed vs float: max %u LSB, mean %.4f LSB, RMS %.4f LSB over %u points\n",
+           deviation.max, deviation.mean, deviation.rms, deviation.points);
+    deviation = depth_lut_deviation();
+    printf("engine lut vs float: max %u LSB, mean %.4f LSB, RMS %.4f LSB over %u points\n",
+           deviation.max, deviation.mean, deviation.rms, deviation.points);
+    return checksum != 0x12345678; // keeps the loops
+}
+
+// Block of 'count' CV samples through the C ABI, in place, with and without
+// regions, then with every input varying. Returns outputs to keep the calls.
+uint32_t abi_run(depth_engine *engine, int variant, const std::vector<uint16_t> &cv, const std::vector<uint16_t> &pots)
+{
+    depth_engine_set_variant(engine, variant);
+    size_t count = cv.size();
+    std::vector<uint16_t> volume(cv);
+    std::vector<uint8_t> region(count);
+
+    bench_clock::time_point start = bench_clock::now();
+    depth_engine_process_block(engine, volume.data(), volume.data(), nullptr, count);
+    double in_place = seconds_since(start);
+    start = bench_clock::now();
+    depth_engine_process_block(engine, cv.data(), volume.data(), region.data(), count);
+    double regions = seconds_since(start);
+
+    const uint16_t *slider = pots.data(), *left = slider + count, *right = left + count;
+    start = bench_clock::now();
+    depth_engine_process_inputs(engine, cv.data(), slider, left, right, volume.data(), region.data(), count);
+    double inputs = seconds_since(start);
+
+    printf("abi %s: in place %.2f ns/sample, with regions %.2f, every input %.2f\n",
+           variant == DEPTH_ENGINE_FIXED ? "fixed" : "float", in_place * 1e9 / count, regions * 1e9 / count,
+           inputs * 1e9 / count);
+    return volume[count / 2] + region[count / 2];
+}
+
+bool bench_abi()
+{
+    const size_t count = 10000000;
+    std::vector<uint16_t> cv(count), pots(3 * count);
+    uint32_t rng = 0x2545F491;
+    for (uint16_t &value : cv) {
+        value = (uint16_t)xorshift32(rng);
+    }
+    for (uint16_t &value : pots) {
+        value = (uint16_t)xorshift32(rng);
+    }
+
+    depth_engine *engine = depth_engine_create();
+    depth_engine_set_pots(engine, 12000, 20000, 40000);
+    uint32_t checksum = abi_run(engine, DEPTH_ENGINE_FIXED, cv, pots);
+    checksum += abi_run(engine, DEPTH_ENGINE_FLOAT, cv, pots);
+    depth_engine_destroy(engine);
+    return checksum != 0x12345678; // keeps the blocks
+}
+
+struct BenchTimer : TimingWheelNode {
+    uint32_t period_us; // 0: re-armed at a random delay
+};
+
+// Delay until the next expiry of a timer
+uint64_t timer_delay(const BenchTimer &timer, uint32_t &rng)
+{
+    return timer.period_us ? timer.period_us : 1 + (xorshift32(rng) & 0xFFFFFF);
+}
+
+// Runs 'events' expiries, returns a hash of the (time, timer) sequence to
+// keep them
+uint64_t timers_wheel(std::vector<BenchTimer> &timers, uint32_t events)
+{
+    static TimingWheel wheel;
+    wheel = TimingWheel();
+    uint32_t rng = 0x9E3779B9;
+    for (BenchTimer &timer : timers) {
+        timer.queued = false;
+        timer.due_us = timer_delay(timer, rng);
+        wheel.insert(&timer);
+    }
+    uint64_t hash = 0;
+    for (uint32_t i = 0; i < events; i++) {
+        BenchTimer *timer = static_cast<BenchTimer *>(wheel.expire(UINT64_MAX));
+        hash = hash * 31 + (timer->due_us ^ (uint64_t)(timer - timers.data()) << 40);
+        timer->due_us += timer_delay(*timer, rng);
+        wheel.insert(timer);
+    }
+    return hash;
+}
+
+uint64_t timers_heap(std::vector<BenchTimer> &timers, uint32_t events)
+{
+    // due time, insertion count for the order of equal due times, timer
+    typedef std::tuple<uint64_t, uint64_t, uint32_t> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    uint64_t inserted = 0;
+    uint32_t rng = 0x9E3779B9;
+    for (uint32_t id = 0; id < timers.size(); id++) {
+        heap.emplace(timer_delay(timers[id], rng), inserted++, id);
+    }
+    uint64_t hash = 0;
+    for (uint32_t i = 0; i < events; i++) {
+        Entry entry = heap.top();
+        heap.pop();
+        uint64_t due = std::get<0>(entry);
+        uint32_t id = std::get<2>(entry);
+        hash = hash * 31 + (due ^ (uint64_t)id << 40);
+        heap.emplace(due + timer_delay(timers[id], rng), inserted++, id);
+    }
+    return hash;
+}
+
+uint64_t timers_run(const char *name, std::vector<BenchTimer> &timers, uint32_t events)
+{
+    bench_clock::time_point start = bench_clock::now();
+    uint64_t wheel = timers_wheel(timers, events);
+    double wheel_s = seconds_since(start);
+    start = bench_clock::now();
+    uint64_t heap = timers_heap(timers, events);
+    double heap_s = seconds_since(start);
+    printf("timers %-8s %6zu timers: wheel %5.1f Mevents/s, priority_queue %5.1f Mevents/s\n", name, timers.size(),
+           events / wheel_s * 1e-6, events / heap_s * 1e-6);
+    return wheel + heap;
+}
+
+bool bench_timers()
+{
+    const uint32_t events = 20000000;
+    uint32_t rng = 0x2545F491;
+    uint64_t checksum = 0;
+    for (uint32_t count : {16u, 1000u, 100000u}) {
+        std::vector<BenchTimer> timers(count);
+        for (BenchTimer &timer : timers) {
+            timer.period_us = 1 + xorshift32(rng) % 1000;
+        }
+        checksum += timers_run("periodic", timers, events);
+        for (BenchTimer &timer : timers) {
+            timer.period_us = 0;
+        }
+        checksum += timers_run("random", timers, events);
+    }
+    return checksum != 0x12345678; // keeps the runs
+}
+
+bool bench_fibers()
+{
+    const uint32_t count = 10000;
+    const uint64_t duration_us = 2000000;
+    static std::vector<uint64_t> wakes(count);
+    static std::vector<Thread> threads(count);
+
+    bench_clock::time_point start = bench_clock::now();
+    uint64_t begin_us = host_time_us();
+    for (uint32_t id = 0; id < count; id++) {
+        threads[id].start([id]() {
+            std::chrono::milliseconds period(1 + id % 8);
+            while (true) {
+                wakes[id]++;
+                ThisThread::sleep_for(period);
+            }
+        });
+    }
+    while (host_time_us() - begin_us < duration_us) {
+        host_advance_us(40);
+    }
+    double elapsed = seconds_since(start);
+
+    uint64_t total = 0;
+    for (uint32_t id = 0; id < count; id++) {
+        total += wakes[id];
+    }
+    printf("fibers %u threads: %llu switches in %.2f s, %.1f Mswitches/s, %.0f ns/switch\n", count,
+           (unsigned long long)total, elapsed, total / elapsed * 1e-6, elapsed * 1e9 / total);
+    return total != 0;
+}
+
+bool bench_pwm()
+{
+    const uint32_t steps = 256, pins = 4, periods = 200000;
+    static PwmPattern<steps> pattern;
+    const uint8_t pin_numbers[pins] = {0, 3, 7, 15};
+    for (uint8_t pin : pin_numbers) {
+        pattern.add_pin(pin, pin == 7);
+    }
+    pattern.fill();
+
+    // Random duty changes at random steps, the DMA half events at their steps
+    uint32_t rng = 0x2545F491;
+    uint32_t next_update = 0, updates = 0, interrupts = 0;
+    double update_ns = 0;
+    for (uint32_t period = 0; period < periods; period++) {
+        for (uint32_t step = 0; step < steps; step++) {
+            if (step + period * steps == next_update) {
+                uint32_t pin = xorshift32(rng) % pins;
+                uint32_t duty = xorshift32(rng) % (steps + 1);
+                bench_clock::time_point start = bench_clock::now();
+                pattern.set_duty(pin_numbers[pin], duty);
+                update_ns += seconds_since(start) * 1e9;
+                updates++;
+                next_update += 1 + xorshift32(rng) % (3 * steps);
+            }
+            if (step == steps / 2 - 1 || step == steps - 1) {
+                if (pattern.pending()) {
+                    interrupts++;
+                }
+                pattern.half_done(step == steps - 1);
+            }
+        }
+    }
+    // Half rewrites cost
+    bench_clock::time_point start = bench_clock::now();
+    for (uint32_t i = 0; i < 100000; i++) {
+        pattern.set_duty(pin_numbers[i % pins], i % (steps + 1));
+        pattern.fill();
+    }
+    double fill_ns = seconds_since(start) * 1e9 / 100000;
+
+    printf("pwm %u pins x %u periods, %u duty changes: DMA interrupts %u (%.2f per change), SoftPWM would take %u\n",
+           pins, periods, updates, interrupts, (double)interrupts / updates, 2 * pins * periods);
+    printf("pwm set_duty %.0f ns, change and refill %.0f ns\n", update_ns / updates, fill_ns);
+    return pattern.words()[0] != 0x12345678; // keeps the pattern
+}
+
+bool bench_curve()
+{
+    const char *source = "c = 0.5; w = 0.2; g = 2; clamp(1 - abs(cv - c)/w, 0, 1)^g";
+    const uint32_t runs = 2000;
+    static DepthCurveProgram program;
+    static uint16_t table[DEPTH_CURVE_POINTS];
+    DepthCurveError error;
+    bool ok = true;
+
+    bench_clock::time_point start = bench_clock::now();
+    for (uint32_t run = 0; run < runs; run++) {
+        ok &= depth_curve_compile(source, program, error);
+    }
+    double compile_us = seconds_since(start) * 1e6 / runs;
+    start = bench_clock::now();
+    for (uint32_t run = 0; run < runs; run++) {
+        ok &= depth_curve_table(program, table, error);
+    }
+    double table_us = seconds_since(start) * 1e6 / runs;
+
+    printf("curve %u ops: compile %.2f us, %u point table %.1f us\n", program.count, compile_us, DEPTH_CURVE_POINTS,
+           table_us);
+    return ok;
+}
+
+// Noisy triangle between low and high, 2 Hz at 25 kHz frames
+uint32_t triangle_cv(uint64_t frame, uint32_t low, uint32_t high, uint32_t &rng)
+{
+    uint32_t phase = (uint32_t)(frame % 12500);
+    uint32_t position = phase < 6250 ? phase : 12500 - phase;
+    int32_t cv = (int32_t)(low + (uint64_t)(high - low) * position / 6250) + (int32_t)(xorshift32(rng) % 601) - 300;
+    return (uint32_t)std::min<int32_t>(std::max<int32_t>(cv, 0), UI16_MAX);
+}
+
+bool bench_autorange()
+{
+    // Steady source for 20 s, then re-patched to another range for 20 s
+    const uint64_t frames = 500000;
+    static AutoRange range;
+    uint32_t rng = 0x2545F491, checksum = 0;
+    bench_clock::time_point start = bench_clock::now();
+    for (uint64_t frame = 0; frame < 2 * frames; frame++) {
+        uint32_t cv = frame >= frames ? triangle_cv(frame, 40000, 60000, rng) : triangle_cv(frame, 10000, 30000, rng);
+        range.add(cv);
+        checksum += range.ready() ? range.scale(cv) : 0;
+    }
+    double ns_per_frame = seconds_since(start) * 1e9 / (2 * frames);
+    printf("autorange %.1f ns/frame, %u coefficient updates in 40 s\n", ns_per_frame, range.updates());
+    return checksum != 0x12345678;
+}
+
+bool bench_link()
+{
+    // Stream with a bit flipped in one frame out of 50, and noise with sync
+    // bytes between the frames every 37
+    const uint32_t frames = 100000;
+    std::vector<uint8_t> stream;
+    uint32_t rng = 0x1B873593;
+    for (uint32_t i = 0; i < frames; i++) {
+        DepthLinkFrame frame{(uint8_t)i, i * 160, DepthInputs{xorshift32(rng) & 0xFFFF, xorshift32(rng) & 0xFFFF, i & 0xFFFF, ~i & 0xFFFF}};
+        uint8_t bytes[DEPTH_LINK_FRAME];
+        depth_link_encode(frame, bytes);
+        if (i % 50 == 25) {
+            bytes[1 + xorshift32(rng) % (DEPTH_LINK_FRAME - 1)] ^= 1u << (xorshift32(rng) % 8);
+        }
+        if (i % 37 == 0) {
+            const uint8_t noise[] = {0x00, DEPTH_LINK_SYNC, 0x13, DEPTH_LINK_SYNC};
+            stream.insert(stream.end(), noise, noise + sizeof(noise));
+        }
+        stream.insert(stream.end(), bytes, bytes + DEPTH_LINK_FRAME);
+    }
+    DepthLinkDecoder decoder;
+    DepthLinkFollower follower;
+    uint32_t applied = 0;
+    bench_clock::time_point start = bench_clock::now();
+    for (uint8_t byte : stream) {
+        DepthLinkFrame frame;
+        if (decoder.feed(byte, frame)) {
+            applied += follower.receive(frame, frame.time_us);
+        }
+    }
+    double ns_per_frame = seconds_since(start) * 1e9 / frames;
+    printf("link decoder and follower %.1f ns/frame, %u frames, %u CRC errors, %u applied\n", ns_per_frame,
+           decoder.frames(), decoder.errors(), applied);
+    return applied != 0;
+}
+
+bool bench_watchdog()
+{
+    FrameWatchdog watchdog;
+    watchdog.start(0);
+    const uint32_t frames = 50000000;
+    bench_clock::time_point start = bench_clock::now();
+    for (uint32_t i = 1; i <= frames; i++) {
+        watchdog.frame(i * 40);
+    }
+    double frame_ns = seconds_since(start) * 1e9 / frames;
+
+    static FlightRecorder<FLIGHT_RECORDER_FRAMES> recorder;
+    start = bench_clock::now();
+    for (uint32_t i = 1; i <= frames; i++) {
+        recorder.record(i * 40, (uint16_t)i, (uint16_t)~i, 0x8000, (uint8_t)(i & 3));
+    }
+    double record_ns = seconds_since(start) * 1e9 / frames;
+    printf("watchdog frame() %.2f ns, flight recorder %.2f ns per frame, %u misses\n", frame_ns, record_ns, watchdog.misses());
+    return watchdog.misses() == 0;
+}
+
+// Producer pushes a sequence in batches of 'batch', the consumer pops it.
+// Order is checked by spsc_test.
+template <uint32_t Capacity>
+void spsc_run(uint32_t items, uint32_t batch)
+{
+    static SpscRing<uint32_t, Capacity> ring;
+
+    bench_clock::time_point start = bench_clock::now();
+    std::thread consumer([&]() {
+        uint32_t buffer[64];
+        uint32_t received = 0;
+        while (received < items) {
+            uint32_t count = batch == 1 ? ring.pop(buffer[0]) : ring.pop(buffer, batch);
+            received += count;
+            if (!count) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t buffer[64];
+    for (uint32_t next = 0; next < items;) {
+        uint32_t count = batch < items - next ? batch : items - next;
+        for (uint32_t i = 0; i < count; i++) {
+            buffer[i] = next + i;
+        }
+        uint32_t pushed = batch == 1 ? ring.push(buffer[0]) : ring.push(buffer, count);
+        next += pushed;
+        if (!pushed) {
+            std::this_thread::yield();
+        }
+    }
+    consumer.join();
+    double elapsed = seconds_since(start);
+
+    printf("spsc capacity %5u batch %2u: %7.1f Mitems/s\n", Capacity, batch, items / elapsed * 1e-6);
+}
+
+bool bench_spsc()
+{
+    spsc_run<64>(20000000, 1);
+    spsc_run<64>(20000000, 16);
+    spsc_run<1024>(50000000, 1);
+    spsc_run<1024>(50000000, 64);
+    return true;
+}
+
+TokenLog<1024> bench_token_log;
+
+__attribute__((noinline)) uint32_t log_site_none(uint32_t x)
+{
+    return x * 2654435761u + 1;
+}
+
+__attribute__((noinline)) uint32_t log_site_compiled_out(uint32_t x)
+{
+    LOG_DEBUG(PWM, bench_token_log, "PWM: %u", x);
+    return x * 2654435761u + 1;
+}
+
+__attribute__((noinline)) uint32_t log_site_masked(uint32_t x)
+{
+    LOG_DEBUG(ENGINE, bench_token_log, "ENGINE: %u", x);
+    return x * 2654435761u + 1;
+}
+
+double log_ns_per_call(uint32_t (*site)(uint32_t), uint32_t &checksum)
+{
+    const uint32_t calls = 200000000;
+    bench_clock::time_point start = bench_clock::now();
+    for (uint32_t i = 0; i < calls; i++) {
+        checksum = site(checksum);
+    }
+    return seconds_since(start) * 1e9 / calls;
+}
+
+bool bench_log()
+{
+    log_enable(LOG_ENGINE, false);
+    uint32_t checksum = 1;
+    printf("log no site:       %.3f ns/call\n", log_ns_per_call(log_site_none, checksum));
+    printf("log compiled out:  %.3f ns/call\n", log_ns_per_call(log_site_compiled_out, checksum));
+    printf("log masked:        %.3f ns/call\n", log_ns_per_call(log_site_masked, checksum));
+    log_enable(LOG_ENGINE, true);
+    return checksum != 0x12345678;
+}
+
+// Control loop frames at 25kHz: triangle CV, noisy inputs
+TelemetrySnapshot synthetic_frame(uint64_t frame, uint32_t &rng)
+{
+    TelemetrySnapshot snapshot{};
+    snapshot.time_us = (uint32_t)(frame * 40);
+    snapshot.frame = (uint32_t)frame;
+    uint32_t phase = (uint32_t)(frame % 25000);
+    uint16_t cv = (uint16_t)(phase < 12500 ? phase * 5 : (25000 - phase) * 5);
+    for (uint8_t input = 0; input < INPUT_COUNT; input++) {
+        uint16_t value = input == INPUT_CV ? cv : (uint16_t)(UI16_MAX / 2);
+        snapshot.raw[input] = (uint16_t)(value + (xorshift32(rng) & 0x1F));
+        snapshot.filtered[input] = value;
+    }
+    DepthOutputs depth = depth_compute_fixed(DepthInputs{cv, UI16_MAX / 2, UI16_MAX / 2, UI16_MAX / 2});
+    snapshot.volume = depth.volume;
+    snapshot.region = depth.region;
+    snapshot.loop_rate_hz = 25000;
+    snapshot.loop_period_ns = 40000;
+    for (uint8_t stage = 0; stage < TELEMETRY_STAGE_COUNT; stage++) {
+        snapshot.stage_cycles[stage] = 60 + (xorshift32(rng) & 0x7);
+    }
+    return snapshot;
+}
+
+double file_mb(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    double mb = ftell(file) / 1e6;
+    fclose(file);
+    return mb;
+}
+
+bool recording_write(const std::string &path, RecordingChunkKind kind, uint64_t first, uint64_t frames, bool append)
+{
+    RecordingWriter writer;
+    std::string error;
+    if (!writer.open(path, kind, append, error)) {
+        printf("recording: %s\n", error.c_str());
+        return false;
+    }
+    uint32_t rng = 0x2545F491 ^ (uint32_t)first;
+    bench_clock::time_point start = bench_clock::now();
+    for (uint64_t frame = first; frame < first + frames; frame++) {
+        writer.write(synthetic_frame(frame, rng));
+    }
+    bool ok = writer.close();
+    double elapsed = seconds_since(start);
+    printf("recording %s write: %.0f MB in %.2f s, %.0f MB/s, %.1f Mframes/s\n", kind == RECORDING_RAW ? "raw  " : "delta",
+           file_mb(path), elapsed, file_mb(path) / elapsed, frames / elapsed * 1e-6);
+    return ok;
+}
+
+// Reads every frame in order, then seeks to random times
+bool recording_read(const std::string &path, uint64_t frames)
+{
+    RecordingReader reader;
+    std::string error;
+    bench_clock::time_point start = bench_clock::now();
+    if (!reader.open(path, error)) {
+        printf("recording: %s\n", error.c_str());
+        return false;
+    }
+    double open_ms = seconds_since(start) * 1e3;
+
+    start = bench_clock::now();
+    uint64_t sum = 0, count = 0;
+    RecordingFrame copy;
+    for (uint64_t frame = 0; frame < reader.frame_count(); frame++) {
+        const RecordingFrame *view = reader.view(frame);
+        if (!view && reader.frame(frame, copy)) {
+            view = &copy;
+        }
+        if (view) {
+            sum += view->fields[2 * INPUT_COUNT + 2]; // volume
+            count++;
+        }
+    }
+    double scan = seconds_since(start);
+
+    // A delta seek decodes its chunk, about a millisecond
+    const uint32_t seeks = reader.view(0) ? 100000 : 1000;
+    uint32_t rng = 0x9E3779B9;
+    start = bench_clock::now();
+    for (uint32_t i = 0; i < seeks; i++) {
+        uint64_t time_us = (((uint64_t)xorshift32(rng) << 32) | xorshift32(rng)) % (frames * 40);
+        if (reader.frame(reader.seek(time_us), copy)) {
+            sum += copy.time_us;
+        }
+    }
+    double seek = seconds_since(start);
+
+    printf("recording %s read: open %.2f ms (%s), scan %.2f s, %.1f Mframes/s, seek %.2f us\n",
+           path.c_str(), open_ms, reader.indexed() ? "index" : "rebuilt", scan, count / scan * 1e-6, seek * 1e6 / seeks);
+    return sum != 0;
+}
+
+bool bench_recording()
+{
+    const char *mb = getenv("DEPTH_BENCH_RECORDING_MB");
+    const char *tmp = getenv("TMPDIR");
+    uint64_t frames = (uint64_t)(mb ? atof(mb) : 2048) * 1000000 / sizeof(RecordingFrame);
+    std::string raw = std::string(tmp ? tmp : "/tmp") + "/depth_bench_raw.drec";
+    std::string delta = std::string(tmp ? tmp : "/tmp") + "/depth_bench_delta.drec";
+
+    bool ok = recording_write(raw, RECORDING_RAW, 0, frames, false) && recording_read(raw, frames);
+    ok = ok && recording_write(delta, RECORDING_DELTA, 0, frames, false) && recording_read(delta, frames);
+    unlink(delta.c_str());
+
+    // Without index: the open scans the chunks
+    ok = ok && truncate(raw.c_str(), (off_t)recording_raw_chunk_offset(frames / RECORDING_CHUNK_FRAMES)) == 0;
+    ok = ok && recording_read(raw, frames / RECORDING_CHUNK_FRAMES * RECORDING_CHUNK_FRAMES);
+    unlink(raw.c_str());
+    return ok;
+}
+
+struct Bench {
+    const char *name;
+    bool (*run)();
+};
+
+const Bench benches[] = {
+    {"engine", bench_engine},
+    {"abi", bench_abi},
+    {"timers", bench_timers},
+    {"fibers", bench_fibers},
+    {"pwm", bench_pwm},
+    {"curve", bench_curve},
+    {"autorange", bench_autorange},
+    {"link", bench_link},
+    {"watchdog", bench_watchdog},
+    {"spsc", bench_spsc},
+    {"log", bench_log},
+    {"recording", bench_recording},
+};
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+    for (const Bench &bench : benches) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; i++) {
+            selected |= strcmp(argv[i], bench.name) == 0;
+        }
+        if (selected) {
+            ok &= bench.run();
+        }
+    }
+    return ok ? 0 : 1;
+}
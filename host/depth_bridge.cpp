@@ -0,0 +1,414 @@
+// Bench monitoring bridge: reads the compressed telemetry stream of the module
+// (TelemetryCodec.h, firmware built with TELEMETRY_STREAM) from a serial
+// device, a pty, a FIFO or a file, and serves rolling aggregates on localhost.
+//
+// depth_bridge <device|file|-> [--port 9105] [--baud 115200] [--once]
+//
+//   GET /metrics        Prometheus text format
+//   GET /snapshot.json  same aggregates and the last frame, as JSON
+//
+// --once decodes the input to its end, prints the metrics and exits:
+//
+//   depth_sim pot_sweep.scn -t sweep.tlm && depth_bridge sweep.tlm --once
+//
+// Memory is bounded: the decoder works a byte at a time and the aggregates
+// are fixed size, whatever the rate and the run time.
+
+#include "TelemetryCodec.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define BRIDGE_DEFAULT_PORT         9105
+#define BRIDGE_DEFAULT_BAUD         115200
+#define BRIDGE_OUTPUT_WINDOW        4096 // frames of the rolling output statistics
+#define BRIDGE_REGIONS              3
+
+namespace {
+
+// Upper bounds of the frame period histogram, in us, +Inf implied
+const double period_buckets_us[] = {20, 30, 35, 38, 39, 40, 41, 42, 45, 50, 60, 80, 100, 200, 500};
+const size_t period_bucket_count = sizeof(period_buckets_us) / sizeof(period_buckets_us[0]);
+
+const char *const stage_names[TELEMETRY_STAGE_COUNT] = {"acquisition", "filter", "output", "engine"};
+
+struct StageAggregate {
+    uint64_t sum;
+    uint64_t count;
+    uint32_t max;
+};
+
+struct Aggregates {
+    uint64_t          bytes;
+    uint32_t          frames;
+    uint32_t          errors;
+    uint32_t          skipped;
+    bool              have_frame;
+    TelemetrySnapshot last;
+
+    // Frame period from the time and frame counter of consecutive frames
+    uint64_t          period_buckets[period_bucket_count + 1];
+    double            period_sum_us;
+    uint64_t          period_count;
+
+    StageAggregate    stages[TELEMETRY_STAGE_COUNT];
+    uint64_t          region_frames[BRIDGE_REGIONS];
+
+    uint16_t          output_window[BRIDGE_OUTPUT_WINDOW];
+    uint32_t          output_count;
+    uint32_t          output_next;
+};
+
+std::mutex  aggregates_mutex;
+Aggregates  aggregates;
+
+void aggregate_frame(Aggregates &a, const TelemetrySnapshot &snapshot)
+{
+    if (a.have_frame && snapshot.frame != a.last.frame) {
+        uint32_t frames = snapshot.frame - a.last.frame;
+        double period_us = (double)(uint32_t)(snapshot.time_us - a.last.time_us) / frames;
+        size_t bucket = 0;
+        while (bucket < period_bucket_count && period_us > period_buckets_us[bucket]) {
+            bucket++;
+        }
+        a.period_buckets[bucket] += frames;
+        a.period_sum_us += period_us * frames;
+        a.period_count += frames;
+        // Frames between two streamed ones spent in the region of the later
+        if (snapshot.region < BRIDGE_REGIONS) {
+            a.region_frames[snapshot.region] += frames;
+        }
+    } else if (snapshot.region < BRIDGE_REGIONS) {
+        a.region_frames[snapshot.region]++;
+    }
+
+    for (uint8_t stage = 0; stage < TELEMETRY_STAGE_COUNT; stage++) {
+        StageAggregate &stats = a.stages[stage];
+        stats.sum += snapshot.stage_cycles[stage];
+        stats.count++;
+        stats.max = std::max(stats.max, snapshot.stage_cycles[stage]);
+    }
+
+    a.output_window[a.output_next] = snapshot.volume;
+    a.output_next = (a.output_next + 1) % BRIDGE_OUTPUT_WINDOW;
+    a.output_count = std::min<uint32_t>(a.output_count + 1, BRIDGE_OUTPUT_WINDOW);
+
+    a.last = snapshot;
+    a.have_frame = true;
+}
+
+struct OutputStats {
+    uint16_t min;
+    uint16_t max;
+    double   mean;
+    double   stddev;
+};
+
+OutputStats output_stats(const Aggregates &a)
+{
+    OutputStats stats{0, 0, 0, 0};
+    if (!a.output_count) {
+        return stats;
+    }
+    stats.min = UINT16_MAX;
+    double sum = 0, squares = 0;
+    for (uint32_t i = 0; i < a.output_count; i++) {
+        uint16_t value = a.output_window[i];
+        stats.min = std::min(stats.min, value);
+        stats.max = std::max(stats.max, value);
+        sum += value;
+        squares += (double)value * value;
+    }
+    stats.mean = sum / a.output_count;
+    stats.stddev = sqrt(std::max(0.0, squares / a.output_count - stats.mean * stats.mean));
+    return stats;
+}
+
+void append(std::string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+void append(std::string &out, const char *format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out += line;
+}
+
+std::string prometheus(const Aggregates &a)
+{
+    std::string out;
+    append(out, "# HELP depth_bridge_bytes_total Telemetry bytes received.\n# TYPE depth_bridge_bytes_total counter\n");
+    append(out, "depth_bridge_bytes_total %llu\n", (unsigned long long)a.bytes);
+    append(out, "# HELP depth_bridge_frames_total Telemetry frames decoded.\n# TYPE depth_bridge_frames_total counter\n");
+    append(out, "depth_bridge_frames_total %u\n", a.frames);
+    append(out, "# HELP depth_bridge_errors_total Frames with a bad CRC or payload and sequence gaps.\n# TYPE depth_bridge_errors_total counter\n");
+    append(out, "depth_bridge_errors_total %u\n", a.errors);
+    append(out, "# HELP depth_bridge_skipped_total Delta frames received before a keyframe.\n# TYPE depth_bridge_skipped_total counter\n");
+    append(out, "depth_bridge_skipped_total %u\n", a.skipped);
+
+    append(out, "# HELP depth_loop_rate_hz Control loop rate reported by the module.\n# TYPE depth_loop_rate_hz gauge\n");
+    append(out, "depth_loop_rate_hz %u\n", a.last.loop_rate_hz);
+    append(out, "# HELP depth_loop_period_ns Smoothed control loop period reported by the module.\n# TYPE depth_loop_period_ns gauge\n");
+    append(out, "depth_loop_period_ns %u\n", a.last.loop_period_ns);
+
+    append(out, "# HELP depth_frame_period_us Control loop period between streamed frames.\n# TYPE depth_frame_period_us histogram\n");
+    uint64_t cumulative = 0;
+    for (size_t bucket = 0; bucket < period_bucket_count; bucket++) {
+        cumulative += a.period_buckets[bucket];
+        append(out, "depth_frame_period_us_bucket{le=\"%g\"} %llu\n", period_buckets_us[bucket], (unsigned long long)cumulative);
+    }
+    append(out, "depth_frame_period_us_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)a.period_count);
+    append(out, "depth_frame_period_us_sum %.1f\n", a.period_sum_us);
+    append(out, "depth_frame_period_us_count %llu\n", (unsigned long long)a.period_count);
+
+    append(out, "# HELP depth_stage_cycles Cycles per control loop stage.\n# TYPE depth_stage_cycles summary\n");
+    for (uint8_t stage = 0; stage < TELEMETRY_STAGE_COUNT; stage++) {
+        append(out, "depth_stage_cycles_sum{stage=\"%s\"} %llu\n", stage_names[stage], (unsigned long long)a.stages[stage].sum);
+        append(out, "depth_stage_cycles_count{stage=\"%s\"} %llu\n", stage_names[stage], (unsigned long long)a.stages[stage].count);
+    }
+    append(out, "# HELP depth_stage_cycles_max Worst cycles per control loop stage.\n# TYPE depth_stage_cycles_max gauge\n");
+    for (uint8_t stage = 0; stage < TELEMETRY_STAGE_COUNT; stage++) {
+        append(out, "depth_stage_cycles_max{stage=\"%s\"} %u\n", stage_names[stage], a.stages[stage].max);
+    }
+
+    static const char *const region_names[BRIDGE_REGIONS] = {"plateau", "left", "right"};
+    append(out, "# HELP depth_region_frames_total Control loop frames spent in each region.\n# TYPE depth_region_frames_total counter\n");
+    for (uint8_t region = 0; region < BRIDGE_REGIONS; region++) {
+        append(out, "depth_region_frames_total{region=\"%s\"} %llu\n", region_names[region], (unsigned long long)a.region_frames[region]);
+    }
+
+    OutputStats output = output_stats(a);
+    append(out, "# HELP depth_output Output volume over the last %u streamed frames.\n# TYPE depth_output gauge\n", BRIDGE_OUTPUT_WINDOW);
+    append(out, "depth_output{stat=\"last\"} %u\n", a.last.volume);
+    append(out, "depth_output{stat=\"min\"} %u\n", output.min);
+    append(out, "depth_output{stat=\"max\"} %u\n", output.max);
+    append(out, "depth_output{stat=\"mean\"} %.1f\n", output.mean);
+    append(out, "depth_output{stat=\"stddev\"} %.1f\n", output.stddev);
+    return out;
+}
+
+std::string json(const Aggregates &a)
+{
+    std::string out = "{";
+    append(out, "\"bytes\":%llu,\"frames\":%u,\"errors\":%u,\"skipped\":%u,", (unsigned long long)a.bytes, a.frames, a.errors, a.skipped);
+    append(out, "\"loop_rate_hz\":%u,\"loop_period_ns\":%u,", a.last.loop_rate_hz, a.last.loop_period_ns);
+    append(out, "\"frame_period_us\":{\"mean\":%.3f,\"count\":%llu,\"buckets\":[",
+           a.period_count ? a.period_sum_us / a.period_count : 0.0, (unsigned long long)a.period_count);
+    for (size_t bucket = 0; bucket <= period_bucket_count; bucket++) {
+        if (bucket < period_bucket_count) {
+            append(out, "%s{\"le\":%g,\"count\":%llu}", bucket ? "," : "", period_buckets_us[bucket], (unsigned long long)a.period_buckets[bucket]);
+        } else {
+            append(out, ",{\"le\":\"+Inf\",\"count\":%llu}", (unsigned long long)a.period_buckets[bucket]);
+        }
+    }
+    out += "]},\"stages\":{";
+    for (uint8_t stage = 0; stage < TELEMETRY_STAGE_COUNT; stage++) {
+        const StageAggregate &stats = a.stages[stage];
+        append(out, "%s\"%s\":{\"mean\":%.1f,\"max\":%u,\"last\":%u}", stage ? "," : "", stage_names[stage],
+               stats.count ? (double)stats.sum / stats.count : 0.0, stats.max, a.last.stage_cycles[stage]);
+    }
+    append(out, "},\"region_frames\":{\"plateau\":%llu,\"left\":%llu,\"right\":%llu},",
+           (unsigned long long)a.region_frames[0], (unsigned long long)a.region_frames[1], (unsigned long long)a.region_frames[2]);
+    OutputStats output = output_stats(a);
+    append(out, "\"output\":{\"last\":%u,\"min\":%u,\"max\":%u,\"mean\":%.1f,\"stddev\":%.1f},",
+           a.last.volume, output.min, output.max, output.mean, output.stddev);
+    append(out, "\"last\":{\"time_us\":%u,\"frame\":%u,\"raw\":[%u,%u,%u,%u,%u],\"filtered\":[%u,%u,%u,%u,%u],",
+           a.last.time_us, a.last.frame,
+           a.last.raw[0], a.last.raw[1], a.last.raw[2], a.last.raw[3], a.last.raw[4],
+           a.last.filtered[0], a.last.filtered[1], a.last.filtered[2], a.last.filtered[3], a.last.filtered[4]);
+    append(out, "\"volume\":%u,\"region\":%u,\"lin_log\":%u,\"curve_switches\":%u,\"warm_start_us\":%u}}\n",
+           a.last.volume, a.last.region, a.last.lin_log, a.last.curve_switches, a.last.warm_start_us);
+    return out;
+}
+
+speed_t baud_constant(int baud)
+{
+    switch (baud) {
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default:     return 0;
+    }
+}
+
+// Serial devices and ptys in raw mode at the given rate, files as they are
+bool configure_serial(int fd, int baud)
+{
+    if (!isatty(fd)) {
+        return true;
+    }
+    speed_t speed = baud_constant(baud);
+    termios tty;
+    if (!speed || tcgetattr(fd, &tty) != 0) {
+        return false;
+    }
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &tty) == 0;
+}
+
+void read_stream(int fd)
+{
+    TelemetryDecoder decoder;
+    uint8_t buffer[4096];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+        std::lock_guard<std::mutex> lock(aggregates_mutex);
+        aggregates.bytes += (uint64_t)count;
+        TelemetrySnapshot snapshot;
+        for (ssize_t i = 0; i < count; i++) {
+            if (decoder.feed(buffer[i], snapshot)) {
+                aggregate_frame(aggregates, snapshot);
+            }
+        }
+        aggregates.frames = decoder.frames();
+        aggregates.errors = decoder.errors();
+        aggregates.skipped = decoder.skipped();
+    }
+}
+
+void send_all(int fd, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t count = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (count <= 0) {
+            return;
+        }
+        sent += (size_t)count;
+    }
+}
+
+void serve_client(int client)
+{
+    // Only the request line matters
+    char request[2048];
+    ssize_t length = recv(client, request, sizeof(request) - 1, 0);
+    if (length <= 0) {
+        return;
+    }
+    request[length] = 0;
+
+    std::string body;
+    const char *type = "text/plain; version=0.0.4";
+    const char *status = "200 OK";
+    if (strncmp(request, "GET /metrics ", 13) == 0) {
+        std::lock_guard<std::mutex> lock(aggregates_mutex);
+        body = prometheus(aggregates);
+    } else if (strncmp(request, "GET /snapshot.json ", 19) == 0) {
+        std::lock_guard<std::mutex> lock(aggregates_mutex);
+        body = json(aggregates);
+        type = "application/json";
+    } else {
+        status = "404 Not Found";
+        type = "text/plain";
+        body = "try /metrics or /snapshot.json\n";
+    }
+
+    std::string response;
+    append(response, "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", status, type, body.size());
+    send_all(client, response + body);
+}
+
+// Localhost only, one client at a time: a scraper and a browser at most
+int serve(int port)
+{
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server < 0) {
+        perror("socket");
+        return 1;
+    }
+    int reuse = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)port);
+    if (bind(server, (sockaddr *)&address, sizeof(address)) != 0 || listen(server, 8) != 0) {
+        perror("bind");
+        close(server);
+        return 1;
+    }
+    fprintf(stderr, "serving http://127.0.0.1:%d/metrics and /snapshot.json\n", port);
+
+    while (true) {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0) {
+            continue;
+        }
+        serve_client(client);
+        close(client);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *path = nullptr;
+    int port = BRIDGE_DEFAULT_PORT;
+    int baud = BRIDGE_DEFAULT_BAUD;
+    bool once = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc) {
+            baud = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--once") == 0) {
+            once = true;
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: depth_bridge <device|file|-> [--port %d] [--baud %d] [--once]\n", BRIDGE_DEFAULT_PORT, BRIDGE_DEFAULT_BAUD);
+        return 2;
+    }
+
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    if (!configure_serial(fd, baud)) {
+        fprintf(stderr, "%s: cannot set %d baud\n", path, baud);
+        return 1;
+    }
+
+    if (once) {
+        read_stream(fd);
+        fputs(prometheus(aggregates).c_str(), stdout);
+        return aggregates.errors ? 1 : 0;
+    }
+
+    std::thread reader(read_stream, fd);
+    reader.detach();
+    return serve(port);
+}
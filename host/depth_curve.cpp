@@ -0,0 +1,29 @@
+// Compiles a depth law (DepthCurve.h) like the firmware does on a
+// "curve <expression>" line, to try it before the upload: prints the table,
+// or the error under the expression.
+//
+// depth_curve '<expression>'            CSV of the table points: cv,volume
+
+#include "DepthCurve.h"
+
+#include <cstdio>
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: depth_curve '<expression>'\n");
+        return 2;
+    }
+    static DepthCurveProgram program;
+    static uint16_t table[DEPTH_CURVE_POINTS];
+    DepthCurveError error;
+    if (!depth_curve_compile(argv[1], program, error) || !depth_curve_table(program, table, error)) {
+        fprintf(stderr, "%s\n%*s^ %s\n", argv[1], (int)error.position, "", error.message);
+        return 1;
+    }
+    printf("cv,volume\n");
+    for (uint32_t point = 0; point < DEPTH_CURVE_POINTS; point++) {
+        printf("%u,%u\n", point << (16 - DEPTH_CURVE_BITS), table[point]);
+    }
+    return 0;
+}
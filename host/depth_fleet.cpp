@@ -0,0 +1,339 @@
+// Virtual rack: many simulated modules run in parallel, each with its own
+// front end tolerances, ADC noise, pot settings and CV source, compared with
+// a module of nominal parts and no noise driven the same way.
+//
+// depth_fleet [--instances 1000] [--seconds 0.5] [--threads N] [--tolerance 1]
+//             [--cap-tolerance 10] [--noise 2] [--seed 1] [--asc file.asc]
+//             [--csv out.csv] [--scaling]
+//
+//   --tolerance, --cap-tolerance   resistor and capacitor spread, in %
+//   --noise                        ADC noise, RMS in 12 bit LSB
+//   --csv                          one line of statistics per instance
+//   --scaling                      runs with 1, 2, 4... threads up to --threads
+//                                  and checks that the results do not change
+//
+// Each module is the firmware signal chain without the RTOS: FrontEnd.h, the
+// 12 bit ADC, the EWMA filters of main.cpp (InputFilter.h),
+// depth_compute_fixed() and the DAC. The instances run on a work-stealing
+// pool (WorkStealing.h): each thread starts on its own block of instances and
+// steals from the others once done. Each instance is seeded by its index, so
+// the results do not depend on the thread count.
+
+#include "DepthEngine.h"
+#include "FrontEnd.h"
+#include "InputFilter.h"
+#include "Scenario.h"
+#include "WorkStealing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define FLEET_FRAME_US              40
+
+#ifndef DEPTH_FLEET_ASC
+#define DEPTH_FLEET_ASC             "Documentation/ldepth_rdepth_cv_to_dac.asc"
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock fleet_clock;
+
+struct FleetOptions {
+    uint32_t    instances = 1000;
+    float       seconds = 0.5f;
+    uint32_t    threads = std::max(1u, std::thread::hardware_concurrency());
+    float       tolerance = 0.01f;
+    float       cap_tolerance = 0.1f;
+    float       noise = 2.0f;
+    uint32_t    seed = 1;
+    std::string asc = DEPTH_FLEET_ASC;
+    std::string csv;
+    bool        scaling = false;
+};
+
+// Per instance results
+struct FleetResult {
+    uint32_t seed;
+    float    rms_error;         // DAC, 12 bit LSB
+    uint32_t max_error;
+    float    region_mismatch;   // % of frames
+    float    ns_per_frame;      // host CPU time
+};
+
+uint32_t xorshift32(uint32_t &x)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+// One module: front end, ADC, filters, engine
+class FleetModule {
+public:
+    FleetModule(const FrontEndParts &parts, float noise_lsb, uint32_t seed) :
+        _front_end(parts, FLEET_FRAME_US),
+        _noise(noise_lsb / 147.8f), // RMS of the sum of four bytes
+        _rng(seed | 1),
+        _cv(FILTER_CV_WEIGHT, FILTER_WEIGHT_SCALE),
+        _slider(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE),
+        _left(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE),
+        _right(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE)
+    {
+    }
+
+    DepthOutputs frame(float cv, uint16_t slider, uint16_t left, uint16_t right, uint16_t &dac)
+    {
+        uint32_t cv_reading = (uint32_t)_cv.filter(adc(_front_end.step(cv) / FRONT_END_VREF * 4095.0f));
+        DepthInputs in{cv_reading, (uint32_t)_slider.filter(adc(slider / 16.0f)), (uint32_t)_left.filter(adc(left / 16.0f)),
+                       (uint32_t)_right.filter(adc(right / 16.0f))};
+        DepthOutputs out = depth_compute_fixed(in);
+        dac = out.volume & 0xFFF0;
+        return out;
+    }
+
+private:
+    // 12 bit conversion with noise, scaled to 16 bits like AnalogIn::read_u16()
+    uint16_t adc(float code)
+    {
+        if (_noise > 0) {
+            uint32_t r = xorshift32(_rng);
+            int32_t sum = (int32_t)((r & 0xFF) + (r >> 8 & 0xFF) + (r >> 16 & 0xFF) + (r >> 24)) - 510;
+            code += sum * _noise;
+        }
+        int32_t value = (int32_t)lrintf(code);
+        value = value < 0 ? 0 : (value > 4095 ? 4095 : value);
+        return (uint16_t)(value << 4 | value >> 8);
+    }
+
+    FrontEnd    _front_end;
+    float       _noise;
+    uint32_t    _rng;
+    InputFilter _cv, _slider, _left, _right;
+};
+
+// Random CV source and pot settings of an instance
+Scenario fleet_scenario(uint32_t &rng)
+{
+    static const ScenarioWave waves[] = {WAVE_RAMP, WAVE_TRIANGLE, WAVE_SINE, WAVE_SQUARE};
+    Scenario scenario;
+    scenario.wave = waves[xorshift32(rng) % 4];
+    scenario.wave_a = (uint16_t)xorshift32(rng);
+    scenario.wave_b = (uint16_t)xorshift32(rng);
+    scenario.wave_hz = 0.5f + (xorshift32(rng) % 2000) / 100.0f;
+    for (int pot = 0; pot < POT_COUNT; pot++) {
+        scenario.pots[pot].push_back(ScenarioKeyframe{0, (uint16_t)xorshift32(rng)});
+    }
+    return scenario;
+}
+
+FleetResult run_instance(const FleetOptions &options, const FrontEndParts &nominal, uint32_t index)
+{
+    FleetResult result{};
+    uint32_t rng = options.seed ^ (index + 1) * 0x9E3779B9;
+    xorshift32(rng);
+    rng |= 1;
+    result.seed = rng;
+
+    Scenario scenario = fleet_scenario(rng);
+    FleetModule module(front_end_draw(nominal, options.tolerance, options.cap_tolerance, rng), options.noise, xorshift32(rng));
+    FleetModule reference(nominal, 0, 1);
+    uint16_t slider = scenario_pot(scenario, POT_SLIDER, 0);
+    uint16_t left = scenario_pot(scenario, POT_LEFT, 0);
+    uint16_t right = scenario_pot(scenario, POT_RIGHT, 0);
+
+    uint64_t frames = (uint64_t)(options.seconds * 1e6f) / FLEET_FRAME_US;
+    uint64_t sum_sq = 0, mismatches = 0;
+    fleet_clock::time_point start = fleet_clock::now();
+    for (uint64_t frame = 0; frame < frames; frame++) {
+        uint32_t cv_rng = 0;
+        uint16_t value = scenario_cv(scenario, frame * FLEET_FRAME_US, cv_rng);
+        float cv = FRONT_END_CV_MIN + (FRONT_END_CV_MAX - FRONT_END_CV_MIN) * value / 65535.0f;
+
+        uint16_t dac, reference_dac;
+        uint8_t region = module.frame(cv, slider, left, right, dac).region;
+        uint8_t reference_region = reference.frame(cv, slider, left, right, reference_dac).region;
+        uint32_t error = (uint32_t)std::abs((int32_t)(dac >> 4) - (int32_t)(reference_dac >> 4));
+        sum_sq += error * error;
+        result.max_error = std::max(result.max_error, error);
+        mismatches += region != reference_region;
+    }
+    double elapsed = std::chrono::duration<double>(fleet_clock::now() - start).count();
+
+    result.rms_error = frames ? (float)sqrt((double)sum_sq / frames) : 0;
+    result.region_mismatch = frames ? (float)mismatches * 100 / frames : 0;
+    result.ns_per_frame = frames ? (float)(elapsed * 1e9 / frames) : 0;
+    return result;
+}
+
+// Runs the fleet on 'threads' workers, returns the wall time
+double run_fleet(const FleetOptions &options, const FrontEndParts &nominal, uint32_t threads, std::vector<FleetResult> &results)
+{
+    results.assign(options.instances, FleetResult{});
+    fleet_clock::time_point start = fleet_clock::now();
+    work_stealing_run(threads, options.instances, [&](uint32_t index) {
+        results[index] = run_instance(options, nominal, index);
+    });
+    return std::chrono::duration<double>(fleet_clock::now() - start).count();
+}
+
+// Value at the fraction q of the sorted values
+template <typename T>
+T percentile(std::vector<T> values, float q)
+{
+    if (values.empty()) {
+        return T();
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(q * values.size()))];
+}
+
+template <typename T, typename Field>
+void print_distribution(const char *name, const std::vector<FleetResult> &results, Field field, const char *format)
+{
+    std::vector<T> values;
+    for (const FleetResult &result : results) {
+        values.push_back(result.*field);
+    }
+    char line[160];
+    snprintf(line, sizeof(line), "  %%-22s p50 %s  p90 %s  p99 %s  max %s\n", format, format, format, format);
+    printf(line, name, percentile(values, 0.5f), percentile(values, 0.9f), percentile(values, 0.99f), percentile(values, 1.0f));
+}
+
+uint64_t results_hash(const std::vector<FleetResult> &results)
+{
+    uint64_t hash = 0;
+    for (const FleetResult &result : results) {
+        uint32_t bits[3];
+        memcpy(&bits[0], &result.rms_error, 4);
+        bits[1] = result.max_error;
+        memcpy(&bits[2], &result.region_mismatch, 4);
+        for (uint32_t word : bits) {
+            hash = (hash ^ word) * 0x100000001B3ULL;
+        }
+    }
+    return hash;
+}
+
+bool parse_options(int argc, char **argv, FleetOptions &options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--scaling") {
+            options.scaling = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (arg == "--instances") {
+            options.instances = (uint32_t)strtoul(value, nullptr, 0);
+        } else if (arg == "--seconds") {
+            options.seconds = strtof(value, nullptr);
+        } else if (arg == "--threads") {
+            options.threads = std::max(1ul, strtoul(value, nullptr, 0));
+        } else if (arg == "--tolerance") {
+            options.tolerance = strtof(value, nullptr) / 100.0f;
+        } else if (arg == "--cap-tolerance") {
+            options.cap_tolerance = strtof(value, nullptr) / 100.0f;
+        } else if (arg == "--noise") {
+            options.noise = strtof(value, nullptr);
+        } else if (arg == "--seed") {
+            options.seed = (uint32_t)strtoul(value, nullptr, 0);
+        } else if (arg == "--asc") {
+            options.asc = value;
+        } else if (arg == "--csv") {
+            options.csv = value;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    FleetOptions options;
+    if (!parse_options(argc, argv, options)) {
+        fprintf(stderr, "usage: depth_fleet [--instances N] [--seconds S] [--threads N] [--tolerance %%] [--cap-tolerance %%]\n"
+                        "                   [--noise LSB] [--seed S] [--asc file.asc] [--csv out.csv] [--scaling]\n");
+        return 2;
+    }
+    FrontEndParts nominal;
+    std::string error;
+    if (!front_end_load(options.asc.c_str(), nominal, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    std::vector<FleetResult> results;
+    uint64_t frames = (uint64_t)options.instances * ((uint64_t)(options.seconds * 1e6f) / FLEET_FRAME_US);
+    if (options.scaling) {
+        double single = 0;
+        uint64_t expected = 0;
+        bool same = true;
+        for (uint32_t threads = 1;; threads = std::min(threads * 2, options.threads)) {
+            double elapsed = run_fleet(options, nominal, threads, results);
+            if (threads == 1) {
+                single = elapsed;
+                expected = results_hash(results);
+            }
+            bool match = results_hash(results) == expected;
+            same &= match;
+            printf("fleet %3u threads: %.2f s, %.1f Mframes/s, speedup x%.2f, efficiency %.0f%%%s\n", threads, elapsed,
+                   frames / elapsed * 1e-6, single / elapsed, single / elapsed / threads * 100, match ? "" : "  RESULTS DIFFER");
+            if (threads == options.threads) {
+                break;
+            }
+        }
+        return same ? 0 : 1;
+    }
+
+    double elapsed = run_fleet(options, nominal, options.threads, results);
+    printf("fleet: %u instances x %.2f s, %u threads, %.2f s, %.1f Mframes/s\n", options.instances, options.seconds,
+           options.threads, elapsed, frames / elapsed * 1e-6);
+    printf("  parts from %s, +/-%.1f%% resistors, +/-%.1f%% C1, ADC noise %.1f LSB RMS\n", options.asc.c_str(),
+           options.tolerance * 100, options.cap_tolerance * 100, options.noise);
+    printf("  DAC error vs nominal module, 12 bit LSB:\n");
+    print_distribution<float>("rms", results, &FleetResult::rms_error, "%6.2f");
+    print_distribution<uint32_t>("max", results, &FleetResult::max_error, "%6u");
+    print_distribution<float>("region mismatch (%)", results, &FleetResult::region_mismatch, "%6.3f");
+    print_distribution<float>("host ns/frame", results, &FleetResult::ns_per_frame, "%6.1f");
+
+    size_t worst = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].rms_error > results[worst].rms_error) {
+            worst = i;
+        }
+    }
+    if (!results.empty()) {
+        printf("  worst instance %zu: rms %.2f LSB, max %u LSB, seed 0x%08X\n", worst, results[worst].rms_error,
+               results[worst].max_error, results[worst].seed);
+    }
+
+    if (!options.csv.empty()) {
+        FILE *csv = fopen(options.csv.c_str(), "w");
+        if (!csv) {
+            fprintf(stderr, "%s: cannot open\n", options.csv.c_str());
+            return 1;
+        }
+        fprintf(csv, "instance,seed,rms_error,max_error,region_mismatch,ns_per_frame\n");
+        for (size_t i = 0; i < results.size(); i++) {
+            const FleetResult &result = results[i];
+            fprintf(csv, "%zu,0x%08X,%.4f,%u,%.6f,%.1f\n", i, result.seed, result.rms_error, result.max_error,
+                    result.region_mismatch, result.ns_per_frame);
+        }
+        fclose(csv);
+    }
+    return 0;
+}
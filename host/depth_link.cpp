@@ -0,0 +1,283 @@
+// Stereo link on the host: a leader and a follower instance of the link code
+// of main.cpp (DepthLink.h) in two processes, connected by a socketpair or a
+// pty pair, on real time.
+//
+// depth_link [--seconds 2] [--hz 20] [--errors 0] [--pty] [--spin]
+//
+//   --hz       frequency of the leader's CV, a full scale triangle
+//   --errors   probability of a bit flip in a frame, for the CRC and the
+//              sequence numbers
+//   --pty      pty pair in raw mode instead of a socketpair
+//   --spin     busy waits instead of sleeping between the events, for hosts
+//              with a core per instance
+//
+// The leader runs a control loop frame every LINK_FRAME_US and writes the
+// bytes of its link frames at the UART pace of DEPTH_LINK_BAUD. The follower
+// reads the link at its own frame boundaries, as the firmware does, and
+// applies the leader's inputs. Both processes read the same monotonic clock:
+// the follower measures the end-to-end latency of each frame, and compares
+// its volume with the one of the leader's inputs at the same instant, with
+// and without the skew compensation.
+
+#include "DepthLink.h"
+
+#include <fcntl.h>
+#include <pty.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define LINK_FRAME_US               40 // control loop period of the firmware, ~25kHz
+#define LINK_BYTE_US                (10 * 1000000 / DEPTH_LINK_BAUD)
+#define LINK_DRAIN_US               50000 // the follower runs this long after the leader
+#define LINK_SLIDER                 32768
+#define LINK_LEFT                   20000
+#define LINK_RIGHT                  45000
+
+namespace {
+
+struct Options {
+    double   seconds = 2.0;
+    double   hz = 20.0;
+    double   errors = 0.0;
+    bool     pty = false;
+    bool     spin = false;
+};
+
+uint64_t monotonic_us()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void wait_until(uint64_t us, bool spin)
+{
+    if (spin) {
+        while (monotonic_us() < us) {
+        }
+        return;
+    }
+    timespec at{(time_t)(us / 1000000), (long)(us % 1000000) * 1000};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, nullptr)) {
+    }
+}
+
+// Leader's inputs at a time, known to both sides
+DepthInputs leader_inputs(uint64_t us, double hz)
+{
+    double phase = (double)us * 1e-6 * hz;
+    phase -= (uint64_t)phase;
+    double triangle = phase < 0.5 ? 2 * phase : 2 - 2 * phase;
+    return DepthInputs{(uint32_t)(triangle * UI16_MAX + 0.5), LINK_SLIDER, LINK_LEFT, LINK_RIGHT};
+}
+
+void run_leader(int fd, const Options &options, uint64_t start_us)
+{
+    DepthLinkLeader leader;
+    std::mt19937 random(1);
+    std::bernoulli_distribution corrupt(options.errors);
+
+    // Bytes in flight, each with the time its stop bit leaves the UART
+    std::vector<uint8_t> pending;
+    std::vector<uint64_t> due;
+    size_t next_byte = 0;
+    uint64_t line_free_us = start_us;
+    uint32_t frames = 0, corrupted = 0, busy = 0;
+
+    uint64_t end_us = start_us + (uint64_t)(options.seconds * 1e6);
+    uint64_t next_frame_us = start_us;
+    while (next_frame_us < end_us || next_byte < pending.size()) {
+        uint64_t next_us = next_byte < pending.size() ? std::min(next_frame_us, due[next_byte]) : next_frame_us;
+        wait_until(next_us, options.spin);
+        uint64_t now_us = monotonic_us();
+
+        if (now_us >= next_frame_us && next_frame_us < end_us) {
+            next_frame_us += LINK_FRAME_US;
+            uint8_t frame[DEPTH_LINK_FRAME];
+            // A frame while the previous one is going out is dropped, as LinkSerial::send() does
+            bool send = leader.frame(leader_inputs(now_us, options.hz), (uint32_t)now_us, frame);
+            if (send && line_free_us > now_us) {
+                busy++;
+            } else if (send) {
+                if (corrupt(random)) {
+                    frame[1 + random() % (DEPTH_LINK_FRAME - 1)] ^= (uint8_t)(1u << (random() % 8));
+                    corrupted++;
+                }
+                for (uint32_t i = 0; i < DEPTH_LINK_FRAME; i++) {
+                    pending.push_back(frame[i]);
+                    due.push_back(now_us + (i + 1) * LINK_BYTE_US);
+                }
+                line_free_us = now_us + DEPTH_LINK_FRAME * LINK_BYTE_US;
+                frames++;
+            }
+        }
+
+        size_t count = 0;
+        while (next_byte + count < pending.size() && due[next_byte + count] <= now_us) {
+            count++;
+        }
+        if (count && write(fd, pending.data() + next_byte, count) == (ssize_t)count) {
+            next_byte += count;
+        }
+    }
+    printf("leader: %u frames sent, %u corrupted, %u dropped on a busy line\n", frames, corrupted, busy);
+    fflush(stdout);
+}
+
+uint32_t percentile(std::vector<uint32_t> &values, double p)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    size_t index = std::min(values.size() - 1, (size_t)(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+uint32_t difference(uint32_t a, uint32_t b)
+{
+    return a > b ? a - b : b - a;
+}
+
+void run_follower(int fd, const Options &options, uint64_t start_us)
+{
+    DepthLinkDecoder decoder;
+    DepthLinkFollower follower;
+    DepthLinkFrame last{};
+    std::vector<uint32_t> latency_us, applied_us, age_error_us, compensated, uncompensated;
+
+    uint64_t end_us = start_us + (uint64_t)(options.seconds * 1e6) + LINK_DRAIN_US;
+    for (uint64_t frame_us = start_us; frame_us < end_us; frame_us += LINK_FRAME_US) {
+        wait_until(frame_us, options.spin);
+
+        // Stamped after the read, as main.cpp does
+        uint8_t bytes[256];
+        ssize_t count;
+        uint64_t now_us;
+        do {
+            count = read(fd, bytes, sizeof(bytes));
+            now_us = monotonic_us();
+            for (ssize_t i = 0; i < count; i++) {
+                DepthLinkFrame frame;
+                if (decoder.feed(bytes[i], frame)) {
+                    follower.receive(frame, (uint32_t)now_us);
+                    latency_us.push_back((uint32_t)now_us - frame.time_us);
+                    last = frame;
+                }
+            }
+        } while (count == sizeof(bytes));
+
+        DepthInputs in;
+        if (decoder.frames() < 2 || !follower.inputs((uint32_t)now_us, in)) {
+            continue;
+        }
+        // Skip the start, the clock offset is estimated from the first frames
+        if (decoder.frames() < 64) {
+            continue;
+        }
+        uint32_t truth = depth_compute_fixed(leader_inputs(now_us, options.hz)).volume;
+        compensated.push_back(difference(depth_compute_fixed(in).volume, truth));
+        uncompensated.push_back(difference(depth_compute_fixed(last.inputs).volume, truth));
+        uint32_t age_us = (uint32_t)now_us - last.time_us;
+        applied_us.push_back(age_us);
+        if (age_us <= DEPTH_LINK_MAX_AGE_US) {
+            age_error_us.push_back(difference((uint32_t)follower.age_us((uint32_t)now_us), age_us));
+        }
+    }
+
+    printf("follower: %u frames, %u CRC errors, %u lost\n", decoder.frames(), decoder.errors(), decoder.lost());
+    printf("  latency, leader frame to decoded:  p50 %uus p99 %uus max %uus (wire %uus)\n",
+           percentile(latency_us, 0.5), percentile(latency_us, 0.99), percentile(latency_us, 1.0), DEPTH_LINK_WIRE_US);
+    printf("  age of the inputs when applied:    p50 %uus p99 %uus max %uus\n",
+           percentile(applied_us, 0.5), percentile(applied_us, 0.99), percentile(applied_us, 1.0));
+    printf("  age estimate error, up to %ums:     p50 %uus p99 %uus\n",
+           DEPTH_LINK_MAX_AGE_US / 1000, percentile(age_error_us, 0.5), percentile(age_error_us, 0.99));
+    printf("  volume error, skew compensated:    p50 %u p99 %u LSB\n", percentile(compensated, 0.5), percentile(compensated, 0.99));
+    printf("  volume error, last frame as is:    p50 %u p99 %u LSB\n", percentile(uncompensated, 0.5), percentile(uncompensated, 0.99));
+}
+
+bool open_link(bool use_pty, int fds[2])
+{
+    if (!use_pty) {
+        return socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0;
+    }
+    if (openpty(&fds[0], &fds[1], nullptr, nullptr, nullptr) != 0) {
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        termios tio;
+        tcgetattr(fds[i], &tio);
+        cfmakeraw(&tio);
+        tcsetattr(fds[i], TCSANOW, &tio);
+    }
+    return true;
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: depth_link [--seconds 2] [--hz 20] [--errors 0] [--pty] [--spin]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (strcmp(arg, "--seconds") == 0 && has_value) {
+            options.seconds = atof(argv[++i]);
+        } else if (strcmp(arg, "--hz") == 0 && has_value) {
+            options.hz = atof(argv[++i]);
+        } else if (strcmp(arg, "--errors") == 0 && has_value) {
+            options.errors = atof(argv[++i]);
+        } else if (strcmp(arg, "--pty") == 0) {
+            options.pty = true;
+        } else if (strcmp(arg, "--spin") == 0) {
+            options.spin = true;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    int fds[2];
+    if (!open_link(options.pty, fds)) {
+        perror("depth_link");
+        return 1;
+    }
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+    // Sleeps end on time rather than within the default 50us of slack
+    prctl(PR_SET_TIMERSLACK, 1);
+    uint64_t start_us = monotonic_us() + 10000;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("depth_link");
+        return 1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        run_follower(fds[1], options, start_us);
+        return 0;
+    }
+    close(fds[1]);
+    run_leader(fds[0], options, start_us);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
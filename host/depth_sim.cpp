@@ -0,0 +1,395 @@
+// Runs the firmware control loop (main.cpp) on the host shim, in virtual time,
+// driven by a scenario file (see Scenario.h).
+//
+// depth_sim <scenario> [-o log.dsim] [-t telemetry.tlm] [-r recording.drec]
+//                                       run, optionally writing the binary log,
+//                                       the compressed telemetry of every frame
+//                                       (TelemetryCodec.h) and its recording
+//                                       (Recording.h). Fails when a telemetry
+//                                       frame does not decode back to its
+//                                       snapshot.
+// depth_sim --dump log.dsim             print a binary log as CSV
+//
+// Binary log: "DSIM", version (u8), channel count (u8), sample period in us
+// (u32 LE), one length-prefixed name per channel, then one record of u16 LE
+// values per sample period.
+//
+// A watchdog reset (after a "stall" or a "fault" of the scenario) ends the
+// run. The report of the retained state (PostMortem.h) the firmware sends at
+// the next boot is then appended to the telemetry, and printed decoded.
+
+#include "DepthEngine.h"
+#include "HostHal.h"
+#include "PostMortem.h"
+#include "Recording.h"
+#include "Scenario.h"
+#include "TelemetryCodec.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define DSIM_VERSION                1
+#define VALID_OUTPUT_TOLERANCE      655 // 1% of full scale
+#define TELEMETRY_PACKED_SIZE       64  // snapshot fields without padding, sync and CRC
+
+// main.cpp
+void depth_setup(void);
+void depth_frame(void);
+const char *depth_command(const char *line);
+extern uint16_t raw_cv_input;
+extern uint32_t filtered_raw_cv_input, filtered_raw_slider_input, filtered_raw_left_input, filtered_raw_right_input;
+extern uint16_t volume;
+extern uint16_t superdebug;
+extern bool lin_log_left, lin_log_right;
+extern uint32_t curve_switches;
+extern SeqLock<TelemetrySnapshot> telemetry;
+extern PostMortem post_mortem;
+
+namespace {
+
+const PinName pot_pins[POT_COUNT] = {A2, D3, A1, A0};
+
+struct ChannelStats {
+    uint32_t min = UINT16_MAX;
+    uint32_t max = 0;
+    uint64_t sum = 0;
+};
+
+// The DAC is within VALID_OUTPUT_TOLERANCE of the depth computed from the
+// current, unfiltered, inputs
+bool output_valid()
+{
+    static AnalogIn cv(A6), slider(A2), left(A1), right(A0);
+    DepthOutputs depth = depth_compute_fixed(DepthInputs{cv.read_u16(), slider.read_u16(), left.read_u16(), right.read_u16(),
+                                                         (uint8_t)(lin_log_left | lin_log_right << 1)});
+    int32_t error = (int32_t)host_analog_output(PA_5) - depth.volume;
+    return error <= VALID_OUTPUT_TOLERANCE && error >= -VALID_OUTPUT_TOLERANCE;
+}
+
+void put_u16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(value & 0xFF);
+    out.push_back(value >> 8);
+}
+
+void put_u32(std::vector<uint8_t> &out, uint32_t value)
+{
+    put_u16(out, value & 0xFFFF);
+    put_u16(out, value >> 16);
+}
+
+int dump(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return 1;
+    }
+    uint8_t header[10];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, "DSIM", 4) != 0 || header[4] != DSIM_VERSION) {
+        fprintf(stderr, "%s: not a depth_sim log\n", path);
+        fclose(file);
+        return 1;
+    }
+    uint8_t channels = header[5];
+    uint32_t sample_us = header[6] | header[7] << 8 | header[8] << 16 | (uint32_t)header[9] << 24;
+
+    printf("time_us");
+    for (uint8_t i = 0; i < channels; i++) {
+        char name[256] = {};
+        int length = fgetc(file);
+        if (length == EOF || fread(name, 1, (size_t)length, file) != (size_t)length) {
+            fprintf(stderr, "%s: truncated header\n", path);
+            fclose(file);
+            return 1;
+        }
+        printf(",%s", name);
+    }
+    printf("\n");
+
+    std::vector<uint8_t> record(channels * 2u);
+    for (uint64_t time_us = 0; fread(record.data(), 1, record.size(), file) == record.size(); time_us += sample_us) {
+        printf("%llu", (unsigned long long)time_us);
+        for (uint8_t i = 0; i < channels; i++) {
+            printf(",%u", record[2 * i] | record[2 * i + 1] << 8);
+        }
+        printf("\n");
+    }
+    fclose(file);
+    return 0;
+}
+
+// Report frames of the next boot (post_mortem_boot() of main.cpp), decoded
+// back as telemetry_decode does
+void report(PostMortem dump, FILE *telemetry_file)
+{
+    dump.reset_reason = (uint8_t)ResetReason::get();
+    post_mortem_seal(dump);
+    TelemetryDecoder decoder;
+    TelemetrySnapshot snapshot;
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    uint32_t length;
+    for (uint8_t chunk = 0; (length = telemetry_encode_report((const uint8_t *)&dump, sizeof(dump), chunk, frame)); chunk++) {
+        if (telemetry_file) {
+            fwrite(frame, 1, length, telemetry_file);
+        }
+        for (uint32_t i = 0; i < length; i++) {
+            decoder.feed(frame[i], snapshot);
+        }
+    }
+    PostMortem decoded;
+    if (!decoder.reports() || decoder.report_length() != sizeof(decoded)) {
+        fprintf(stderr, "  report not decoded\n");
+        return;
+    }
+    memcpy(&decoded, decoder.report(), sizeof(decoded));
+    if (!post_mortem_valid(decoded)) {
+        fprintf(stderr, "  no post-mortem\n");
+        return;
+    }
+    FlightRecord records[FLIGHT_RECORDER_FRAMES];
+    uint32_t count = decoded.flight.copy(records);
+    fprintf(stderr, "  post-mortem: reset reason %u, kind %u at %u us, frame %u, cause %u task %u, last frame at %u us, %u deadline misses\n",
+            decoded.reset_reason, decoded.kind, decoded.time_us, decoded.frame, decoded.cause, decoded.task, decoded.last_frame_us,
+            decoded.misses);
+    fprintf(stderr, "  post-mortem: error %08x, %u frames recorded, the last at %u us, cv %u volume %u\n",
+            decoded.fault[FAULT_ERROR_STATUS], decoded.flight.recorded(), count ? records[count - 1].time_us : 0,
+            count ? records[count - 1].cv_volume & 0xFFFF : 0, count ? records[count - 1].cv_volume >> 16 : 0);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "--dump") == 0) {
+        return dump(argv[2]);
+    }
+    const char *log_path = nullptr;
+    const char *telemetry_path = nullptr;
+    const char *recording_path = nullptr;
+    bool usage = argc < 2;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            log_path = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            telemetry_path = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            recording_path = argv[++i];
+        } else {
+            usage = true;
+        }
+    }
+    if (usage) {
+        fprintf(stderr, "usage: depth_sim <scenario> [-o log.dsim] [-t telemetry.tlm] [-r recording.drec]\n       depth_sim --dump log.dsim\n");
+        return 2;
+    }
+
+    Scenario scenario;
+    std::string error;
+    if (!scenario_load(argv[1], scenario, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    FILE *log = nullptr;
+    if (log_path) {
+        log = fopen(log_path, "wb");
+        if (!log) {
+            fprintf(stderr, "%s: cannot create\n", log_path);
+            return 1;
+        }
+        std::vector<uint8_t> header = {'D', 'S', 'I', 'M', DSIM_VERSION, (uint8_t)scenario.channels.size()};
+        put_u32(header, scenario.sample_us);
+        for (ScenarioChannel channel : scenario.channels) {
+            const char *name = scenario_channel_names[channel];
+            header.push_back((uint8_t)strlen(name));
+            header.insert(header.end(), name, name + strlen(name));
+        }
+        fwrite(header.data(), 1, header.size(), log);
+    }
+
+    // Every frame coded, and decoded back to check the round trip
+    FILE *telemetry_file = nullptr;
+    if (telemetry_path) {
+        telemetry_file = fopen(telemetry_path, "wb");
+        if (!telemetry_file) {
+            fprintf(stderr, "%s: cannot create\n", telemetry_path);
+            return 1;
+        }
+    }
+    TelemetryEncoder encoder;
+    TelemetryDecoder decoder;
+
+    RecordingWriter recording;
+    if (recording_path && !recording.open(recording_path, RECORDING_DELTA, false, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    uint64_t telemetry_bytes = 0, telemetry_mismatches = 0;
+    double encode_seconds = 0;
+
+    // Buttons have pull-ups, released until the scenario presses them
+    host_digital_set(PB_4, 1);
+    host_digital_set(PB_5, 1);
+
+    uint32_t rng = 0x2545F491;
+    for (int pot = 0; pot < POT_COUNT; pot++) {
+        host_analog_set(pot_pins[pot], scenario_pot(scenario, (ScenarioPot)pot, 0));
+    }
+    host_analog_set(A6, scenario_cv(scenario, 0, rng));
+
+    depth_setup();
+    // Time to the first valid output, -1 while the output never was valid
+    int64_t valid_us = output_valid() ? 0 : -1;
+
+    std::vector<ChannelStats> stats(scenario.channels.size());
+    std::vector<uint8_t> record;
+    size_t next_button = 0, next_command = 0;
+    uint64_t next_sample_us = 0;
+    uint64_t frames = 0;
+    uint32_t led_high = 0, led_frames = 0;
+    bool halted = false;
+
+    auto start = std::chrono::steady_clock::now();
+    while (host_time_us() < scenario.duration_us) {
+        uint64_t now = host_time_us();
+        for (; next_button < scenario.buttons.size() && scenario.buttons[next_button].time_us <= now; next_button++) {
+            const ScenarioButton &button = scenario.buttons[next_button];
+            host_digital_set(button.button == 'l' ? PB_4 : PB_5, !button.down);
+        }
+        for (; next_command < scenario.commands.size() && scenario.commands[next_command].time_us <= now; next_command++) {
+            const ScenarioCommand &command = scenario.commands[next_command];
+            const char *error = depth_command(command.line.c_str());
+            if (error) {
+                fprintf(stderr, "%s: '%s' at %llu us: %s\n", argv[1], command.line.c_str(), (unsigned long long)command.time_us, error);
+                return 1;
+            }
+        }
+        for (int pot = 0; pot < POT_COUNT; pot++) {
+            host_analog_set(pot_pins[pot], scenario_pot(scenario, (ScenarioPot)pot, now));
+        }
+        host_analog_set(A6, scenario_cv(scenario, now, rng));
+
+        if (now >= scenario.warning_us) {
+            mbed_warning(MBED_ERROR_INVALID_ARGUMENT, "Invalid argument", 0, __FILE__, __LINE__);
+            scenario.warning_us = UINT64_MAX;
+        }
+        if (now >= scenario.fault_us) {
+            if (!halted) {
+                mbed_error(MBED_ERROR_HARDFAULT_EXCEPTION, "Fault exception", 0, __FILE__, __LINE__);
+                halted = true;
+            }
+        } else if (!scenario_stalled(scenario, now)) {
+            depth_frame();
+            frames++;
+        }
+        if (valid_us < 0 && output_valid()) {
+            valid_us = (int64_t)now;
+        }
+
+        if (recording_path && !recording.write(telemetry.read())) {
+            fprintf(stderr, "%s: cannot write\n", recording_path);
+            return 1;
+        }
+        if (telemetry_file) {
+            TelemetrySnapshot snapshot = telemetry.read();
+            uint8_t frame[TELEMETRY_FRAME_MAX];
+            auto encode_start = std::chrono::steady_clock::now();
+            uint32_t length = encoder.encode(snapshot, frame);
+            encode_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - encode_start).count();
+            fwrite(frame, 1, length, telemetry_file);
+            telemetry_bytes += length;
+
+            TelemetrySnapshot decoded;
+            bool complete = false;
+            for (uint32_t i = 0; i < length; i++) {
+                complete = decoder.feed(frame[i], decoded);
+            }
+            uint32_t expected[TELEMETRY_FIELD_COUNT], actual[TELEMETRY_FIELD_COUNT];
+            telemetry_to_fields(snapshot, expected);
+            telemetry_to_fields(decoded, actual);
+            if (!complete || memcmp(expected, actual, sizeof(expected)) != 0) {
+                telemetry_mismatches++;
+            }
+        }
+
+        // SoftPWM output, as its duty cycle over the sample period
+        led_high += host_digital_output(LED1);
+        led_frames++;
+
+        if (now >= next_sample_us) {
+            record.clear();
+            for (size_t i = 0; i < scenario.channels.size(); i++) {
+                uint32_t value = 0;
+                switch (scenario.channels[i]) {
+                    case CHANNEL_CV_RAW: value = raw_cv_input; break;
+                    case CHANNEL_CV:     value = filtered_raw_cv_input; break;
+                    case CHANNEL_SLIDER: value = filtered_raw_slider_input; break;
+                    case CHANNEL_LEFT:   value = filtered_raw_left_input; break;
+                    case CHANNEL_RIGHT:  value = filtered_raw_right_input; break;
+                    case CHANNEL_VOLUME: value = volume; break;
+                    case CHANNEL_REGION: value = superdebug; break;
+                    case CHANNEL_DAC:    value = host_analog_output(PA_5); break;
+                    case CHANNEL_LED:    value = (uint32_t)((uint64_t)led_high * UINT16_MAX / led_frames); break;
+                    case CHANNEL_LIN_LOG: value = lin_log_left | lin_log_right << 1; break;
+                    default:             break;
+                }
+                value = std::min<uint32_t>(value, UINT16_MAX);
+                put_u16(record, (uint16_t)value);
+                stats[i].min = std::min(stats[i].min, value);
+                stats[i].max = std::max(stats[i].max, value);
+                stats[i].sum += value;
+            }
+            if (log) {
+                fwrite(record.data(), 1, record.size(), log);
+            }
+            led_high = led_frames = 0;
+            next_sample_us += scenario.sample_us;
+        }
+
+        host_advance_us(scenario.frame_us);
+        if (host_watchdog_resets()) {
+            break;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double simulated = scenario.duration_us * 1e-6;
+    uint64_t samples = next_sample_us / scenario.sample_us;
+
+    if (log) {
+        fclose(log);
+    }
+    if (recording_path && !recording.close()) {
+        fprintf(stderr, "%s: cannot write\n", recording_path);
+        return 1;
+    }
+
+    fprintf(stderr, "%s: %llu frames, %.3f s simulated in %.3f s (x%.0f)\n", argv[1], (unsigned long long)frames, simulated, elapsed, simulated / elapsed);
+    fprintf(stderr, "  %u Lin/Log switches\n", (unsigned int)curve_switches);
+    if (telemetry_file && frames) {
+        double bytes_per_frame = (double)telemetry_bytes / frames;
+        fprintf(stderr, "  telemetry %.2f bytes/frame, x%.2f vs %u packed bytes, %.0f ns/frame to encode, %llu round trip mismatches\n",
+                bytes_per_frame, TELEMETRY_PACKED_SIZE / bytes_per_frame, TELEMETRY_PACKED_SIZE, encode_seconds * 1e9 / frames,
+                (unsigned long long)telemetry_mismatches);
+    }
+    if (host_watchdog_resets()) {
+        fprintf(stderr, "  watchdog reset at %llu us\n", (unsigned long long)host_watchdog_reset_us());
+        report(post_mortem, telemetry_file);
+    }
+    if (valid_us >= 0) {
+        fprintf(stderr, "  valid output after %lld us\n", (long long)valid_us);
+    } else {
+        fprintf(stderr, "  output never valid\n");
+    }
+    for (size_t i = 0; i < scenario.channels.size(); i++) {
+        fprintf(stderr, "  %-8s min %5u  max %5u  mean %8.1f\n", scenario_channel_names[scenario.channels[i]],
+                stats[i].min, stats[i].max, samples ? (double)stats[i].sum / samples : 0.0);
+    }
+    if (telemetry_file) {
+        fclose(telemetry_file);
+    }
+    return telemetry_mismatches ? 1 : 0;
+}
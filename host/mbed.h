@@ -0,0 +1,322 @@
+#pragma once
+
+// Host stand-in for the parts of mbed-os used by the firmware. Pins, timers
+// and threads run on the virtual clock of HostHal.h.
+
+#include "TimingWheel.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <unistd.h>
+
+// Same encoding as the STM32 targets: port in the high nibble
+typedef enum {
+    PA_0 = 0x00, PA_1, PA_2, PA_3, PA_4, PA_5, PA_6, PA_7,
+    PA_8, PA_9, PA_10, PA_11, PA_12, PA_13, PA_14, PA_15,
+    PB_0 = 0x10, PB_1, PB_2, PB_3, PB_4, PB_5, PB_6, PB_7,
+    PB_8, PB_9, PB_10, PB_11, PB_12, PB_13, PB_14, PB_15,
+    PC_14 = 0x2E, PC_15 = 0x2F,
+
+    // NUCLEO_L432KC
+    A0 = PA_0,
+    A1 = PA_1,
+    A2 = PA_3,
+    A3 = PA_4,
+    A4 = PA_5,
+    A5 = PA_6,
+    A6 = PA_7,
+    A7 = PA_2,
+    D0 = PA_10,
+    D1 = PA_9,
+    D3 = PB_0,
+    D11 = PB_5,
+    D12 = PB_4,
+    D13 = PB_3,
+    LED1 = PB_3,
+    USBTX = PA_2,
+    USBRX = PA_15,
+
+    NC = (int)0xFFFFFFFF
+} PinName;
+
+#define HOST_PIN_COUNT 0x30
+
+// Peripheral of a pin, for pinmap_find_peripheral()
+typedef struct {
+    PinName pin;
+    int     peripheral;
+    int     function;
+} PinMap;
+
+#define DEVICE_PWMOUT 1
+
+// Timers, the peripherals of PinMap_PWM. PWM_2 is TIM2, the us_ticker timer.
+typedef enum {
+    PWM_1 = 1,
+    PWM_2 = 2,
+    PWM_15 = 15,
+    PWM_16 = 16
+} PWMName;
+
+// Timer channels of the NUCLEO_L432KC pins, in HostHal.cpp: NC when the pin
+// has none
+extern const PinMap PinMap_PWM[];
+uint32_t pinmap_find_peripheral(PinName pin, const PinMap *map);
+
+typedef enum {
+    PullNone = 0,
+    PullUp = 1,
+    PullDown = 2,
+    PullDefault = PullNone
+} PinMode;
+
+typedef enum {
+    osPriorityLow = 8,
+    osPriorityBelowNormal = 16,
+    osPriorityNormal = 24,
+    osPriorityAboveNormal = 32,
+    osPriorityHigh = 40,
+    osPriorityRealtime = 48
+} osPriority;
+
+// hal/reset_reason_api.h
+typedef enum {
+    RESET_REASON_POWER_ON,
+    RESET_REASON_PIN_RESET,
+    RESET_REASON_BROWN_OUT,
+    RESET_REASON_SOFTWARE,
+    RESET_REASON_WATCHDOG,
+    RESET_REASON_LOCKUP,
+    RESET_REASON_WAKE_LOW_POWER,
+    RESET_REASON_ACCESS_ERROR,
+    RESET_REASON_BOOT_ERROR,
+    RESET_REASON_MULTIPLE,
+    RESET_REASON_PLATFORM,
+    RESET_REASON_UNKNOWN
+} reset_reason_t;
+
+// platform/mbed_error.h, the context fields the firmware reads
+typedef int mbed_error_status_t;
+typedef struct {
+    mbed_error_status_t error_status;
+    uint32_t            error_address;
+    uint32_t            error_value;
+} mbed_error_ctx;
+typedef void (*mbed_error_hook_t)(const mbed_error_ctx *error_ctx);
+#define MBED_SUCCESS 0
+#define MBED_GET_ERROR_CODE(error_status) ((int)((error_status) & 0xFFFF))
+#define MBED_ERROR_CODE_ASSERTION_FAILED 273
+#define MBED_ERROR_CODE_HARDFAULT_EXCEPTION 317
+#define MBED_ERROR_CODE_MEMMANAGE_EXCEPTION 318
+#define MBED_ERROR_CODE_BUSFAULT_EXCEPTION 319
+#define MBED_ERROR_CODE_USAGEFAULT_EXCEPTION 320
+#define MBED_ERROR_HARDFAULT_EXCEPTION (int)0x80FF013D
+#define MBED_ERROR_INVALID_ARGUMENT (int)0x80FF0101
+
+// Calls the hook and returns: the simulator stops the control loop itself
+mbed_error_status_t mbed_error(mbed_error_status_t error_status, const char *error_msg, unsigned int error_value, const char *filename, int line_number);
+// Calls the hook too, as mbed does
+mbed_error_status_t mbed_warning(mbed_error_status_t error_status, const char *error_msg, unsigned int error_value, const char *filename, int line_number);
+mbed_error_status_t mbed_set_error_hook(mbed_error_hook_t custom_error_hook);
+
+typedef int32_t osStatus;
+#define osOK 0
+
+#define OS_STACK_SIZE 4096
+
+namespace mbed {
+
+template <typename Signature>
+using Callback = std::function<Signature>;
+
+template <typename R>
+Callback<R()> callback(R (*func)())
+{
+    return func;
+}
+
+template <typename T, typename R>
+Callback<R()> callback(T *obj, R (T::*method)())
+{
+    return [obj, method]() {
+        return (obj->*method)();
+    };
+}
+
+class AnalogIn {
+public:
+    AnalogIn(PinName pin);
+    uint16_t read_u16();
+    float read();
+
+protected:
+    PinName _pin;
+};
+
+class AnalogOut {
+public:
+    AnalogOut(PinName pin);
+    void write_u16(uint16_t value);
+    void write(float value);
+    float read();
+
+protected:
+    PinName _pin;
+};
+
+class DigitalIn {
+public:
+    DigitalIn(PinName pin);
+    void mode(PinMode pull);
+    int read();
+    operator int()
+    {
+        return read();
+    }
+
+protected:
+    PinName _pin;
+};
+
+class DigitalOut {
+public:
+    DigitalOut(PinName pin, int value = 0);
+    void write(int value);
+    int read();
+    DigitalOut &operator=(int value)
+    {
+        write(value);
+        return *this;
+    }
+    operator int()
+    {
+        return read();
+    }
+
+protected:
+    PinName _pin;
+};
+
+// Timer channel: the pin level follows the virtual clock, with no timer
+// event nor DigitalOut write, like the hardware output
+class PwmOut {
+public:
+    PwmOut(PinName pin);
+    void write(float value);
+    float read();
+    void period(float seconds);
+    void period_ms(int ms);
+    void period_us(int us);
+    void pulsewidth(float seconds);
+    void pulsewidth_ms(int ms);
+    void pulsewidth_us(int us);
+    PwmOut &operator=(float value)
+    {
+        write(value);
+        return *this;
+    }
+    operator float()
+    {
+        return read();
+    }
+
+protected:
+    PinName _pin;
+};
+
+// Pending Ticker/Timeout, queued on the virtual clock by HostHal.cpp
+struct HostTimer : TimingWheelNode {
+    Callback<void()> handler;
+    uint64_t         period_us; // 0 for a Timeout
+};
+
+class Ticker {
+public:
+    Ticker();
+    ~Ticker();
+    void attach(Callback<void()> func, float t);
+    void attach(Callback<void()> func, std::chrono::microseconds t);
+    void attach_us(Callback<void()> func, uint64_t t);
+    void detach();
+
+protected:
+    bool      _one_shot;
+    HostTimer _timer;
+};
+
+class Timeout : public Ticker {
+public:
+    Timeout();
+};
+
+// Independent watchdog on the virtual clock: expiring does not restart the
+// firmware, it counts a reset (host_watchdog_resets()) and stops the watchdog
+class Watchdog {
+public:
+    static Watchdog &get_instance();
+    bool start(uint32_t timeout);
+    bool stop();
+    void kick();
+    uint32_t get_timeout() const;
+    bool is_running() const;
+
+private:
+    Watchdog();
+
+    uint32_t _timeout;
+    bool     _running;
+};
+
+// platform/FileHandle.h, the console only: mbed_file_handle(STDOUT_FILENO)
+// writes to stdout, after what was printed to it
+class FileHandle {
+public:
+    ssize_t write(const void *buffer, size_t size);
+};
+
+FileHandle *mbed_file_handle(int fd);
+
+// Watchdog after a simulated watchdog reset (host_watchdog_resets()), power
+// on otherwise
+class ResetReason {
+public:
+    static reset_reason_t get();
+    static uint32_t get_raw();
+};
+
+} // namespace mbed
+
+// Simulated thread state, in HostHal.cpp
+struct HostFiber;
+
+namespace rtos {
+
+// A fiber on its own stack, not an OS thread: it runs on the simulator's
+// thread when the virtual clock reaches its wake-up time, until it sleeps again
+class Thread {
+public:
+    Thread(osPriority priority = osPriorityNormal, uint32_t stack_size = OS_STACK_SIZE, unsigned char *stack_mem = nullptr, const char *name = nullptr);
+    osStatus start(mbed::Callback<void()> task);
+
+private:
+    uint32_t   _stack_size;
+    HostFiber *_fiber;
+};
+
+namespace ThisThread {
+void sleep_for(std::chrono::milliseconds rel_time);
+void sleep_until(uint64_t abs_time_us);
+}
+
+} // namespace rtos
+
+void wait_us(int us);
+
+// Free running microsecond counter
+uint32_t us_ticker_read(void);
+
+using namespace mbed;
+using namespace rtos;
+using namespace std::chrono_literals;
@@ -0,0 +1,129 @@
+// Decodes a compressed telemetry stream (TelemetryCodec.h) to CSV: a console
+// capture of the firmware built with TELEMETRY_STREAM, or depth_sim -t.
+//
+// telemetry_decode [stream.tlm] [-r report.csv]
+//                                       reads stdin without a file
+//
+// The report of the last run the firmware sends at boot (PostMortem.h) goes
+// to stderr, its flight recorder frames to report.csv. The boot log lines the
+// firmware prints after it are skipped with the other bytes outside frames.
+
+#include "PostMortem.h"
+#include "TelemetryCodec.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char *const kind_names[] = {"none", "watchdog pre-timeout", "fault", "flight recorder only"};
+
+void print_report(const TelemetryDecoder &decoder, FILE *csv)
+{
+    PostMortem dump;
+    if (decoder.report_length() != sizeof(dump)) {
+        fprintf(stderr, "report of %u bytes, %u expected\n", decoder.report_length(), (unsigned int)sizeof(dump));
+        return;
+    }
+    memcpy(&dump, decoder.report(), sizeof(dump));
+    if (!post_mortem_valid(dump)) {
+        fprintf(stderr, "report with a bad checksum\n");
+        return;
+    }
+    fprintf(stderr, "report: reset reason %u, %s at %u us, frame %u\n", dump.reset_reason,
+            dump.kind <= POST_MORTEM_RECORDER ? kind_names[dump.kind] : "?", dump.time_us, dump.frame);
+    fprintf(stderr, "  watchdog cause %u task %u, last frame at %u us, %u deadline misses\n",
+            dump.cause, dump.task, dump.last_frame_us, dump.misses);
+    fprintf(stderr, "  CFSR %08x HFSR %08x MMFAR %08x BFAR %08x, mbed error %08x at %08x\n",
+            dump.fault[FAULT_CFSR], dump.fault[FAULT_HFSR], dump.fault[FAULT_MMFAR], dump.fault[FAULT_BFAR],
+            dump.fault[FAULT_ERROR_STATUS], dump.fault[FAULT_ERROR_ADDRESS]);
+    fprintf(stderr, "  stage cycles, average/max:");
+    for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+        fprintf(stderr, " %u/%u", dump.stage_average[stage], dump.stage_max[stage]);
+    }
+    FlightRecord records[FLIGHT_RECORDER_FRAMES];
+    uint32_t count = dump.flight.copy(records);
+    fprintf(stderr, "\n  %u frames recorded, the last %u kept\n", dump.flight.recorded(), count);
+    if (!csv) {
+        return;
+    }
+    fprintf(csv, "time_us,cv,volume,slider,region\n");
+    for (uint32_t i = 0; i < count; i++) {
+        fprintf(csv, "%u,%u,%u,%u,%u\n", records[i].time_us, records[i].cv_volume & 0xFFFF, records[i].cv_volume >> 16,
+                records[i].slider_region & 0xFFFF, records[i].slider_region >> 16);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *path = nullptr;
+    const char *report_path = nullptr;
+    bool usage = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            report_path = argv[++i];
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            usage = true;
+        }
+    }
+    if (usage) {
+        fprintf(stderr, "usage: telemetry_decode [stream.tlm] [-r report.csv]\n");
+        return 2;
+    }
+    FILE *file = path ? fopen(path, "rb") : stdin;
+    if (!file) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return 1;
+    }
+    FILE *csv = nullptr;
+    if (report_path) {
+        csv = fopen(report_path, "w");
+        if (!csv) {
+            fprintf(stderr, "%s: cannot create\n", report_path);
+            return 1;
+        }
+    }
+
+    printf("time_us,frame,cv_raw,slider_raw,center_raw,left_raw,right_raw,cv,slider,center,left,right,"
+           "volume,region,loop_rate_hz,loop_period_ns,warm_start_us,lin_log,curve_switches,"
+           "acquisition_cycles,filter_cycles,output_cycles,engine_cycles\n");
+
+    TelemetryDecoder decoder;
+    TelemetrySnapshot snapshot;
+    uint64_t bytes = 0;
+    uint8_t buffer[4096];
+    size_t count;
+    uint32_t reports = 0;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes += count;
+        for (size_t i = 0; i < count; i++) {
+            if (!decoder.feed(buffer[i], snapshot)) {
+                if (decoder.reports() != reports) {
+                    reports = decoder.reports();
+                    print_report(decoder, csv);
+                }
+                continue;
+            }
+            uint32_t fields[TELEMETRY_FIELD_COUNT];
+            telemetry_to_fields(snapshot, fields);
+            for (uint8_t field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+                printf(field ? ",%u" : "%u", (unsigned int)fields[field]);
+            }
+            printf("\n");
+        }
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+    if (csv) {
+        fclose(csv);
+    }
+
+    fprintf(stderr, "%llu bytes, %u frames, %u bad frames, %u deltas before a keyframe\n",
+            (unsigned long long)bytes, decoder.frames(), decoder.errors(), decoder.skipped());
+    return decoder.errors() ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdio>
+
+// Checks of the host tests: a failed CHECK() prints the expression and where,
+// and the test's main() returns check_result(), non-zero after any failure.
+// No test framework: each test is a plain executable run by ctest.
+
+inline int &check_failures()
+{
+    static int failures;
+    return failures;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            check_failures()++; \
+        } \
+    } while (0)
+
+inline int check_result()
+{
+    printf("%s\n", check_failures() ? "FAILED" : "passed");
+    return check_failures() ? 1 : 0;
+}
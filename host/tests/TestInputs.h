@@ -0,0 +1,41 @@
+#pragma once
+
+#include "DepthEngine.h"
+#include "TestRandom.h"
+
+#include <vector>
+
+// Engine inputs shared by the host tests that compare the engine variants and
+// the C ABI against depth_compute().
+
+// Every input uniformly random, Lin/Log modes included
+inline DepthInputs random_depth_inputs(uint32_t &rng)
+{
+    DepthInputs in;
+    in.cv = xorshift32(rng) & UI16_MAX;
+    in.slider = xorshift32(rng) & UI16_MAX;
+    in.left = xorshift32(rng) & UI16_MAX;
+    in.right = xorshift32(rng) & UI16_MAX;
+    in.lin_log = xorshift32(rng) & (DEPTH_LOG_LEFT | DEPTH_LOG_RIGHT);
+    return in;
+}
+
+// Every CV reading, the slider and the pots at their ends and middle, both
+// ramps Lin then Log
+inline std::vector<DepthInputs> sweep_depth_inputs()
+{
+    std::vector<DepthInputs> points;
+    const uint32_t pots[] = {0, UI16_MAX / 2, UI16_MAX};
+    for (uint8_t lin_log : {0, DEPTH_LOG_LEFT | DEPTH_LOG_RIGHT}) {
+        for (uint32_t slider : pots) {
+            for (uint32_t left : pots) {
+                for (uint32_t right : pots) {
+                    for (uint32_t cv = 0; cv <= UI16_MAX; cv++) {
+                        points.push_back(DepthInputs{cv, slider, left, right, lin_log});
+                    }
+                }
+            }
+        }
+    }
+    return points;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+// Random inputs of the host tests: every test draws from xorshift32() with a
+// fixed seed, so that a failure replays the same sequence.
+
+inline uint32_t xorshift32(uint32_t &x)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+inline uint32_t abs_diff(uint32_t a, uint32_t b)
+{
+    return a > b ? a - b : b - a;
+}
@@ -0,0 +1,52 @@
+# Decodes the console output of log_test with the format table of its own
+# ELF, no sources: every frame comes back as text. Then a source with two
+# formats of the same token must make tokenlog_decode fail. See the
+# tokenlog_decode test in CMakeLists.txt.
+#
+# cmake -DLOG_TEST=<log_test> -DTOKENLOG_DECODE=<tokenlog_decode> -DOUTPUT=<prefix> -P TokenLogDecodeTest.cmake
+
+get_filename_component(output_dir ${OUTPUT} DIRECTORY)
+file(MAKE_DIRECTORY ${output_dir})
+
+execute_process(
+    COMMAND ${LOG_TEST}
+    OUTPUT_FILE ${OUTPUT}.console
+    RESULT_VARIABLE result
+)
+if(result)
+    message(FATAL_ERROR "log_test failed: ${result}")
+endif()
+
+execute_process(
+    COMMAND ${TOKENLOG_DECODE} ${LOG_TEST}
+    INPUT_FILE ${OUTPUT}.console
+    OUTPUT_VARIABLE decoded
+    ERROR_VARIABLE errors
+    RESULT_VARIABLE result
+)
+message("${decoded}${errors}")
+if(result OR errors)
+    message(FATAL_ERROR "tokenlog_decode ${LOG_TEST} failed: ${result}")
+endif()
+
+set(expected
+    "ENGINE: 3 abcd\nunknown command\nFRAME: 0 0\nFRAME: 1 1\nFRAME: 2 2\nFRAME: 3 3\nTOKENLOG: 2 frames dropped\npassed\n"
+)
+if(NOT decoded STREQUAL expected)
+    message(FATAL_ERROR "decoded console differs, expected:\n${expected}")
+endif()
+
+# "COLLISION 462382" and "COLLISION 679599" share the FNV-1a token 82F7E202
+file(WRITE ${OUTPUT}.collision.cpp
+    "TOKENLOG(log, \"COLLISION 462382\");\nTOKENLOG(log, \"COLLISION 679599\");\n"
+)
+execute_process(
+    COMMAND ${TOKENLOG_DECODE} ${OUTPUT}.collision.cpp
+    INPUT_FILE ${OUTPUT}.console
+    OUTPUT_QUIET
+    ERROR_VARIABLE errors
+    RESULT_VARIABLE result
+)
+if(NOT result OR NOT errors MATCHES "token collision")
+    message(FATAL_ERROR "tokenlog_decode accepted a token collision: ${result}")
+endif()
@@ -0,0 +1,92 @@
+// libdepthengine (DepthEngineC.h): the library and the header agree on the
+// ABI version, unknown variants are refused, a new engine runs the fixed
+// variant with the pots at mid scale, and blocks processed in place, with and
+// without regions and with every input varying, give what depth_compute*()
+// gives when called directly, for every CV reading.
+
+#include "Check.h"
+#include "DepthEngine.h"
+#include "DepthEngineC.h"
+#include "TestInputs.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+const size_t COUNT = 65536;
+
+DepthOutputs expected(int variant, const DepthInputs &in)
+{
+    return variant == DEPTH_ENGINE_FIXED ? depth_compute_fixed(in) : depth_compute(in);
+}
+
+// Every CV against the pots set on the engine, then random inputs
+uint32_t mismatches(depth_engine *engine, int variant, uint16_t slider, uint16_t left, uint16_t right)
+{
+    std::vector<uint16_t> cv(COUNT), volume(COUNT), in_place(COUNT);
+    std::vector<uint8_t> region(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        cv[i] = in_place[i] = (uint16_t)i;
+    }
+    depth_engine_set_pots(engine, slider, left, right);
+    uint32_t wrong = 0;
+    wrong += depth_engine_process_block(engine, cv.data(), volume.data(), region.data(), COUNT) != COUNT;
+    wrong += depth_engine_process_block(engine, in_place.data(), in_place.data(), nullptr, COUNT) != COUNT;
+    for (size_t i = 0; i < COUNT; i++) {
+        DepthOutputs out = expected(variant, DepthInputs{cv[i], slider, left, right});
+        wrong += volume[i] != out.volume || region[i] != out.region || in_place[i] != out.volume;
+    }
+
+    std::vector<uint16_t> pots(3 * COUNT);
+    uint16_t *sliders = pots.data(), *lefts = sliders + COUNT, *rights = lefts + COUNT;
+    uint32_t rng = 0x2545F491 ^ slider;
+    for (size_t i = 0; i < COUNT; i++) {
+        DepthInputs in = random_depth_inputs(rng);
+        sliders[i] = (uint16_t)in.slider;
+        lefts[i] = (uint16_t)in.left;
+        rights[i] = (uint16_t)in.right;
+    }
+    wrong += depth_engine_process_inputs(engine, cv.data(), sliders, lefts, rights, volume.data(), region.data(), COUNT) != COUNT;
+    for (size_t i = 0; i < COUNT; i++) {
+        DepthOutputs out = expected(variant, DepthInputs{cv[i], sliders[i], lefts[i], rights[i]});
+        wrong += volume[i] != out.volume || region[i] != out.region;
+    }
+    printf("%s, pots %5u %5u %5u: %u mismatches\n", variant == DEPTH_ENGINE_FIXED ? "fixed" : "float", slider, left,
+           right, wrong);
+    return wrong;
+}
+
+} // namespace
+
+int main()
+{
+    CHECK(depth_engine_abi_version() == DEPTH_ENGINE_ABI_VERSION);
+
+    depth_engine *engine = depth_engine_create();
+    CHECK(engine != nullptr);
+    CHECK(depth_engine_set_variant(engine, 2) == -1);
+    CHECK(depth_engine_set_variant(engine, -1) == -1);
+
+    // Defaults: fixed variant, pots at mid scale
+    std::vector<uint16_t> volume(COUNT);
+    bool defaults = true;
+    for (size_t i = 0; i < COUNT; i++) {
+        volume[i] = (uint16_t)i;
+    }
+    depth_engine_process_block(engine, volume.data(), volume.data(), nullptr, COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        defaults &= volume[i] == depth_compute_fixed(DepthInputs{(uint16_t)i, UI16_MAX / 2, UI16_MAX / 2, UI16_MAX / 2}).volume;
+    }
+    CHECK(defaults);
+
+    for (int variant : {DEPTH_ENGINE_FIXED, DEPTH_ENGINE_FLOAT}) {
+        CHECK(depth_engine_set_variant(engine, variant) == 0);
+        CHECK(mismatches(engine, variant, 12000, 20000, 40000) == 0);
+        CHECK(mismatches(engine, variant, 0, 0, 0) == 0);
+        CHECK(mismatches(engine, variant, UI16_MAX, UI16_MAX, UI16_MAX) == 0);
+    }
+    CHECK(depth_engine_process_block(engine, nullptr, nullptr, nullptr, 0) == 0);
+    depth_engine_destroy(engine);
+    return check_result();
+}
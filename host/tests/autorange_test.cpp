@@ -0,0 +1,123 @@
+// AutoRange.h: P2Quantiles within 1% of full scale of the exact quantiles of
+// uniform, skewed and bell shaped CVs; AutoRange scaling the range of a
+// steady source to full scale with few coefficient updates, following a
+// source re-patched to another range within a window, widening a constant CV
+// to the narrowest span, and starting over after reset().
+
+#include "AutoRange.h"
+#include "Check.h"
+#include "TestRandom.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+// Triangle between low and high at 2 Hz in 25 kHz frames, with noise
+uint32_t triangle_cv(uint64_t frame, uint32_t low, uint32_t high, uint32_t &rng)
+{
+    uint32_t phase = (uint32_t)(frame % 12500);
+    uint32_t position = phase < 6250 ? phase : 12500 - phase;
+    int32_t cv = (int32_t)(low + (uint64_t)(high - low) * position / 6250) + (int32_t)(xorshift32(rng) % 601) - 300;
+    return (uint32_t)std::min<int32_t>(std::max<int32_t>(cv, 0), UI16_MAX);
+}
+
+// Largest distance to the exact quantiles, in LSB
+float quantile_error(uint32_t shape, uint32_t &rng)
+{
+    const uint32_t samples = 100000;
+    P2Quantiles<3> estimator(auto_range_probabilities);
+    std::vector<float> values(samples);
+    for (float &value : values) {
+        float u = (float)(xorshift32(rng) & 0xFFFF) / 0xFFFF;
+        if (shape == 1) {
+            value = u * u * u * UI16_MAX;
+        } else if (shape == 2) {
+            float sum = 0;
+            for (int i = 0; i < 4; i++) {
+                sum += (float)(xorshift32(rng) & 0xFFFF) / 0xFFFF;
+            }
+            value = sum / 4 * UI16_MAX;
+        } else {
+            value = u * UI16_MAX;
+        }
+        estimator.add(value);
+    }
+    std::sort(values.begin(), values.end());
+    float max_error = 0;
+    for (uint32_t q = 0; q < 3; q++) {
+        float exact = values[(size_t)(auto_range_probabilities[q] * (samples - 1))];
+        max_error = std::max(max_error, fabsf(estimator.quantile(q) - exact));
+    }
+    printf("%s: quantile error %.0f LSB\n", shape == 0 ? "uniform" : shape == 1 ? "skewed" : "bell", max_error);
+    return max_error;
+}
+
+bool near(uint32_t value, uint32_t expected, uint32_t tolerance)
+{
+    return abs_diff(value, expected) <= tolerance;
+}
+
+} // namespace
+
+int main()
+{
+    uint32_t rng = 0x2545F491;
+    for (uint32_t shape = 0; shape < 3; shape++) {
+        CHECK(quantile_error(shape, rng) < 0.01f * UI16_MAX);
+    }
+
+    // Steady source for 20 s, then re-patched to another range for 20 s
+    const uint64_t frames = 500000;
+    static AutoRange range;
+    CHECK(!range.ready());
+    uint32_t steady_updates = 0;
+    uint64_t follow_frames = 0;
+    for (uint64_t frame = 0; frame < 2 * frames; frame++) {
+        bool second = frame >= frames;
+        uint32_t cv = second ? triangle_cv(frame, 40000, 60000, rng) : triangle_cv(frame, 10000, 30000, rng);
+        bool updated = range.add(cv);
+        if (updated && frame >= frames / 2 && !second) {
+            steady_updates++;
+        }
+        const AutoRangeCoefficients &c = range.coefficients();
+        if (second && !follow_frames && abs((int32_t)c.low - 40400) < 2 * AUTO_RANGE_DRIFT
+            && abs((int32_t)c.high - 59600) < 2 * AUTO_RANGE_DRIFT) {
+            follow_frames = frame - frames;
+        }
+        if (frame == frames - 1) {
+            // The 2% and 98% ends of the first range at the ends of the scale
+            CHECK(range.ready());
+            CHECK(range.scale(10400) < 2 * AUTO_RANGE_DRIFT * 65535 / 19200);
+            CHECK(range.scale(29600) > UI16_MAX - 2 * AUTO_RANGE_DRIFT * 65535 / 19200);
+            CHECK(range.scale(0) == 0 && range.scale(UI16_MAX) == UI16_MAX);
+            CHECK(near(range.scale(c.median), UI16_MAX / 2, 2 * AUTO_RANGE_DRIFT * 65535 / 19200));
+        }
+    }
+    printf("%u coefficient updates in 10 s of a steady source, re-patch followed in %llu frames (%.2f s)\n",
+           steady_updates, (unsigned long long)follow_frames, follow_frames / 25000.0);
+    CHECK(steady_updates <= 4);
+    CHECK(follow_frames && follow_frames <= (uint64_t)AUTO_RANGE_WINDOW * AUTO_RANGE_DIVIDER);
+
+    // A constant CV: the narrowest span around it, not an infinite gain
+    range.reset();
+    CHECK(!range.ready());
+    for (uint64_t frame = 0; frame < frames && !range.ready(); frame++) {
+        range.add(20000);
+    }
+    CHECK(range.ready());
+    const AutoRangeCoefficients &c = range.coefficients();
+    CHECK(c.offset == 20000 - AUTO_RANGE_MIN_SPAN / 2);
+    CHECK(near(range.scale(20000), UI16_MAX / 2, 16));
+
+    // At the top of the scale the span stays inside it
+    range.reset();
+    for (uint64_t frame = 0; frame < frames && !range.ready(); frame++) {
+        range.add(UI16_MAX);
+    }
+    CHECK(range.ready() && range.coefficients().offset == UI16_MAX - AUTO_RANGE_MIN_SPAN);
+    return check_result();
+}
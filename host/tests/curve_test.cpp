@@ -0,0 +1,94 @@
+// DepthCurve.h: expressions evaluate as written, operators, precedence,
+// definitions and functions included; interpolated tables stay within 64 LSB
+// of the expression at every CV; broken expressions and code past the fixed
+// sizes are refused, with the error at the right place.
+
+#include "Check.h"
+#include "DepthCurve.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+DepthCurveProgram program;
+uint16_t table[DEPTH_CURVE_POINTS];
+
+bool evaluates(const char *source, float cv, float expected)
+{
+    DepthCurveError error{0, nullptr};
+    if (!depth_curve_compile(source, program, error)) {
+        printf("'%s': %s at %u\n", source, error.message, error.position);
+        return false;
+    }
+    float value = program.evaluate(cv);
+    bool ok = fabsf(value - expected) < 1e-5f;
+    if (!ok) {
+        printf("'%s' at %.3f: %f, expected %f\n", source, cv, value, expected);
+    }
+    return ok;
+}
+
+// Largest distance between the table and the clamped expression
+uint32_t interpolation_error(const char *source)
+{
+    DepthCurveError error{0, nullptr};
+    if (!depth_curve_compile(source, program, error) || !depth_curve_table(program, table, error)) {
+        printf("'%s': %s at %u\n", source, error.message, error.position);
+        return UINT32_MAX;
+    }
+    uint32_t max_error = 0;
+    for (uint32_t cv = 0; cv <= 65535; cv++) {
+        float exact = std::min(1.0f, std::max(0.0f, program.evaluate((float)cv / 65535))) * 65535;
+        max_error = std::max(max_error, (uint32_t)fabsf(depth_curve_lookup(table, cv) - exact));
+    }
+    printf("'%s': interpolation error %u LSB\n", source, max_error);
+    return max_error;
+}
+
+bool error_at(const char *source, uint16_t position)
+{
+    DepthCurveError error{0, nullptr};
+    bool compiled = depth_curve_compile(source, program, error) && depth_curve_table(program, table, error);
+    if (compiled || error.position != position || !error.message) {
+        printf("'%s': %s at %u, expected an error at %u\n", source, compiled ? "compiled" : error.message,
+               error.position, position);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main()
+{
+    CHECK(evaluates("cv", 0.25f, 0.25f));
+    CHECK(evaluates("1 - 2 * cv", 0.25f, 0.5f));
+    CHECK(evaluates("(1 - 2) * cv", 0.25f, -0.25f));
+    CHECK(evaluates("2 ^ 3 ^ 2", 0, 512));
+    CHECK(evaluates("-2 ^ 2", 0, -4));
+    CHECK(evaluates("a = cv * 2; b = a + 1; b * a", 0.5f, 2));
+    CHECK(evaluates("min(cv, 0.3) + max(cv, 0.3)", 0.5f, 0.8f));
+    CHECK(evaluates("clamp(cv * 4, 0.5, 1.5)", 0.1f, 0.5f));
+    CHECK(evaluates("pow(cv, 2) + sqrt(cv) + abs(-cv)", 0.25f, 0.0625f + 0.5f + 0.25f));
+    CHECK(evaluates("exp(log(cv))", 0.4f, 0.4f));
+    CHECK(evaluates("sin(pi / 2) + cos(0)", 0, 2));
+
+    CHECK(interpolation_error("c = 0.5; w = 0.2; g = 2; clamp(1 - abs(cv - c)/w, 0, 1)^g") <= 64);
+    CHECK(interpolation_error("cv") <= 1);
+    CHECK(interpolation_error("1 - cv") <= 1);
+    CHECK(interpolation_error("cv ^ 3") <= 64);
+    CHECK(interpolation_error("0.5 + 0.5 * sin(8 * pi * cv)") <= 64);
+    CHECK(interpolation_error("2 * cv - 0.5") <= 1);
+
+    CHECK(error_at("1 - cv)", 6));
+    CHECK(error_at("clamp(cv, 0)", 11));
+    CHECK(error_at("a = 2; a * cvv", 11));
+    CHECK(error_at("cv = 1; cv", 0));
+    CHECK(error_at("sqrt(cv - 2)", 0));
+    CHECK(error_at("log(cv) +", 9));
+    CHECK(error_at("1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1))))))))))))))))))", 49));
+    CHECK(error_at("", 0));
+    return check_result();
+}
@@ -0,0 +1,133 @@
+// Engine variants against the float depth_compute(): depth_divide_lut() is
+// exact for every divisor, and depth_compute_fixed() and depth_compute_lut()
+// stay within their tolerances of DepthEngine.h, Lin and Log, on random
+// inputs, CV sweeps and the filtered inputs of the recordings given as
+// arguments (the scenario runs of depth_sim). Prints the max, mean and RMS
+// deviation of each.
+//
+// engine_test [recording.drec...]
+
+#include "Check.h"
+#include "DepthEngine.h"
+#include "Recording.h"
+#include "TestInputs.h"
+#include "TestRandom.h"
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Variant {
+    const char  *name;
+    DepthOutputs (*compute)(const DepthInputs &);
+    uint32_t     max;       // tolerances, mean and RMS in thousandths of LSB
+    uint32_t     mean;
+    uint32_t     rms;
+};
+
+const Variant variants[] = {
+    {"fixed", depth_compute_fixed, FIXED_MAX_DEVIATION, FIXED_MEAN_DEVIATION, FIXED_RMS_DEVIATION},
+    {"lut", depth_compute_lut, LUT_MAX_DEVIATION, LUT_MEAN_DEVIATION, LUT_RMS_DEVIATION},
+};
+
+// Every divisor, at the ends of the numerator range, around its multiples
+// and at random numerators
+uint32_t divide_lut_failures()
+{
+    uint32_t rng = 0x3C6EF372;
+    uint32_t failures = 0;
+    for (uint32_t divisor = 1; divisor <= UI16_MAX; divisor++) {
+        uint32_t limit = UI16_MAX * divisor;
+        auto check = [&](uint32_t numerator) {
+            failures += depth_divide_lut(numerator, divisor) != numerator / divisor;
+        };
+        check(0);
+        check((uint32_t)UI16_MAX * UI16_MAX);
+        for (uint32_t multiple = 1; multiple <= UI16_MAX; multiple += 4099) {
+            check(multiple * divisor - 1);
+            check(multiple * divisor);
+        }
+        for (int i = 0; i < 32; i++) {
+            check(xorshift32(rng) % limit);
+        }
+    }
+    return failures;
+}
+
+void check_deviation(const Variant &variant, const char *inputs, const std::vector<DepthInputs> &points)
+{
+    uint32_t max = 0;
+    double sum = 0, sum_sq = 0;
+    for (const DepthInputs &in : points) {
+        uint32_t magnitude = abs_diff(variant.compute(in).volume, depth_compute(in).volume);
+        max = magnitude > max ? magnitude : max;
+        sum += magnitude;
+        sum_sq += (double)magnitude * magnitude;
+    }
+    double mean = sum / points.size();
+    double rms = std::sqrt(sum_sq / points.size());
+    printf("%-5s %-10s max %u LSB, mean %.4f LSB, RMS %.4f LSB over %zu points\n", variant.name, inputs, max, mean, rms,
+           points.size());
+    CHECK(max <= variant.max);
+    CHECK(mean * 1000 <= variant.mean);
+    CHECK(rms * 1000 <= variant.rms);
+}
+
+std::vector<DepthInputs> random_inputs()
+{
+    std::vector<DepthInputs> points(1000000);
+    uint32_t rng = 0x2545F491;
+    for (DepthInputs &in : points) {
+        in = random_depth_inputs(rng);
+    }
+    return points;
+}
+
+bool recorded_inputs(const char *path, std::vector<DepthInputs> &points)
+{
+    RecordingReader reader;
+    std::string error;
+    if (!reader.open(path, error)) {
+        printf("%s\n", error.c_str());
+        return false;
+    }
+    RecordingFrame frame;
+    TelemetrySnapshot snapshot;
+    for (uint64_t i = 0; i < reader.frame_count(); i++) {
+        if (!reader.frame(i, frame)) {
+            printf("%s: frame %llu unreadable\n", path, (unsigned long long)i);
+            return false;
+        }
+        telemetry_from_fields(frame.fields, snapshot);
+        points.push_back(DepthInputs{snapshot.filtered[INPUT_CV], snapshot.filtered[INPUT_SLIDER],
+                                     snapshot.filtered[INPUT_LEFT], snapshot.filtered[INPUT_RIGHT], snapshot.lin_log});
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    CHECK(divide_lut_failures() == 0);
+
+    std::vector<DepthInputs> random = random_inputs();
+    std::vector<DepthInputs> sweep = sweep_depth_inputs();
+    std::vector<DepthInputs> recorded;
+    for (int i = 1; i < argc; i++) {
+        CHECK(recorded_inputs(argv[i], recorded));
+    }
+    CHECK(argc == 1 || !recorded.empty());
+
+    for (const Variant &variant : variants) {
+        check_deviation(variant, "random", random);
+        check_deviation(variant, "sweep", sweep);
+        if (!recorded.empty()) {
+            check_deviation(variant, "recorded", recorded);
+        }
+    }
+    return check_result();
+}
@@ -0,0 +1,77 @@
+// Host Thread fibers (mbed.h, HostHal.cpp): threads sleeping 1 to 8 ms in
+// loops, with sleep_for() and sleep_until(), wake up exactly when due, as
+// often as their period allows, and in time order with a Ticker handler on
+// the same virtual clock.
+
+#include "Check.h"
+#include "HostHal.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+const uint32_t COUNT = 200;
+const uint64_t DURATION_US = 100000;
+
+std::vector<uint64_t> wakes(COUNT);
+std::vector<uint64_t> late(COUNT);
+uint64_t last_event_us;
+uint32_t out_of_order;
+
+// Every wake-up and tick in a single timeline
+void event()
+{
+    out_of_order += host_time_us() < last_event_us;
+    last_event_us = host_time_us();
+}
+
+} // namespace
+
+int main()
+{
+    static std::vector<Thread> threads(COUNT);
+    uint64_t begin_us = host_time_us();
+    for (uint32_t id = 0; id < COUNT; id++) {
+        threads[id].start([id, begin_us]() {
+            uint64_t period_us = (1 + id % 8) * 1000;
+            uint64_t next_us = begin_us;
+            while (true) {
+                late[id] += host_time_us() - next_us;
+                wakes[id]++;
+                event();
+                next_us = host_time_us() + period_us;
+                if (id & 1) {
+                    ThisThread::sleep_until(next_us);
+                } else {
+                    ThisThread::sleep_for(std::chrono::milliseconds(period_us / 1000));
+                }
+            }
+        });
+    }
+    uint32_t ticks = 0;
+    Ticker ticker;
+    ticker.attach_us([&ticks]() {
+        ticks++;
+        event();
+    }, 250);
+
+    while (host_time_us() - begin_us < DURATION_US) {
+        host_advance_us(40);
+    }
+    ticker.detach();
+
+    uint64_t total = 0, expected = 0, lateness = 0;
+    for (uint32_t id = 0; id < COUNT; id++) {
+        total += wakes[id];
+        lateness += late[id];
+        expected += DURATION_US / ((1 + id % 8) * 1000) + 1;
+    }
+    printf("%u threads: %llu wake-ups for %llu expected, %llu us late, %u ticks, %u out of order\n", COUNT,
+           (unsigned long long)total, (unsigned long long)expected, (unsigned long long)lateness, ticks, out_of_order);
+    CHECK(total == expected);
+    CHECK(lateness == 0);
+    CHECK(ticks == DURATION_US / 250);
+    CHECK(out_of_order == 0);
+    return check_result();
+}
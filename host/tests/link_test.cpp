@@ -0,0 +1,172 @@
+// DepthLink.h: the CRC check value; frames decoded as encoded; a stream with
+// corrupted frames and noise between frames, every intact frame decoded and
+// the others counted lost, false frames rare and never applied by the
+// follower; the follower ignoring repeated and out of order frames, timing
+// out, following a leader restart, and compensating the age of the frames on
+// a clock offset from the leader's.
+
+#include "Check.h"
+#include "DepthLink.h"
+#include "TestRandom.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+namespace {
+
+bool same(const DepthLinkFrame &a, const DepthLinkFrame &b)
+{
+    return a.sequence == b.sequence && a.time_us == b.time_us && a.inputs.cv == b.inputs.cv
+           && a.inputs.slider == b.inputs.slider && a.inputs.left == b.inputs.left && a.inputs.right == b.inputs.right;
+}
+
+// A bit flipped in one frame out of 50, and noise with sync bytes between the
+// frames every 37
+void corrupted_stream()
+{
+    const uint32_t frames = 100000;
+    std::vector<uint8_t> stream;
+    std::vector<DepthLinkFrame> sent; // by time / 160
+    std::vector<bool> intact_sent;
+    uint32_t rng = 0x1B873593, corrupted = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        DepthLinkFrame frame{(uint8_t)i, i * 160, DepthInputs{xorshift32(rng) & 0xFFFF, xorshift32(rng) & 0xFFFF, i & 0xFFFF, ~i & 0xFFFF}};
+        uint8_t bytes[DEPTH_LINK_FRAME];
+        depth_link_encode(frame, bytes);
+        sent.push_back(frame);
+        intact_sent.push_back(i % 50 != 25);
+        if (!intact_sent.back()) {
+            bytes[1 + xorshift32(rng) % (DEPTH_LINK_FRAME - 1)] ^= 1u << (xorshift32(rng) % 8);
+            corrupted++;
+        }
+        if (i % 37 == 0) {
+            const uint8_t noise[] = {0x00, DEPTH_LINK_SYNC, 0x13, DEPTH_LINK_SYNC};
+            stream.insert(stream.end(), noise, noise + sizeof(noise));
+        }
+        stream.insert(stream.end(), bytes, bytes + DEPTH_LINK_FRAME);
+    }
+
+    DepthLinkDecoder decoder;
+    DepthLinkFollower follower;
+    uint32_t matched = 0, false_frames = 0, false_accepted = 0, last_time_us = 0;
+    for (uint8_t byte : stream) {
+        DepthLinkFrame frame;
+        if (decoder.feed(byte, frame)) {
+            uint32_t index = frame.time_us / 160;
+            bool intact = frame.time_us % 160 == 0 && index < frames && intact_sent[index] && same(frame, sent[index]);
+            matched += intact;
+            false_frames += !intact;
+            // Received on time, on a follower clock that is the leader's
+            last_time_us = intact ? frame.time_us : last_time_us;
+            false_accepted += follower.receive(frame, last_time_us) && !intact;
+        }
+    }
+    printf("%u of %u intact frames, %u CRC errors, %u lost for %u corrupted, %u false frames, %u applied\n", matched,
+           frames - corrupted, decoder.errors(), decoder.lost(), corrupted, false_frames, false_accepted);
+
+    // A false frame takes the bytes of one or two real ones
+    CHECK(matched + 2 * false_frames >= frames - corrupted);
+    CHECK(decoder.lost() >= corrupted);
+    // After a bad CRC, the decoder tries the frame starting at each following
+    // sync byte, misaligned: its CRC-16 matches by chance once in 65536
+    // tries. Such false frames are expected, up to four times the odds here,
+    // and the follower must apply none of them: their sequence number and
+    // time do not follow the last frame.
+    CHECK(false_frames <= 2 + decoder.errors() / 16384);
+    CHECK(false_accepted == 0);
+}
+
+// Leader's CV on its clock: a ramp of 1 LSB per 2 us, wrapping below full scale
+uint32_t ramp_cv(uint32_t leader_us)
+{
+    return 1000 + leader_us / 2 % 60000;
+}
+
+// Follower clock 123456 us ahead and its frames every 41 us, the leader's
+// every 40: a link frame every 160 us taking the wire time, read at the next
+// follower frame. Largest CV error at each follower frame against the
+// leader's CV at the same instant, compensated and as received.
+void clock_offset()
+{
+    const uint32_t offset_us = 123456;
+    DepthLinkLeader leader;
+    DepthLinkFollower follower;
+    DepthLinkDecoder link;
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> in_flight; // arrival, leader clock
+    uint32_t compensated = 0, as_is = 0, last_cv = 0, sent = 0;
+    for (uint32_t leader_us = 0; leader_us < 2000000; leader_us++) {
+        uint8_t bytes[DEPTH_LINK_FRAME];
+        if (leader_us % 40 == 0 && leader.frame(DepthInputs{ramp_cv(leader_us), 0, 0, 0}, leader_us, bytes)) {
+            in_flight.push_back({leader_us + DEPTH_LINK_WIRE_US, std::vector<uint8_t>(bytes, bytes + DEPTH_LINK_FRAME)});
+            sent++;
+        }
+        if (leader_us % 41 != 7) {
+            continue;
+        }
+        uint32_t follower_us = leader_us + offset_us;
+        for (auto it = in_flight.begin(); it != in_flight.end();) {
+            if (it->first > leader_us) {
+                ++it;
+                continue;
+            }
+            for (uint8_t byte : it->second) {
+                DepthLinkFrame frame;
+                if (link.feed(byte, frame)) {
+                    follower.receive(frame, follower_us);
+                    last_cv = frame.inputs.cv;
+                }
+            }
+            it = in_flight.erase(it);
+        }
+        DepthInputs in;
+        uint32_t truth = ramp_cv(leader_us);
+        // Once the offset is measured, away from the wrap of the ramp where no extrapolation can follow
+        if (leader_us > 10000 && follower.inputs(follower_us, in) && truth > 2000 && truth < 60000) {
+            compensated = std::max(compensated, (uint32_t)abs((int32_t)in.cv - (int32_t)truth));
+            as_is = std::max(as_is, (uint32_t)abs((int32_t)last_cv - (int32_t)truth));
+        }
+    }
+    printf("follower CV error max %u LSB skew compensated, %u LSB as received (ramp of 0.5 LSB/us)\n", compensated, as_is);
+    CHECK(sent == 2000000 / 40 / DEPTH_LINK_DIVIDER);
+    CHECK(link.errors() == 0 && link.lost() == 0);
+    CHECK(compensated <= 2);
+    CHECK(as_is > 50);
+}
+
+} // namespace
+
+int main()
+{
+    CHECK(depth_link_crc((const uint8_t *)"123456789", 9) == 0x29B1);
+
+    DepthLinkFrame frame{200, 0x89ABCDEF, DepthInputs{1, 0xFFFF, 0x1234, 0x8000}}, decoded{};
+    uint8_t bytes[DEPTH_LINK_FRAME];
+    depth_link_encode(frame, bytes);
+    DepthLinkDecoder decoder;
+    bool complete = false;
+    for (uint8_t byte : bytes) {
+        complete = decoder.feed(byte, decoded);
+    }
+    CHECK(complete && same(frame, decoded) && decoder.frames() == 1);
+
+    // Repeated and out of order frames ignored, a restart followed after
+    // the timeout, and no inputs without frames for the timeout
+    DepthLinkFollower follower;
+    DepthInputs in;
+    CHECK(!follower.inputs(0, in));
+    CHECK(follower.receive(DepthLinkFrame{10, 1000, DepthInputs{100, 0, 0, 0}}, 5000));
+    CHECK(!follower.receive(DepthLinkFrame{10, 1000, DepthInputs{200, 0, 0, 0}}, 5100));
+    CHECK(!follower.receive(DepthLinkFrame{9, 840, DepthInputs{200, 0, 0, 0}}, 5200));
+    CHECK(!follower.receive(DepthLinkFrame{11, 1000 + DEPTH_LINK_TIMEOUT_US + 1, DepthInputs{200, 0, 0, 0}}, 5300));
+    CHECK(follower.inputs(5300, in) && in.cv == 100);
+    CHECK(follower.receive(DepthLinkFrame{11, 1160, DepthInputs{300, 0, 0, 0}}, 5400));
+    CHECK(!follower.inputs(5400 + DEPTH_LINK_TIMEOUT_US + 1, in));
+    CHECK(follower.receive(DepthLinkFrame{0, 0, DepthInputs{400, 0, 0, 0}}, 5400 + DEPTH_LINK_TIMEOUT_US + 1));
+    CHECK(follower.inputs(5400 + DEPTH_LINK_TIMEOUT_US + 1, in) && in.cv == 400);
+
+    corrupted_stream();
+    clock_offset();
+    return check_result();
+}
@@ -0,0 +1,104 @@
+// Log.h and TokenLog.h: a site above its category's build level and a site
+// masked at run time evaluate nothing and queue nothing, an enabled site
+// queues its token and arguments, drain() prints them as "#T<hex>" lines
+// (text frames as they are), and frames that do not fit are counted and
+// reported.
+
+#include "Check.h"
+#include "Log.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace {
+
+uint32_t evaluations;
+
+uint32_t argument(uint32_t value)
+{
+    evaluations++;
+    return value;
+}
+
+// What drain() prints to stdout
+template <uint32_t Capacity>
+std::string drained(TokenLog<Capacity> &log)
+{
+    fflush(stdout);
+    FILE *capture = tmpfile();
+    int saved = dup(STDOUT_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+    log.drain();
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    std::string text;
+    rewind(capture);
+    char buffer[256];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), capture)) > 0) {
+        text.append(buffer, length);
+    }
+    fclose(capture);
+    return text;
+}
+
+std::string frame_line(uint32_t token, std::initializer_list<uint32_t> args)
+{
+    std::string line = "#T";
+    char hex[3];
+    uint8_t header[TOKENLOG_FRAME_HEADER];
+    memcpy(header, &token, 4);
+    header[4] = (uint8_t)args.size();
+    for (uint8_t byte : header) {
+        snprintf(hex, sizeof(hex), "%02X", byte);
+        line += hex;
+    }
+    for (uint32_t arg : args) {
+        for (int i = 0; i < 4; i++) {
+            snprintf(hex, sizeof(hex), "%02X", (arg >> (8 * i)) & 0xFF);
+            line += hex;
+        }
+    }
+    return line + "\n";
+}
+
+} // namespace
+
+int main()
+{
+    static_assert(tokenlog_arg_count("%u %5.2f %% %08x") == 3, "argument count, %% excluded");
+
+    TokenLog<256> log;
+
+    // PWM is built at INFO: its DEBUG sites are compiled out
+    LOG_DEBUG(PWM, log, "PWM: %u", argument(1));
+    log_enable(LOG_ENGINE, false);
+    LOG_DEBUG(ENGINE, log, "ENGINE: %u", argument(2));
+    CHECK(evaluations == 0);
+    CHECK(drained(log).empty());
+
+    log_enable(LOG_ENGINE, true);
+    LOG_DEBUG(ENGINE, log, "ENGINE: %u %x", argument(3), 0xABCDu);
+    CHECK(evaluations == 1);
+    log.write_text("unknown command");
+    std::string expected = frame_line(tokenlog_hash("ENGINE: %u %x"), {3, 0xABCD}) + "unknown command\n";
+    std::string text = drained(log);
+    printf("%s", text.c_str());
+    CHECK(text == expected);
+
+    // 64 bytes: four frames of 13 bytes fit, the last two are dropped
+    TokenLog<64> small;
+    for (uint32_t i = 0; i < 6; i++) {
+        TOKENLOG(small, "FRAME: %u %u", i, i);
+    }
+    text = drained(small);
+    printf("%s", text.c_str());
+    CHECK(text.find("TOKENLOG: 2 frames dropped\n") != std::string::npos);
+    CHECK(drained(small).empty());
+    return check_result();
+}
@@ -0,0 +1,107 @@
+// PostMortem.h: the flight recorder keeps the last frames in order, before
+// and after it wraps, written in place in the retained struct outside the
+// checksum; the checksum seals the dump and any changed word breaks it; the
+// dump goes through the report frames of a telemetry stream between
+// snapshots, and a report missing a chunk is not delivered.
+
+#include "Check.h"
+#include "PostMortem.h"
+#include "TelemetryCodec.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+PostMortem dump;
+
+// Stream of a snapshot, the report frames but skip_chunk, and a snapshot
+std::vector<uint8_t> report_stream(uint32_t skip_chunk, uint32_t &chunks)
+{
+    std::vector<uint8_t> stream;
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    TelemetryEncoder encoder;
+    TelemetrySnapshot snapshot{};
+    stream.insert(stream.end(), frame, frame + encoder.encode(snapshot, frame));
+    uint32_t length;
+    chunks = 0;
+    for (uint8_t chunk = 0; (length = telemetry_encode_report((const uint8_t *)&dump, sizeof(dump), chunk, frame)); chunk++) {
+        if (chunk != skip_chunk) {
+            stream.insert(stream.end(), frame, frame + length);
+        }
+        chunks++;
+    }
+    stream.insert(stream.end(), frame, frame + encoder.encode(snapshot, frame));
+    return stream;
+}
+
+} // namespace
+
+int main()
+{
+    // Fewer frames than the recorder holds, then wrapped
+    FlightRecord records[FLIGHT_RECORDER_FRAMES];
+    for (uint32_t i = 1; i <= 10; i++) {
+        dump.flight.record(i * 40, (uint16_t)i, (uint16_t)(i + 1), 0x8000, (uint8_t)(i & 3));
+    }
+    CHECK(dump.flight.copy(records) == 10 && dump.flight.recorded() == 10);
+    CHECK(records[0].time_us == 40 && records[9].time_us == 400);
+    CHECK(records[9].cv_volume == (10u | 11u << 16) && records[9].slider_region == (0x8000u | 2u << 16));
+    for (uint32_t i = 11; i <= 100; i++) {
+        dump.flight.record(i * 40, (uint16_t)i, 0, 0, 0);
+    }
+    uint32_t count = dump.flight.copy(records);
+    bool in_order = count == FLIGHT_RECORDER_FRAMES && dump.flight.recorded() == 100;
+    for (uint32_t i = 0; i < count; i++) {
+        in_order &= records[i].time_us == (100 - FLIGHT_RECORDER_FRAMES + 1 + i) * 40;
+    }
+    CHECK(in_order);
+
+    // The recorder written after the seal leaves the dump valid, any other
+    // word changed breaks it
+    CHECK(!post_mortem_valid(dump));
+    dump.fault[FAULT_CFSR] = 0x8200;
+    dump.kind = POST_MORTEM_FAULT;
+    post_mortem_seal(dump);
+    CHECK(post_mortem_valid(dump));
+    dump.flight.record(101 * 40, 0, 0, 0, 0);
+    dump.recorder_magic = POST_MORTEM_RECORDER_MAGIC;
+    CHECK(post_mortem_valid(dump));
+    uint32_t *words = &dump.checksum + 1;
+    bool every_word = true;
+    for (uint32_t *word = words; word < &dump.recorder_magic; word++) {
+        *word ^= 0x100;
+        every_word &= !post_mortem_valid(dump);
+        *word ^= 0x100;
+    }
+    CHECK(every_word && post_mortem_valid(dump));
+
+    // Through the report frames, between snapshots
+    uint32_t chunks;
+    std::vector<uint8_t> stream = report_stream(UINT32_MAX, chunks);
+    TelemetryDecoder decoder;
+    TelemetrySnapshot snapshot;
+    for (uint8_t byte : stream) {
+        decoder.feed(byte, snapshot);
+    }
+    printf("post-mortem of %u bytes in %u report frames\n", (unsigned)sizeof(PostMortem), chunks);
+    CHECK(chunks == (sizeof(PostMortem) + TELEMETRY_REPORT_CHUNK - 1) / TELEMETRY_REPORT_CHUNK);
+    CHECK(decoder.reports() == 1 && decoder.report_length() == sizeof(PostMortem));
+    CHECK(decoder.frames() == 2 && decoder.errors() == 0);
+    PostMortem decoded;
+    if (decoder.reports() == 1 && decoder.report_length() == sizeof(decoded)) {
+        memcpy(&decoded, decoder.report(), sizeof(decoded));
+        CHECK(memcmp(&decoded, &dump, sizeof(decoded)) == 0);
+        CHECK(post_mortem_valid(decoded) && decoded.fault[FAULT_CFSR] == 0x8200 && decoded.flight.recorded() == 101);
+    }
+
+    // A chunk lost: no report
+    stream = report_stream(chunks / 2, chunks);
+    TelemetryDecoder partial;
+    for (uint8_t byte : stream) {
+        partial.feed(byte, snapshot);
+    }
+    CHECK(partial.reports() == 0 && partial.frames() == 2);
+    return check_result();
+}
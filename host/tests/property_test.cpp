@@ -0,0 +1,418 @@
+// Randomized properties of the control chain as main.cpp runs it, one frame
+// at a time: EWMA input filters, Lin/Log buttons through the debouncers,
+// auto-range and the depth engine. Each seed generates a sequence of steps
+// (pot and CV sweeps, CV noise bursts, bouncing button presses, auto-range
+// switches, holds) whose frames are checked for:
+//   bounds      the volume in the region of the CV, not below the pot level
+//               of its ramp, full on the plateau
+//   slew        the volume change bounded by the ramp slopes and the input
+//               moves (DepthEngine.cpp), except on a Lin/Log switch
+//   debounce    a button changing state exactly when DEBOUNCE_SAMPLES
+//               samples agree on the other state: bounces give no event
+//   lin/log     each mode the parity of the presses of its button, a Log
+//               ramp never above the Lin one
+//   auto-range  the scaling monotonic, within full scale, zero at the offset,
+//               and the coefficients only changing when add() says so
+//   fixed       depth_compute_fixed() within FIXED_MAX_DEVIATION of
+//               depth_compute()
+// A failing sequence is shrunk, steps dropped and shortened while it still
+// fails the same property, and the smallest one is printed. The static_asserts
+// of DepthEngine.cpp stay as the compile-time smoke test of the engine alone.
+//
+// The seeds are shared out to hardware_concurrency() threads. The results are
+// collected per seed, and the failure of the first failing seed is shrunk.
+//
+// property_test [first seed] [seeds] [frames per seed]
+
+#include "AutoRange.h"
+#include "Check.h"
+#include "Debouncer.h"
+#include "DepthEngine.h"
+#include "InputFilter.h"
+#include "TestRandom.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+enum StepKind : uint8_t {
+    STEP_SWEEP,     // input 'target' linearly to 'value' over 'frames'
+    STEP_NOISE,     // CV noise of amplitude 'value' over 'frames'
+    STEP_PRESS,     // button 'target' held 'frames', 'value' bounces on each edge
+    STEP_RANGE,     // auto-range switched on or off
+    STEP_HOLD       // nothing moves for 'frames'
+};
+
+const char *const step_names[] = {"sweep", "noise", "press", "range", "hold"};
+const char *const input_names[] = {"cv", "slider", "left", "right"};
+const char *const button_names[] = {"left", "right"};
+
+// Each step draws from its own seed: dropping a step while shrinking leaves
+// the others as they were
+struct Step {
+    StepKind kind;
+    uint8_t  target;
+    uint32_t frames;
+    uint32_t value;
+    uint32_t seed;
+};
+
+enum Property {
+    PROPERTY_NONE,
+    PROPERTY_BOUNDS,
+    PROPERTY_SLEW,
+    PROPERTY_DEBOUNCE,
+    PROPERTY_LIN_LOG,
+    PROPERTY_AUTO_RANGE,
+    PROPERTY_FIXED
+};
+
+const char *const property_names[] = {"none", "bounds", "slew", "debounce", "lin/log", "auto-range", "fixed"};
+
+struct Failure {
+    Property property;
+    uint32_t frame;
+};
+
+std::vector<Step> generate(uint32_t seed, uint32_t frames)
+{
+    std::vector<Step> steps;
+    uint32_t rng = seed;
+    for (uint32_t total = 0; total < frames;) {
+        Step step{};
+        uint32_t pick = xorshift32(rng) % 16;
+        step.kind = pick < 7 ? STEP_SWEEP : pick < 9 ? STEP_NOISE : pick < 13 ? STEP_PRESS : pick < 14 ? STEP_RANGE : STEP_HOLD;
+        step.seed = xorshift32(rng);
+        switch (step.kind) {
+            case STEP_SWEEP:
+                step.target = xorshift32(rng) % 4;
+                step.value = xorshift32(rng) & UI16_MAX;
+                step.frames = 1 + xorshift32(rng) % 4000;
+                break;
+            case STEP_NOISE:
+                step.value = xorshift32(rng) % 8192;
+                step.frames = 1 + xorshift32(rng) % 2000;
+                break;
+            case STEP_PRESS:
+                step.target = xorshift32(rng) % 2;
+                step.value = xorshift32(rng) % 6;
+                step.frames = 1 + xorshift32(rng) % (3 * DEBOUNCE_SAMPLES);
+                break;
+            case STEP_RANGE:
+                step.frames = 1;
+                break;
+            case STEP_HOLD:
+                step.frames = 1 + xorshift32(rng) % 20000;
+                break;
+        }
+        steps.push_back(step);
+        total += step.frames;
+    }
+    return steps;
+}
+
+// The inputs of update_depth() and their state, from main.cpp
+class Rig {
+public:
+    Rig() :
+        _filters{InputFilter(FILTER_CV_WEIGHT, FILTER_WEIGHT_SCALE), InputFilter(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE),
+                 InputFilter(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE), InputFilter(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE)},
+        _level{UI16_MAX / 2, UI16_MAX / 2, 0, 0},
+        _pins{1, 1},
+        _runs{0, 0},
+        _presses{0, 0},
+        _lin_log(0),
+        _auto_range(false),
+        _have_previous(false),
+        _frame(0)
+    {
+    }
+
+    // Runs the steps, returns the first failure, or PROPERTY_NONE and the
+    // frame count
+    Failure run(const std::vector<Step> &steps)
+    {
+        Property property = PROPERTY_NONE;
+        for (const Step &step : steps) {
+            uint32_t rng = step.seed | 1;
+            switch (step.kind) {
+                case STEP_SWEEP: {
+                    uint32_t start = _level[step.target];
+                    for (uint32_t i = 1; i <= step.frames && !property; i++) {
+                        _level[step.target] = (uint32_t)((int32_t)start + ((int32_t)step.value - (int32_t)start) * (int64_t)i / step.frames);
+                        property = frame(_level[0]);
+                    }
+                    break;
+                }
+                case STEP_NOISE:
+                    for (uint32_t i = 0; i < step.frames && !property; i++) {
+                        int32_t cv = (int32_t)_level[0] + (int32_t)(xorshift32(rng) % (2 * step.value + 1)) - (int32_t)step.value;
+                        property = frame(cv < 0 ? 0 : (cv > UI16_MAX ? UI16_MAX : (uint32_t)cv));
+                    }
+                    break;
+                case STEP_PRESS:
+                    // Pressed then released, each edge after bounces shorter
+                    // than the debouncer. A press shorter than it is no press.
+                    for (int level = 0; level <= 1; level++) {
+                        for (uint32_t bounce = 0; bounce < step.value; bounce++) {
+                            uint32_t length = 1 + xorshift32(rng) % (DEBOUNCE_SAMPLES - 1);
+                            for (uint32_t i = 0; i < 2 * length && !property; i++) {
+                                _pins[step.target] = i < length ? level : !level;
+                                property = frame(_level[0]);
+                            }
+                        }
+                        _pins[step.target] = level;
+                        for (uint32_t i = 0; i < (level ? DEBOUNCE_SAMPLES : step.frames) && !property; i++) {
+                            property = frame(_level[0]);
+                        }
+                    }
+                    break;
+                case STEP_RANGE:
+                    _auto_range = !_auto_range;
+                    _range.reset();
+                    property = frame(_level[0]);
+                    break;
+                case STEP_HOLD:
+                    for (uint32_t i = 0; i < step.frames && !property; i++) {
+                        property = frame(_level[0]);
+                    }
+                    break;
+            }
+            if (property) {
+                return Failure{property, _frame - 1};
+            }
+        }
+        return Failure{PROPERTY_NONE, _frame};
+    }
+
+private:
+    // One frame of the control loop with this CV reading
+    Property frame(uint32_t cv_reading)
+    {
+        _frame++;
+        uint32_t filtered[4];
+        for (int i = 0; i < 4; i++) {
+            filtered[i] = (uint32_t)_filters[i].filter(i ? (int)_level[i] : (int)cv_reading);
+        }
+
+        // Button samples: a change exactly when the samples agree on it
+        for (int b = 0; b < 2; b++) {
+            bool was_pressed = _debouncers[b].pressed();
+            _runs[b] = _pins[b] == _last_pins[b] ? _runs[b] + 1 : 1;
+            _last_pins[b] = _pins[b];
+            bool changed = _debouncers[b].sample(_pins[b]);
+            bool expected = _runs[b] >= DEBOUNCE_SAMPLES && (_pins[b] == 0) != was_pressed;
+            if (changed != expected || _debouncers[b].pressed() != (changed ? !was_pressed : was_pressed)) {
+                return PROPERTY_DEBOUNCE;
+            }
+            if (changed && _debouncers[b].pressed()) {
+                _presses[b]++;
+                _lin_log ^= b ? DEPTH_LOG_RIGHT : DEPTH_LOG_LEFT;
+            }
+        }
+        if (!(_lin_log & DEPTH_LOG_LEFT) != !(_presses[0] & 1) || !(_lin_log & DEPTH_LOG_RIGHT) != !(_presses[1] & 1)) {
+            return PROPERTY_LIN_LOG;
+        }
+
+        AutoRangeCoefficients before = _range.coefficients();
+        bool updated = _auto_range && _range.add(filtered[0]);
+        if (!updated && !same(before, _range.coefficients())) {
+            return PROPERTY_AUTO_RANGE;
+        }
+
+        DepthInputs in{filtered[0], filtered[1], filtered[2], filtered[3], _lin_log};
+        if (_auto_range && _range.ready()) {
+            if (!scaling_valid(in.cv)) {
+                return PROPERTY_AUTO_RANGE;
+            }
+            in.cv = _range.scale(in.cv);
+            in.slider = _range.slider(in.slider);
+        }
+
+        DepthOutputs out = depth_compute_fixed(in);
+        if (!in_bounds(in, out)) {
+            return PROPERTY_BOUNDS;
+        }
+        if (abs_diff(out.volume, depth_compute(in).volume) > FIXED_MAX_DEVIATION) {
+            return PROPERTY_FIXED;
+        }
+        DepthInputs lin = in;
+        lin.lin_log = 0;
+        if (in.lin_log && out.volume > depth_compute_fixed(lin).volume) {
+            return PROPERTY_LIN_LOG;
+        }
+        if (_have_previous && !depth_slew_bounded(_previous_in, _previous_out, in, out)) {
+            return PROPERTY_SLEW;
+        }
+        _previous_in = in;
+        _previous_out = out;
+        _have_previous = true;
+        return PROPERTY_NONE;
+    }
+
+    static bool same(const AutoRangeCoefficients &a, const AutoRangeCoefficients &b)
+    {
+        return a.low == b.low && a.high == b.high && a.median == b.median && a.offset == b.offset && a.gain == b.gain
+               && a.center_slider == b.center_slider;
+    }
+
+    bool scaling_valid(uint32_t cv) const
+    {
+        const AutoRangeCoefficients &range = _range.coefficients();
+        uint32_t below = cv ? _range.scale(cv - 1) : 0;
+        uint32_t above = _range.scale(cv < UI16_MAX ? cv + 1 : cv);
+        return range.low <= range.median && range.median <= range.high && _range.scale(range.offset) == 0
+               && below <= _range.scale(cv) && _range.scale(cv) <= above && above <= UI16_MAX;
+    }
+
+    static bool in_bounds(const DepthInputs &in, const DepthOutputs &out)
+    {
+        switch (out.region) {
+            case DEPTH_LEFT:
+                return in.cv < out.left_slide_point && out.volume >= in.left;
+            case DEPTH_RIGHT:
+                return in.cv > out.right_slide_point && out.volume >= in.right;
+            default:
+                return in.cv >= out.left_slide_point && in.cv <= out.right_slide_point && out.volume == UI16_MAX;
+        }
+    }
+
+    InputFilter  _filters[4];
+    uint32_t     _level[4];     // readings of the inputs, the CV before its noise
+    Debouncer    _debouncers[2];
+    int          _pins[2];
+    int          _last_pins[2] = {1, 1};
+    uint32_t     _runs[2];      // samples of the pin at its level
+    uint32_t     _presses[2];
+    uint8_t      _lin_log;
+    AutoRange    _range;
+    bool         _auto_range;
+    DepthInputs  _previous_in;
+    DepthOutputs _previous_out;
+    bool         _have_previous;
+    uint32_t     _frame;
+};
+
+Failure run(const std::vector<Step> &steps)
+{
+    Rig rig;
+    return rig.run(steps);
+}
+
+// Drops each step, then pairs of steps (two presses of a button, an
+// auto-range switch and back), then halves the frames of each, as long as the
+// same property still fails
+std::vector<Step> shrink(std::vector<Step> steps, Property property)
+{
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (size_t i = steps.size(); i-- > 0;) {
+            std::vector<Step> fewer(steps);
+            fewer.erase(fewer.begin() + i);
+            if (run(fewer).property == property) {
+                steps.swap(fewer);
+                progress = true;
+            }
+        }
+        for (size_t j = steps.size(); j-- > 1;) {
+            for (size_t i = j; i-- > 0 && j < steps.size();) {
+                std::vector<Step> fewer(steps);
+                fewer.erase(fewer.begin() + j);
+                fewer.erase(fewer.begin() + i);
+                if (run(fewer).property == property) {
+                    steps.swap(fewer);
+                    progress = true;
+                    break;
+                }
+            }
+        }
+        for (Step &step : steps) {
+            while (step.frames > 1) {
+                uint32_t frames = step.frames;
+                step.frames = frames / 2;
+                if (run(steps).property != property) {
+                    step.frames = frames;
+                    break;
+                }
+                progress = true;
+            }
+        }
+    }
+    return steps;
+}
+
+void print(const std::vector<Step> &steps)
+{
+    for (const Step &step : steps) {
+        printf("  %-5s", step_names[step.kind]);
+        switch (step.kind) {
+            case STEP_SWEEP: printf(" %s to %u", input_names[step.target], step.value); break;
+            case STEP_NOISE: printf(" +-%u", step.value); break;
+            case STEP_PRESS: printf(" %s, %u bounces", button_names[step.target], step.value); break;
+            default:         break;
+        }
+        printf(", %u frames, seed %08x\n", step.frames, step.seed);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    uint32_t first_seed = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 0) : 1;
+    uint32_t seeds = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 0) : 64;
+    uint32_t frames = argc > 3 ? (uint32_t)strtoul(argv[3], nullptr, 0) : 200000;
+
+    // Each worker takes the next seed until none is left
+    std::vector<Failure> results(seeds);
+    std::atomic<uint32_t> next{0};
+    auto worker = [&]() {
+        for (uint32_t index = next++; index < seeds; index = next++) {
+            results[index] = run(generate(first_seed + index, frames));
+        }
+    };
+    uint32_t threads = std::min(std::max(1u, std::thread::hardware_concurrency()), std::max(1u, seeds));
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < threads; i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t checked = 0;
+    bool shrunk = false;
+    for (uint32_t index = 0; index < seeds; index++) {
+        const Failure &failure = results[index];
+        uint32_t seed = first_seed + index;
+        checked += failure.frame;
+        if (failure.property == PROPERTY_NONE) {
+            continue;
+        }
+        CHECK(failure.property == PROPERTY_NONE);
+        if (shrunk) {
+            printf("seed %u: %s fails at frame %u\n", seed, property_names[failure.property], failure.frame);
+            continue;
+        }
+        std::vector<Step> steps = generate(seed, frames);
+        std::vector<Step> smallest = shrink(steps, failure.property);
+        Failure last = run(smallest);
+        printf("seed %u: %s fails at frame %u, shrunk from %zu to %zu steps, failing at frame %u:\n", seed,
+               property_names[failure.property], failure.frame, steps.size(), smallest.size(), last.frame);
+        print(smallest);
+        shrunk = true;
+    }
+    printf("%u seeds, %llu frames on %u threads, %.0f frames/s\n", seeds, (unsigned long long)checked, threads,
+           elapsed > 0 ? checked / elapsed : 0.0);
+    return check_result();
+}
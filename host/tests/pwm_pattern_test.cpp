@@ -0,0 +1,120 @@
+// PwmPattern (PwmPattern.h) against a simulated DMA and GPIO port: 4 pins,
+// one inverted, random duty changes at random steps. Every period of every
+// pin is a single pulse, with a duty within the duties set around it, and
+// exact once settled; a stopped DMA gets the exact duties from fill().
+
+#include "Check.h"
+#include "PwmPattern.h"
+#include "TestRandom.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+const uint32_t STEPS = 256, PINS = 4, PERIODS = 20000, WINDOW = 3;
+const uint8_t pin_numbers[PINS] = {0, 3, 7, 15};
+const uint8_t INVERTED = 7;
+
+// Steps the pin is active in one period of the pattern, and its rising edges
+uint32_t active_steps(PwmPattern<STEPS> &pattern, uint8_t bit, uint32_t &rises)
+{
+    uint32_t high = 0;
+    bool level = false;
+    rises = 0;
+    for (uint32_t step = 0; step < STEPS; step++) {
+        uint32_t word = pattern.words()[step];
+        bool value = (word >> bit) & 1 ? true : ((word >> (bit + 16)) & 1 ? false : level);
+        bool active = value != (bit == INVERTED);
+        rises += active && (step == 0 || !level);
+        level = active;
+        high += active;
+    }
+    return high;
+}
+
+} // namespace
+
+int main()
+{
+    static PwmPattern<STEPS> pattern;
+    for (uint8_t pin : pin_numbers) {
+        pattern.add_pin(pin, pin == INVERTED);
+    }
+    pattern.fill();
+
+    // Off until set, exact duties with the DMA stopped, clamped to STEPS
+    uint32_t rises;
+    for (uint8_t pin : pin_numbers) {
+        CHECK(active_steps(pattern, pin, rises) == 0);
+    }
+    for (uint32_t duty : {0u, 1u, STEPS / 2 - 1, STEPS / 2, STEPS / 2 + 1, STEPS - 1, STEPS, STEPS + 10}) {
+        pattern.set_duty(pin_numbers[1], duty);
+        pattern.set_duty(pin_numbers[2], duty);
+        pattern.fill();
+        CHECK(!pattern.pending());
+        CHECK(pattern.duty(pin_numbers[1]) == std::min(duty, STEPS));
+        CHECK(active_steps(pattern, pin_numbers[1], rises) == std::min(duty, STEPS) && rises == (duty != 0));
+        CHECK(active_steps(pattern, pin_numbers[2], rises) == std::min(duty, STEPS) && rises == (duty != 0));
+    }
+
+    // Range of the duties set during each of the last periods of each pin: a
+    // period may show any duty within them until the pattern settles
+    uint32_t low[PINS][WINDOW + 1] = {}, top[PINS][WINDOW + 1] = {};
+    uint32_t rng = 0x2545F491;
+    uint32_t next_update = 0, updates = 0, single_pulse_errors = 0, range_errors = 0, settle_errors = 0;
+    bool level[PINS] = {};
+    for (uint32_t pin = 0; pin < PINS; pin++) {
+        level[pin] = pattern.duty(pin_numbers[pin]) == STEPS;
+    }
+
+    for (uint32_t period = 0; period < PERIODS; period++) {
+        for (uint32_t pin = 0; pin < PINS; pin++) {
+            for (uint32_t i = 0; i < WINDOW; i++) {
+                low[pin][i] = low[pin][i + 1];
+                top[pin][i] = top[pin][i + 1];
+            }
+            low[pin][WINDOW] = top[pin][WINDOW] = pattern.duty(pin_numbers[pin]);
+        }
+        uint32_t high[PINS] = {}, period_rises[PINS] = {};
+        for (uint32_t step = 0; step < STEPS; step++) {
+            if (step + period * STEPS == next_update) {
+                uint32_t pin = xorshift32(rng) % PINS;
+                uint32_t duty = xorshift32(rng) % (STEPS + 1);
+                pattern.set_duty(pin_numbers[pin], duty);
+                low[pin][WINDOW] = std::min(low[pin][WINDOW], duty);
+                top[pin][WINDOW] = std::max(top[pin][WINDOW], duty);
+                updates++;
+                next_update += 1 + xorshift32(rng) % (3 * STEPS);
+            }
+
+            // The DMA writes the word to the port
+            uint32_t word = pattern.words()[step];
+            for (uint32_t pin = 0; pin < PINS; pin++) {
+                uint8_t bit = pin_numbers[pin];
+                bool value = (word >> bit) & 1 ? true : ((word >> (bit + 16)) & 1 ? false : level[pin]);
+                bool active = value != (bit == INVERTED);
+                period_rises[pin] += active && (step == 0 || !level[pin]);
+                level[pin] = active;
+                high[pin] += active;
+            }
+            if (step == STEPS / 2 - 1 || step == STEPS - 1) {
+                pattern.half_done(step == STEPS - 1);
+            }
+        }
+        for (uint32_t pin = 0; pin < PINS; pin++) {
+            uint32_t allowed_low = *std::min_element(low[pin], low[pin] + WINDOW + 1);
+            uint32_t allowed_top = *std::max_element(top[pin], top[pin] + WINDOW + 1);
+            single_pulse_errors += period_rises[pin] > 1;
+            range_errors += high[pin] < allowed_low || high[pin] > allowed_top;
+            settle_errors += allowed_low == allowed_top && high[pin] != allowed_low;
+        }
+    }
+    printf("%u pins x %u periods, %u duty changes: %u multiple pulses, %u out of range, %u not settled\n", PINS, PERIODS,
+           updates, single_pulse_errors, range_errors, settle_errors);
+    CHECK(updates > PERIODS / 2);
+    CHECK(single_pulse_errors == 0);
+    CHECK(range_errors == 0);
+    CHECK(settle_errors == 0);
+    return check_result();
+}
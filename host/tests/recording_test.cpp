@@ -0,0 +1,130 @@
+// Recording.h: raw and delta recordings read back every frame and seek by
+// time, with the index of the file or rebuilt by a scan when the file was cut;
+// appending continues after the last complete chunk, and a file of the other
+// chunk kind is left alone.
+
+#include "Check.h"
+#include "Recording.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+const uint64_t FRAMES = 5 * RECORDING_CHUNK_FRAMES / 2;
+
+// Frame n, 40us apart, with fields that change by small and large steps
+TelemetrySnapshot snapshot_of(uint64_t frame)
+{
+    TelemetrySnapshot snapshot{};
+    snapshot.time_us = (uint32_t)(frame * 40);
+    snapshot.frame = (uint32_t)frame;
+    for (uint8_t input = 0; input < INPUT_COUNT; input++) {
+        snapshot.raw[input] = (uint16_t)(frame * 7 + input);
+        snapshot.filtered[input] = (uint16_t)(frame * 5 * input);
+    }
+    snapshot.volume = (uint16_t)(frame * 1103515245u >> 16);
+    snapshot.region = (uint8_t)(frame % 3);
+    snapshot.loop_rate_hz = 25000;
+    return snapshot;
+}
+
+bool write(const std::string &path, RecordingChunkKind kind, uint64_t first, uint64_t frames, bool append)
+{
+    RecordingWriter writer;
+    std::string error;
+    if (!writer.open(path, kind, append, error)) {
+        printf("%s\n", error.c_str());
+        return false;
+    }
+    bool ok = true;
+    for (uint64_t frame = first; frame < first + frames; frame++) {
+        ok &= writer.write(snapshot_of(frame));
+    }
+    return writer.close() && ok;
+}
+
+bool same_frame(const RecordingFrame &frame, uint64_t index)
+{
+    uint32_t fields[TELEMETRY_FIELD_COUNT];
+    telemetry_to_fields(snapshot_of(index), fields);
+    return frame.time_us == index * 40 && memcmp(frame.fields, fields, sizeof(fields)) == 0;
+}
+
+// Every frame, and a seek to each chunk boundary and between frames
+bool read_back(const std::string &path, uint64_t frames, bool raw, bool indexed)
+{
+    RecordingReader reader;
+    std::string error;
+    if (!reader.open(path, error)) {
+        printf("%s\n", error.c_str());
+        return false;
+    }
+    bool ok = reader.frame_count() == frames && reader.indexed() == indexed
+              && reader.chunk_count() == (frames + RECORDING_CHUNK_FRAMES - 1) / RECORDING_CHUNK_FRAMES;
+    RecordingFrame copy;
+    for (uint64_t frame = 0; frame < frames; frame++) {
+        const RecordingFrame *view = reader.view(frame);
+        ok &= (view != nullptr) == raw && (!view || same_frame(*view, frame));
+        ok &= reader.frame(frame, copy) && same_frame(copy, frame);
+    }
+    for (uint64_t frame = 0; frame < frames; frame += RECORDING_CHUNK_FRAMES / 2) {
+        ok &= reader.seek(frame * 40) == frame && reader.seek(frame * 40 + 1) == frame + 1;
+    }
+    ok &= reader.seek(frames * 40) == frames && !reader.frame(frames, copy);
+    printf("%s: %llu frames, %zu chunks, %s index%s\n", path.c_str(), (unsigned long long)reader.frame_count(),
+           reader.chunk_count(), reader.indexed() ? "file" : "rebuilt", ok ? "" : "  MISMATCH");
+    return ok;
+}
+
+long file_size(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+} // namespace
+
+int main()
+{
+    const char *tmp = getenv("TMPDIR");
+    std::string raw = std::string(tmp ? tmp : "/tmp") + "/recording_test_raw.drec";
+    std::string delta = std::string(tmp ? tmp : "/tmp") + "/recording_test_delta.drec";
+
+    CHECK(write(raw, RECORDING_RAW, 0, FRAMES, false));
+    CHECK(read_back(raw, FRAMES, true, true));
+    CHECK(write(delta, RECORDING_DELTA, 0, FRAMES, false));
+    CHECK(read_back(delta, FRAMES, false, true));
+
+    // Appending to a file of the other kind fails, the file untouched
+    long size = file_size(delta);
+    RecordingWriter writer;
+    std::string error;
+    CHECK(!writer.open(delta, RECORDING_RAW, true, error) && !error.empty());
+    CHECK(!writer.write(snapshot_of(FRAMES)));
+    CHECK(file_size(delta) == size);
+    CHECK(read_back(delta, FRAMES, false, true));
+
+    // Cut in the middle of the second chunk, without index: the first chunk
+    // is read back, and appending continues after it
+    CHECK(truncate(raw.c_str(), (off_t)recording_raw_chunk_offset(1) + 1000) == 0);
+    CHECK(read_back(raw, RECORDING_CHUNK_FRAMES, true, false));
+    CHECK(write(raw, RECORDING_RAW, RECORDING_CHUNK_FRAMES, FRAMES - RECORDING_CHUNK_FRAMES, true));
+    CHECK(read_back(raw, FRAMES, true, true));
+
+    CHECK(!writer.open("/nonexistent/recording.drec", RECORDING_RAW, false, error));
+
+    unlink(raw.c_str());
+    unlink(delta.c_str());
+    return check_result();
+}
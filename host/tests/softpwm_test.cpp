@@ -0,0 +1,74 @@
+// SoftPWM on the host shim pins: a pin with a timer channel in PinMap_PWM
+// uses it and takes no interrupt, a pin without and the pins of TIM2, the
+// us_ticker timer, LED1 among them, write the pin from the Ticker and
+// Timeout handlers, twice per period. Both give the duty set, inverted pins
+// included, measured over 20 periods. A pin on a timer channel is never
+// written as a GPIO.
+
+#include "Check.h"
+#include "HostHal.h"
+#include "SoftPWM.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+bool duty_run(PinName pin, bool positive, bool timer, float duty)
+{
+    const uint32_t period_us = 10000, periods = 20, sample_us = 10;
+    SoftPWM pwm(pin, positive);
+    pwm.period_us(period_us);
+    pwm.write(duty);
+    // The Ticker starts a pulse at the end of the first period
+    host_advance_us(period_us);
+
+    uint32_t writes = host_digital_writes(pin);
+    uint32_t samples = 0, active = 0;
+    for (uint64_t t = 0; t < (uint64_t)period_us * periods; t += sample_us) {
+        host_advance_us(sample_us);
+        active += host_digital_output(pin) == (positive ? 1 : 0);
+        samples++;
+    }
+    writes = host_digital_writes(pin) - writes;
+    pwm.stop();
+
+    float measured = (float)active / samples;
+    uint32_t expected_writes = timer ? 0 : 2 * periods;
+    bool ok = pwm.uses_timer() == timer && fabsf(measured - duty) < 0.01f && writes == expected_writes;
+    printf("pin 0x%02X%s: %s, duty %.3f for %.3f, %u interrupt writes in %u periods%s\n", pin,
+           positive ? "" : " inverted", pwm.uses_timer() ? "timer channel" : "Ticker/Timeout", measured, duty, writes,
+           periods, ok ? "" : "  FAILED");
+    return ok;
+}
+
+} // namespace
+
+int main()
+{
+    // TIM2 pins: none of them on a timer channel
+    for (PinName pin : {PA_0, PA_5, PA_15, PB_3}) {
+        CHECK(!SoftPWM::has_timer(pin));
+    }
+    CHECK(LED1 == PB_3);
+    CHECK(SoftPWM::has_timer(PA_8) && SoftPWM::has_timer(PA_2) && SoftPWM::has_timer(PB_6));
+    CHECK(!SoftPWM::has_timer(PB_4));
+
+    // A pin on a timer channel gets no DigitalOut: nothing writes it as a GPIO
+    uint32_t writes = host_digital_writes(PA_9);
+    {
+        SoftPWM pwm(PA_9, false);
+        pwm.write(0.5f);
+        pwm.stop();
+    }
+    CHECK(host_digital_writes(PA_9) == writes);
+
+    for (float duty : {0.3f, 0.75f}) {
+        CHECK(duty_run(LED1, true, false, duty));
+        CHECK(duty_run(PA_8, false, true, duty));
+        CHECK(duty_run(PA_8, true, true, duty));
+        CHECK(duty_run(PB_4, true, false, duty));
+        CHECK(duty_run(PB_4, false, false, duty));
+    }
+    return check_result();
+}
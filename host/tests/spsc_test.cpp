@@ -0,0 +1,84 @@
+// SpscRing: the whole capacity is usable, single and batch pushes and pops
+// wrap around in order, and two threads passing a sequence through small and
+// large rings, in single items and batches, receive it in order.
+
+#include "Check.h"
+#include "SpscRing.h"
+
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+// Producer pushes 0..items-1 in batches of 'batch', the consumer checks them
+template <uint32_t Capacity>
+bool threads_in_order(uint32_t items, uint32_t batch)
+{
+    static SpscRing<uint32_t, Capacity> ring;
+    bool in_order = true;
+
+    std::thread consumer([&]() {
+        uint32_t buffer[64];
+        uint32_t expected = 0;
+        while (expected < items) {
+            uint32_t count = batch == 1 ? ring.pop(buffer[0]) : ring.pop(buffer, batch);
+            for (uint32_t i = 0; i < count; i++) {
+                in_order &= buffer[i] == expected++;
+            }
+            if (!count) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t buffer[64];
+    for (uint32_t next = 0; next < items;) {
+        uint32_t count = batch < items - next ? batch : items - next;
+        for (uint32_t i = 0; i < count; i++) {
+            buffer[i] = next + i;
+        }
+        uint32_t pushed = batch == 1 ? ring.push(buffer[0]) : ring.push(buffer, count);
+        next += pushed;
+        if (!pushed) {
+            std::this_thread::yield();
+        }
+    }
+    consumer.join();
+    printf("capacity %4u batch %2u: %u items %s\n", Capacity, batch, items, in_order ? "in order" : "OUT OF ORDER");
+    return in_order && ring.empty();
+}
+
+} // namespace
+
+int main()
+{
+    SpscRing<uint32_t, 8> ring;
+    uint32_t value = 0;
+    CHECK(ring.empty());
+    CHECK(!ring.pop(value));
+    for (uint32_t i = 0; i < 8; i++) {
+        CHECK(ring.push(i));
+    }
+    CHECK(!ring.push(8));
+    CHECK(ring.size() == 8 && ring.free_space() == 0);
+
+    // Wrap around: pop 5, push 5 in a batch past the end of the array
+    uint32_t items[8];
+    CHECK(ring.pop(items, 5) == 5);
+    CHECK(items[0] == 0 && items[4] == 4);
+    uint32_t more[6] = {8, 9, 10, 11, 12, 13};
+    CHECK(ring.push(more, 6) == 5);
+    CHECK(ring.pop(items, 8) == 8);
+    bool wrapped = true;
+    for (uint32_t i = 0; i < 8; i++) {
+        wrapped &= items[i] == 5 + i;
+    }
+    CHECK(wrapped);
+    CHECK(ring.empty() && ring.pop(items, 8) == 0);
+
+    CHECK(threads_in_order<64>(2000000, 1));
+    CHECK(threads_in_order<64>(2000000, 16));
+    CHECK(threads_in_order<1024>(5000000, 1));
+    CHECK(threads_in_order<1024>(5000000, 64));
+    return check_result();
+}
@@ -0,0 +1,119 @@
+// TelemetryCodec: a synthetic stream decodes back to its snapshots and its
+// report, and the same stream through the newline conversion of the mbed
+// console (0x0A sent as 0D 0A) loses the frames it touches, without producing
+// a wrong snapshot: the reason the firmware writes the frames below that
+// conversion (telemetry_write() in main.cpp).
+
+#include "Check.h"
+#include "TelemetryCodec.h"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const uint32_t SNAPSHOTS = 2000;
+const uint32_t REPORT_LENGTH = 860;
+
+TelemetrySnapshot snapshot_at(uint32_t i)
+{
+    TelemetrySnapshot snapshot{};
+    snapshot.time_us = i * 2000;
+    snapshot.frame = i * 50;
+    for (uint8_t input = 0; input < INPUT_COUNT; input++) {
+        snapshot.raw[input] = (uint16_t)(i * (97 + input * 13) + input * 1000);
+        snapshot.filtered[input] = (uint16_t)(snapshot.raw[input] & 0xFFF0);
+    }
+    snapshot.volume = (uint16_t)(65535 - i * 31);
+    snapshot.region = (uint8_t)(i / 100 % 3);
+    snapshot.loop_rate_hz = 25000 + i % 7;
+    snapshot.loop_period_ns = 40000 - i % 7;
+    snapshot.warm_start_us = 1200;
+    snapshot.lin_log = (uint8_t)(i / 500 % 4);
+    snapshot.curve_switches = i / 500;
+    for (uint8_t stage = 0; stage < TELEMETRY_STAGE_COUNT; stage++) {
+        snapshot.stage_cycles[stage] = 300 + (i * 7 + stage) % 40;
+    }
+    return snapshot;
+}
+
+bool same(const TelemetrySnapshot &a, const TelemetrySnapshot &b)
+{
+    uint32_t fields_a[TELEMETRY_FIELD_COUNT], fields_b[TELEMETRY_FIELD_COUNT];
+    telemetry_to_fields(a, fields_a);
+    telemetry_to_fields(b, fields_b);
+    return memcmp(fields_a, fields_b, sizeof(fields_a)) == 0;
+}
+
+struct Decoded {
+    uint32_t snapshots = 0;
+    uint32_t wrong = 0;
+};
+
+// Snapshot frames decoded from stream, checked against snapshot_at()
+Decoded decode(const std::vector<uint8_t> &stream, TelemetryDecoder &decoder)
+{
+    Decoded decoded;
+    TelemetrySnapshot snapshot;
+    for (uint8_t byte : stream) {
+        if (decoder.feed(byte, snapshot)) {
+            decoded.snapshots++;
+            decoded.wrong += !same(snapshot, snapshot_at(snapshot.time_us / 2000));
+        }
+    }
+    return decoded;
+}
+
+} // namespace
+
+int main()
+{
+    std::vector<uint8_t> report(REPORT_LENGTH);
+    for (uint32_t i = 0; i < REPORT_LENGTH; i++) {
+        report[i] = (uint8_t)(i * 7);
+    }
+
+    // The report at boot, then the snapshots
+    std::vector<uint8_t> stream;
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    uint32_t length;
+    for (uint8_t chunk = 0; (length = telemetry_encode_report(report.data(), REPORT_LENGTH, chunk, frame)); chunk++) {
+        stream.insert(stream.end(), frame, frame + length);
+    }
+    TelemetryEncoder encoder;
+    for (uint32_t i = 0; i < SNAPSHOTS; i++) {
+        length = encoder.encode(snapshot_at(i), frame);
+        stream.insert(stream.end(), frame, frame + length);
+    }
+
+    TelemetryDecoder decoder;
+    Decoded raw = decode(stream, decoder);
+    printf("raw stream: %u bytes, %u of %u snapshots, %u errors, %u reports\n",
+           (unsigned)stream.size(), raw.snapshots, SNAPSHOTS, decoder.errors(), decoder.reports());
+    CHECK(raw.snapshots == SNAPSHOTS);
+    CHECK(raw.wrong == 0);
+    CHECK(decoder.errors() == 0);
+    CHECK(decoder.reports() == 1);
+    CHECK(decoder.report_length() == REPORT_LENGTH);
+    CHECK(memcmp(decoder.report(), report.data(), REPORT_LENGTH) == 0);
+
+    // stdio-convert-newlines
+    std::vector<uint8_t> converted;
+    for (uint8_t byte : stream) {
+        if (byte == '\n') {
+            converted.push_back('\r');
+        }
+        converted.push_back(byte);
+    }
+    CHECK(converted.size() > stream.size());
+
+    TelemetryDecoder converted_decoder;
+    Decoded through_stdio = decode(converted, converted_decoder);
+    printf("converted stream: %u bytes, %u of %u snapshots, %u wrong, %u errors, %u reports\n",
+           (unsigned)converted.size(), through_stdio.snapshots, SNAPSHOTS, through_stdio.wrong,
+           converted_decoder.errors(), converted_decoder.reports());
+    CHECK(through_stdio.snapshots < SNAPSHOTS);
+    CHECK(through_stdio.wrong == 0);
+    CHECK(converted_decoder.errors() > 0);
+    return check_result();
+}
@@ -0,0 +1,150 @@
+// TimingWheel: against a std::map of (due time, insertion count) under random
+// inserts, re-inserts, removes and expiries with due times from the past to
+// far in the future, periodic timers like SoftPWM's and timeouts re-armed at
+// random delays; the same nodes expire in the same order at the same time.
+
+#include "Check.h"
+#include "TestRandom.h"
+#include "TimingWheel.h"
+
+#include <cstdio>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Due times expire in order, equal ones in insertion order; a due time
+// before the wheel time counts as the wheel time
+class Model {
+public:
+    void insert(uint32_t id, uint64_t due_us)
+    {
+        remove(id);
+        _keys[id] = std::make_pair(due_us > _now ? due_us : _now, _inserted++);
+        _queue[_keys[id]] = id;
+    }
+
+    void remove(uint32_t id)
+    {
+        auto key = _keys.find(id);
+        if (key != _keys.end()) {
+            _queue.erase(key->second);
+            _keys.erase(key);
+        }
+    }
+
+    // Timer id, or -1 with the time moved to target
+    int expire(uint64_t target)
+    {
+        if (_queue.empty() || _queue.begin()->first.first > target) {
+            _now = target > _now ? target : _now;
+            return -1;
+        }
+        _now = _queue.begin()->first.first;
+        uint32_t id = _queue.begin()->second;
+        remove(id);
+        return (int)id;
+    }
+
+    uint64_t now() const
+    {
+        return _now;
+    }
+
+private:
+    uint64_t _now = 0;
+    uint64_t _inserted = 0;
+    std::map<uint32_t, std::pair<uint64_t, uint64_t>> _keys;
+    std::map<std::pair<uint64_t, uint64_t>, uint32_t> _queue;
+};
+
+uint64_t random_delay(uint32_t &rng)
+{
+    switch (xorshift32(rng) % 6) {
+        case 0:  return 0;
+        case 1:  return xorshift32(rng) % 256;
+        case 2:  return xorshift32(rng) % 65536;
+        case 3:  return xorshift32(rng) & 0xFFFFFF;
+        case 4:  return (uint64_t)xorshift32(rng) << (xorshift32(rng) % 32);
+        default: return 1 + xorshift32(rng) % 1000;
+    }
+}
+
+// Returns the number of steps where the wheel and the model differ
+uint32_t run(uint32_t timers, uint32_t steps, uint32_t seed)
+{
+    static TimingWheel wheel;
+    wheel = TimingWheel();
+    Model model;
+    std::vector<TimingWheelNode> nodes(timers);
+    uint32_t rng = seed, differ = 0, expired = 0;
+    for (TimingWheelNode &node : nodes) {
+        node = TimingWheelNode{};
+    }
+    for (uint32_t step = 0; step < steps; step++) {
+        uint32_t op = xorshift32(rng) % 8;
+        uint32_t id = xorshift32(rng) % timers;
+        if (op < 3) {
+            // Insert or re-insert, past due times included
+            uint64_t due = wheel.now() + random_delay(rng);
+            if (op == 0 && wheel.now() > 0) {
+                due = wheel.now() - 1 - xorshift32(rng) % wheel.now();
+            }
+            nodes[id].due_us = due;
+            wheel.insert(&nodes[id]);
+            model.insert(id, due);
+        } else if (op == 3) {
+            wheel.remove(&nodes[id]);
+            model.remove(id);
+        } else {
+            uint64_t target = op == 4 ? UINT64_MAX : wheel.now() + random_delay(rng);
+            TimingWheelNode *node = wheel.expire(target);
+            int expected = model.expire(target);
+            int actual = node ? (int)(node - nodes.data()) : -1;
+            differ += actual != expected || wheel.now() != model.now() || (node && node->queued);
+            expired += node != nullptr;
+            // Odd timers periodic, like SoftPWM's Ticker
+            if (node && (actual & 1)) {
+                node->due_us = wheel.now() + 1 + actual % 1000;
+                wheel.insert(node);
+                model.insert((uint32_t)actual, node->due_us);
+            }
+        }
+    }
+    // Drain: everything left expires in order
+    while (TimingWheelNode *node = wheel.expire(UINT64_MAX)) {
+        differ += (int)(node - nodes.data()) != model.expire(UINT64_MAX) || wheel.now() != model.now();
+        expired++;
+    }
+    differ += model.expire(UINT64_MAX) != -1 || !wheel.empty();
+    printf("%6u timers, %u steps, seed %08x: %u expired, %u differences\n", timers, steps, seed, expired, differ);
+    return differ;
+}
+
+} // namespace
+
+int main()
+{
+    // Equal due times expire in insertion order, past due ones at once
+    TimingWheel wheel;
+    TimingWheelNode nodes[4] = {};
+    nodes[0].due_us = nodes[1].due_us = nodes[2].due_us = 1000;
+    for (TimingWheelNode &node : nodes) {
+        wheel.insert(&node);
+    }
+    CHECK(wheel.expire(999) == &nodes[3] && wheel.now() == 0);
+    CHECK(wheel.expire(999) == nullptr && wheel.now() == 999);
+    CHECK(wheel.expire(UINT64_MAX) == &nodes[0] && wheel.now() == 1000);
+    CHECK(wheel.expire(UINT64_MAX) == &nodes[1]);
+    wheel.remove(&nodes[2]);
+    wheel.remove(&nodes[2]);
+    CHECK(wheel.empty() && wheel.expire(UINT64_MAX) == nullptr);
+
+    for (uint32_t seed : {0x2545F491u, 0x9E3779B9u, 0x12345678u}) {
+        CHECK(run(16, 200000, seed) == 0);
+        CHECK(run(1000, 200000, seed) == 0);
+        CHECK(run(50000, 200000, seed) == 0);
+    }
+    return check_result();
+}
@@ -0,0 +1,101 @@
+// FrameWatchdog.h on a simulated clock: a steady loop kicks at every check;
+// a loop held off for two RTOS time slices still does; a hiccup past the
+// frame deadline skips a kick or two without a pre-timeout; a stalled loop
+// and a task that stops its heartbeats get a pre-timeout, with the cause,
+// the late task and the time of the pre-timeout bounded.
+
+#include "Check.h"
+#include "FrameWatchdog.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+struct WatchdogRun {
+    uint32_t kicks = 0;
+    uint32_t skipped = 0;
+    uint32_t misses = 0;
+    uint32_t longest_without_kick_us = 0;
+    uint32_t pretimeouts = 0;
+    uint32_t pretimeout_us = 0;  // 0 without pre-timeout
+    WatchdogCause cause = WATCHDOG_OK; // at the pre-timeout
+    uint8_t late_task = 0;
+};
+
+// 1 s of frames every 40 us but in [gap_us, gap_us + gap_length_us), and
+// two tasks beating every 10 and 500 ms, the first one until task_stop_us.
+// Checks every WATCHDOG_SERVICE_MS.
+WatchdogRun watchdog_run(uint32_t gap_us, uint32_t gap_length_us, uint32_t task_stop_us)
+{
+    FrameWatchdog watchdog;
+    uint8_t fast = watchdog.add_task(100);
+    uint8_t slow = watchdog.add_task(3000);
+    watchdog.start(0);
+    WatchdogRun run;
+    uint32_t last_kick_us = 0;
+    for (uint32_t now_us = 40; now_us <= 1000000; now_us += 40) {
+        if (now_us < gap_us || now_us >= gap_us + gap_length_us) {
+            watchdog.frame(now_us);
+        }
+        if (now_us % 10000 == 0 && now_us < task_stop_us) {
+            watchdog.heartbeat(fast);
+        }
+        if (now_us % 500000 == 0) {
+            watchdog.heartbeat(slow);
+        }
+        if (now_us % (WATCHDOG_SERVICE_MS * 1000) != 0) {
+            continue;
+        }
+        if (watchdog.service(now_us)) {
+            run.kicks++;
+            run.longest_without_kick_us = std::max(run.longest_without_kick_us, now_us - last_kick_us);
+            last_kick_us = now_us;
+        } else if (watchdog.pretimeout(now_us)) {
+            run.pretimeouts++;
+            run.pretimeout_us = now_us;
+            run.cause = watchdog.cause();
+            run.late_task = watchdog.late_task();
+        }
+    }
+    run.skipped = watchdog.skipped();
+    run.misses = watchdog.misses();
+    printf("gap %u us at %u us, fast task until %u us: %u kicks, %u skipped, %u misses, pre-timeout at %u us, cause %u task %u\n",
+           gap_length_us, gap_us, task_stop_us, run.kicks, run.skipped, run.misses, run.pretimeout_us, run.cause,
+           run.late_task);
+    return run;
+}
+
+} // namespace
+
+int main()
+{
+    const uint32_t checks = 1000 / WATCHDOG_SERVICE_MS;
+    WatchdogRun steady = watchdog_run(UINT32_MAX, 0, UINT32_MAX);
+    CHECK(steady.kicks == checks && steady.skipped == 0 && steady.misses == 0 && steady.pretimeout_us == 0);
+
+    // The loop held off by two other threads of its priority, a time slice each
+    WatchdogRun slices = watchdog_run(500000, 2 * WATCHDOG_RTOS_SLICE_MS * 1000, UINT32_MAX);
+    CHECK(slices.kicks == checks && slices.skipped == 0 && slices.pretimeout_us == 0);
+
+    // Past the deadline: a kick or two skipped, counted, no pre-timeout
+    WatchdogRun hiccup = watchdog_run(500000, WATCHDOG_FRAME_DEADLINE_US + 5000, UINT32_MAX);
+    CHECK(hiccup.pretimeout_us == 0);
+    CHECK(hiccup.kicks >= checks - 2 && hiccup.kicks < checks);
+    CHECK(hiccup.skipped == checks - hiccup.kicks && hiccup.misses == 1);
+    CHECK(hiccup.longest_without_kick_us < WATCHDOG_PRETIMEOUT_MS * 1000);
+
+    // The last kick is up to a deadline after the last frame
+    WatchdogRun stall = watchdog_run(500000, 1000000, UINT32_MAX);
+    uint32_t stall_ms = (stall.pretimeout_us - 500000) / 1000;
+    CHECK(stall.pretimeouts == 1 && stall.cause == WATCHDOG_FRAMES_STOPPED);
+    CHECK(stall_ms >= WATCHDOG_PRETIMEOUT_MS);
+    CHECK(stall_ms <= WATCHDOG_PRETIMEOUT_MS + WATCHDOG_FRAME_DEADLINE_US / 1000 + WATCHDOG_SERVICE_MS);
+
+    // The fast task's last beat at 490 ms, late from 590 ms
+    WatchdogRun late = watchdog_run(UINT32_MAX, 0, 500000);
+    uint32_t late_ms = late.pretimeout_us / 1000;
+    CHECK(late.pretimeouts == 1 && late.cause == WATCHDOG_TASK_LATE && late.late_task == 0);
+    CHECK(late_ms >= 590 + WATCHDOG_PRETIMEOUT_MS && late_ms <= 590 + WATCHDOG_PRETIMEOUT_MS + WATCHDOG_SERVICE_MS);
+    return check_result();
+}
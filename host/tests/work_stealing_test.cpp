@@ -0,0 +1,87 @@
+// WorkStealing.h: the owner pops its deque last pushed first and thieves
+// steal first pushed first, the last item goes to only one of them, and
+// work_stealing_run() runs every task exactly once whatever the thread count,
+// with tasks of very uneven length.
+
+#include "Check.h"
+#include "WorkStealing.h"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Every index run once, on 'threads' workers
+bool each_once(uint32_t threads, uint32_t tasks)
+{
+    std::vector<std::atomic<uint32_t>> runs(tasks);
+    std::atomic<uint32_t> total(0);
+    work_stealing_run(threads, tasks, [&](uint32_t index) {
+        // The first block is much slower: the other workers steal its tail
+        if (index < tasks / threads) {
+            std::this_thread::yield();
+        }
+        runs[index]++;
+        total++;
+    });
+    bool once = total == tasks;
+    for (std::atomic<uint32_t> &count : runs) {
+        once &= count == 1;
+    }
+    printf("%u threads, %5u tasks: %s\n", threads, tasks, once ? "each once" : "MISSED OR REPEATED");
+    return once;
+}
+
+// Two threads racing for the last item of a deque, many times
+bool last_item_once(uint32_t rounds)
+{
+    uint32_t taken_twice = 0, lost = 0;
+    for (uint32_t round = 0; round < rounds; round++) {
+        WorkStealingDeque<uint32_t> deque(1);
+        deque.push(round);
+        uint32_t stolen_item = 0, popped_item = 0;
+        WorkStealingDeque<uint32_t>::Steal steal = WorkStealingDeque<uint32_t>::STEAL_LOST;
+        std::thread thief([&]() {
+            while ((steal = deque.steal(stolen_item)) == WorkStealingDeque<uint32_t>::STEAL_LOST) {
+            }
+        });
+        bool popped = deque.pop(popped_item);
+        thief.join();
+        bool stolen = steal == WorkStealingDeque<uint32_t>::STEAL_TAKEN;
+        taken_twice += popped && stolen;
+        lost += !popped && !stolen;
+    }
+    printf("last item raced %u times: %u taken twice, %u lost\n", rounds, taken_twice, lost);
+    return taken_twice == 0 && lost == 0;
+}
+
+} // namespace
+
+int main()
+{
+    WorkStealingDeque<uint32_t> deque(4);
+    uint32_t item = 0;
+    CHECK(!deque.pop(item));
+    CHECK(deque.steal(item) == WorkStealingDeque<uint32_t>::STEAL_EMPTY);
+    for (uint32_t i = 0; i < 4; i++) {
+        CHECK(deque.push(i));
+    }
+    CHECK(!deque.push(4));
+    CHECK(deque.pop(item) && item == 3);
+    CHECK(deque.steal(item) == WorkStealingDeque<uint32_t>::STEAL_TAKEN && item == 0);
+    CHECK(deque.steal(item) == WorkStealingDeque<uint32_t>::STEAL_TAKEN && item == 1);
+    CHECK(deque.pop(item) && item == 2);
+    CHECK(!deque.pop(item));
+    CHECK(deque.steal(item) == WorkStealingDeque<uint32_t>::STEAL_EMPTY);
+
+    CHECK(last_item_once(2000));
+
+    for (uint32_t threads : {1u, 2u, 3u, 8u}) {
+        for (uint32_t tasks : {0u, 1u, 7u, 5000u}) {
+            CHECK(each_once(threads, tasks));
+        }
+    }
+    return check_result();
+}
@@ -0,0 +1,318 @@
+// Rebuilds the text of the TOKENLOG() frames of a console capture (see
+// TokenLog.h). The format strings are taken from the ".tokenlog" sections of
+// the ELF the capture came from, the firmware or a host tool, so they are
+// those of that build. Sources given instead are scanned for their TOKENLOG()
+// and LOG_*() calls (Log.h): the sites GCC leaves out of the table, in
+// templates, or an ELF that is gone. Other console lines pass through. Two
+// formats with the same token are an error: the tool exits 1 without
+// decoding, since their frames could not be told apart.
+//
+// tokenlog_decode <elf|source>... < console.txt
+
+#include "TokenLog.h"
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Reads the string literal(s) at text[pos], adjacent literals concatenated.
+// Returns false when there is no literal there.
+bool read_literal(const std::string &text, size_t pos, std::string &literal)
+{
+    bool found = false;
+    while (true) {
+        while (pos < text.size() && isspace((unsigned char)text[pos])) {
+            pos++;
+        }
+        if (pos >= text.size() || text[pos] != '"') {
+            return found;
+        }
+        found = true;
+        for (pos++; pos < text.size() && text[pos] != '"'; pos++) {
+            char c = text[pos];
+            if (c == '\\' && pos + 1 < text.size()) {
+                c = text[++pos];
+                switch (c) {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'r': c = '\r'; break;
+                    default: break;
+                }
+            }
+            literal += c;
+        }
+        pos++;
+    }
+}
+
+// Logging macros, and the number of arguments before their format string
+const struct {
+    const char *name;
+    int         leading;
+} log_macros[] = {
+    {"TOKENLOG(", 1},
+    {"LOG_ERROR(", 2},
+    {"LOG_WARN(", 2},
+    {"LOG_INFO(", 2},
+    {"LOG_DEBUG(", 2}
+};
+
+// Adds the format under its token. Returns false when the token is taken by
+// another format: frames of that token could not be told apart.
+bool add_format(const std::string &path, const std::string &format, std::map<uint32_t, std::string> &formats)
+{
+    uint32_t token = tokenlog_hash(format.c_str());
+    auto known = formats.find(token);
+    if (known != formats.end() && known->second != format) {
+        std::cerr << path << ": token collision between \"" << known->second << "\" and \"" << format << "\"\n";
+        return false;
+    }
+    formats[token] = format;
+    return true;
+}
+
+// Format strings of every logging call, by token. Returns false on a token
+// collision.
+bool scan_source(const std::string &path, const std::string &text, std::map<uint32_t, std::string> &formats)
+{
+    for (const auto &macro : log_macros) {
+        for (size_t pos = text.find(macro.name); pos != std::string::npos; pos = text.find(macro.name, pos + 1)) {
+            size_t comma = pos;
+            for (int i = 0; i < macro.leading && comma != std::string::npos; i++) {
+                comma = text.find(',', comma + 1);
+            }
+            std::string format;
+            if (comma == std::string::npos || !read_literal(text, comma + 1, format)) {
+                continue;
+            }
+            if (!add_format(path, format, formats)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename T>
+T read_le(const std::string &image, size_t offset)
+{
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        value |= (T)(uint8_t)image[offset + i] << (8 * i);
+    }
+    return value;
+}
+
+// Format strings of the ".tokenlog" sections of a little endian ELF, 32 or 64
+// bits: one input section per TOKENLOG() site, merged or not by the link.
+// Returns false on a malformed ELF or a token collision.
+bool read_elf(const std::string &path, const std::string &image, std::map<uint32_t, std::string> &formats)
+{
+    bool wide = image.size() > 4 && image[4] == 2;
+    size_t header_size = wide ? 64 : 52;
+    if (image.size() < header_size || image[5] != 1) {
+        std::cerr << path << ": not a little endian ELF\n";
+        return false;
+    }
+    uint64_t sections = wide ? read_le<uint64_t>(image, 0x28) : read_le<uint32_t>(image, 0x20);
+    uint16_t entry_size = read_le<uint16_t>(image, wide ? 0x3A : 0x2E);
+    uint16_t count = read_le<uint16_t>(image, wide ? 0x3C : 0x30);
+    uint16_t names = read_le<uint16_t>(image, wide ? 0x3E : 0x32);
+    if (sections + (uint64_t)count * entry_size > image.size() || names >= count) {
+        std::cerr << path << ": truncated section headers\n";
+        return false;
+    }
+
+    struct Section {
+        uint32_t name;
+        uint32_t type;
+        uint64_t offset;
+        uint64_t size;
+    };
+    auto section = [&](uint16_t index) {
+        size_t header = sections + (size_t)index * entry_size;
+        Section s;
+        s.name = read_le<uint32_t>(image, header);
+        s.type = read_le<uint32_t>(image, header + 4);
+        s.offset = wide ? read_le<uint64_t>(image, header + 0x18) : read_le<uint32_t>(image, header + 0x10);
+        s.size = wide ? read_le<uint64_t>(image, header + 0x20) : read_le<uint32_t>(image, header + 0x14);
+        return s;
+    };
+
+    const uint32_t SHT_NOBITS = 8;
+    Section strings = section(names);
+    size_t found = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        Section s = section(i);
+        if (strings.offset + s.name >= image.size() || s.type == SHT_NOBITS
+            || s.offset + s.size > image.size()) {
+            continue;
+        }
+        std::string name = image.c_str() + strings.offset + s.name;
+        if (name != ".tokenlog" && name.compare(0, 10, ".tokenlog.") != 0) {
+            continue;
+        }
+        // NUL terminated formats, with the padding of their alignment between
+        for (size_t pos = s.offset, end = s.offset + s.size; pos < end;) {
+            size_t length = strnlen(image.c_str() + pos, end - pos);
+            if (length) {
+                if (!add_format(path, image.substr(pos, length), formats)) {
+                    return false;
+                }
+                found++;
+            }
+            pos += length + 1;
+        }
+    }
+    if (!found) {
+        std::cerr << path << ": no .tokenlog section\n";
+    }
+    return true;
+}
+
+// printf of the format with the 32 bit argument words, one specifier at a time
+std::string format_frame(const std::string &format, const std::vector<uint32_t> &words)
+{
+    std::string out;
+    size_t arg = 0;
+    for (size_t pos = 0; pos < format.size(); pos++) {
+        if (format[pos] != '%') {
+            out += format[pos];
+            continue;
+        }
+        if (pos + 1 < format.size() && format[pos + 1] == '%') {
+            out += '%';
+            pos++;
+            continue;
+        }
+
+        // Flags, width and precision kept, length modifiers dropped: the
+        // arguments are all 32 bits
+        std::string spec = "%";
+        for (pos++; pos < format.size() && !tokenlog_is_conversion(format[pos]); pos++) {
+            if (!strchr("hlLjzt", format[pos])) {
+                spec += format[pos];
+            }
+        }
+        if (pos >= format.size()) {
+            break;
+        }
+        char conversion = format[pos];
+        uint32_t word = arg < words.size() ? words[arg] : 0;
+        arg++;
+
+        char text[64];
+        if (strchr("fFeEgG", conversion)) {
+            float value;
+            memcpy(&value, &word, sizeof(value));
+            snprintf(text, sizeof(text), (spec + conversion).c_str(), (double)value);
+        } else if (conversion == 'd' || conversion == 'i') {
+            snprintf(text, sizeof(text), (spec + conversion).c_str(), (int)(int32_t)word);
+        } else if (conversion == 's' || conversion == 'p') {
+            snprintf(text, sizeof(text), "<%%%c>", conversion);
+        } else {
+            snprintf(text, sizeof(text), (spec + conversion).c_str(), (unsigned int)word);
+        }
+        out += text;
+    }
+    return out;
+}
+
+int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+bool decode_hex(const std::string &hex, std::vector<uint8_t> &bytes)
+{
+    if (hex.size() % 2) {
+        return false;
+    }
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        int high = hex_value(hex[i]);
+        int low = hex_value(hex[i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        bytes.push_back((uint8_t)(high << 4 | low));
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: tokenlog_decode <elf|source>... < console.txt\n");
+        return 2;
+    }
+
+    std::map<uint32_t, std::string> formats;
+    for (int i = 1; i < argc; i++) {
+        std::ifstream file(argv[i], std::ios::binary);
+        if (!file) {
+            std::cerr << argv[i] << ": cannot open\n";
+            return 1;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string image = buffer.str();
+        if (image.compare(0, 4, "\x7F" "ELF") == 0) {
+            if (!read_elf(argv[i], image, formats)) {
+                return 1;
+            }
+        } else if (!scan_source(argv[i], image, formats)) {
+            return 1;
+        }
+    }
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.compare(0, 2, "#T") != 0) {
+            std::cout << line << '\n';
+            continue;
+        }
+
+        std::vector<uint8_t> frame;
+        if (!decode_hex(line.substr(2), frame) || frame.size() < TOKENLOG_FRAME_HEADER
+            || frame.size() != TOKENLOG_FRAME_HEADER + 4u * frame[4]) {
+            std::cout << "<bad frame> " << line << '\n';
+            continue;
+        }
+        uint32_t token = frame[0] | frame[1] << 8 | frame[2] << 16 | (uint32_t)frame[3] << 24;
+        std::vector<uint32_t> words(frame[4]);
+        for (size_t i = 0; i < words.size(); i++) {
+            const uint8_t *word = &frame[TOKENLOG_FRAME_HEADER + 4 * i];
+            words[i] = word[0] | word[1] << 8 | word[2] << 16 | (uint32_t)word[3] << 24;
+        }
+
+        auto format = formats.find(token);
+        if (format == formats.end()) {
+            char text[32];
+            snprintf(text, sizeof(text), "<unknown token %08X>", (unsigned int)token);
+            std::cout << text << '\n';
+            continue;
+        }
+        std::cout << format_frame(format->second, words) << '\n';
+    }
+    return 0;
+}
@@ -10,50 +10,161 @@
 #include "Thread.h"
 #include "mbed.h"
 #include "SoftPWM.h"
-#include "EwmaT.h"
+#include "DmaPWM.h"
+#include "InputFilter.h"
+#include "DepthEngine.h"
+#include "DepthCurve.h"
+#include "AutoRange.h"
+#include "FastAnalog.h"
+#include "StageProfiler.h"
+#include "LoopRate.h"
+#include "Telemetry.h"
+#include "Debouncer.h"
+#include "SpscRing.h"
+#include "Log.h"
+#include "TelemetryCodec.h"
+#include "DepthLink.h"
+#include "LinkSerial.h"
+#include "FrameWatchdog.h"
+#include "FlightRecorder.h"
+#include "PostMortem.h"
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <iterator>
 
-#define UI16_MAX                    65535
 #define BLINKING_RATE               5ms
+#define LED_PWM_PERIOD_MS           10
 #define CONSOLE_RATE                1000ms
-#define FILTER_CV_WEIGHT            1 // [0, 100] Higher the value - less smoothing (higher the latest reading impact)
-#define FILTER_POTS_WEIGHT          3
-
-// Pente de profondeur selon l'entrée CV
-// Largeur du plateau, en %
-#define CENTER_WIDTH                0.2
-#define CENTER_WIDTH_UI16           (uint16_t)(CENTER_WIDTH * UI16_MAX) / 2
-#define SLIDER_LENGTH_MINUS_CENTER  (uint16_t)(UI16_MAX - (CENTER_WIDTH_UI16 * 2))
-#define LEFT_SILDER_ADJ             50 // Pour ajuster le point où le plateau recouvre tout à gauche (dépend des valeurs absolues)
-#define RIGHT_SILDER_ADJ            50
-
-SoftPWM                             led(LED1);  // TO COMMENT
-AnalogIn                            cv_input(A6); // CV input
-AnalogIn                            slider_input(A2); // SLIDER input
-AnalogIn                            center_input(D3); // POT CENTER input
-AnalogIn                            left_input(A1); // POT R Left input
-AnalogIn                            right_input(A0); // POT L Left input
+#define WARM_START_READINGS         16 // readings averaged to seed the filters at power up
+#define BUTTON_EVENTS               8 // queued debounced events, drained every frame
+#define LOOP_LOG_BUFFER             512 // bytes of control loop log frames between two console drains
+#define CONSOLE_LOG_BUFFER          256
+#define TELEMETRY_STREAM            0 // 1: compressed telemetry frames on the console instead of the logs
+#define TELEMETRY_STREAM_DIVIDER    50 // one streamed frame every 50 control loop frames, ~500Hz, ~6KB/s at 115200 baud
+#define TELEMETRY_STREAM_BUFFER     32
+#define TELEMETRY_STREAM_RATE       10ms
+#define FAST_ANALOG                 1 // 0: mbed AnalogIn/AnalogOut, to compare the acquisition cycles
+#define FIXED_ENGINE                1 // 1: depth_compute_fixed(), within FIXED_MAX_DEVIATION (1 LSB) of the float depth_compute()
+#define CONSOLE_COMMANDS            1 // 1: "curve <expression>|off", "range auto|manual" and "link ..." lines on the console input
+#define COMMAND_LINE                160
+#define COMMAND_THREAD_STACK        3072 // curve compiler state and the command line
+#define COMMAND_LOG_BUFFER          128
+#define DEPTH_LINK                  1 // 1: "link leader|follower|off", stereo link to a second module on D1 (TX) / D0 (RX)
+#define WATCHDOG                    1 // 1: hardware watchdog, fed while the frames meet their deadline and the tasks beat
+#define WATCHDOG_LED_MS             100 // longest heartbeat interval of each task
+#define WATCHDOG_CONSOLE_MS         3000
+#define WATCHDOG_TELEMETRY_MS       100
+#define DMA_PWM                     1 // 0: SoftPWM, a Ticker and a Timeout interrupt per period: LED1's only timer channel is on TIM2, the us_ticker timer
+
+#if FAST_ANALOG
+typedef FastAnalogIn                ControlAnalogIn;
+typedef FastAnalogOut               ControlAnalogOut;
+#else
+typedef AnalogIn                    ControlAnalogIn;
+typedef AnalogOut                   ControlAnalogOut;
+#endif
+
+#if DMA_PWM
+typedef DmaPWM                      LedPWM;
+#else
+typedef SoftPWM                     LedPWM;
+#endif
+
+LedPWM                              led(LED1);
+// Only read by the control loop: the fast path does not lock the ADC
+ControlAnalogIn                     cv_input(A6); // CV input
+ControlAnalogIn                     slider_input(A2); // SLIDER input
+ControlAnalogIn                     center_input(D3); // POT CENTER input
+ControlAnalogIn                     left_input(A1); // POT R Left input
+ControlAnalogIn                     right_input(A0); // POT L Left input
 //AnalogOut                         raw_output(PA_4); // DAC 1  // TO COMMENT
-AnalogOut                           filtered_output(PA_5); // DAC 2
+ControlAnalogOut                    filtered_output(PA_5); // DAC 2
 
 DigitalIn                           but_r_lin_log(PB_5); // Lin/Log algo to R depth
 DigitalIn                           but_l_lin_log(PB_4); // Lin/Log algo to L depth
 
+enum LinLogButton : uint8_t {
+    BUTTON_L_LIN_LOG,
+    BUTTON_R_LIN_LOG
+};
+
+// Buttons sampled from a Ticker, debounced events handed to the control loop
+Ticker                              button_ticker;
+Debouncer                           debounce_l_lin_log, debounce_r_lin_log;
+SpscRing<ButtonEvent, BUTTON_EVENTS> button_events;
+
 // Exponentially Weighted Moving Average filter
 // https://github.com/jonnieZG/EWMA
-EwmaT <int>                         ewma_cv(FILTER_CV_WEIGHT, 100);
-EwmaT <int>                         ewma_slider(FILTER_POTS_WEIGHT, 100);
-EwmaT <int>                         ewma_center(FILTER_POTS_WEIGHT, 100);
-EwmaT <int>                         ewma_left(FILTER_POTS_WEIGHT, 100);
-EwmaT <int>                         ewma_right(FILTER_POTS_WEIGHT, 100);
+InputFilter                         ewma_cv(FILTER_CV_WEIGHT, FILTER_WEIGHT_SCALE);
+InputFilter                         ewma_slider(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE);
+InputFilter                         ewma_center(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE);
+InputFilter                         ewma_left(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE);
+InputFilter                         ewma_right(FILTER_POTS_WEIGHT, FILTER_WEIGHT_SCALE);
+
+StageProfiler                       profiler;
+LoopRate                            loop_rate;
+SeqLock<TelemetrySnapshot>          telemetry;
+#if TELEMETRY_STREAM
+SpscRing<TelemetrySnapshot, TELEMETRY_STREAM_BUFFER> telemetry_stream;
+#endif
+TokenLog<LOOP_LOG_BUFFER>           loop_log; // written by the control loop
+TokenLog<CONSOLE_LOG_BUFFER>        console_log; // written by the console thread
+TokenLog<COMMAND_LOG_BUFFER>        command_log; // written by the console commands, and their errors
 
-Thread                              threadRefresh;
 Thread                              threadLed;
 Thread                              threadConsole;
+#if CONSOLE_COMMANDS && !defined(DEPTH_SIM)
+// Below the loop and the console: a compile waits for the console, never the
+// other way round
+Thread                              threadCommand(osPriorityBelowNormal, COMMAND_THREAD_STACK);
+#endif
+
+// User depth law (DepthCurve.h), compiled into the table the control loop is
+// not reading, then published. nullptr: the built-in law.
+uint16_t                            curve_tables[2][DEPTH_CURVE_POINTS];
+const uint16_t *volatile            curve_table;
+const uint16_t *volatile            curve_reading; // table of the frame in progress
+
+// CV scaled to its tracked range and plateau centred on its median
+// (AutoRange.h), "range auto" / "range manual"
+AutoRange                           auto_range;
+volatile bool                       auto_range_enabled;
+bool                                auto_range_active; // control loop side
+
+#if DEPTH_LINK
+enum LinkMode : uint8_t {
+    LINK_OFF,
+    LINK_LEADER,
+    LINK_FOLLOWER
+};
+
+// Stereo link (DepthLink.h): the leader sends the inputs of its engine, the
+// follower runs on them as long as frames come in
+LinkSerial                          link_serial(D1, D0, DEPTH_LINK_BAUD);
+DepthLinkLeader                     link_leader;
+DepthLinkDecoder                    link_decoder;
+DepthLinkFollower                   link_follower;
+volatile uint8_t                    link_mode_request;
+uint8_t                             link_mode; // control loop side
+bool                                link_following;
+uint32_t                            link_send_busy; // frames dropped, the previous one still going out
+#endif
+
+#if WATCHDOG
+// Frame deadlines and task heartbeats checked from a Ticker, which kicks the
+// watchdog while they are met (FrameWatchdog.h)
+Ticker                              watchdog_ticker;
+FrameWatchdog                       frame_watchdog;
+uint8_t                             watchdog_led_task, watchdog_console_task, watchdog_telemetry_task;
+#endif
+// Flight recorder written by every frame, the rest by the watchdog
+// pre-timeout or a fault, reported at the next boot (PostMortem.h)
+RETAINED PostMortem                 post_mortem;
 
 uint16_t                            raw_cv_input, raw_slider_input, raw_center_input, raw_left_input, raw_right_input;
-uint32_t                            refresh,old_refresh;
+uint32_t                            frame_count;
+uint32_t                            warm_start_us;
 uint32_t                            filtered_raw_cv_input, filtered_raw_slider_input, filtered_raw_center_input, filtered_raw_left_input, filtered_raw_right_input;
 uint16_t                            center_from_slider;
 uint16_t                            volume, volume_right, volume_left;
@@ -62,57 +173,53 @@ uint16_t                            left_slide_point, right_slide_point;
 
 float                               left_cv_calc, right_cv_calc;
 
-void refresh_thread(void)
-{
-    while (true) {
-        old_refresh = refresh;
-        refresh = 0;
-        ThisThread::sleep_for(1000ms);
-    }
-}
+bool                                lin_log_left, lin_log_right; // false: Lin, true: Log
+uint32_t                            curve_switches;
 
 void led_thread(void)
 {
     while (true) {
-        led.write(((float)volume)/(float)UI16_MAX);  // TO COMMENT
+        led.write(((float)volume)/(float)UI16_MAX);
+#if WATCHDOG
+        frame_watchdog.heartbeat(watchdog_led_task);
+#endif
         ThisThread::sleep_for(BLINKING_RATE);
     }
 }
 
+// Console output, by category and level (Log.h): rate and output at INFO,
+// every input and the stage cycles at TELEMETRY DEBUG
 void console_thread(void)
 {
+    LOG_INFO(ACQUISITION, console_log, "WARM START: valid output %uus after reset", warm_start_us);
+
     while (true) {
-        printf("%iHz | %f\%\n",
-        old_refresh,
-        filtered_output.read()
-        );
+        TelemetrySnapshot snapshot = telemetry.read();
+        LOG_INFO(TELEMETRY, console_log, "%iHz | %f%%", snapshot.loop_rate_hz, filtered_output.read());
 
-        ThisThread::sleep_for(CONSOLE_RATE);
-    }
-}
+        // Ramp slopes, not computed by the integer engine
+        left_cv_calc = left_slide_point ? ((float)(UI16_MAX - filtered_raw_left_input)) / ((float)(left_slide_point)) : 0;
+        right_cv_calc = (right_slide_point < UI16_MAX) ? -((float)(UI16_MAX - filtered_raw_right_input)) / ((float)(UI16_MAX - right_slide_point)) : 0;
 
-void big_console_thread(void)
-{
-    while (true) {
-        printf("CV INPUT: 0x%04X, %05i/UI16_MAX, %fV | OUTPUT: %f\% | SLIDER: %f\%/%f\%, CENTER:%i/%i| L%d-R%d | CENTER: %f\%/%f\% | LEFT: %f\%/%f\% | RIGHT: %f\%/%f\% | %iHz | %d | %d | %f * CV + %d = %d | %f * (CV - %d) + %d = %d\n",
+        LOG_DEBUG(TELEMETRY, console_log, "CV INPUT: 0x%04X, %05i/UI16_MAX, %fV | OUTPUT: %f%% | SLIDER: %f%%/%f%%, CENTER:%i/%i| L%d-R%d | CENTER: %f%%/%f%% | LEFT: %f%%/%f%% | RIGHT: %f%%/%f%% | %iHz | %d | %d | %f * CV + %d = %d | %f * (CV - %d) + %d = %d",
         raw_cv_input,
         raw_cv_input,
         3.3*((float)raw_cv_input)/((float)UI16_MAX),
         //raw_output.read(),
         filtered_output.read(),
-        slider_input.read(),
+        (float)raw_slider_input / (float)UI16_MAX,
         (float)filtered_raw_slider_input / (float)UI16_MAX,
         center_from_slider,
         (uint16_t)CENTER_WIDTH_UI16,
-        but_l_lin_log.read(),
-        but_r_lin_log.read(),
-        center_input.read(),
+        snapshot.lin_log & 1,
+        snapshot.lin_log >> 1,
+        (float)raw_center_input / (float)UI16_MAX,
         (float)filtered_raw_center_input / (float)UI16_MAX,
-        left_input.read(),
+        (float)raw_left_input / (float)UI16_MAX,
         (float)filtered_raw_left_input / (float)UI16_MAX,
-        right_input.read(),
+        (float)raw_right_input / (float)UI16_MAX,
         (float)filtered_raw_right_input / (float)UI16_MAX,
-        old_refresh,
+        snapshot.loop_rate_hz,
         volume,
         superdebug,
         left_cv_calc,
@@ -124,73 +231,522 @@ void big_console_thread(void)
         volume_right
         );
 
+        // Average / max cycles of each stage of the control loop
+        static_assert(STAGE_COUNT == 4, "one STAGES field per profiled stage");
+        uint32_t average[STAGE_COUNT];
+        for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+            const StageStats &stats = profiler.stats((ProfileStage)stage);
+            average[stage] = stats.count ? stats.total / stats.count : 0;
+        }
+        LOG_DEBUG(TELEMETRY, console_log, "STAGES: acquisition %u/%u filter %u/%u output %u/%u engine %u/%u",
+        average[STAGE_ACQUISITION], profiler.stats(STAGE_ACQUISITION).max,
+        average[STAGE_FILTER], profiler.stats(STAGE_FILTER).max,
+        average[STAGE_OUTPUT], profiler.stats(STAGE_OUTPUT).max,
+        average[STAGE_ENGINE], profiler.stats(STAGE_ENGINE).max
+        );
+        profiler.reset();
+
+#if DEPTH_LINK
+        if (link_mode != LINK_OFF) {
+            LOG_DEBUG(ENGINE, console_log, "LINK: mode %u following %u | %u frames, %u CRC errors, %u lost, %u send busy",
+            link_mode, link_following, link_decoder.frames(), link_decoder.errors(), link_decoder.lost(), link_send_busy);
+        }
+#endif
+
+#if WATCHDOG
+        // None in a normal run: a count here means the deadline is too short
+        // for the scheduler, or a frame really was late
+        static uint32_t skipped_reported;
+        if (frame_watchdog.skipped() != skipped_reported) {
+            skipped_reported = frame_watchdog.skipped();
+            LOG_WARN(ENGINE, console_log, "WATCHDOG: %u kicks skipped, %u late frames, last cause %u",
+            skipped_reported, frame_watchdog.misses(), frame_watchdog.cause());
+        }
+#endif
+
+        // The frames are printed here, at the console priority
+        loop_log.drain();
+        console_log.drain();
+        command_log.drain();
+#if WATCHDOG
+        frame_watchdog.heartbeat(watchdog_console_task);
+#endif
+
         ThisThread::sleep_for(CONSOLE_RATE);
     }
 }
 
+#if TELEMETRY_STREAM
+// Binary frames go to the console FileHandle itself: the stdio retarget
+// above it turns every 0x0A into 0D 0A (platform.stdio-convert-newlines),
+// which breaks the frames. Text printed before them is flushed first.
+void telemetry_write(const uint8_t *frame, uint32_t length)
+{
+    fflush(stdout);
+    mbed_file_handle(STDOUT_FILENO)->write(frame, length);
+}
 
-int main()
+// Console output as TelemetryCodec frames, decoded on the host by
+// telemetry_decode. Snapshots lost to a full ring only make a bigger delta.
+void telemetry_thread(void)
+{
+    TelemetryEncoder encoder;
+    while (true) {
+        TelemetrySnapshot snapshot;
+        while (telemetry_stream.pop(snapshot)) {
+            uint8_t frame[TELEMETRY_FRAME_MAX];
+            telemetry_write(frame, encoder.encode(snapshot, frame));
+        }
+#if WATCHDOG
+        frame_watchdog.heartbeat(watchdog_telemetry_task);
+#endif
+
+        ThisThread::sleep_for(TELEMETRY_STREAM_RATE);
+    }
+}
+#endif
+
+// Ticker handler, one debouncer sample per button
+void sample_buttons(void)
+{
+    if (debounce_l_lin_log.sample(but_l_lin_log.read())) {
+        button_events.push(ButtonEvent{BUTTON_L_LIN_LOG, debounce_l_lin_log.pressed() ? BUTTON_PRESSED : BUTTON_RELEASED});
+    }
+    if (debounce_r_lin_log.sample(but_r_lin_log.read())) {
+        button_events.push(ButtonEvent{BUTTON_R_LIN_LOG, debounce_r_lin_log.pressed() ? BUTTON_PRESSED : BUTTON_RELEASED});
+    }
+}
+
+// Each press toggles the Lin/Log curve of its side, once
+void handle_buttons(void)
+{
+    ButtonEvent event;
+    while (button_events.pop(event)) {
+        if (event.type != BUTTON_PRESSED) {
+            continue;
+        }
+        if (event.button == BUTTON_L_LIN_LOG) {
+            lin_log_left = !lin_log_left;
+        } else {
+            lin_log_right = !lin_log_right;
+        }
+        curve_switches++;
+        LOG_INFO(ENGINE, loop_log, "LIN/LOG: L%u R%u at frame %u", lin_log_left, lin_log_right, frame_count);
+    }
+}
+
+// Compiles a depth law and publishes its table, "off" restores the built-in
+// law. Waits for the control loop to leave the table it overwrites: the loop
+// announces its table, then checks it still is the published one.
+bool depth_load_curve(const char *source, DepthCurveError &error)
+{
+    if (strcmp(source, "off") == 0) {
+        curve_table = nullptr;
+        LOG_INFO(ENGINE, command_log, "CURVE: off");
+        return true;
+    }
+    static DepthCurveProgram program;
+    uint32_t start = StageProfiler::cycles();
+    if (!depth_curve_compile(source, program, error)) {
+        return false;
+    }
+    uint32_t compiled = StageProfiler::cycles();
+
+    uint16_t *table = curve_tables[curve_table == curve_tables[0] ? 1 : 0];
+    while (curve_reading == table) {
+        ThisThread::sleep_for(1ms);
+    }
+    uint32_t waited = StageProfiler::cycles();
+    if (!depth_curve_table(program, table, error)) {
+        return false;
+    }
+    curve_table = table;
+    LOG_INFO(ENGINE, command_log, "CURVE: %u ops compiled in %u cycles, %u points in %u cycles",
+             program.count, compiled - start, DEPTH_CURVE_POINTS, StageProfiler::cycles() - waited);
+    return true;
+}
+
+// One console input line. Returns nullptr, or the error to print.
+const char *depth_command(const char *line)
+{
+    static char reply[64];
+    if (strncmp(line, "curve ", 6) == 0) {
+        DepthCurveError error;
+        if (!depth_load_curve(line + 6, error)) {
+            snprintf(reply, sizeof(reply), "curve: %s at %u", error.message, (unsigned int)error.position);
+            return reply;
+        }
+        return nullptr;
+    }
+    if (strcmp(line, "range auto") == 0 || strcmp(line, "range manual") == 0) {
+        auto_range_enabled = line[6] == 'a';
+        LOG_INFO(ENGINE, command_log, "RANGE: auto %u", auto_range_enabled);
+        return nullptr;
+    }
+#if DEPTH_LINK
+    if (strcmp(line, "link leader") == 0 || strcmp(line, "link follower") == 0 || strcmp(line, "link off") == 0) {
+        link_mode_request = line[5] == 'l' ? LINK_LEADER : (line[5] == 'f' ? LINK_FOLLOWER : LINK_OFF);
+        LOG_INFO(ENGINE, command_log, "LINK: mode %u", link_mode_request);
+        return nullptr;
+    }
+#endif
+    return "unknown command";
+}
+
+#if CONSOLE_COMMANDS && !defined(DEPTH_SIM)
+void command_thread(void)
+{
+    char line[COMMAND_LINE];
+    while (fgets(line, sizeof(line), stdin)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        const char *error = line[0] ? depth_command(line) : nullptr;
+        if (error) {
+            // Printed by the console thread, with the other command logs
+            command_log.write_text(error);
+        }
+    }
+}
+#endif
+
+#if DEPTH_LINK
+// Leader: sends the engine inputs every DEPTH_LINK_DIVIDER frames. Follower:
+// takes the frames received since the last frame and replaces the inputs
+// with the leader's, brought to this frame boundary.
+void link_inputs(DepthInputs &in)
+{
+    if (link_mode_request != link_mode) {
+        link_mode = link_mode_request;
+        link_following = false;
+        link_decoder.reset();
+        link_follower.reset();
+    }
+    if (link_mode == LINK_OFF) {
+        return;
+    }
+    if (link_mode == LINK_LEADER) {
+        uint8_t frame[DEPTH_LINK_FRAME];
+        if (link_leader.frame(in, us_ticker_read(), frame) && !link_serial.send(frame, sizeof(frame))) {
+            link_send_busy++;
+        }
+        return;
+    }
+
+    // Frames are stamped after the bytes are taken: never before their arrival
+    uint8_t bytes[2 * DEPTH_LINK_FRAME];
+    uint32_t count;
+    uint32_t now_us;
+    do {
+        count = link_serial.receive(bytes, sizeof(bytes));
+        now_us = us_ticker_read();
+        for (uint32_t i = 0; i < count; i++) {
+            DepthLinkFrame frame;
+            if (link_decoder.feed(bytes[i], frame)) {
+                link_follower.receive(frame, now_us);
+            }
+        }
+    } while (count == sizeof(bytes));
+    bool following = link_follower.inputs(now_us, in);
+    if (following != link_following) {
+        link_following = following;
+        LOG_INFO(ENGINE, loop_log, "LINK: following %u at frame %u", following, frame_count);
+    }
+}
+#endif
+
+// Runs the engine on the filtered inputs
+void update_depth(void)
+{
+    DepthInputs in{filtered_raw_cv_input, filtered_raw_slider_input, filtered_raw_left_input, filtered_raw_right_input,
+                   (uint8_t)(lin_log_left | lin_log_right << 1)};
+    if (auto_range_active && auto_range.ready()) {
+        in.cv = auto_range.scale(in.cv);
+        in.slider = auto_range.slider(in.slider);
+    }
+#if DEPTH_LINK
+    link_inputs(in);
+#endif
+#if FIXED_ENGINE
+    DepthOutputs depth = depth_compute_fixed(in);
+#else
+    DepthOutputs depth = depth_compute(in);
+#endif
+    const uint16_t *table;
+    do {
+        table = curve_table;
+        curve_reading = table;
+    } while (table != curve_table);
+    if (table) {
+        depth.volume = depth_curve_lookup(table, in.cv);
+    }
+    curve_reading = nullptr;
+    center_from_slider = depth.center_from_slider;
+    left_slide_point = depth.left_slide_point;
+    right_slide_point = depth.right_slide_point;
+    volume_left = depth.volume_left;
+    volume_right = depth.volume_right;
+    volume = depth.volume;
+    superdebug = depth.region;
+}
+
+// From the watchdog pre-timeout or the mbed error hook. The first one of a
+// run is kept: the watchdog fires after a fault too.
+void post_mortem_dump(PostMortemKind kind, uint32_t now_us)
 {
-    old_refresh = 0;
-    raw_cv_input = 0;
-    filtered_raw_cv_input = 0;
-    filtered_raw_slider_input = 0;
-    filtered_raw_left_input = 0;
-    filtered_raw_right_input = 0;
-    superdebug = 0;
-    volume = 0;
-    volume_left = 0;
-    volume_right = 0;
+    if (post_mortem_valid(post_mortem)) {
+        return;
+    }
+    post_mortem.kind = kind;
+    post_mortem.time_us = now_us;
+    post_mortem.frame = frame_count;
+#if WATCHDOG
+    post_mortem.last_frame_us = frame_watchdog.last_frame_us();
+    post_mortem.misses = frame_watchdog.misses();
+    post_mortem.cause = frame_watchdog.cause();
+    post_mortem.task = frame_watchdog.late_task();
+#endif
+    for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+        const StageStats &stats = profiler.stats((ProfileStage)stage);
+        post_mortem.stage_max[stage] = stats.max;
+        post_mortem.stage_average[stage] = stats.count ? stats.total / stats.count : 0;
+    }
+    post_mortem_seal(post_mortem);
+}
+
+// Faults and failed asserts, before mbed halts: the watchdog resets the module.
+// mbed_warning() calls the hook too and carries on, its status is ignored.
+void depth_error_hook(const mbed_error_ctx *context)
+{
+    int code = MBED_GET_ERROR_CODE(context->error_status);
+    bool fatal = code == MBED_ERROR_CODE_HARDFAULT_EXCEPTION || code == MBED_ERROR_CODE_MEMMANAGE_EXCEPTION
+                 || code == MBED_ERROR_CODE_BUSFAULT_EXCEPTION || code == MBED_ERROR_CODE_USAGEFAULT_EXCEPTION
+                 || code == MBED_ERROR_CODE_ASSERTION_FAILED;
+    // The first dump of the run is kept, fault registers included
+    if (!fatal || post_mortem_valid(post_mortem)) {
+        return;
+    }
+    post_mortem_fault_registers(post_mortem.fault);
+    post_mortem.fault[FAULT_ERROR_STATUS] = (uint32_t)context->error_status;
+    post_mortem.fault[FAULT_ERROR_ADDRESS] = context->error_address;
+    post_mortem_dump(POST_MORTEM_FAULT, us_ticker_read());
+}
+
+#if WATCHDOG
+// Ticker handler. On the pre-timeout, the control loop or a task is stuck:
+// the watchdog resets the module within WATCHDOG_TIMEOUT_MS - WATCHDOG_PRETIMEOUT_MS.
+void watchdog_service(void)
+{
+    uint32_t now_us = us_ticker_read();
+    if (frame_watchdog.service(now_us)) {
+        Watchdog::get_instance().kick();
+    } else if (frame_watchdog.pretimeout(now_us)) {
+        post_mortem_dump(POST_MORTEM_PRETIMEOUT, now_us);
+    }
+}
+#endif
+
+// At boot, before the threads: the report of the last run, once. A watchdog
+// reset without a dump, the interrupts blocked, leaves the flight recorder.
+void post_mortem_boot(void)
+{
+    reset_reason_t reason = ResetReason::get();
+    bool recorded = post_mortem.recorder_magic == POST_MORTEM_RECORDER_MAGIC && reason != RESET_REASON_POWER_ON;
+    bool dumped = recorded && post_mortem_valid(post_mortem);
+    if (dumped || (recorded && reason == RESET_REASON_WATCHDOG)) {
+        if (!dumped) {
+            memset(&post_mortem, 0, offsetof(PostMortem, recorder_magic));
+            post_mortem.kind = POST_MORTEM_RECORDER;
+        }
+        post_mortem.reset_reason = (uint8_t)reason;
+        post_mortem_seal(post_mortem);
+#if TELEMETRY_STREAM
+        uint8_t frame[TELEMETRY_FRAME_MAX];
+        uint32_t length;
+        for (uint8_t chunk = 0; (length = telemetry_encode_report((const uint8_t *)&post_mortem, sizeof(post_mortem), chunk, frame)); chunk++) {
+            telemetry_write(frame, length);
+        }
+#endif
+        // Before the console thread starts, the only other console_log writer
+        LOG_INFO(ENGINE, console_log, "POSTMORTEM: reset %u, kind %u cause %u task %u at frame %u, last frame %uus before, %u deadline misses",
+                 post_mortem.reset_reason, post_mortem.kind, post_mortem.cause, post_mortem.task, post_mortem.frame,
+                 post_mortem.time_us - post_mortem.last_frame_us, post_mortem.misses);
+        LOG_INFO(ENGINE, console_log, "POSTMORTEM: CFSR %08x HFSR %08x MMFAR %08x BFAR %08x error %08x at %08x",
+                 post_mortem.fault[FAULT_CFSR], post_mortem.fault[FAULT_HFSR], post_mortem.fault[FAULT_MMFAR],
+                 post_mortem.fault[FAULT_BFAR], post_mortem.fault[FAULT_ERROR_STATUS], post_mortem.fault[FAULT_ERROR_ADDRESS]);
+    }
+    post_mortem.magic = 0;
+    post_mortem.flight.reset();
+    post_mortem.recorder_magic = POST_MORTEM_RECORDER_MAGIC;
+}
+
+// Seeds the filters with the average of a burst of readings and outputs the
+// matching depth before the loop starts, so the VCA does not sweep from zero
+// depth at power up. EwmaT takes its first input as its state.
+void warm_start(void)
+{
+    uint32_t cv = 0, slider = 0, center = 0, left = 0, right = 0;
+    for (uint8_t i = 0; i < WARM_START_READINGS; i++) {
+        cv += cv_input.read_u16();
+        slider += slider_input.read_u16();
+        center += center_input.read_u16();
+        left += left_input.read_u16();
+        right += right_input.read_u16();
+    }
+    raw_cv_input = cv / WARM_START_READINGS;
+    raw_slider_input = slider / WARM_START_READINGS;
+    raw_center_input = center / WARM_START_READINGS;
+    raw_left_input = left / WARM_START_READINGS;
+    raw_right_input = right / WARM_START_READINGS;
+
+    filtered_raw_cv_input = ewma_cv.filter(raw_cv_input);
+    filtered_raw_slider_input = ewma_slider.filter(raw_slider_input);
+    filtered_raw_center_input = ewma_center.filter(raw_center_input);
+    filtered_raw_left_input = ewma_left.filter(raw_left_input);
+    filtered_raw_right_input = ewma_right.filter(raw_right_input);
+
+    update_depth();
+    filtered_output.write_u16(volume);
+
+    // The microsecond ticker starts at boot
+    warm_start_us = us_ticker_read();
+}
+
+void depth_setup(void)
+{
+    frame_count = 0;
+    warm_start();
     //printf("-- START --");
 
     but_r_lin_log.mode(PullUp);
     but_l_lin_log.mode(PullUp);
 
-    led.period_ms(10); // TO COMMENT
+    led.period_ms(LED_PWM_PERIOD_MS);
+    // Before the console thread starts, the only other console_log writer
+    LOG_INFO(PWM, console_log, "PWM: LED1 period %ums", LED_PWM_PERIOD_MS);
+
+    post_mortem_boot();
+#if TELEMETRY_STREAM
+    // No console thread to drain the boot lines (PWM, POSTMORTEM): they go
+    // out now, as text after the report frames. telemetry_decode skips them,
+    // ASCII never holds the frame sync byte.
+    console_log.drain();
+#endif
+    mbed_set_error_hook(depth_error_hook);
+
+    button_ticker.attach(sample_buttons, std::chrono::microseconds(DEBOUNCE_SAMPLE_US));
+
+    StageProfiler::init();
+
+#if WATCHDOG
+    watchdog_led_task = frame_watchdog.add_task(WATCHDOG_LED_MS);
+#if TELEMETRY_STREAM
+    watchdog_telemetry_task = frame_watchdog.add_task(WATCHDOG_TELEMETRY_MS);
+#else
+    watchdog_console_task = frame_watchdog.add_task(WATCHDOG_CONSOLE_MS);
+#endif
+    frame_watchdog.start(us_ticker_read());
+    Watchdog::get_instance().start(WATCHDOG_TIMEOUT_MS);
+    watchdog_ticker.attach(watchdog_service, std::chrono::milliseconds(WATCHDOG_SERVICE_MS));
+#endif
 
-    threadRefresh.start(refresh_thread);
     threadLed.start(led_thread);
-    threadConsole.start(big_console_thread);  // TO COMMENT
-    //threadConsole.start(console_thread);  // TO COMMENT
+#if TELEMETRY_STREAM
+    threadConsole.start(telemetry_thread);
+#else
+    threadConsole.start(console_thread);
+#endif
+#if CONSOLE_COMMANDS && !defined(DEPTH_SIM)
+    threadCommand.start(command_thread);
+#endif
+}
+
+// One iteration of the control loop
+void depth_frame(void)
+{
+    profiler.begin();
+
+    // check inputs
+    raw_cv_input = cv_input.read_u16();
+    raw_slider_input = slider_input.read_u16();
+    raw_center_input = center_input.read_u16();
+    raw_left_input = left_input.read_u16();
+    raw_right_input = right_input.read_u16();
+    profiler.mark(STAGE_ACQUISITION);
 
+    filtered_raw_slider_input = ewma_slider.filter(raw_slider_input);
+    filtered_raw_center_input = ewma_center.filter(raw_center_input);
+    filtered_raw_left_input = ewma_left.filter(raw_left_input);
+    filtered_raw_right_input = ewma_right.filter(raw_right_input);
+
+    filtered_raw_cv_input = ewma_cv.filter(raw_cv_input); // 2nd DAC, filtered version
+
+    // Range tracking, restarted when switched on
+    if (auto_range_enabled != auto_range_active) {
+        auto_range_active = auto_range_enabled;
+        auto_range.reset();
+    }
+    if (auto_range_active && auto_range.add(filtered_raw_cv_input)) {
+        const AutoRangeCoefficients &range = auto_range.coefficients();
+        LOG_DEBUG(ENGINE, loop_log, "RANGE: %u-%u median %u at frame %u", range.low, range.high, range.median, frame_count);
+    }
+    profiler.mark(STAGE_FILTER);
+
+    filtered_output.write_u16(volume);
+    profiler.mark(STAGE_OUTPUT);
+
+    handle_buttons();
+    uint16_t previous_region = superdebug;
+    update_depth();
+    if (superdebug != previous_region) {
+        LOG_DEBUG(ENGINE, loop_log, "REGION: %u -> %u at frame %u", previous_region, superdebug, frame_count);
+    }
+    profiler.mark(STAGE_ENGINE);
+
+    uint32_t now_us = us_ticker_read();
+    loop_rate.tick(now_us);
+    post_mortem.flight.record(now_us, filtered_raw_cv_input, volume, filtered_raw_slider_input, superdebug);
+#if WATCHDOG
+    frame_watchdog.frame(now_us);
+#endif
+
+    TelemetrySnapshot snapshot;
+    snapshot.time_us = now_us;
+    snapshot.frame = frame_count++;
+    snapshot.raw[INPUT_CV] = raw_cv_input;
+    snapshot.raw[INPUT_SLIDER] = raw_slider_input;
+    snapshot.raw[INPUT_CENTER] = raw_center_input;
+    snapshot.raw[INPUT_LEFT] = raw_left_input;
+    snapshot.raw[INPUT_RIGHT] = raw_right_input;
+    snapshot.filtered[INPUT_CV] = filtered_raw_cv_input;
+    snapshot.filtered[INPUT_SLIDER] = filtered_raw_slider_input;
+    snapshot.filtered[INPUT_CENTER] = filtered_raw_center_input;
+    snapshot.filtered[INPUT_LEFT] = filtered_raw_left_input;
+    snapshot.filtered[INPUT_RIGHT] = filtered_raw_right_input;
+    snapshot.volume = volume;
+    snapshot.region = superdebug;
+    snapshot.loop_rate_hz = loop_rate.rate_hz();
+    snapshot.loop_period_ns = loop_rate.period_ns();
+    snapshot.warm_start_us = warm_start_us;
+    snapshot.lin_log = lin_log_left | lin_log_right << 1;
+    snapshot.curve_switches = curve_switches;
+    static_assert(TELEMETRY_STAGE_COUNT == STAGE_COUNT, "one telemetry field per profiled stage");
+    for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+        snapshot.stage_cycles[stage] = profiler.last((ProfileStage)stage);
+    }
+    telemetry.write(snapshot);
+#if TELEMETRY_STREAM
+    if (snapshot.frame % TELEMETRY_STREAM_DIVIDER == 0) {
+        telemetry_stream.push(snapshot);
+    }
+#endif
+}
+
+// The host simulator (host/depth_sim.cpp) drives depth_setup() and depth_frame() itself
+#ifndef DEPTH_SIM
+int main()
+{
+    depth_setup();
     while (true) {
-        // check inputs
-        raw_cv_input = cv_input.read_u16();
-        raw_slider_input = slider_input.read_u16();
-        raw_center_input = center_input.read_u16();
-        raw_left_input = left_input.read_u16();
-        raw_right_input = right_input.read_u16();
-
-        filtered_raw_slider_input = ewma_slider.filter(raw_slider_input);
-        filtered_raw_center_input = ewma_center.filter(raw_center_input);
-        filtered_raw_left_input = ewma_left.filter(raw_left_input);
-        filtered_raw_right_input = ewma_right.filter(raw_right_input);
-
-        filtered_raw_cv_input = ewma_cv.filter(raw_cv_input); // 2nd DAC, filtered version
-        filtered_output.write_u16(volume);
-
-        center_from_slider = CENTER_WIDTH_UI16 + (uint16_t)((float)filtered_raw_slider_input * ((float)SLIDER_LENGTH_MINUS_CENTER / (float)UI16_MAX));
-        left_slide_point = center_from_slider - CENTER_WIDTH_UI16;
-        right_slide_point = center_from_slider + CENTER_WIDTH_UI16;
-
-        if (filtered_raw_cv_input < ((center_from_slider - CENTER_WIDTH_UI16))) {
-            superdebug = 1;
-            left_cv_calc = ((float)(UI16_MAX - filtered_raw_left_input)) / ((float)(left_slide_point));
-            volume_left = ((uint16_t)(left_cv_calc * (float)filtered_raw_cv_input)) + filtered_raw_left_input;
-            volume = volume_left;
-            volume_right = 0;
-        } else if (filtered_raw_cv_input > ((center_from_slider + CENTER_WIDTH_UI16))) {
-            superdebug = 2;
-            right_cv_calc = -((float)(0 - (filtered_raw_right_input - UI16_MAX)) / (float)(UI16_MAX - (right_slide_point)));
-            volume_right = ((uint16_t)(right_cv_calc * (float)(filtered_raw_cv_input - right_slide_point))) + UI16_MAX;
-            volume = volume_right;
-            volume_left = 0;
-        } else {
-            volume = UI16_MAX;
-            volume_left = 0;
-            volume_right = 0;
-            superdebug = 0;
-        }
-        refresh++;
+        depth_frame();
     }
 }
+#endif